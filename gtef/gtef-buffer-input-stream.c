@@ -21,6 +21,7 @@
 #include "gtef-buffer-input-stream.h"
 #include <string.h>
 #include "gtef-enum-types.h"
+#include "gtef-utils.h"
 
 /* Code coming from GtkSourceView. */
 
@@ -34,8 +35,21 @@
 struct _GtefBufferInputStreamPrivate
 {
 	GtkTextBuffer *buffer;
+
+	/* End of the text already fetched from the buffer. */
 	GtkTextMark *pos;
-	gint bytes_partial;
+
+	/* The text is fetched by runs of several lines, with one
+	 * gtk_text_iter_get_slice() call per run. A run is then translated
+	 * progressively into the caller's buffers.
+	 */
+	gchar *run;
+	gsize run_length;
+	gsize run_pos;
+	gint run_n_chars;
+
+	/* Number of characters of the runs entirely read. */
+	gint n_chars_read;
 
 	GtefNewlineType newline_type;
 
@@ -52,6 +66,9 @@ enum
 	PROP_ADD_TRAILING_NEWLINE
 };
 
+/* Number of characters fetched at once from the GtkTextBuffer. */
+#define RUN_N_CHARS (64 * 1024)
+
 G_DEFINE_TYPE_WITH_PRIVATE (GtefBufferInputStream, _gtef_buffer_input_stream, G_TYPE_INPUT_STREAM);
 
 static gsize
@@ -96,22 +113,27 @@ get_new_line (GtefBufferInputStream *stream)
 	return "\n";
 }
 
-static gsize
-read_line (GtefBufferInputStream *stream,
-	   gchar                 *outbuf,
-	   gsize                  space_left)
+static void
+free_run (GtefBufferInputStream *stream)
 {
-	GtkTextIter start, next, end;
-	gchar *buf;
-	gint bytes; /* int since it's what iter_get_offset returns */
-	gsize bytes_to_write, newline_size, read;
-	const gchar *newline;
-	gboolean is_last;
+	g_free (stream->priv->run);
+	stream->priv->run = NULL;
+	stream->priv->run_length = 0;
+	stream->priv->run_pos = 0;
+	stream->priv->run_n_chars = 0;
+}
 
-	if (stream->priv->buffer == NULL)
-	{
-		return 0;
-	}
+/* Fetches the next run of text. Returns FALSE at the end of the buffer. */
+static gboolean
+fetch_next_run (GtefBufferInputStream *stream)
+{
+	GtkTextIter start;
+	GtkTextIter end;
+
+	g_assert (stream->priv->run_pos == stream->priv->run_length);
+
+	stream->priv->n_chars_read += stream->priv->run_n_chars;
+	free_run (stream);
 
 	gtk_text_buffer_get_iter_at_mark (stream->priv->buffer,
 					  &start,
@@ -119,107 +141,134 @@ read_line (GtefBufferInputStream *stream,
 
 	if (gtk_text_iter_is_end (&start))
 	{
-		return 0;
+		return FALSE;
 	}
 
-	end = next = start;
-	newline = get_new_line (stream);
+	end = start;
+	gtk_text_iter_forward_chars (&end, RUN_N_CHARS);
 
-	/* Check needed for empty lines */
-	if (!gtk_text_iter_ends_line (&end))
+	/* Do not split a \r\n between two runs. */
+	if (!gtk_text_iter_is_end (&end) &&
+	    gtk_text_iter_get_char (&end) == '\n')
 	{
-		gtk_text_iter_forward_to_line_end (&end);
-	}
+		GtkTextIter prev = end;
 
-	gtk_text_iter_forward_line (&next);
+		if (gtk_text_iter_backward_char (&prev) &&
+		    gtk_text_iter_get_char (&prev) == '\r')
+		{
+			gtk_text_iter_forward_char (&end);
+		}
+	}
 
-	buf = gtk_text_iter_get_slice (&start, &end);
+	stream->priv->run = gtk_text_iter_get_slice (&start, &end);
+	stream->priv->run_length = strlen (stream->priv->run);
+	stream->priv->run_n_chars = gtk_text_iter_get_offset (&end) - gtk_text_iter_get_offset (&start);
 
-	/* the bytes of a line includes also the newline, so with the
-	   offsets we remove the newline and we add the new newline size */
-	bytes = gtk_text_iter_get_bytes_in_line (&start) - stream->priv->bytes_partial;
+	gtk_text_buffer_move_mark (stream->priv->buffer,
+				   stream->priv->pos,
+				   &end);
 
-	/* bytes_in_line includes the newlines, so we remove that assuming that
-	   they are single byte characters */
-	bytes -= gtk_text_iter_get_offset (&next) - gtk_text_iter_get_offset (&end);
-	is_last = gtk_text_iter_is_end (&end);
+	return TRUE;
+}
 
-	/* bytes_to_write contains the amount of bytes we would like to write.
-	   This means its the amount of bytes in the line (without the newline
-	   in the buffer) + the amount of bytes for the newline we want to
-	   write (newline_size) */
-	bytes_to_write = bytes;
+/* Copies the current run into @outbuf, replacing the line terminators by the
+ * newline type of the stream. Characters are never split. Returns the number
+ * of bytes written, 0 if there is not enough space left.
+ */
+static gsize
+translate_run (GtefBufferInputStream *stream,
+	       gchar                 *outbuf,
+	       gsize                  space_left)
+{
+	const gchar *newline;
+	gsize newline_size;
+	gboolean skip_lf;
+	gsize written = 0;
 
-	/* do not add the new newline_size for the last line */
+	newline = get_new_line (stream);
 	newline_size = get_new_line_size (stream);
-	if (!is_last)
-	{
-		bytes_to_write += newline_size;
-	}
 
-	if (bytes_to_write > space_left)
+	/* The \n are kept as is, only the other terminators need a stop. */
+	skip_lf = stream->priv->newline_type == GTEF_NEWLINE_TYPE_LF;
+
+	while (stream->priv->run_pos < stream->priv->run_length)
 	{
-		gchar *ptr;
-		gint char_offset;
-		gint written;
-		glong to_write;
-
-		/* Here the line does not fit in the buffer, we thus write
-		   the amount of bytes we can still fit, storing the position
-		   for the next read with the mark. Do not try to write the
-		   new newline in this case, it will be handled in the next
-		   iteration */
-		to_write = MIN ((glong)space_left, bytes);
-		ptr = buf;
-		written = 0;
-		char_offset = 0;
-
-		while (written < to_write)
+		const gchar *text = stream->priv->run + stream->priv->run_pos;
+		gsize text_length = stream->priv->run_length - stream->priv->run_pos;
+		gsize n;
+		gsize terminator_length;
+
+		n = _gtef_utils_find_line_terminator (text, text_length, skip_lf);
+
+		if (n > 0)
 		{
-			gint w;
+			gsize to_copy = MIN (n, space_left);
 
-			ptr = g_utf8_next_char (ptr);
-			w = (ptr - buf);
-			if (w > to_write)
+			/* Back up to a character boundary. */
+			while (to_copy < n &&
+			       to_copy > 0 &&
+			       (text[to_copy] & 0xC0) == 0x80)
 			{
-				break;
+				to_copy--;
 			}
-			else
+
+			memcpy (outbuf + written, text, to_copy);
+			written += to_copy;
+			space_left -= to_copy;
+			stream->priv->run_pos += to_copy;
+
+			if (to_copy < n)
 			{
-				written = w;
-				++char_offset;
+				break;
 			}
+
+			continue;
 		}
 
-		memcpy (outbuf, buf, written);
+		if (text[0] == '\r')
+		{
+			terminator_length = text_length >= 2 && text[1] == '\n' ? 2 : 1;
+		}
+		else if (text[0] == '\n')
+		{
+			terminator_length = 1;
+		}
+		else if (text_length >= 3 &&
+			 (guchar) text[1] == 0x80 &&
+			 (guchar) text[2] == 0xA9)
+		{
+			/* U+2029 PARAGRAPH SEPARATOR */
+			terminator_length = 3;
+		}
+		else
+		{
+			/* Another character starting with the same byte, three
+			 * bytes long.
+			 */
+			if (space_left < 3)
+			{
+				break;
+			}
 
-		/* Note: offset is one past what we wrote */
-		gtk_text_iter_forward_chars (&start, char_offset);
-		stream->priv->bytes_partial += written;
-		read = written;
-	}
-	else
-	{
-		/* First just copy the bytes without the newline */
-		memcpy (outbuf, buf, bytes);
+			memcpy (outbuf + written, text, 3);
+			written += 3;
+			space_left -= 3;
+			stream->priv->run_pos += 3;
+			continue;
+		}
 
-		/* Then add the newline, but not for the last line */
-		if (!is_last)
+		if (space_left < newline_size)
 		{
-			memcpy (outbuf + bytes, newline, newline_size);
+			break;
 		}
 
-		start = next;
-		stream->priv->bytes_partial = 0;
-		read = bytes_to_write;
+		memcpy (outbuf + written, newline, newline_size);
+		written += newline_size;
+		space_left -= newline_size;
+		stream->priv->run_pos += terminator_length;
 	}
 
-	gtk_text_buffer_move_mark (stream->priv->buffer,
-				   stream->priv->pos,
-				   &start);
-
-	g_free (buf);
-	return read;
+	return written;
 }
 
 static gssize
@@ -231,7 +280,8 @@ _gtef_buffer_input_stream_read (GInputStream  *input_stream,
 {
 	GtefBufferInputStream *stream;
 	GtkTextIter iter;
-	gssize space_left, read, n;
+	gsize space_left;
+	gsize read;
 
 	stream = GTEF_BUFFER_INPUT_STREAM (input_stream);
 
@@ -267,12 +317,26 @@ _gtef_buffer_input_stream_read (GInputStream  *input_stream,
 	space_left = count;
 	read = 0;
 
-	do
+	while (space_left > 0)
 	{
-		n = read_line (stream, (gchar *)buffer + read, space_left);
+		gsize n;
+
+		if (stream->priv->run_pos == stream->priv->run_length &&
+		    !fetch_next_run (stream))
+		{
+			break;
+		}
+
+		n = translate_run (stream, (gchar *)buffer + read, space_left);
+
+		if (n == 0)
+		{
+			break;
+		}
+
 		read += n;
 		space_left -= n;
-	} while (space_left > 0 && n != 0 && stream->priv->bytes_partial == 0);
+	}
 
 	/* Make sure that non-empty files are always terminated with \n (see bug #95676).
 	 * Note that we strip the trailing \n when loading the file */
@@ -280,11 +344,12 @@ _gtef_buffer_input_stream_read (GInputStream  *input_stream,
 					  &iter,
 					  stream->priv->pos);
 
-	if (gtk_text_iter_is_end (&iter) &&
+	if (stream->priv->run_pos == stream->priv->run_length &&
+	    gtk_text_iter_is_end (&iter) &&
 	    !gtk_text_iter_is_start (&iter) &&
 	    stream->priv->add_trailing_newline)
 	{
-		gssize newline_size;
+		gsize newline_size;
 
 		newline_size = get_new_line_size (stream);
 
@@ -313,6 +378,7 @@ _gtef_buffer_input_stream_close (GInputStream  *input_stream,
 	GtefBufferInputStream *stream = GTEF_BUFFER_INPUT_STREAM (input_stream);
 
 	stream->priv->newline_added = FALSE;
+	free_run (stream);
 
 	if (stream->priv->is_initialized &&
 	    stream->priv->buffer != NULL)
@@ -386,6 +452,7 @@ _gtef_buffer_input_stream_dispose (GObject *object)
 	GtefBufferInputStream *stream = GTEF_BUFFER_INPUT_STREAM (object);
 
 	g_clear_object (&stream->priv->buffer);
+	free_run (stream);
 
 	G_OBJECT_CLASS (_gtef_buffer_input_stream_parent_class)->dispose (object);
 }
@@ -493,21 +560,16 @@ _gtef_buffer_input_stream_tell (GtefBufferInputStream *stream)
 {
 	g_return_val_if_fail (GTEF_IS_BUFFER_INPUT_STREAM (stream), 0);
 
-	/* FIXME: is this potentially inefficient? If yes, we could keep
-	   track of the offset internally, assuming the mark doesn't move
-	   during the operation */
 	if (!stream->priv->is_initialized ||
 	    stream->priv->buffer == NULL)
 	{
 		return 0;
 	}
-	else
-	{
-		GtkTextIter iter;
 
-		gtk_text_buffer_get_iter_at_mark (stream->priv->buffer,
-						  &iter,
-						  stream->priv->pos);
-		return gtk_text_iter_get_offset (&iter);
+	if (stream->priv->run_pos == stream->priv->run_length)
+	{
+		return stream->priv->n_chars_read + stream->priv->run_n_chars;
 	}
+
+	return stream->priv->n_chars_read;
 }
@@ -45,6 +45,12 @@ struct _GtefBufferPrivate
 
 	GtkTextTag *invalid_char_tag;
 
+	/* Number of characters having the invalid_char_tag, kept up to date
+	 * on each change, so that _gtef_buffer_has_invalid_chars() doesn't
+	 * need to search the tag in the whole buffer.
+	 */
+	gint n_invalid_chars;
+
 	guint n_nested_user_actions;
 	guint idle_cursor_moved_id;
 };
@@ -251,6 +257,122 @@ gtef_buffer_changed (GtkTextBuffer *buffer)
 	}
 }
 
+/* Returns the number of characters between @start and @end having @tag. */
+static gint
+count_tagged_chars (GtkTextTag        *tag,
+		    const GtkTextIter *start,
+		    const GtkTextIter *end)
+{
+	GtkTextIter iter;
+	gboolean tagged;
+	gint count = 0;
+
+	iter = *start;
+	tagged = gtk_text_iter_has_tag (&iter, tag);
+
+	while (gtk_text_iter_compare (&iter, end) < 0)
+	{
+		GtkTextIter toggle = iter;
+
+		if (!gtk_text_iter_forward_to_tag_toggle (&toggle, tag) ||
+		    gtk_text_iter_compare (&toggle, end) > 0)
+		{
+			toggle = *end;
+		}
+
+		if (tagged)
+		{
+			count += gtk_text_iter_get_offset (&toggle) - gtk_text_iter_get_offset (&iter);
+		}
+
+		tagged = !tagged;
+		iter = toggle;
+	}
+
+	return count;
+}
+
+static void
+gtef_buffer_insert_text (GtkTextBuffer *buffer,
+			 GtkTextIter   *location,
+			 const gchar   *text,
+			 gint           length)
+{
+	GtefBufferPrivate *priv = gtef_buffer_get_instance_private (GTEF_BUFFER (buffer));
+	gint start_offset = 0;
+
+	/* Text inserted inside a tagged area has the tag too. */
+	if (priv->n_invalid_chars > 0)
+	{
+		start_offset = gtk_text_iter_get_offset (location);
+	}
+
+	GTK_TEXT_BUFFER_CLASS (gtef_buffer_parent_class)->insert_text (buffer, location, text, length);
+
+	if (priv->n_invalid_chars > 0)
+	{
+		GtkTextIter start;
+
+		gtk_text_buffer_get_iter_at_offset (buffer, &start, start_offset);
+
+		if (gtk_text_iter_has_tag (&start, priv->invalid_char_tag))
+		{
+			priv->n_invalid_chars += gtk_text_iter_get_offset (location) - start_offset;
+		}
+	}
+}
+
+static void
+gtef_buffer_delete_range (GtkTextBuffer *buffer,
+			  GtkTextIter   *start,
+			  GtkTextIter   *end)
+{
+	GtefBufferPrivate *priv = gtef_buffer_get_instance_private (GTEF_BUFFER (buffer));
+
+	if (priv->n_invalid_chars > 0)
+	{
+		priv->n_invalid_chars -= count_tagged_chars (priv->invalid_char_tag, start, end);
+	}
+
+	GTK_TEXT_BUFFER_CLASS (gtef_buffer_parent_class)->delete_range (buffer, start, end);
+}
+
+static void
+gtef_buffer_apply_tag (GtkTextBuffer     *buffer,
+		       GtkTextTag        *tag,
+		       const GtkTextIter *start,
+		       const GtkTextIter *end)
+{
+	GtefBufferPrivate *priv = gtef_buffer_get_instance_private (GTEF_BUFFER (buffer));
+
+	if (tag == priv->invalid_char_tag)
+	{
+		gint n_chars;
+
+		n_chars = gtk_text_iter_get_offset (end) - gtk_text_iter_get_offset (start);
+		priv->n_invalid_chars += n_chars - count_tagged_chars (tag, start, end);
+	}
+
+	GTK_TEXT_BUFFER_CLASS (gtef_buffer_parent_class)->apply_tag (buffer, tag, start, end);
+}
+
+static void
+gtef_buffer_remove_tag (GtkTextBuffer     *buffer,
+			GtkTextTag        *tag,
+			const GtkTextIter *start,
+			const GtkTextIter *end)
+{
+	GtefBufferPrivate *priv = gtef_buffer_get_instance_private (GTEF_BUFFER (buffer));
+
+	if (tag == priv->invalid_char_tag &&
+	    priv->n_invalid_chars > 0)
+	{
+		priv->n_invalid_chars -= count_tagged_chars (tag, start, end);
+	}
+
+	GTK_TEXT_BUFFER_CLASS (gtef_buffer_parent_class)->remove_tag (buffer, tag, start, end);
+}
+
 static void
 gtef_buffer_modified_changed (GtkTextBuffer *buffer)
 {
@@ -277,6 +399,10 @@ gtef_buffer_class_init (GtefBufferClass *klass)
 	text_buffer_class->mark_set = gtef_buffer_mark_set;
 	text_buffer_class->changed = gtef_buffer_changed;
 	text_buffer_class->modified_changed = gtef_buffer_modified_changed;
+	text_buffer_class->insert_text = gtef_buffer_insert_text;
+	text_buffer_class->delete_range = gtef_buffer_delete_range;
+	text_buffer_class->apply_tag = gtef_buffer_apply_tag;
+	text_buffer_class->remove_tag = gtef_buffer_remove_tag;
 
 	/**
 	 * GtefBuffer:gtef-title:
@@ -637,28 +763,16 @@ _gtef_buffer_set_as_invalid_character (GtefBuffer        *buffer,
 	                           end);
 }
 
+/* Runs in O(1). */
 gboolean
 _gtef_buffer_has_invalid_chars (GtefBuffer *buffer)
 {
 	GtefBufferPrivate *priv;
-	GtkTextIter start;
 
 	g_return_val_if_fail (GTEF_IS_BUFFER (buffer), FALSE);
 
 	priv = gtef_buffer_get_instance_private (buffer);
 
-	if (priv->invalid_char_tag == NULL)
-	{
-		return FALSE;
-	}
-
-	gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (buffer), &start);
-
-	if (gtk_text_iter_starts_tag (&start, priv->invalid_char_tag) ||
-	    gtk_text_iter_forward_to_tag_toggle (&start, priv->invalid_char_tag))
-	{
-		return TRUE;
-	}
-
-	return FALSE;
+	g_warn_if_fail (priv->n_invalid_chars >= 0);
+	return priv->n_invalid_chars > 0;
 }
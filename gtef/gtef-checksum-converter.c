@@ -0,0 +1,161 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "gtef-checksum-converter.h"
+#include <string.h>
+#include <glib/gi18n-lib.h>
+#include "gtef-content-hash.h"
+
+/* GtefChecksumConverter is a GConverter that copies its input unchanged, and
+ * computes meanwhile a checksum of it. In a GConverterOutputStream directly on
+ * top of a GFileOutputStream, it gives the checksum of the bytes written to
+ * the file, without reading the file afterwards.
+ */
+
+struct _GtefChecksumConverterPrivate
+{
+	GtefContentHash *hash;
+};
+
+static void _gtef_checksum_converter_iface_init (GConverterIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (GtefChecksumConverter,
+			 _gtef_checksum_converter,
+			 G_TYPE_OBJECT,
+			 G_ADD_PRIVATE (GtefChecksumConverter)
+			 G_IMPLEMENT_INTERFACE (G_TYPE_CONVERTER,
+						_gtef_checksum_converter_iface_init))
+
+static GConverterResult
+_gtef_checksum_converter_convert (GConverter      *converter,
+				  const void      *inbuf,
+				  gsize            inbuf_size,
+				  void            *outbuf,
+				  gsize            outbuf_size,
+				  GConverterFlags  flags,
+				  gsize           *bytes_read,
+				  gsize           *bytes_written,
+				  GError         **error)
+{
+	GtefChecksumConverterPrivate *priv = GTEF_CHECKSUM_CONVERTER (converter)->priv;
+	gsize size;
+
+	if (inbuf_size > 0 && outbuf_size == 0)
+	{
+		g_set_error_literal (error,
+				     G_IO_ERROR,
+				     G_IO_ERROR_NO_SPACE,
+				     _("Not enough space in the output buffer."));
+		return G_CONVERTER_ERROR;
+	}
+
+	size = MIN (inbuf_size, outbuf_size);
+
+	if (size > 0)
+	{
+		memcpy (outbuf, inbuf, size);
+		_gtef_content_hash_update (priv->hash, inbuf, size);
+	}
+
+	*bytes_read = size;
+	*bytes_written = size;
+
+	if (size == inbuf_size)
+	{
+		if (flags & G_CONVERTER_INPUT_AT_END)
+		{
+			return G_CONVERTER_FINISHED;
+		}
+
+		if (flags & G_CONVERTER_FLUSH)
+		{
+			return G_CONVERTER_FLUSHED;
+		}
+	}
+
+	return G_CONVERTER_CONVERTED;
+}
+
+static void
+_gtef_checksum_converter_reset (GConverter *converter)
+{
+	GtefChecksumConverterPrivate *priv = GTEF_CHECKSUM_CONVERTER (converter)->priv;
+
+	_gtef_content_hash_free (priv->hash);
+	priv->hash = _gtef_content_hash_new ();
+}
+
+static void
+_gtef_checksum_converter_iface_init (GConverterIface *iface)
+{
+	iface->convert = _gtef_checksum_converter_convert;
+	iface->reset = _gtef_checksum_converter_reset;
+}
+
+static void
+_gtef_checksum_converter_finalize (GObject *object)
+{
+	GtefChecksumConverter *converter = GTEF_CHECKSUM_CONVERTER (object);
+
+	_gtef_content_hash_free (converter->priv->hash);
+
+	G_OBJECT_CLASS (_gtef_checksum_converter_parent_class)->finalize (object);
+}
+
+static void
+_gtef_checksum_converter_class_init (GtefChecksumConverterClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+	object_class->finalize = _gtef_checksum_converter_finalize;
+}
+
+static void
+_gtef_checksum_converter_init (GtefChecksumConverter *converter)
+{
+	converter->priv = _gtef_checksum_converter_get_instance_private (converter);
+	converter->priv->hash = _gtef_content_hash_new ();
+}
+
+/*
+ * _gtef_checksum_converter_new:
+ *
+ * Returns: a new #GtefChecksumConverter.
+ */
+GtefChecksumConverter *
+_gtef_checksum_converter_new (void)
+{
+	return g_object_new (GTEF_TYPE_CHECKSUM_CONVERTER, NULL);
+}
+
+/*
+ * _gtef_checksum_converter_get_checksum:
+ * @converter: a #GtefChecksumConverter.
+ *
+ * Returns: the checksum, as a hexadecimal string, of the bytes converted so
+ * far. Free with g_free().
+ */
+gchar *
+_gtef_checksum_converter_get_checksum (GtefChecksumConverter *converter)
+{
+	g_return_val_if_fail (GTEF_IS_CHECKSUM_CONVERTER (converter), NULL);
+
+	return _gtef_content_hash_get_string (converter->priv->hash);
+}
@@ -0,0 +1,61 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GTEF_CHECKSUM_CONVERTER_H
+#define GTEF_CHECKSUM_CONVERTER_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define GTEF_TYPE_CHECKSUM_CONVERTER             (_gtef_checksum_converter_get_type ())
+#define GTEF_CHECKSUM_CONVERTER(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), GTEF_TYPE_CHECKSUM_CONVERTER, GtefChecksumConverter))
+#define GTEF_CHECKSUM_CONVERTER_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST ((klass), GTEF_TYPE_CHECKSUM_CONVERTER, GtefChecksumConverterClass))
+#define GTEF_IS_CHECKSUM_CONVERTER(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GTEF_TYPE_CHECKSUM_CONVERTER))
+#define GTEF_IS_CHECKSUM_CONVERTER_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass), GTEF_TYPE_CHECKSUM_CONVERTER))
+#define GTEF_CHECKSUM_CONVERTER_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj), GTEF_TYPE_CHECKSUM_CONVERTER, GtefChecksumConverterClass))
+
+typedef struct _GtefChecksumConverter         GtefChecksumConverter;
+typedef struct _GtefChecksumConverterClass    GtefChecksumConverterClass;
+typedef struct _GtefChecksumConverterPrivate  GtefChecksumConverterPrivate;
+
+struct _GtefChecksumConverter
+{
+	GObject parent;
+
+	GtefChecksumConverterPrivate *priv;
+};
+
+struct _GtefChecksumConverterClass
+{
+	GObjectClass parent_class;
+};
+
+G_GNUC_INTERNAL
+GType			_gtef_checksum_converter_get_type	(void);
+
+G_GNUC_INTERNAL
+GtefChecksumConverter *	_gtef_checksum_converter_new		(void);
+
+G_GNUC_INTERNAL
+gchar *			_gtef_checksum_converter_get_checksum	(GtefChecksumConverter *converter);
+
+G_END_DECLS
+
+#endif /* GTEF_CHECKSUM_CONVERTER_H */
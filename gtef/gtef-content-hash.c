@@ -0,0 +1,263 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "gtef-content-hash.h"
+#include <string.h>
+
+/* A fast non-cryptographic hash of a file content, to detect whether it has
+ * changed. It is the XXH64 algorithm of xxHash, by Yann Collet, which hashes
+ * several GB/s. The content can be fed in chunks of any size, for example in a
+ * worker thread while the file is read.
+ */
+
+#define PRIME64_1 G_GUINT64_CONSTANT (0x9E3779B185EBCA87)
+#define PRIME64_2 G_GUINT64_CONSTANT (0xC2B2AE3D27D4EB4F)
+#define PRIME64_3 G_GUINT64_CONSTANT (0x165667B19E3779F9)
+#define PRIME64_4 G_GUINT64_CONSTANT (0x85EBCA77C2B2AE63)
+#define PRIME64_5 G_GUINT64_CONSTANT (0x27D4EB2F165667C5)
+
+/* The content is processed in stripes of 32 bytes, with four accumulators. */
+#define STRIPE_SIZE 32
+
+#define SEED 0
+
+struct _GtefContentHash
+{
+	guint64 accumulators[4];
+	guint64 total_length;
+
+	/* The start of an incomplete stripe. */
+	guint8 pending[STRIPE_SIZE];
+	gsize pending_length;
+};
+
+static inline guint64
+rotate_left (guint64 value,
+	     guint   n_bits)
+{
+	return (value << n_bits) | (value >> (64 - n_bits));
+}
+
+static inline guint64
+read_uint64 (const guint8 *p)
+{
+	guint64 value;
+
+	memcpy (&value, p, sizeof (value));
+	return GUINT64_FROM_LE (value);
+}
+
+static inline guint32
+read_uint32 (const guint8 *p)
+{
+	guint32 value;
+
+	memcpy (&value, p, sizeof (value));
+	return GUINT32_FROM_LE (value);
+}
+
+static inline guint64
+hash_round (guint64 accumulator,
+	    guint64 input)
+{
+	accumulator += input * PRIME64_2;
+	accumulator = rotate_left (accumulator, 31);
+	return accumulator * PRIME64_1;
+}
+
+static inline guint64
+merge_accumulator (guint64 hash,
+		   guint64 accumulator)
+{
+	hash ^= hash_round (0, accumulator);
+	return hash * PRIME64_1 + PRIME64_4;
+}
+
+static void
+process_stripe (GtefContentHash *hash,
+		const guint8    *stripe)
+{
+	hash->accumulators[0] = hash_round (hash->accumulators[0], read_uint64 (stripe));
+	hash->accumulators[1] = hash_round (hash->accumulators[1], read_uint64 (stripe + 8));
+	hash->accumulators[2] = hash_round (hash->accumulators[2], read_uint64 (stripe + 16));
+	hash->accumulators[3] = hash_round (hash->accumulators[3], read_uint64 (stripe + 24));
+}
+
+GtefContentHash *
+_gtef_content_hash_new (void)
+{
+	GtefContentHash *hash;
+
+	hash = g_new0 (GtefContentHash, 1);
+
+	hash->accumulators[0] = SEED + PRIME64_1 + PRIME64_2;
+	hash->accumulators[1] = SEED + PRIME64_2;
+	hash->accumulators[2] = SEED;
+	hash->accumulators[3] = SEED - PRIME64_1;
+
+	return hash;
+}
+
+void
+_gtef_content_hash_free (GtefContentHash *hash)
+{
+	g_free (hash);
+}
+
+void
+_gtef_content_hash_update (GtefContentHash *hash,
+			   gconstpointer    data,
+			   gsize            length)
+{
+	const guint8 *p = data;
+	const guint8 *end = p + length;
+
+	g_return_if_fail (hash != NULL);
+	g_return_if_fail (data != NULL || length == 0);
+
+	hash->total_length += length;
+
+	/* Complete the pending stripe first. */
+	if (hash->pending_length > 0)
+	{
+		gsize n_bytes;
+
+		n_bytes = MIN (length, STRIPE_SIZE - hash->pending_length);
+		memcpy (hash->pending + hash->pending_length, p, n_bytes);
+		hash->pending_length += n_bytes;
+		p += n_bytes;
+
+		if (hash->pending_length < STRIPE_SIZE)
+		{
+			return;
+		}
+
+		process_stripe (hash, hash->pending);
+		hash->pending_length = 0;
+	}
+
+	while (end - p >= STRIPE_SIZE)
+	{
+		process_stripe (hash, p);
+		p += STRIPE_SIZE;
+	}
+
+	memcpy (hash->pending, p, end - p);
+	hash->pending_length = end - p;
+}
+
+/* Returns the hash of the content fed so far. More content can still be fed
+ * afterwards.
+ */
+static guint64
+get_digest (const GtefContentHash *hash)
+{
+	const guint8 *p = hash->pending;
+	const guint8 *end = hash->pending + hash->pending_length;
+	guint64 digest;
+
+	if (hash->total_length >= STRIPE_SIZE)
+	{
+		digest = (rotate_left (hash->accumulators[0], 1) +
+			  rotate_left (hash->accumulators[1], 7) +
+			  rotate_left (hash->accumulators[2], 12) +
+			  rotate_left (hash->accumulators[3], 18));
+
+		digest = merge_accumulator (digest, hash->accumulators[0]);
+		digest = merge_accumulator (digest, hash->accumulators[1]);
+		digest = merge_accumulator (digest, hash->accumulators[2]);
+		digest = merge_accumulator (digest, hash->accumulators[3]);
+	}
+	else
+	{
+		digest = SEED + PRIME64_5;
+	}
+
+	digest += hash->total_length;
+
+	while (end - p >= 8)
+	{
+		digest ^= hash_round (0, read_uint64 (p));
+		digest = rotate_left (digest, 27) * PRIME64_1 + PRIME64_4;
+		p += 8;
+	}
+
+	if (end - p >= 4)
+	{
+		digest ^= (guint64) read_uint32 (p) * PRIME64_1;
+		digest = rotate_left (digest, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+	}
+
+	while (p < end)
+	{
+		digest ^= *p * PRIME64_5;
+		digest = rotate_left (digest, 11) * PRIME64_1;
+		p++;
+	}
+
+	/* Avalanche. */
+	digest ^= digest >> 33;
+	digest *= PRIME64_2;
+	digest ^= digest >> 29;
+	digest *= PRIME64_3;
+	digest ^= digest >> 32;
+
+	return digest;
+}
+
+/*
+ * _gtef_content_hash_get_string:
+ * @hash: a #GtefContentHash.
+ *
+ * The hash is not closed, more content can be fed afterwards.
+ *
+ * Returns: the hash of the content fed so far, as a hexadecimal string. Free
+ * with g_free().
+ */
+gchar *
+_gtef_content_hash_get_string (const GtefContentHash *hash)
+{
+	g_return_val_if_fail (hash != NULL, NULL);
+
+	return g_strdup_printf ("%016" G_GINT64_MODIFIER "x", get_digest (hash));
+}
+
+/*
+ * _gtef_content_hash_compute_for_data:
+ * @data: the content.
+ * @length: the length of @data.
+ *
+ * Returns: the hash of @data, as a hexadecimal string. Free with g_free().
+ */
+gchar *
+_gtef_content_hash_compute_for_data (gconstpointer data,
+				     gsize         length)
+{
+	GtefContentHash *hash;
+	gchar *str;
+
+	hash = _gtef_content_hash_new ();
+	_gtef_content_hash_update (hash, data, length);
+	str = _gtef_content_hash_get_string (hash);
+	_gtef_content_hash_free (hash);
+
+	return str;
+}
@@ -0,0 +1,49 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GTEF_CONTENT_HASH_H
+#define GTEF_CONTENT_HASH_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GtefContentHash GtefContentHash;
+
+G_GNUC_INTERNAL
+GtefContentHash *	_gtef_content_hash_new			(void);
+
+G_GNUC_INTERNAL
+void			_gtef_content_hash_free			(GtefContentHash *hash);
+
+G_GNUC_INTERNAL
+void			_gtef_content_hash_update		(GtefContentHash *hash,
+								 gconstpointer    data,
+								 gsize            length);
+
+G_GNUC_INTERNAL
+gchar *			_gtef_content_hash_get_string		(const GtefContentHash *hash);
+
+G_GNUC_INTERNAL
+gchar *			_gtef_content_hash_compute_for_data	(gconstpointer data,
+								 gsize         length);
+
+G_END_DECLS
+
+#endif /* GTEF_CONTENT_HASH_H */
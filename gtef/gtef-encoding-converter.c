@@ -23,6 +23,9 @@
 #include <string.h>
 #include <gio/gio.h>
 #include <glib/gi18n-lib.h>
+#include "gtef-encoding-private.h"
+#include "gtef-utf16-converter.h"
+#include "gtef-utils.h"
 
 /* A higher-level, more convenient API for character encoding streaming
  * conversion based on iconv.
@@ -37,12 +40,72 @@
  * - the output string is nul-terminated.
  * - the buffer size of this object can be adjusted, to control how often the
  *   callback is called.
+ * - invalid sequences can be skipped and reported to another callback, instead
+ *   of stopping the conversion.
+ * - the conversion from a single-byte charset to UTF-8 doesn't use iconv, but a
+ *   table with the UTF-8 form of each byte, and ASCII runs are copied as-is.
+ * - the conversion from UTF-16, UTF-16LE and UTF-16BE to UTF-8 doesn't use
+ *   iconv either, see gtef-utf16-converter.c.
+ *
+ * The iconv descriptors and the output buffers are taken from a process-wide
+ * pool when opening the converter, and given back to the pool when closing it.
+ * So loading many files in a row doesn't call g_iconv_open() and doesn't
+ * allocate a big output buffer each time.
+ */
+
+/* An incomplete multi-byte sequence is at most a few bytes for the charsets
+ * supported by iconv, with some margin for the escape sequences of the stateful
+ * charsets.
  */
+#define CARRY_MAX_LENGTH 16
+
+typedef struct _SingleByteTable SingleByteTable;
+
+/* The UTF-8 form of each byte of a single-byte charset. */
+struct _SingleByteTable
+{
+	/* 0 if the byte is invalid in the charset. */
+	guint8 length[256];
+
+	/* The characters are in the BMP, so at most 3 bytes in UTF-8. */
+	gchar utf8[256][3];
+};
+
+typedef struct _PooledConv PooledConv;
+
+struct _PooledConv
+{
+	gchar *to_codeset;
+	gchar *from_codeset;
+	GIConv conv;
+};
+
+typedef struct _PooledOutbuf PooledOutbuf;
+
+struct _PooledOutbuf
+{
+	gchar *outbuf;
+	gint64 size;
+};
 
 struct _GtefEncodingConverterPrivate
 {
 	GIConv conv;
 
+	/* The codesets of conv, to give it back to the pool. */
+	gchar *to_codeset;
+	gchar *from_codeset;
+
+	/* Used instead of conv, if non-NULL. */
+	const SingleByteTable *table;
+
+	/* Used instead of conv, if TRUE. For "UTF-16", utf16_big_endian is
+	 * changed by the BOM, if any.
+	 */
+	guint utf16 : 1;
+	guint utf16_big_endian : 1;
+	guint utf16_bom_pending : 1;
+
 	/* - outbuf_size is the full size of outbuf (if outbuf is non-NULL),
 	 *   *including* the additional byte to nul-terminate the string.
 	 * - The following condition must be met:
@@ -57,10 +120,14 @@ struct _GtefEncodingConverterPrivate
 	GtefEncodingConversionCallback callback;
 	gpointer callback_user_data;
 
+	GtefEncodingInvalidSequenceCallback invalid_sequence_callback;
+	gpointer invalid_sequence_callback_user_data;
+
 	/* On incomplete input, store the remaining inbuf so that it can be used
 	 * for the next chunk.
 	 */
-	GString *remaining_inbuf;
+	gchar carry[CARRY_MAX_LENGTH];
+	gsize carry_length;
 };
 
 enum
@@ -83,10 +150,246 @@ typedef enum _Result
 /* One byte of data, one byte to nul-terminate the string. */
 #define MIN_OUTBUF_SIZE 2
 
+/* Maximum length of a character in a SingleByteTable. */
+#define SINGLE_BYTE_TABLE_MAX_CHAR_LENGTH 3
+
+/* Maximum length of a UTF-16 character, and of its UTF-8 form. */
+#define UTF16_MAX_CHAR_LENGTH 4
+
+/* Limits of the pool, the least recently used entries are freed beyond. The
+ * iconv descriptors are small, but they are limited too because each
+ * (to, from) pair has its own descriptors.
+ */
+#define MAX_POOLED_CONVS 8
+#define MAX_POOLED_OUTBUFS_SIZE (4 * DEFAULT_OUTBUF_SIZE)
+
 static GParamSpec *properties[N_PROPERTIES];
 
+/* The SingleByteTables, built on first use and kept until the end of the
+ * process. The keys are the charsets in uppercase. A value is NULL if the
+ * table can not be built, the converter then uses iconv.
+ */
+static GHashTable *single_byte_tables;
+G_LOCK_DEFINE_STATIC (single_byte_tables);
+
+/* The idle iconv descriptors (PooledConv's) and output buffers
+ * (PooledOutbuf's), the most recently used first.
+ */
+static GQueue pooled_convs = G_QUEUE_INIT;
+static GQueue pooled_outbufs = G_QUEUE_INIT;
+static gint64 pooled_outbufs_size;
+G_LOCK_DEFINE_STATIC (pool);
+
 G_DEFINE_TYPE_WITH_PRIVATE (GtefEncodingConverter, _gtef_encoding_converter, G_TYPE_OBJECT)
 
+static void
+pooled_conv_free (PooledConv *pooled_conv)
+{
+	if (pooled_conv != NULL)
+	{
+		g_iconv_close (pooled_conv->conv);
+		g_free (pooled_conv->to_codeset);
+		g_free (pooled_conv->from_codeset);
+		g_free (pooled_conv);
+	}
+}
+
+static void
+pooled_outbuf_free (PooledOutbuf *pooled_outbuf)
+{
+	if (pooled_outbuf != NULL)
+	{
+		g_free (pooled_outbuf->outbuf);
+		g_free (pooled_outbuf);
+	}
+}
+
+/* Called from any thread. Returns (GIConv)-1 on error, with errno set by
+ * g_iconv_open().
+ */
+static GIConv
+acquire_conv (const gchar *to_codeset,
+	      const gchar *from_codeset)
+{
+	PooledConv *pooled_conv = NULL;
+	GIConv conv;
+	GList *l;
+
+	G_LOCK (pool);
+
+	for (l = pooled_convs.head; l != NULL; l = l->next)
+	{
+		PooledConv *cur_pooled_conv = l->data;
+
+		if (g_ascii_strcasecmp (cur_pooled_conv->to_codeset, to_codeset) == 0 &&
+		    g_ascii_strcasecmp (cur_pooled_conv->from_codeset, from_codeset) == 0)
+		{
+			pooled_conv = cur_pooled_conv;
+			g_queue_delete_link (&pooled_convs, l);
+			break;
+		}
+	}
+
+	G_UNLOCK (pool);
+
+	if (pooled_conv == NULL)
+	{
+		return g_iconv_open (to_codeset, from_codeset);
+	}
+
+	conv = pooled_conv->conv;
+	g_free (pooled_conv->to_codeset);
+	g_free (pooled_conv->from_codeset);
+	g_free (pooled_conv);
+
+	return conv;
+}
+
+/* Called from any thread. Takes ownership of the codesets. */
+static void
+release_conv (GIConv  conv,
+	      gchar  *to_codeset,
+	      gchar  *from_codeset)
+{
+	PooledConv *pooled_conv;
+	GList *unused_convs = NULL;
+
+	/* Reset the conversion state, in case the conversion has not been
+	 * completed.
+	 */
+	g_iconv (conv, NULL, NULL, NULL, NULL);
+
+	pooled_conv = g_new (PooledConv, 1);
+	pooled_conv->to_codeset = to_codeset;
+	pooled_conv->from_codeset = from_codeset;
+	pooled_conv->conv = conv;
+
+	G_LOCK (pool);
+
+	g_queue_push_head (&pooled_convs, pooled_conv);
+
+	while (pooled_convs.length > MAX_POOLED_CONVS)
+	{
+		unused_convs = g_list_prepend (unused_convs, g_queue_pop_tail (&pooled_convs));
+	}
+
+	G_UNLOCK (pool);
+
+	g_list_free_full (unused_convs, (GDestroyNotify) pooled_conv_free);
+}
+
+/* Called from any thread. */
+static gchar *
+acquire_outbuf (gint64 size)
+{
+	gchar *outbuf = NULL;
+	GList *l;
+
+	G_LOCK (pool);
+
+	for (l = pooled_outbufs.head; l != NULL; l = l->next)
+	{
+		PooledOutbuf *pooled_outbuf = l->data;
+
+		if (pooled_outbuf->size == size)
+		{
+			outbuf = pooled_outbuf->outbuf;
+			pooled_outbufs_size -= size;
+
+			g_free (pooled_outbuf);
+			g_queue_delete_link (&pooled_outbufs, l);
+			break;
+		}
+	}
+
+	G_UNLOCK (pool);
+
+	if (outbuf == NULL)
+	{
+		outbuf = g_malloc (size);
+	}
+
+	return outbuf;
+}
+
+/* Called from any thread. */
+static void
+release_outbuf (gchar  *outbuf,
+		gint64  size)
+{
+	PooledOutbuf *pooled_outbuf;
+	GList *unused_outbufs = NULL;
+
+	if (size > MAX_POOLED_OUTBUFS_SIZE)
+	{
+		g_free (outbuf);
+		return;
+	}
+
+	pooled_outbuf = g_new (PooledOutbuf, 1);
+	pooled_outbuf->outbuf = outbuf;
+	pooled_outbuf->size = size;
+
+	G_LOCK (pool);
+
+	g_queue_push_head (&pooled_outbufs, pooled_outbuf);
+	pooled_outbufs_size += size;
+
+	while (pooled_outbufs_size > MAX_POOLED_OUTBUFS_SIZE)
+	{
+		pooled_outbuf = g_queue_pop_tail (&pooled_outbufs);
+		pooled_outbufs_size -= pooled_outbuf->size;
+		unused_outbufs = g_list_prepend (unused_outbufs, pooled_outbuf);
+	}
+
+	G_UNLOCK (pool);
+
+	g_list_free_full (unused_outbufs, (GDestroyNotify) pooled_outbuf_free);
+}
+
+/* Frees the idle iconv descriptors and output buffers. For the unit tests and
+ * the benchmarks.
+ */
+void
+_gtef_encoding_converter_clear_pool (void)
+{
+	GList *convs;
+	GList *outbufs;
+
+	G_LOCK (pool);
+
+	convs = pooled_convs.head;
+	outbufs = pooled_outbufs.head;
+	g_queue_init (&pooled_convs);
+	g_queue_init (&pooled_outbufs);
+	pooled_outbufs_size = 0;
+
+	G_UNLOCK (pool);
+
+	g_list_free_full (convs, (GDestroyNotify) pooled_conv_free);
+	g_list_free_full (outbufs, (GDestroyNotify) pooled_outbuf_free);
+}
+
+/* For the unit tests. */
+void
+_gtef_encoding_converter_get_pool_size (guint  *n_convs,
+					gint64 *outbufs_size)
+{
+	G_LOCK (pool);
+
+	if (n_convs != NULL)
+	{
+		*n_convs = pooled_convs.length;
+	}
+
+	if (outbufs_size != NULL)
+	{
+		*outbufs_size = pooled_outbufs_size;
+	}
+
+	G_UNLOCK (pool);
+}
+
 static void
 check_invariants (GtefEncodingConverter *converter)
 {
@@ -97,7 +400,9 @@ check_invariants (GtefEncodingConverter *converter)
 static gboolean
 is_opened (GtefEncodingConverter *converter)
 {
-	return converter->priv->conv != (GIConv)-1;
+	return (converter->priv->conv != (GIConv)-1 ||
+		converter->priv->table != NULL ||
+		converter->priv->utf16);
 }
 
 static gboolean
@@ -140,19 +445,29 @@ flush_outbuf (GtefEncodingConverter *converter)
 	converter->priv->outbytes_left = (converter->priv->outbuf_size - 1);
 }
 
+/* Gives the iconv descriptor and the output buffer back to the pool. */
 static void
 close_conv (GtefEncodingConverter *converter)
 {
 	if (converter->priv->conv != (GIConv)-1)
 	{
-		g_iconv_close (converter->priv->conv);
+		release_conv (converter->priv->conv,
+			      converter->priv->to_codeset,
+			      converter->priv->from_codeset);
+
 		converter->priv->conv = (GIConv)-1;
+		converter->priv->to_codeset = NULL;
+		converter->priv->from_codeset = NULL;
 	}
 
-	if (converter->priv->remaining_inbuf != NULL)
+	converter->priv->table = NULL;
+	converter->priv->utf16 = FALSE;
+	converter->priv->carry_length = 0;
+
+	if (converter->priv->outbuf != NULL)
 	{
-		g_string_free (converter->priv->remaining_inbuf, TRUE);
-		converter->priv->remaining_inbuf = NULL;
+		release_outbuf (converter->priv->outbuf, converter->priv->outbuf_size);
+		converter->priv->outbuf = NULL;
 	}
 }
 
@@ -202,7 +517,6 @@ _gtef_encoding_converter_finalize (GObject *object)
 	GtefEncodingConverter *converter = GTEF_ENCODING_CONVERTER (object);
 
 	close_conv (converter);
-	g_free (converter->priv->outbuf);
 
 	G_OBJECT_CLASS (_gtef_encoding_converter_parent_class)->finalize (object);
 }
@@ -278,6 +592,137 @@ _gtef_encoding_converter_set_callback (GtefEncodingConverter          *converter
 	converter->priv->callback_user_data = user_data;
 }
 
+/* If an invalid sequence callback is set, the conversion doesn't stop on an
+ * invalid sequence. The incomplete input at the end of the content is also
+ * reported to this callback.
+ */
+void
+_gtef_encoding_converter_set_invalid_sequence_callback (GtefEncodingConverter               *converter,
+							GtefEncodingInvalidSequenceCallback  callback,
+							gpointer                             user_data)
+{
+	g_return_if_fail (GTEF_IS_ENCODING_CONVERTER (converter));
+
+	converter->priv->invalid_sequence_callback = callback;
+	converter->priv->invalid_sequence_callback_user_data = user_data;
+}
+
+/* Converts each byte with iconv, the result is thus the same as with the iconv
+ * path. Returns NULL if @charset is not a stateless single-byte charset that
+ * is a superset of ASCII.
+ */
+static SingleByteTable *
+build_single_byte_table (const gchar *charset)
+{
+	SingleByteTable *table;
+	GIConv conv;
+	guint byte;
+
+	conv = g_iconv_open ("UTF-8", charset);
+	if (conv == (GIConv)-1)
+	{
+		return NULL;
+	}
+
+	table = g_new0 (SingleByteTable, 1);
+
+	for (byte = 0; byte < 256; byte++)
+	{
+		gchar in = (gchar) byte;
+		gchar *inbuf = &in;
+		gsize inbytes_left = 1;
+		gchar out[8];
+		gchar *outbuf = out;
+		gsize outbytes_left = sizeof (out);
+		gsize length;
+
+		/* Reset the conversion state. */
+		g_iconv (conv, NULL, NULL, NULL, NULL);
+
+		if (g_iconv (conv, &inbuf, &inbytes_left, &outbuf, &outbytes_left) == (gsize)-1)
+		{
+			if (errno == EILSEQ)
+			{
+				/* Invalid byte, the length stays at 0. */
+				continue;
+			}
+
+			goto error;
+		}
+
+		length = outbuf - out;
+
+		if (length == 0 || length > SINGLE_BYTE_TABLE_MAX_CHAR_LENGTH)
+		{
+			goto error;
+		}
+
+		/* ASCII runs are copied without looking at the table. */
+		if (byte < 0x80 &&
+		    (length != 1 || out[0] != in))
+		{
+			goto error;
+		}
+
+		table->length[byte] = length;
+		memcpy (table->utf8[byte], out, length);
+	}
+
+	g_iconv_close (conv);
+	return table;
+
+error:
+	g_iconv_close (conv);
+	g_free (table);
+	return NULL;
+}
+
+/* Called from any thread. */
+static const SingleByteTable *
+get_single_byte_table (const gchar *charset)
+{
+	SingleByteTable *table;
+	gchar *key;
+
+	if (!_gtef_encoding_charset_is_single_byte (charset))
+	{
+		return NULL;
+	}
+
+	key = g_ascii_strup (charset, -1);
+
+	G_LOCK (single_byte_tables);
+
+	if (single_byte_tables == NULL)
+	{
+		single_byte_tables = g_hash_table_new_full (g_str_hash,
+							    g_str_equal,
+							    g_free,
+							    g_free);
+	}
+
+	if (g_hash_table_lookup_extended (single_byte_tables, key, NULL, (gpointer *) &table))
+	{
+		g_free (key);
+	}
+	else
+	{
+		table = build_single_byte_table (charset);
+		g_hash_table_insert (single_byte_tables, key, table);
+	}
+
+	G_UNLOCK (single_byte_tables);
+
+	return table;
+}
+
+static gboolean
+is_utf8_codeset (const gchar *codeset)
+{
+	return (g_ascii_strcasecmp (codeset, "UTF-8") == 0 ||
+		g_ascii_strcasecmp (codeset, "UTF8") == 0);
+}
+
 gboolean
 _gtef_encoding_converter_open (GtefEncodingConverter  *converter,
 			       const gchar            *to_codeset,
@@ -290,9 +735,40 @@ _gtef_encoding_converter_open (GtefEncodingConverter  *converter,
 	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 	g_return_val_if_fail (!is_opened (converter), FALSE);
 
-	converter->priv->conv = g_iconv_open (to_codeset, from_codeset);
+	/* The outbuf must have room for a whole character. */
+	if (is_utf8_codeset (to_codeset) &&
+	    converter->priv->outbuf_size - 1 >= UTF16_MAX_CHAR_LENGTH)
+	{
+		gboolean big_endian;
+		gboolean with_bom;
+
+		if (_gtef_utf16_charset_get_byte_order (from_codeset, &big_endian, &with_bom))
+		{
+			converter->priv->utf16 = TRUE;
+			converter->priv->utf16_big_endian = big_endian;
+			converter->priv->utf16_bom_pending = with_bom;
+		}
+	}
+
+	if (!converter->priv->utf16 &&
+	    is_utf8_codeset (to_codeset) &&
+	    converter->priv->outbuf_size - 1 >= SINGLE_BYTE_TABLE_MAX_CHAR_LENGTH)
+	{
+		converter->priv->table = get_single_byte_table (from_codeset);
+	}
+
+	if (!is_opened (converter))
+	{
+		converter->priv->conv = acquire_conv (to_codeset, from_codeset);
+
+		if (converter->priv->conv != (GIConv)-1)
+		{
+			converter->priv->to_codeset = g_strdup (to_codeset);
+			converter->priv->from_codeset = g_strdup (from_codeset);
+		}
+	}
 
-	if (converter->priv->conv == (GIConv)-1)
+	if (!is_opened (converter))
 	{
 		if (errno == EINVAL)
 		{
@@ -319,7 +795,7 @@ _gtef_encoding_converter_open (GtefEncodingConverter  *converter,
 
 	if (converter->priv->outbuf == NULL)
 	{
-		converter->priv->outbuf = g_malloc (converter->priv->outbuf_size);
+		converter->priv->outbuf = acquire_outbuf (converter->priv->outbuf_size);
 	}
 
 	converter->priv->outbytes_left = (converter->priv->outbuf_size - 1);
@@ -360,6 +836,21 @@ read_inbuf (GtefEncodingConverter  *converter,
 			{
 				return RESULT_INCOMPLETE_INPUT;
 			}
+			else if (errno == EILSEQ &&
+				 converter->priv->invalid_sequence_callback != NULL &&
+				 inbuf != NULL)
+			{
+				/* Skip one byte, the next ones can be valid. */
+				flush_outbuf (converter);
+
+				converter->priv->invalid_sequence_callback (*inbuf,
+									    1,
+									    converter->priv->invalid_sequence_callback_user_data);
+
+				(*inbuf)++;
+				(*inbytes_left)--;
+				continue;
+			}
 			else if (errno == EILSEQ)
 			{
 				g_set_error_literal (error,
@@ -389,73 +880,344 @@ read_inbuf (GtefEncodingConverter  *converter,
 	return RESULT_OK;
 }
 
-/* One possible implementation would be to concatenate remaining_inbuf with the
- * new inbuf, but it would need a complete re-allocation.
- * Instead, only one char of inbuf is appended at a time to remaining_inbuf,
- * until it succeeds. That way, it's just tiny allocations.
+/* Converts with the SingleByteTable. There is never an incomplete input. */
+static gboolean
+decode_single_byte (GtefEncodingConverter  *converter,
+		    const gchar            *inbuf,
+		    gsize                   inbytes_left,
+		    GError                **error)
+{
+	const SingleByteTable *table = converter->priv->table;
+
+	while (inbytes_left > 0)
+	{
+		gsize ascii_length;
+
+		if (converter->priv->outbytes_left == 0)
+		{
+			flush_outbuf (converter);
+		}
+
+		ascii_length = _gtef_utils_get_ascii_prefix_length (inbuf,
+								    MIN (inbytes_left, converter->priv->outbytes_left));
+
+		memcpy (converter->priv->outbuf + get_outbuf_used_length (converter),
+			inbuf,
+			ascii_length);
+
+		converter->priv->outbytes_left -= ascii_length;
+		inbuf += ascii_length;
+		inbytes_left -= ascii_length;
+
+		/* The other bytes, until the next ASCII run. */
+		while (inbytes_left > 0)
+		{
+			guchar byte = (guchar) *inbuf;
+			gsize length;
+
+			if (byte != 0 && byte < 0x80)
+			{
+				break;
+			}
+
+			length = table->length[byte];
+
+			if (length == 0)
+			{
+				if (converter->priv->invalid_sequence_callback == NULL)
+				{
+					g_set_error_literal (error,
+							     G_CONVERT_ERROR,
+							     G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+							     _("The input data contains an invalid sequence."));
+					return FALSE;
+				}
+
+				flush_outbuf (converter);
+
+				converter->priv->invalid_sequence_callback (inbuf,
+									    1,
+									    converter->priv->invalid_sequence_callback_user_data);
+			}
+			else
+			{
+				if (converter->priv->outbytes_left < length)
+				{
+					flush_outbuf (converter);
+				}
+
+				memcpy (converter->priv->outbuf + get_outbuf_used_length (converter),
+					table->utf8[byte],
+					length);
+
+				converter->priv->outbytes_left -= length;
+			}
+
+			inbuf++;
+			inbytes_left--;
+		}
+	}
+
+	return TRUE;
+}
+
+static void
+remove_carry_prefix (GtefEncodingConverter *converter,
+		     gsize                  length)
+{
+	g_assert (length <= converter->priv->carry_length);
+
+	converter->priv->carry_length -= length;
+	memmove (converter->priv->carry,
+		 converter->priv->carry + length,
+		 converter->priv->carry_length);
+}
+
+/* Converts from UTF-16 until the end of @inbuf or until an incomplete
+ * character, @bytes_read is set to the number of bytes consumed.
  */
-static Result
-handle_remaining_inbuf (GtefEncodingConverter  *converter,
-			gchar                 **inbuf,
-			gsize                  *inbytes_left,
-			GError                **error)
+static gboolean
+decode_utf16_chunk (GtefEncodingConverter  *converter,
+		    const gchar            *inbuf,
+		    gsize                   inbytes_left,
+		    gsize                  *bytes_read,
+		    GError                **error)
+{
+	const gchar *p = inbuf;
+
+	if (converter->priv->utf16_bom_pending)
+	{
+		guchar first;
+		guchar second;
+
+		if (inbytes_left < 2)
+		{
+			*bytes_read = 0;
+			return TRUE;
+		}
+
+		first = (guchar) p[0];
+		second = (guchar) p[1];
+
+		if (first == 0xFF && second == 0xFE)
+		{
+			converter->priv->utf16_big_endian = FALSE;
+			p += 2;
+			inbytes_left -= 2;
+		}
+		else if (first == 0xFE && second == 0xFF)
+		{
+			converter->priv->utf16_big_endian = TRUE;
+			p += 2;
+			inbytes_left -= 2;
+		}
+
+		converter->priv->utf16_bom_pending = FALSE;
+	}
+
+	while (inbytes_left > 0)
+	{
+		GtefUtf16Status status;
+		gsize n_read;
+		gsize n_written;
+
+		status = _gtef_utf16_to_utf8 (p,
+					      inbytes_left,
+					      converter->priv->utf16_big_endian,
+					      converter->priv->outbuf + get_outbuf_used_length (converter),
+					      converter->priv->outbytes_left,
+					      &n_read,
+					      &n_written);
+
+		p += n_read;
+		inbytes_left -= n_read;
+		converter->priv->outbytes_left -= n_written;
+
+		if (status == GTEF_UTF16_STATUS_OUTPUT_FULL)
+		{
+			flush_outbuf (converter);
+		}
+		else if (status == GTEF_UTF16_STATUS_INVALID)
+		{
+			if (converter->priv->invalid_sequence_callback == NULL)
+			{
+				g_set_error_literal (error,
+						     G_CONVERT_ERROR,
+						     G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+						     _("The input data contains an invalid sequence."));
+				return FALSE;
+			}
+
+			/* Skip the lone surrogate. */
+			flush_outbuf (converter);
+
+			converter->priv->invalid_sequence_callback (p,
+								    2,
+								    converter->priv->invalid_sequence_callback_user_data);
+
+			p += 2;
+			inbytes_left -= 2;
+		}
+		else
+		{
+			/* Done, or an incomplete character at the end. */
+			break;
+		}
+	}
+
+	*bytes_read = p - inbuf;
+	return TRUE;
+}
+
+/* An incomplete character is at most 3 bytes (a high surrogate and half of the
+ * low surrogate), it is kept in the carry. With the first bytes of the next
+ * chunk appended, the incomplete character can be converted.
+ */
+static gboolean
+decode_utf16 (GtefEncodingConverter  *converter,
+	      const gchar            *inbuf,
+	      gsize                   inbytes_left,
+	      GError                **error)
 {
-	if (converter->priv->remaining_inbuf == NULL)
+	gsize n_read;
+
+	if (converter->priv->carry_length > 0)
+	{
+		gsize carry_length = converter->priv->carry_length;
+		gsize n_appended;
+
+		n_appended = MIN (inbytes_left, UTF16_MAX_CHAR_LENGTH);
+		memcpy (converter->priv->carry + carry_length, inbuf, n_appended);
+		converter->priv->carry_length += n_appended;
+
+		if (!decode_utf16_chunk (converter,
+					 converter->priv->carry,
+					 converter->priv->carry_length,
+					 &n_read,
+					 error))
+		{
+			return FALSE;
+		}
+
+		if (n_read < carry_length)
+		{
+			/* Still incomplete, all the chunk is in the carry. */
+			g_assert (n_appended == inbytes_left);
+			remove_carry_prefix (converter, n_read);
+			return TRUE;
+		}
+
+		inbuf += n_read - carry_length;
+		inbytes_left -= n_read - carry_length;
+		converter->priv->carry_length = 0;
+	}
+
+	if (!decode_utf16_chunk (converter, inbuf, inbytes_left, &n_read, error))
 	{
-		return RESULT_OK;
+		return FALSE;
 	}
 
-	if (converter->priv->remaining_inbuf->len == 0)
+	g_assert (inbytes_left - n_read < UTF16_MAX_CHAR_LENGTH);
+	memcpy (converter->priv->carry, inbuf + n_read, inbytes_left - n_read);
+	converter->priv->carry_length = inbytes_left - n_read;
+
+	return TRUE;
+}
+
+/* Skips the first byte of inbuf, when no progress can be made. */
+static gboolean
+skip_invalid_byte (GtefEncodingConverter  *converter,
+		   gchar                 **inbuf,
+		   gsize                  *inbytes_left,
+		   GError                **error)
+{
+	if (converter->priv->invalid_sequence_callback == NULL)
 	{
-		g_string_free (converter->priv->remaining_inbuf, TRUE);
-		converter->priv->remaining_inbuf = NULL;
-		return RESULT_OK;
+		g_set_error_literal (error,
+				     G_CONVERT_ERROR,
+				     G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+				     _("The input data contains an invalid sequence."));
+		return FALSE;
 	}
 
-	while (*inbytes_left > 0)
+	flush_outbuf (converter);
+
+	converter->priv->invalid_sequence_callback (*inbuf,
+						    1,
+						    converter->priv->invalid_sequence_callback_user_data);
+
+	(*inbuf)++;
+	(*inbytes_left)--;
+	return TRUE;
+}
+
+/* The incomplete input of the previous chunk is in the carry. As many bytes of
+ * inbuf as the carry can hold are appended to it, and the carry is converted.
+ * Once the incomplete character is converted, the conversion continues
+ * directly in inbuf, so the bytes appended after the character are not used.
+ */
+static Result
+handle_carry (GtefEncodingConverter  *converter,
+	      gchar                 **inbuf,
+	      gsize                  *inbytes_left,
+	      GError                **error)
+{
+	while (converter->priv->carry_length > 0)
 	{
+		gsize carry_length = converter->priv->carry_length;
+		gsize n_appended;
 		gchar *my_inbuf;
 		gsize my_inbytes_left;
-		gboolean my_result;
+		gsize n_read;
+
+		n_appended = MIN (*inbytes_left, CARRY_MAX_LENGTH - carry_length);
+		memcpy (converter->priv->carry + carry_length, *inbuf, n_appended);
+		converter->priv->carry_length += n_appended;
 
-		g_string_append_len (converter->priv->remaining_inbuf, *inbuf, 1);
-		(*inbuf)++;
-		(*inbytes_left)--;
+		my_inbuf = converter->priv->carry;
+		my_inbytes_left = converter->priv->carry_length;
 
-		my_inbuf = converter->priv->remaining_inbuf->str;
-		my_inbytes_left = converter->priv->remaining_inbuf->len;
+		if (read_inbuf (converter, &my_inbuf, &my_inbytes_left, error) == RESULT_ERROR)
+		{
+			return RESULT_ERROR;
+		}
 
-		my_result = read_inbuf (converter,
-					&my_inbuf,
-					&my_inbytes_left,
-					error);
+		n_read = converter->priv->carry_length - my_inbytes_left;
 
-		switch (my_result)
+		if (n_read >= carry_length)
 		{
-			case RESULT_OK:
-				g_string_free (converter->priv->remaining_inbuf, TRUE);
-				converter->priv->remaining_inbuf = NULL;
-				return RESULT_OK;
+			*inbuf += n_read - carry_length;
+			*inbytes_left -= n_read - carry_length;
+			converter->priv->carry_length = 0;
+			return RESULT_OK;
+		}
 
-			case RESULT_INCOMPLETE_INPUT:
-				/* I think my_inbytes_left cannot have been
-				 * changed here, but it's anyway safer to handle
-				 * the case.
-				 */
-				g_string_erase (converter->priv->remaining_inbuf,
-						0,
-						converter->priv->remaining_inbuf->len - my_inbytes_left);
-				break;
+		/* Still incomplete, all the appended bytes are in the carry. */
+		*inbuf += n_appended;
+		*inbytes_left -= n_appended;
+		remove_carry_prefix (converter, n_read);
 
-			case RESULT_ERROR:
+		if (*inbytes_left == 0)
+		{
+			return RESULT_INCOMPLETE_INPUT;
+		}
+
+		/* The carry is full, without progress. */
+		if (n_read == 0)
+		{
+			gchar *carry = converter->priv->carry;
+			gsize length = converter->priv->carry_length;
+
+			if (!skip_invalid_byte (converter, &carry, &length, error))
+			{
 				return RESULT_ERROR;
+			}
 
-			default:
-				g_assert_not_reached ();
+			remove_carry_prefix (converter, 1);
 		}
 	}
 
-	return RESULT_INCOMPLETE_INPUT;
+	return RESULT_OK;
 }
 
 /*
@@ -488,10 +1250,20 @@ _gtef_encoding_converter_feed (GtefEncodingConverter  *converter,
 	inbuf = (gchar *)chunk;
 	inbytes_left = size == -1 ? strlen (chunk) : (gsize)size;
 
-	result = handle_remaining_inbuf (converter,
-					 &inbuf,
-					 &inbytes_left,
-					 error);
+	if (converter->priv->table != NULL)
+	{
+		return decode_single_byte (converter, inbuf, inbytes_left, error);
+	}
+
+	if (converter->priv->utf16)
+	{
+		return decode_utf16 (converter, inbuf, inbytes_left, error);
+	}
+
+	result = handle_carry (converter,
+			       &inbuf,
+			       &inbytes_left,
+			       error);
 
 	switch (result)
 	{
@@ -508,20 +1280,36 @@ _gtef_encoding_converter_feed (GtefEncodingConverter  *converter,
 			g_assert_not_reached ();
 	}
 
-	g_assert (converter->priv->remaining_inbuf == NULL);
+	g_assert (converter->priv->carry_length == 0);
 
 	result = read_inbuf (converter,
 			     &inbuf,
 			     &inbytes_left,
 			     error);
 
+	/* Can not be an incomplete character. */
+	while (result == RESULT_INCOMPLETE_INPUT &&
+	       inbytes_left > CARRY_MAX_LENGTH)
+	{
+		if (!skip_invalid_byte (converter, &inbuf, &inbytes_left, error))
+		{
+			return FALSE;
+		}
+
+		result = read_inbuf (converter,
+				     &inbuf,
+				     &inbytes_left,
+				     error);
+	}
+
 	switch (result)
 	{
 		case RESULT_OK:
 			break;
 
 		case RESULT_INCOMPLETE_INPUT:
-			converter->priv->remaining_inbuf = g_string_new_len (inbuf, inbytes_left);
+			memcpy (converter->priv->carry, inbuf, inbytes_left);
+			converter->priv->carry_length = inbytes_left;
 			break;
 
 		case RESULT_ERROR:
@@ -534,6 +1322,20 @@ _gtef_encoding_converter_feed (GtefEncodingConverter  *converter,
 	return TRUE;
 }
 
+/* Triggers the callback with the content converted so far, without closing the
+ * converter. An incomplete multi-byte char at the end of the last chunk is kept
+ * in the carry, it is converted with the next chunk. Useful when the input can
+ * grow later, for example a log file.
+ */
+void
+_gtef_encoding_converter_flush (GtefEncodingConverter *converter)
+{
+	g_return_if_fail (GTEF_IS_ENCODING_CONVERTER (converter));
+	g_return_if_fail (is_opened (converter));
+
+	flush_outbuf (converter);
+}
+
 /* This function can trigger the callback a last time. There can be an error if
  * the last chunk ended with an incomplete multi-byte char.
  */
@@ -547,16 +1349,30 @@ _gtef_encoding_converter_close (GtefEncodingConverter  *converter,
 	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 	g_return_val_if_fail (is_opened (converter), FALSE);
 
-	if (converter->priv->remaining_inbuf != NULL &&
-	    converter->priv->remaining_inbuf->len > 0)
+	if (converter->priv->carry_length > 0)
 	{
-		g_set_error_literal (error,
-				     G_CONVERT_ERROR,
-				     G_CONVERT_ERROR_PARTIAL_INPUT,
-				     _("The input data ends with an incomplete multi-byte sequence."));
-		ok = FALSE;
+		if (converter->priv->invalid_sequence_callback != NULL)
+		{
+			flush_outbuf (converter);
+
+			converter->priv->invalid_sequence_callback (converter->priv->carry,
+								    converter->priv->carry_length,
+								    converter->priv->invalid_sequence_callback_user_data);
+		}
+		else
+		{
+			g_set_error_literal (error,
+					     G_CONVERT_ERROR,
+					     G_CONVERT_ERROR_PARTIAL_INPUT,
+					     _("The input data ends with an incomplete multi-byte sequence."));
+			ok = FALSE;
+		}
 	}
-	else
+
+	/* Reset the iconv state. Nothing to do for the SingleByteTable and
+	 * UTF-16.
+	 */
+	if (ok && converter->priv->conv != (GIConv)-1)
 	{
 		gchar **inbuf = NULL;
 		gsize inbytes_left = 0;
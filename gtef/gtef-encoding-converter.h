@@ -62,6 +62,20 @@ typedef void (*GtefEncodingConversionCallback) (const gchar *str,
 						gsize        length,
 						gpointer     user_data);
 
+/**
+ * GtefEncodingInvalidSequenceCallback:
+ * @bytes: the invalid bytes.
+ * @length: the number of bytes.
+ * @user_data: user data set when the callback was connected.
+ *
+ * Called instead of returning a %G_CONVERT_ERROR_ILLEGAL_SEQUENCE error. The
+ * #GtefEncodingConversionCallback has been called before for all the content
+ * converted so far, and the conversion continues after the invalid bytes.
+ */
+typedef void (*GtefEncodingInvalidSequenceCallback) (const gchar *bytes,
+						     gsize        length,
+						     gpointer     user_data);
+
 G_GNUC_INTERNAL
 GType		_gtef_encoding_converter_get_type		(void);
 
@@ -77,6 +91,11 @@ void		_gtef_encoding_converter_set_callback		(GtefEncodingConverter          *co
 								 GtefEncodingConversionCallback  callback,
 								 gpointer                        user_data);
 
+G_GNUC_INTERNAL
+void		_gtef_encoding_converter_set_invalid_sequence_callback	(GtefEncodingConverter               *converter,
+									 GtefEncodingInvalidSequenceCallback  callback,
+									 gpointer                             user_data);
+
 G_GNUC_INTERNAL
 gboolean	_gtef_encoding_converter_open			(GtefEncodingConverter  *converter,
 								 const gchar            *to_codeset,
@@ -89,10 +108,20 @@ gboolean	_gtef_encoding_converter_feed			(GtefEncodingConverter  *converter,
 								 gssize                  size,
 								 GError                **error);
 
+G_GNUC_INTERNAL
+void		_gtef_encoding_converter_flush			(GtefEncodingConverter *converter);
+
 G_GNUC_INTERNAL
 gboolean	_gtef_encoding_converter_close			(GtefEncodingConverter  *converter,
 								 GError                **error);
 
+G_GNUC_INTERNAL
+void		_gtef_encoding_converter_clear_pool		(void);
+
+G_GNUC_INTERNAL
+void		_gtef_encoding_converter_get_pool_size		(guint  *n_convs,
+								 gint64 *outbufs_size);
+
 G_END_DECLS
 
 #endif /* GTEF_ENCODING_CONVERTER_H */
@@ -42,6 +42,9 @@ G_GNUC_INTERNAL
 GSList *	_gtef_encoding_remove_duplicates	(GSList                 *encodings,
 							 GtefEncodingDuplicates  removal_type);
 
+G_GNUC_INTERNAL
+gboolean	_gtef_encoding_charset_is_single_byte	(const gchar *charset);
+
 G_END_DECLS
 
 #endif  /* GTEF_ENCODING_PRIVATE_H */
@@ -186,6 +186,49 @@ static const EncodingData encodings_table[] =
 	{ "WINDOWS-1258", N_("Vietnamese") }
 };
 
+/* The charsets of encodings_table where each byte is one character, without
+ * state, and that are supersets of ASCII. Not in the list: WINDOWS-1255,
+ * WINDOWS-1258 and TCVN, iconv combines diacritics with the previous character
+ * for them; IBM864 and VISCII, some bytes below 0x80 are not ASCII.
+ */
+static const gchar *single_byte_charsets[] =
+{
+	"ISO-8859-1",
+	"ISO-8859-2",
+	"ISO-8859-3",
+	"ISO-8859-4",
+	"ISO-8859-5",
+	"ISO-8859-6",
+	"ISO-8859-7",
+	"ISO-8859-8",
+	"ISO-8859-9",
+	"ISO-8859-10",
+	"ISO-8859-13",
+	"ISO-8859-14",
+	"ISO-8859-15",
+	"ISO-8859-16",
+	"ARMSCII-8",
+	"CP866",
+	"GEORGIAN-ACADEMY",
+	"IBM850",
+	"IBM852",
+	"IBM855",
+	"IBM857",
+	"IBM862",
+	"ISO-IR-111",
+	"KOI8R",
+	"KOI8-R",
+	"KOI8U",
+	"TIS-620",
+	"WINDOWS-1250",
+	"WINDOWS-1251",
+	"WINDOWS-1252",
+	"WINDOWS-1253",
+	"WINDOWS-1254",
+	"WINDOWS-1256",
+	"WINDOWS-1257"
+};
+
 static GtefEncoding *
 _gtef_encoding_new_full (const gchar *charset,
 			 const gchar *translated_name)
@@ -565,6 +608,31 @@ _gtef_encoding_remove_duplicates (GSList                 *list,
 	g_return_val_if_reached (list);
 }
 
+/*
+ * _gtef_encoding_charset_is_single_byte:
+ * @charset: a character set.
+ *
+ * Returns: whether @charset is a stateless single-byte character set, among
+ * the ones known by #GtefEncoding.
+ */
+gboolean
+_gtef_encoding_charset_is_single_byte (const gchar *charset)
+{
+	gsize i;
+
+	g_return_val_if_fail (charset != NULL, FALSE);
+
+	for (i = 0; i < G_N_ELEMENTS (single_byte_charsets); i++)
+	{
+		if (g_ascii_strcasecmp (single_byte_charsets[i], charset) == 0)
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
 /* Returns: (transfer full) (element-type GtefEncoding). */
 static GSList *
 strv_to_list (const gchar * const *enc_str)
@@ -26,22 +26,52 @@
  * The progress callback is called after each chunk read. The chunk size can be
  * adjusted.
  * Doesn't handle/recover from errors.
+ *
+ * By default all the chunks are kept in memory, see
+ * _gtef_file_content_loader_get_content(). If a chunk callback is set, the
+ * chunks are instead given to the callback as soon as they are read, and are
+ * not kept, so that the content can be processed in a streaming fashion.
+ *
+ * Local regular files are by default memory-mapped, instead of being read
+ * with a GInputStream. The chunks are then zero-copy slices of the
+ * GMappedFile. If the chunk size is not set explicitly, they are larger, since
+ * progress reporting is less important for local files. If the file cannot be mapped, the GInputStream is used.
  */
 
 typedef struct _TaskData TaskData;
 
+/* Chunk size used for memory-mapped files, if the chunk size is not set
+ * explicitly. Big enough to avoid too many main loop iterations, small enough to
+ * still report progress and to not block the main loop too long.
+ */
+#define MAPPED_CHUNK_SIZE (1024 * 1024)
+
 struct _GtefFileContentLoaderPrivate
 {
 	GFile *location;
 
 	gint64 max_size;
 	gint64 chunk_size;
+	goffset start_offset;
 
 	GTask *task;
 
+	guint use_mmap : 1;
+
+	/* Whether the chunk size has been set explicitly, to honour it for
+	 * memory-mapped files too.
+	 */
+	guint chunk_size_set : 1;
+
+	/* See _gtef_file_content_loader_pause(). */
+	guint paused : 1;
+
 	GFileInfo *info;
 	gchar *etag;
 
+	GtefFileContentLoaderChunkCallback chunk_cb;
+	gpointer chunk_cb_data;
+
 	/* List of GBytes*. */
 	GQueue *content;
 };
@@ -50,12 +80,21 @@ struct _TaskData
 {
 	GFileInputStream *file_input_stream;
 
+	/* Non-NULL if the file is memory-mapped. */
+	GBytes *mapped_content;
+	gsize mapped_offset;
+
 	GFileProgressCallback progress_cb;
 	gpointer progress_cb_data;
 	GDestroyNotify progress_cb_notify;
 
 	goffset total_bytes_read;
 	goffset total_size;
+
+	/* Whether the next read has been deferred because the loader is
+	 * paused.
+	 */
+	guint read_deferred : 1;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (GtefFileContentLoader, _gtef_file_content_loader, G_TYPE_OBJECT)
@@ -80,6 +119,7 @@ task_data_free (gpointer data)
 	}
 
 	g_clear_object (&task_data->file_input_stream);
+	g_clear_pointer (&task_data->mapped_content, (GDestroyNotify)g_bytes_unref);
 
 	if (task_data->progress_cb_notify != NULL)
 	{
@@ -95,6 +135,8 @@ reset (GtefFileContentLoader *loader)
 	g_clear_object (&loader->priv->task);
 	g_clear_object (&loader->priv->info);
 
+	loader->priv->paused = FALSE;
+
 	g_free (loader->priv->etag);
 	loader->priv->etag = NULL;
 
@@ -131,6 +173,7 @@ _gtef_file_content_loader_init (GtefFileContentLoader *loader)
 
 	loader->priv->max_size = GTEF_FILE_CONTENT_LOADER_DEFAULT_MAX_SIZE;
 	loader->priv->chunk_size = GTEF_FILE_CONTENT_LOADER_DEFAULT_CHUNK_SIZE;
+	loader->priv->use_mmap = TRUE;
 }
 
 GtefFileContentLoader *
@@ -170,6 +213,66 @@ _gtef_file_content_loader_set_chunk_size (GtefFileContentLoader *loader,
 	g_return_if_fail (chunk_size >= 1);
 
 	loader->priv->chunk_size = chunk_size;
+	loader->priv->chunk_size_set = TRUE;
+}
+
+/*
+ * _gtef_file_content_loader_set_start_offset:
+ * @loader: a #GtefFileContentLoader.
+ * @start_offset: the number of bytes to skip at the beginning of the file.
+ *
+ * 0 by default. The max-size is still checked against the whole file size, but
+ * the progress is reported for the bytes actually read.
+ */
+void
+_gtef_file_content_loader_set_start_offset (GtefFileContentLoader *loader,
+					    goffset                start_offset)
+{
+	g_return_if_fail (GTEF_IS_FILE_CONTENT_LOADER (loader));
+	g_return_if_fail (start_offset >= 0);
+	g_return_if_fail (loader->priv->task == NULL);
+
+	loader->priv->start_offset = start_offset;
+}
+
+/*
+ * _gtef_file_content_loader_set_use_mmap:
+ * @loader: a #GtefFileContentLoader.
+ * @use_mmap: whether to memory-map local files.
+ *
+ * %TRUE by default. Should be disabled for files that can be truncated while
+ * they are read, like followed log files. Also useful for the performance
+ * tests, to compare with the GInputStream code path.
+ */
+void
+_gtef_file_content_loader_set_use_mmap (GtefFileContentLoader *loader,
+					gboolean               use_mmap)
+{
+	g_return_if_fail (GTEF_IS_FILE_CONTENT_LOADER (loader));
+	g_return_if_fail (loader->priv->task == NULL);
+
+	loader->priv->use_mmap = use_mmap != FALSE;
+}
+
+/*
+ * _gtef_file_content_loader_set_chunk_callback:
+ * @loader: a #GtefFileContentLoader.
+ * @callback: (nullable): the function to call for each chunk read, or %NULL.
+ * @user_data: user data to pass to @callback.
+ *
+ * When a chunk callback is set, the content is not kept in memory by @loader,
+ * _gtef_file_content_loader_get_content() will return an empty queue.
+ */
+void
+_gtef_file_content_loader_set_chunk_callback (GtefFileContentLoader              *loader,
+					      GtefFileContentLoaderChunkCallback  callback,
+					      gpointer                            user_data)
+{
+	g_return_if_fail (GTEF_IS_FILE_CONTENT_LOADER (loader));
+	g_return_if_fail (loader->priv->task == NULL);
+
+	loader->priv->chunk_cb = callback;
+	loader->priv->chunk_cb_data = user_data;
 }
 
 static void
@@ -207,55 +310,55 @@ close_input_stream (GTask *task)
 				    task);
 }
 
-static void
-read_next_chunk_cb (GObject      *source_object,
-		    GAsyncResult *result,
-		    gpointer      user_data)
+/* Returns %FALSE if an error occurred, in which case the task has been
+ * returned.
+ */
+static gboolean
+add_chunk (GTask  *task,
+	   GBytes *chunk)
 {
-	GInputStream *input_stream = G_INPUT_STREAM (source_object);
-	GTask *task = G_TASK (user_data);
 	GtefFileContentLoader *loader;
 	TaskData *task_data;
-	GBytes *chunk;
-	gsize chunk_size;
 	GError *error = NULL;
 
 	loader = g_task_get_source_object (task);
 	task_data = g_task_get_task_data (task);
 
-	chunk = g_input_stream_read_bytes_finish (input_stream, result, &error);
+	task_data->total_bytes_read += g_bytes_get_size (chunk);
 
-	if (error != NULL)
+	if (loader->priv->chunk_cb != NULL)
 	{
-		g_task_return_error (task, error);
-		g_clear_pointer (&chunk, (GDestroyNotify)g_bytes_unref);
-		return;
-	}
-
-	chunk_size = g_bytes_get_size (chunk);
+		gboolean ok;
 
-	if (chunk_size == 0)
-	{
-		/* Finished reading */
-		close_input_stream (task);
+		ok = loader->priv->chunk_cb (chunk, loader->priv->chunk_cb_data, &error);
 		g_bytes_unref (chunk);
-		return;
-	}
 
-	if (loader->priv->content == NULL)
+		if (!ok)
+		{
+			g_assert (error != NULL);
+			g_task_return_error (task, error);
+			return FALSE;
+		}
+	}
+	else
 	{
-		loader->priv->content = g_queue_new ();
+		if (loader->priv->content == NULL)
+		{
+			loader->priv->content = g_queue_new ();
+		}
+
+		g_queue_push_tail (loader->priv->content, chunk);
 	}
 
-	g_queue_push_tail (loader->priv->content, chunk);
-	task_data->total_bytes_read += chunk_size;
+	return TRUE;
+}
 
-	/* Read next chunk before calling the progress_cb, because the
-	 * progress_cb can take some time. If for some reason the progress_cb
-	 * takes more time than reading the next chunk, the ordering will still
-	 * be good, with the main event loop.
-	 */
-	read_next_chunk (task);
+static void
+report_progress (GTask *task)
+{
+	TaskData *task_data;
+
+	task_data = g_task_get_task_data (task);
 
 	if (task_data->progress_cb != NULL &&
 	    task_data->total_size > 0)
@@ -277,6 +380,48 @@ read_next_chunk_cb (GObject      *source_object,
 	}
 }
 
+static void
+read_next_chunk_cb (GObject      *source_object,
+		    GAsyncResult *result,
+		    gpointer      user_data)
+{
+	GInputStream *input_stream = G_INPUT_STREAM (source_object);
+	GTask *task = G_TASK (user_data);
+	GBytes *chunk;
+	GError *error = NULL;
+
+	chunk = g_input_stream_read_bytes_finish (input_stream, result, &error);
+
+	if (error != NULL)
+	{
+		g_task_return_error (task, error);
+		g_clear_pointer (&chunk, (GDestroyNotify)g_bytes_unref);
+		return;
+	}
+
+	if (g_bytes_get_size (chunk) == 0)
+	{
+		/* Finished reading */
+		close_input_stream (task);
+		g_bytes_unref (chunk);
+		return;
+	}
+
+	if (!add_chunk (task, chunk))
+	{
+		return;
+	}
+
+	/* Read next chunk before calling the progress_cb, because the
+	 * progress_cb can take some time. If for some reason the progress_cb
+	 * takes more time than reading the next chunk, the ordering will still
+	 * be good, with the main event loop.
+	 */
+	read_next_chunk (task);
+
+	report_progress (task);
+}
+
 static void
 read_next_chunk (GTask *task)
 {
@@ -286,6 +431,12 @@ read_next_chunk (GTask *task)
 	loader = g_task_get_source_object (task);
 	task_data = g_task_get_task_data (task);
 
+	if (loader->priv->paused)
+	{
+		task_data->read_deferred = TRUE;
+		return;
+	}
+
 	/* GIO provides several functions to read content from a GInputStream or
 	 * a GFile. Here we want to report progress information, mainly in case
 	 * the content comes from a remote file (with potentially a slow
@@ -308,6 +459,189 @@ read_next_chunk (GTask *task)
 					 task);
 }
 
+static gboolean
+read_next_mapped_chunk (gpointer user_data)
+{
+	GTask *task = G_TASK (user_data);
+	GtefFileContentLoader *loader;
+	TaskData *task_data;
+	gsize total_size;
+	gsize chunk_size;
+	GBytes *chunk;
+
+	loader = g_task_get_source_object (task);
+	task_data = g_task_get_task_data (task);
+
+	if (g_task_return_error_if_cancelled (task))
+	{
+		return G_SOURCE_REMOVE;
+	}
+
+	total_size = g_bytes_get_size (task_data->mapped_content);
+	g_assert (task_data->mapped_offset <= total_size);
+
+	if (task_data->mapped_offset == total_size)
+	{
+		/* Finished reading */
+		g_clear_pointer (&task_data->mapped_content, (GDestroyNotify)g_bytes_unref);
+		close_input_stream (task);
+		return G_SOURCE_REMOVE;
+	}
+
+	chunk_size = loader->priv->chunk_size_set ? loader->priv->chunk_size : MAPPED_CHUNK_SIZE;
+	chunk_size = MIN (chunk_size, total_size - task_data->mapped_offset);
+
+	/* Zero-copy: the chunk keeps a ref on the mapped content. */
+	chunk = g_bytes_new_from_bytes (task_data->mapped_content,
+					task_data->mapped_offset,
+					chunk_size);
+	task_data->mapped_offset += chunk_size;
+
+	if (!add_chunk (task, chunk))
+	{
+		return G_SOURCE_REMOVE;
+	}
+
+	report_progress (task);
+
+	if (loader->priv->paused)
+	{
+		task_data->read_deferred = TRUE;
+		return G_SOURCE_REMOVE;
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void
+read_mapped_chunks (GTask *task)
+{
+	GSource *source;
+
+	source = g_idle_source_new ();
+	g_task_attach_source (task, source, read_next_mapped_chunk);
+	g_source_unref (source);
+}
+
+static void
+return_too_big_error (GTask *task)
+{
+	GtefFileContentLoader *loader;
+	gchar *max_size_str;
+
+	loader = g_task_get_source_object (task);
+
+	max_size_str = g_format_size (loader->priv->max_size);
+
+	g_task_return_new_error (task,
+				 GTEF_FILE_LOADER_ERROR,
+				 GTEF_FILE_LOADER_ERROR_TOO_BIG,
+				 _("The file is too big. Maximum %s can be loaded."),
+				 max_size_str);
+
+	g_free (max_size_str);
+}
+
+/* Returns whether the file has been memory-mapped. */
+static gboolean
+map_file (GTask *task)
+{
+	GtefFileContentLoader *loader;
+	TaskData *task_data;
+	gchar *path;
+	GMappedFile *mapped_file;
+
+	loader = g_task_get_source_object (task);
+	task_data = g_task_get_task_data (task);
+
+	if (!loader->priv->use_mmap ||
+	    !g_file_has_uri_scheme (loader->priv->location, "file"))
+	{
+		return FALSE;
+	}
+
+	/* Some special files, for example in /proc, have a size of 0 but have
+	 * a content. Reading empty files with the GInputStream is anyway fast.
+	 */
+	if (task_data->total_size <= 0 ||
+	    !g_file_info_has_attribute (loader->priv->info, G_FILE_ATTRIBUTE_STANDARD_TYPE) ||
+	    g_file_info_get_file_type (loader->priv->info) != G_FILE_TYPE_REGULAR)
+	{
+		return FALSE;
+	}
+
+	path = g_file_get_path (loader->priv->location);
+	if (path == NULL)
+	{
+		return FALSE;
+	}
+
+	/* If an error occurs, fallback to the GInputStream. Note that if the
+	 * file is truncated by another process while it is mapped, reading it
+	 * can crash (SIGBUS). For files that are expected to be truncated, the
+	 * caller should disable mmap, see
+	 * _gtef_file_content_loader_set_use_mmap().
+	 */
+	mapped_file = g_mapped_file_new (path, FALSE, NULL);
+	g_free (path);
+
+	if (mapped_file == NULL)
+	{
+		return FALSE;
+	}
+
+	g_assert (task_data->mapped_content == NULL);
+	task_data->mapped_content = g_mapped_file_get_bytes (mapped_file);
+	task_data->mapped_offset = 0;
+	g_mapped_file_unref (mapped_file);
+
+	/* The file can have changed since querying its size. */
+	task_data->total_size = g_bytes_get_size (task_data->mapped_content);
+
+	return TRUE;
+}
+
+static void
+skip_cb (GObject      *source_object,
+	 GAsyncResult *result,
+	 gpointer      user_data)
+{
+	GInputStream *input_stream = G_INPUT_STREAM (source_object);
+	GTask *task = G_TASK (user_data);
+	GError *error = NULL;
+
+	g_input_stream_skip_finish (input_stream, result, &error);
+
+	if (error != NULL)
+	{
+		g_task_return_error (task, error);
+		return;
+	}
+
+	/* Start reading */
+	read_next_chunk (task);
+}
+
+static void
+skip_to_start_offset (GTask *task)
+{
+	GtefFileContentLoader *loader;
+	TaskData *task_data;
+
+	loader = g_task_get_source_object (task);
+	task_data = g_task_get_task_data (task);
+
+	/* Skipping is like seeking for a local file, but it works also for the
+	 * streams that are not seekable.
+	 */
+	g_input_stream_skip_async (G_INPUT_STREAM (task_data->file_input_stream),
+				   loader->priv->start_offset,
+				   g_task_get_priority (task),
+				   g_task_get_cancellable (task),
+				   skip_cb,
+				   task);
+}
+
 static void
 check_file_size (GTask *task)
 {
@@ -324,19 +658,32 @@ check_file_size (GTask *task)
 		if (loader->priv->max_size >= 0 &&
 		    task_data->total_size > loader->priv->max_size)
 		{
-			gchar *max_size_str;
-
-			max_size_str = g_format_size (loader->priv->max_size);
-
-			g_task_return_new_error (task,
-						 GTEF_FILE_LOADER_ERROR,
-						 GTEF_FILE_LOADER_ERROR_TOO_BIG,
-						 _("The file is too big. Maximum %s can be loaded."),
-						 max_size_str);
+			return_too_big_error (task);
+			return;
+		}
+	}
 
-			g_free (max_size_str);
+	if (map_file (task))
+	{
+		if (loader->priv->max_size >= 0 &&
+		    task_data->total_size > loader->priv->max_size)
+		{
+			return_too_big_error (task);
 			return;
 		}
+
+		task_data->mapped_offset = MIN (loader->priv->start_offset, task_data->total_size);
+		task_data->total_size -= task_data->mapped_offset;
+
+		read_mapped_chunks (task);
+		return;
+	}
+
+	if (loader->priv->start_offset > 0)
+	{
+		task_data->total_size = MAX (0, task_data->total_size - loader->priv->start_offset);
+		skip_to_start_offset (task);
+		return;
 	}
 
 	/* Start reading */
@@ -379,8 +726,12 @@ query_info_on_location (GTask *task)
 	 * normal conditions).
 	 */
 	g_file_query_info_async (loader->priv->location,
+				 G_FILE_ATTRIBUTE_STANDARD_TYPE ","
 				 G_FILE_ATTRIBUTE_STANDARD_SIZE ","
-				 G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE,
+				 G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+				 G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC ","
+				 G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE ","
+				 G_FILE_ATTRIBUTE_ID_FILE,
 				 G_FILE_QUERY_INFO_NONE,
 				 g_task_get_priority (task),
 				 g_task_get_cancellable (task),
@@ -536,6 +887,63 @@ _gtef_file_content_loader_load_async (GtefFileContentLoader *loader,
 	open_file (loader->priv->task);
 }
 
+/*
+ * _gtef_file_content_loader_pause:
+ * @loader: a #GtefFileContentLoader.
+ *
+ * Stops reading the content after the current chunk, until
+ * _gtef_file_content_loader_resume() is called. Can be called from the chunk
+ * callback, to not read the content faster than it is consumed.
+ */
+void
+_gtef_file_content_loader_pause (GtefFileContentLoader *loader)
+{
+	g_return_if_fail (GTEF_IS_FILE_CONTENT_LOADER (loader));
+
+	loader->priv->paused = TRUE;
+}
+
+/*
+ * _gtef_file_content_loader_resume:
+ * @loader: a #GtefFileContentLoader.
+ *
+ * Continues reading the content after _gtef_file_content_loader_pause().
+ */
+void
+_gtef_file_content_loader_resume (GtefFileContentLoader *loader)
+{
+	GTask *task;
+	TaskData *task_data;
+
+	g_return_if_fail (GTEF_IS_FILE_CONTENT_LOADER (loader));
+
+	loader->priv->paused = FALSE;
+
+	task = loader->priv->task;
+	if (task == NULL)
+	{
+		return;
+	}
+
+	task_data = g_task_get_task_data (task);
+
+	if (!task_data->read_deferred)
+	{
+		return;
+	}
+
+	task_data->read_deferred = FALSE;
+
+	if (task_data->mapped_content != NULL)
+	{
+		read_mapped_chunks (task);
+	}
+	else
+	{
+		read_next_chunk (task);
+	}
+}
+
 /*
  * _gtef_file_content_loader_load_finish:
  * @loader: a #GtefFileContentLoader.
@@ -595,6 +1003,53 @@ _gtef_file_content_loader_get_etag (GtefFileContentLoader *loader)
 	return loader->priv->etag;
 }
 
+/*
+ * Can be called as soon as the first chunk has been received (or, for an empty
+ * file, when the load operation is finished).
+ *
+ * Returns: (nullable): a string that changes when the file is modified, built
+ * from the size, the modification time and the etag, or %NULL if they are not
+ * available. Free with g_free().
+ */
+gchar *
+_gtef_file_content_loader_get_validity_key (GtefFileContentLoader *loader)
+{
+	GFileInfo *info;
+
+	g_return_val_if_fail (GTEF_IS_FILE_CONTENT_LOADER (loader), NULL);
+
+	info = loader->priv->info;
+
+	if (info == NULL ||
+	    !g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_SIZE) ||
+	    !g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_TIME_MODIFIED))
+	{
+		return NULL;
+	}
+
+	return g_strdup_printf ("%" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT ".%06u:%s",
+				g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_STANDARD_SIZE),
+				g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED),
+				g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC),
+				loader->priv->etag != NULL ? loader->priv->etag : "");
+}
+
+/*
+ * Should be called only after a successful load operation.
+ *
+ * Returns: (nullable): the identifier of the file, which is different after
+ * the file has been replaced, for example by a log rotation. %NULL if not
+ * available.
+ */
+const gchar *
+_gtef_file_content_loader_get_file_id (GtefFileContentLoader *loader)
+{
+	g_return_val_if_fail (GTEF_IS_FILE_CONTENT_LOADER (loader), NULL);
+	g_return_val_if_fail (loader->priv->info != NULL, NULL);
+
+	return g_file_info_get_attribute_string (loader->priv->info, G_FILE_ATTRIBUTE_ID_FILE);
+}
+
 /* Should be called only after a successful load operation. */
 gboolean
 _gtef_file_content_loader_get_readonly (GtefFileContentLoader *loader)
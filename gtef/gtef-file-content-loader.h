@@ -53,6 +53,19 @@ struct _GtefFileContentLoaderClass
 	GObjectClass parent_class;
 };
 
+/*
+ * GtefFileContentLoaderChunkCallback:
+ * @chunk: a non-empty chunk of content, just read.
+ * @user_data: user data set when the callback was connected.
+ * @error: location to a %NULL #GError, or %NULL.
+ *
+ * Returns: %TRUE to continue reading, %FALSE to abort the load operation (in
+ * which case @error must be set).
+ */
+typedef gboolean (*GtefFileContentLoaderChunkCallback) (GBytes   *chunk,
+							 gpointer  user_data,
+							 GError  **error);
+
 G_GNUC_INTERNAL
 GType			_gtef_file_content_loader_get_type		(void);
 
@@ -67,6 +80,19 @@ G_GNUC_INTERNAL
 void			_gtef_file_content_loader_set_chunk_size	(GtefFileContentLoader *loader,
 									 gint64                 chunk_size);
 
+G_GNUC_INTERNAL
+void			_gtef_file_content_loader_set_start_offset	(GtefFileContentLoader *loader,
+									 goffset                start_offset);
+
+G_GNUC_INTERNAL
+void			_gtef_file_content_loader_set_use_mmap		(GtefFileContentLoader *loader,
+									 gboolean               use_mmap);
+
+G_GNUC_INTERNAL
+void			_gtef_file_content_loader_set_chunk_callback	(GtefFileContentLoader              *loader,
+									 GtefFileContentLoaderChunkCallback  callback,
+									 gpointer                            user_data);
+
 G_GNUC_INTERNAL
 void			_gtef_file_content_loader_load_async		(GtefFileContentLoader *loader,
 									 gint                   io_priority,
@@ -77,6 +103,12 @@ void			_gtef_file_content_loader_load_async		(GtefFileContentLoader *loader,
 									 GAsyncReadyCallback    callback,
 									 gpointer               user_data);
 
+G_GNUC_INTERNAL
+void			_gtef_file_content_loader_pause			(GtefFileContentLoader *loader);
+
+G_GNUC_INTERNAL
+void			_gtef_file_content_loader_resume		(GtefFileContentLoader *loader);
+
 G_GNUC_INTERNAL
 gboolean		_gtef_file_content_loader_load_finish		(GtefFileContentLoader  *loader,
 									 GAsyncResult           *result,
@@ -88,6 +120,12 @@ GQueue *		_gtef_file_content_loader_get_content		(GtefFileContentLoader *loader)
 G_GNUC_INTERNAL
 const gchar *		_gtef_file_content_loader_get_etag		(GtefFileContentLoader *loader);
 
+G_GNUC_INTERNAL
+gchar *			_gtef_file_content_loader_get_validity_key	(GtefFileContentLoader *loader);
+
+G_GNUC_INTERNAL
+const gchar *		_gtef_file_content_loader_get_file_id		(GtefFileContentLoader *loader);
+
 G_GNUC_INTERNAL
 gboolean		_gtef_file_content_loader_get_readonly		(GtefFileContentLoader *loader);
 
@@ -19,13 +19,18 @@
 
 #include "config.h"
 #include "gtef-file-loader.h"
+#include <string.h>
 #include <uchardet.h>
 #include <glib/gi18n-lib.h>
 #include "gtef-buffer.h"
+#include "gtef-content-hash.h"
 #include "gtef-file.h"
 #include "gtef-file-content-loader.h"
+#include "gtef-file-metadata.h"
 #include "gtef-encoding.h"
 #include "gtef-encoding-converter.h"
+#include "gtef-line-diff.h"
+#include "gtef-utils.h"
 
 /**
  * SECTION:file-loader
@@ -52,10 +57,52 @@
  * After a file loading, the buffer is reset to the content provided by the
  * #GFile, so the buffer is set as “unmodified”, that is,
  * gtk_text_buffer_set_modified() is called with %FALSE.
+ *
+ * The content is converted and inserted into the buffer while it is read, it
+ * is not first entirely kept in memory. The character encoding is detected on
+ * the beginning of the content, see the #GtefFileLoader:sniff-size property.
+ * The encoding detection and conversion are done in a worker thread, and the
+ * content is inserted into the buffer by small batches, to keep the user
+ * interface responsive.
+ * As a consequence, if an error occurs during the load operation, the buffer
+ * can contain a part of the content.
+ *
+ * A gzip-compressed file is recognized by its magic bytes and is decompressed
+ * in the worker thread too. The #GtefFileLoader:max-size is then checked
+ * against the uncompressed size.
+ *
+ * After a successful load, the detected encoding and newline type are stored
+ * in the #GtefFileMetadata of the #GtefFile, with the metadata keys
+ * “gtef-encoding” and “gtef-newline-type”, along with a “gtef-validity-key”
+ * built from the size, the modification time and the etag of the file. They
+ * are saved on disk with the other metadata, by gtef_file_metadata_save(). If
+ * the metadata have been loaded before gtef_file_loader_load_async() and the
+ * file has not changed since, the encoding detection is skipped, see
+ * %GTEF_ENCODING_DETECTION_METHOD_METADATA. If the conversion fails with that
+ * encoding, the content is loaded again with the encoding detection.
+ *
+ * With the #GtefFileLoader:follow property, for example for a log file, the
+ * #GtefFileLoader keeps the byte offset and the state of the conversion at the
+ * end of a load operation. The next gtef_file_loader_load_async() on the same
+ * #GtefFileLoader then reads only the content appended since, and inserts it at
+ * the end of the buffer, with the encoding already known. If the file has been
+ * truncated or replaced (e.g. by a log rotation), or if the buffer has been
+ * modified, the whole content is loaded again. See also
+ * #GtefView:auto-scroll, and #GtefFileWatcher to know when the file changes.
+ *
+ * With the #GtefFileLoader:patch-buffer property, reloading a file that has
+ * been modified externally doesn't empty the buffer. The new content is
+ * compared line by line to the buffer content in the worker thread, and only
+ * the lines that differ are deleted and inserted at the end. The text marks,
+ * including the cursor and the #GtefFoldRegion's, are kept on the unchanged
+ * lines.
  */
 
 typedef struct _GtefFileLoaderPrivate GtefFileLoaderPrivate;
 typedef struct _TaskData TaskData;
+typedef struct _Decoder Decoder;
+typedef struct _Block Block;
+typedef struct _FollowState FollowState;
 
 struct _GtefFileLoaderPrivate
 {
@@ -74,31 +121,282 @@ struct _GtefFileLoaderPrivate
 	GFile *location;
 	gint64 max_size;
 	gint64 chunk_size;
+	gint64 sniff_size;
 	GTask *task;
 
+	/* Whether chunk_size has been set explicitly. Otherwise the content
+	 * loader chooses it.
+	 */
+	guint chunk_size_set : 1;
+
+	guint escape_invalid_chars : 1;
+	guint follow : 1;
+	guint patch_buffer : 1;
+
+	/* With the follow mode, the state at the end of the previous load, or
+	 * %NULL if the next load must read the whole content.
+	 */
+	FollowState *follow_state;
+
 	GtefEncoding *detected_encoding;
 	GtefNewlineType detected_newline_type;
+	GtefCompressionType detected_compression_type;
+	GtefEncodingDetectionMethod encoding_detection_method;
+
+	/* Number of newlines of each type in the whole content, indexed by
+	 * GtefNewlineType.
+	 */
+	guint64 newline_counts[3];
+
+	/* Incremented at each change of the buffer content, to know if the
+	 * buffer has been modified by something else since a given time. Unlike
+	 * the number of characters, it detects the changes of the same length.
+	 */
+	guint64 buffer_stamp;
+
+	/* For the unit tests: the maximum number of raw chunks that have
+	 * waited in the Decoder input queue during the last load.
+	 */
+	guint max_input_length;
 };
 
 struct _TaskData
 {
 	GtefFileContentLoader *content_loader;
 
-	/* TODO report progress also when determining encoding, and when
-	 * converting and inserting the content.
+	/* The decoder runs in a worker thread. Created when the first chunk is
+	 * read.
 	 */
+	GTask *decoder_task;
+	Decoder *decoder;
+
+	/* The first error that occurred. */
+	GError *error;
+
 	GFileProgressCallback progress_cb;
 	gpointer progress_cb_data;
 	GDestroyNotify progress_cb_notify;
+	goffset total_size;
+
+	guint insert_source_id;
+
+	/* The encoding stored in the GtefFileMetadata by a previous load, with
+	 * the validity key of the file at that time. Used only if the file
+	 * still has the same validity key, computed when the decoder is
+	 * launched.
+	 */
+	GtefEncoding *cached_encoding;
+	gchar *cached_validity_key;
+	gchar *validity_key;
+
+	/* With the escape-invalid-chars mode, the InvalidRanges in character
+	 * offsets, in the order of the content. Tagged all at once at the end.
+	 */
+	GArray *invalid_ranges;
+
+	/* With the follow mode, the state of the previous load, taken from the
+	 * GtefFileLoaderPrivate.
+	 */
+	FollowState *follow_state;
+
+	/* When appending, the first bytes read are the last bytes of the
+	 * previous load, they must not have changed. tail_check is set to %NULL
+	 * once they have all been compared.
+	 */
+	GBytes *tail_check;
+	gsize tail_check_pos;
+
+	/* With the follow mode, the last raw bytes read and the offset of the
+	 * end of the content read, for the next FollowState.
+	 */
+	GByteArray *tail;
+	goffset end_offset;
+
+	/* The state of the Decoder at the end, with the follow mode. */
+	GtefEncodingConverter *follow_converter;
+	GString *follow_pending_text;
+
+	/* With the patch-buffer mode, the buffer text before the load and the
+	 * buffer stamp at that time. The buffer is not emptied, it is patched
+	 * at the end.
+	 */
+	GBytes *old_text;
+	guint64 old_buffer_stamp;
 
+	/* The hash of the whole raw content, owned by the Decoder while its
+	 * worker thread runs. %NULL if GtefFile:compute-checksum is FALSE or
+	 * when only the appended content is read.
+	 */
+	GtefContentHash *content_hash;
+
+	guint patching : 1;
+	guint appending : 1;
+	guint tail_mismatch : 1;
 	guint tried_mount : 1;
+	guint use_cached_encoding : 1;
+	guint reading_done : 1;
+	guint decoder_done : 1;
+	guint returned : 1;
+};
 
-	/* Whether the next char to insert in the GtkTextBuffer is a carriage
-	 * return. If it is followed by a newline, the \r\n must be inserted in
-	 * one block, because of a bug in GtkTextBuffer:
-	 * https://bugzilla.gnome.org/show_bug.cgi?id=631468
+/* The content is read in the main thread. The encoding detection and the
+ * conversion to UTF-8 are done in a worker thread, the Decoder. The Decoder
+ * produces Blocks of UTF-8 text, ready to be inserted in the GtkTextBuffer by
+ * the main thread.
+ */
+struct _Decoder
+{
+	/* Set before launching the worker thread, read-only afterwards. The
+	 * task is kept alive by the user_data of the decoder task callback.
+	 */
+	GTask *loader_task;
+	GMainContext *main_context;
+	gint64 sniff_size;
+	gint64 max_size;
+	gboolean escape_invalid_chars;
+
+	/* At the end of the content, keep the converter opened and the pending
+	 * text, instead of flushing them, because the content can continue in
+	 * the next load.
+	 */
+	gboolean follow;
+
+	/* Raw chunks, GBytes*. An empty GBytes marks the end of the input. */
+	GAsyncQueue *input;
+
+	GMutex mutex;
+	GCond cond;
+
+	/* Protected by the mutex. Queue of Block*. */
+	GQueue *output;
+	guint aborted : 1;
+
+	/* Protected by the mutex. Whether the reading of the content is paused
+	 * because the input queue is full. The worker thread resumes it once
+	 * the queue is drained enough.
+	 */
+	guint input_paused : 1;
+
+	/* Accessed only by the worker thread, until it has finished. */
+	GtefEncoding *encoding;
+	GtefEncodingDetectionMethod encoding_detection_method;
+	GByteArray *sniff_content;
+	GtefEncodingConverter *converter;
+
+	/* The first bytes of the sniff window are classified as soon as they
+	 * are received: a BOM decides the encoding, and binary content aborts
+	 * the loading without waiting for the whole sniff window.
+	 */
+	gboolean bom_checked;
+	gsize binary_checked_length;
+
+	/* Number of bytes of the raw content (i.e. compressed, if it is)
+	 * received so far.
+	 */
+	goffset n_bytes_fed;
+
+	/* Taken from the TaskData, so that the raw content is hashed in the
+	 * worker thread. %NULL if the content is not hashed.
+	 */
+	GtefContentHash *content_hash;
+
+	/* The compression is determined on the first bytes of the content,
+	 * kept in compression_sniff meanwhile. The decompressed content is
+	 * then fed to the encoding detection and conversion.
+	 */
+	GByteArray *compression_sniff;
+	GtefCompressionType compression_type;
+	GConverter *decompressor;
+	goffset n_uncompressed_bytes;
+
+	/* Indexed by GtefNewlineType. */
+	guint64 newline_counts[3];
+
+	/* If the content is UTF-8, it is only validated, and the Blocks are
+	 * slices of the raw chunks. The converter is not used.
+	 */
+	gboolean utf8_fast_path;
+
+	/* Text not yet pushed: a \r waiting for the next character, and, with
+	 * the UTF-8 fast path, a multi-byte character split between two chunks.
+	 */
+	GString *pending_text;
+
+	/* With the patch-buffer mode, the buffer text before the load, set
+	 * before launching the worker thread. The converted content is then
+	 * collected in new_text, and the Blocks are empty, they only report
+	 * the progress. At the end, new_text is compared to old_text.
+	 */
+	GBytes *old_text;
+	gboolean remove_trailing_newline;
+	GString *new_text;
+	glong new_text_n_chars;
+
+	/* The results with the patch-buffer mode, taken by the main thread
+	 * once the worker thread has finished: the InvalidRanges in character
+	 * offsets of new_text, the trailing newline removed from new_text, and
+	 * the GtefLineDiffHunks, with the old offsets converted to characters.
 	 */
-	guint insert_carriage_return : 1;
+	GArray *new_invalid_ranges;
+	gchar *removed_newline;
+	GArray *hunks;
+};
+
+/* A range of escaped invalid bytes. In a Block, offsets in bytes of the Block
+ * text; in the TaskData, offsets in characters of the buffer. The escaped text
+ * is ASCII, so the length is the same in bytes and in characters.
+ */
+typedef struct
+{
+	gsize start;
+	gsize length;
+} InvalidRange;
+
+struct _Block
+{
+	GBytes *text;
+
+	/* InvalidRanges in @text, or %NULL. */
+	GArray *invalid_ranges;
+
+	/* Number of bytes of the raw content that have been converted, for
+	 * reporting progress.
+	 */
+	goffset n_raw_bytes;
+};
+
+/* What is needed to continue reading the content where the previous load
+ * operation has stopped.
+ */
+struct _FollowState
+{
+	/* Number of bytes already read, and the last bytes before that offset
+	 * (at most FOLLOW_TAIL_SIZE), to detect a file rewritten in place.
+	 */
+	goffset offset;
+	GBytes *tail;
+
+	/* G_FILE_ATTRIBUTE_ID_FILE, or %NULL. A rotated log file is a new file
+	 * with the same name.
+	 */
+	gchar *file_id;
+
+	/* The Decoder state: the converter, still opened, with an incomplete
+	 * multi-byte character in its carry; or %NULL for the UTF-8 fast
+	 * path. And the pending text, e.g. a \r waiting for the next character.
+	 */
+	GtefEncodingConverter *converter;
+	GString *pending_text;
+
+	/* The trailing newline removed from the buffer, inserted again before
+	 * the appended content. %NULL if no newline has been removed.
+	 */
+	gchar *removed_newline;
+
+	/* The buffer stamp at the end of the previous load, to detect that the
+	 * buffer content has been changed by something else since then.
+	 */
+	guint64 buffer_stamp;
 };
 
 enum
@@ -109,18 +407,84 @@ enum
 	PROP_LOCATION,
 	PROP_MAX_SIZE,
 	PROP_CHUNK_SIZE,
+	PROP_SNIFF_SIZE,
+	PROP_ESCAPE_INVALID_CHARS,
+	PROP_FOLLOW,
+	PROP_PATCH_BUFFER,
 	N_PROPERTIES
 };
 
 /* Take the default buffer-size of GtefEncodingConverter. */
 #define ENCODING_CONVERTER_BUFFER_SIZE (-1)
 
+/* Large enough for uchardet to take a good decision, small enough to not delay
+ * too much the first insertion in the buffer.
+ */
+#define DEFAULT_SNIFF_SIZE (64 * 1024)
+
+/* Maximum number of bytes given to uchardet. With a bigger sniff window, the
+ * sample starts at the first non-ASCII byte, where the interesting part is.
+ */
+#define UCHARDET_SAMPLE_SIZE (64 * 1024)
+
+/* Maximum size of a Block, in bytes. Inserting a Block in the GtkTextBuffer
+ * must be fast compared to the time budget.
+ */
+#define BLOCK_SIZE (32 * 1024)
+
+/* Maximum number of Blocks waiting to be inserted. Above that, the worker
+ * thread waits, to not keep too much converted content in memory.
+ */
+#define MAX_PENDING_BLOCKS 32
+
+/* Maximum number of raw chunks waiting to be decoded. Above that, the reading
+ * of the content is paused, to not keep the whole raw content in memory when
+ * the worker thread is slower than the reading.
+ */
+#define MAX_PENDING_CHUNKS 8
+
+/* Time spent inserting Blocks per main loop iteration, to keep the UI
+ * responsive. Less than one frame at 60 Hz, to leave time for the redraw.
+ */
+#define INSERTION_TIME_BUDGET (8 * G_TIME_SPAN_MILLISECOND)
+
+/* Number of bytes needed to recognize the gzip magic bytes. */
+#define COMPRESSION_SNIFF_SIZE 2
+
+#define METADATA_KEY_ENCODING "gtef-encoding"
+#define METADATA_KEY_NEWLINE_TYPE "gtef-newline-type"
+#define METADATA_KEY_VALIDITY_KEY "gtef-validity-key"
+
+/* Indexed by GtefNewlineType, for the metadata. */
+static const gchar *newline_type_names[] =
+{
+	"lf",
+	"cr",
+	"cr-lf"
+};
+
+/* Number of bytes read again, just before the offset of the previous load, to
+ * check that the file has only grown.
+ */
+#define FOLLOW_TAIL_SIZE 64
+
+/* Size of the output buffer of the decompressor, on the worker thread stack. */
+#define DECOMPRESSION_BUFFER_SIZE (64 * 1024)
+
+/* With the patch-buffer mode, maximum number of inserted and deleted lines for
+ * which a minimal diff is searched. Above that, all the lines between the first
+ * and the last change are replaced.
+ */
+#define MAX_PATCH_COST 1000
+
 static GParamSpec *properties[N_PROPERTIES];
 
 G_DEFINE_TYPE_WITH_PRIVATE (GtefFileLoader, gtef_file_loader, G_TYPE_OBJECT)
 
 /* Prototypes */
 static void load_content (GTask *task);
+static void reset (GtefFileLoader *loader);
+static void prepare_buffer (GTask *task);
 
 GQuark
 gtef_file_loader_error_quark (void)
@@ -135,10 +499,29 @@ gtef_file_loader_error_quark (void)
 	return quark;
 }
 
+static void
+follow_state_free (FollowState *state)
+{
+	if (state != NULL)
+	{
+		g_bytes_unref (state->tail);
+		g_free (state->file_id);
+		g_clear_object (&state->converter);
+		g_string_free (state->pending_text, TRUE);
+		g_free (state->removed_newline);
+		g_free (state);
+	}
+}
+
 static TaskData *
 task_data_new (void)
 {
-	return g_new0 (TaskData, 1);
+	TaskData *task_data;
+
+	task_data = g_new0 (TaskData, 1);
+	task_data->tail = g_byte_array_new ();
+
+	return task_data;
 }
 
 static void
@@ -152,6 +535,41 @@ task_data_free (gpointer data)
 	}
 
 	g_clear_object (&task_data->content_loader);
+	g_clear_object (&task_data->decoder_task);
+	g_clear_error (&task_data->error);
+	gtef_encoding_free (task_data->cached_encoding);
+	g_free (task_data->cached_validity_key);
+	g_free (task_data->validity_key);
+
+	if (task_data->invalid_ranges != NULL)
+	{
+		g_array_unref (task_data->invalid_ranges);
+	}
+
+	follow_state_free (task_data->follow_state);
+
+	if (task_data->tail_check != NULL)
+	{
+		g_bytes_unref (task_data->tail_check);
+	}
+
+	g_byte_array_unref (task_data->tail);
+	g_clear_object (&task_data->follow_converter);
+
+	if (task_data->follow_pending_text != NULL)
+	{
+		g_string_free (task_data->follow_pending_text, TRUE);
+	}
+
+	if (task_data->old_text != NULL)
+	{
+		g_bytes_unref (task_data->old_text);
+	}
+
+	if (task_data->content_hash != NULL)
+	{
+		_gtef_content_hash_free (task_data->content_hash);
+	}
 
 	if (task_data->progress_cb_notify != NULL)
 	{
@@ -174,72 +592,63 @@ empty_buffer (GtefFileLoader *loader)
 	}
 }
 
+/* Takes the most frequent newline type in the whole content, so that a file
+ * with mixed newlines is saved with the terminator used by most lines.
+ */
 static void
 detect_newline_type (GtefFileLoader *loader)
 {
 	GtefFileLoaderPrivate *priv;
-	GtkTextIter iter;
-	gunichar first_char;
+	guint64 lf_count;
+	guint64 cr_count;
+	guint64 cr_lf_count;
 
 	priv = gtef_file_loader_get_instance_private (loader);
 
-	if (priv->buffer == NULL)
-	{
-		priv->detected_newline_type = GTEF_NEWLINE_TYPE_DEFAULT;
-		return;
-	}
+	lf_count = priv->newline_counts[GTEF_NEWLINE_TYPE_LF];
+	cr_count = priv->newline_counts[GTEF_NEWLINE_TYPE_CR];
+	cr_lf_count = priv->newline_counts[GTEF_NEWLINE_TYPE_CR_LF];
 
-	gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (priv->buffer), &iter);
-	if (!gtk_text_iter_ends_line (&iter))
+	if (lf_count == 0 &&
+	    cr_count == 0 &&
+	    cr_lf_count == 0)
 	{
-		gtk_text_iter_forward_to_line_end (&iter);
+		priv->detected_newline_type = GTEF_NEWLINE_TYPE_DEFAULT;
 	}
-
-	first_char = gtk_text_iter_get_char (&iter);
-
-	if (first_char == '\n')
+	else if (lf_count >= cr_lf_count &&
+		 lf_count >= cr_count)
 	{
 		priv->detected_newline_type = GTEF_NEWLINE_TYPE_LF;
 	}
-	else if (first_char == '\r')
+	else if (cr_lf_count >= cr_count)
 	{
-		gunichar second_char;
-
-		gtk_text_iter_forward_char (&iter);
-		second_char = gtk_text_iter_get_char (&iter);
-
-		if (second_char == '\n')
-		{
-			priv->detected_newline_type = GTEF_NEWLINE_TYPE_CR_LF;
-		}
-		else
-		{
-			priv->detected_newline_type = GTEF_NEWLINE_TYPE_CR;
-		}
+		priv->detected_newline_type = GTEF_NEWLINE_TYPE_CR_LF;
 	}
 	else
 	{
-		priv->detected_newline_type = GTEF_NEWLINE_TYPE_DEFAULT;
+		priv->detected_newline_type = GTEF_NEWLINE_TYPE_CR;
 	}
 }
 
-static void
+/* Returns the removed newline, or %NULL. Free with g_free(). */
+static gchar *
 remove_trailing_newline_if_needed (GtefFileLoader *loader)
 {
 	GtefFileLoaderPrivate *priv;
 	GtkTextIter start;
 	GtkTextIter end;
+	gchar *removed_newline = NULL;
 
 	priv = gtef_file_loader_get_instance_private (loader);
 
 	if (priv->buffer == NULL)
 	{
-		return;
+		return NULL;
 	}
 
 	if (!gtk_source_buffer_get_implicit_trailing_newline (GTK_SOURCE_BUFFER (priv->buffer)))
 	{
-		return;
+		return NULL;
 	}
 
 	gtk_text_buffer_get_end_iter (GTK_TEXT_BUFFER (priv->buffer), &end);
@@ -255,10 +664,26 @@ remove_trailing_newline_if_needed (GtefFileLoader *loader)
 			gtk_text_iter_forward_to_line_end (&start);
 		}
 
+		removed_newline = gtk_text_buffer_get_text (GTK_TEXT_BUFFER (priv->buffer),
+							    &start,
+							    &end,
+							    TRUE);
+
 		gtk_text_buffer_delete (GTK_TEXT_BUFFER (priv->buffer),
 					&start,
 					&end);
 	}
+
+	return removed_newline;
+}
+
+static void
+buffer_changed_cb (GtkTextBuffer  *buffer,
+		   GtefFileLoader *loader)
+{
+	GtefFileLoaderPrivate *priv = gtef_file_loader_get_instance_private (loader);
+
+	priv->buffer_stamp++;
 }
 
 static void
@@ -291,6 +716,22 @@ gtef_file_loader_get_property (GObject    *object,
 			g_value_set_int64 (value, gtef_file_loader_get_chunk_size (loader));
 			break;
 
+		case PROP_SNIFF_SIZE:
+			g_value_set_int64 (value, gtef_file_loader_get_sniff_size (loader));
+			break;
+
+		case PROP_ESCAPE_INVALID_CHARS:
+			g_value_set_boolean (value, gtef_file_loader_get_escape_invalid_chars (loader));
+			break;
+
+		case PROP_FOLLOW:
+			g_value_set_boolean (value, gtef_file_loader_get_follow (loader));
+			break;
+
+		case PROP_PATCH_BUFFER:
+			g_value_set_boolean (value, gtef_file_loader_get_patch_buffer (loader));
+			break;
+
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 			break;
@@ -313,6 +754,12 @@ gtef_file_loader_set_property (GObject      *object,
 			priv->buffer = g_value_get_object (value);
 			g_object_add_weak_pointer (G_OBJECT (priv->buffer),
 						   (gpointer *) &priv->buffer);
+
+			g_signal_connect_object (priv->buffer,
+						 "changed",
+						 G_CALLBACK (buffer_changed_cb),
+						 loader,
+						 0);
 			break;
 
 		case PROP_FILE:
@@ -335,6 +782,22 @@ gtef_file_loader_set_property (GObject      *object,
 			gtef_file_loader_set_chunk_size (loader, g_value_get_int64 (value));
 			break;
 
+		case PROP_SNIFF_SIZE:
+			gtef_file_loader_set_sniff_size (loader, g_value_get_int64 (value));
+			break;
+
+		case PROP_ESCAPE_INVALID_CHARS:
+			gtef_file_loader_set_escape_invalid_chars (loader, g_value_get_boolean (value));
+			break;
+
+		case PROP_FOLLOW:
+			gtef_file_loader_set_follow (loader, g_value_get_boolean (value));
+			break;
+
+		case PROP_PATCH_BUFFER:
+			gtef_file_loader_set_patch_buffer (loader, g_value_get_boolean (value));
+			break;
+
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 			break;
@@ -387,6 +850,9 @@ gtef_file_loader_dispose (GObject *object)
 	g_clear_object (&priv->location);
 	g_clear_object (&priv->task);
 
+	follow_state_free (priv->follow_state);
+	priv->follow_state = NULL;
+
 	G_OBJECT_CLASS (gtef_file_loader_parent_class)->dispose (object);
 }
 
@@ -492,7 +958,9 @@ gtef_file_loader_class_init (GtefFileLoaderClass *klass)
 	 * as reporting progress information after each chunk read.
 	 *
 	 * A small chunk size is better when loading a remote file with a slow
-	 * connection. For local files, the chunk size can be larger.
+	 * connection. For local files, the chunk size can be larger. If the
+	 * chunk size is not set explicitly, local files are read by bigger
+	 * chunks.
 	 *
 	 * Since: 1.0
 	 */
@@ -504,9 +972,108 @@ gtef_file_loader_class_init (GtefFileLoaderClass *klass)
 				    G_MAXINT64,
 				    GTEF_FILE_CONTENT_LOADER_DEFAULT_CHUNK_SIZE,
 				    G_PARAM_READWRITE |
+				    G_PARAM_STATIC_STRINGS);
+
+	/**
+	 * GtefFileLoader:sniff-size:
+	 *
+	 * The number of bytes, at the beginning of the content, used to
+	 * determine the character encoding. The content is inserted into the
+	 * buffer only once the encoding is determined, so a smaller sniff size
+	 * permits to show the content sooner, and to keep less raw content in
+	 * memory.
+	 *
+	 * A byte order mark decides the encoding as soon as it is received,
+	 * and binary content in the sniff window aborts the loading with the
+	 * %GTEF_FILE_LOADER_ERROR_BINARY_CONTENT error without reading the
+	 * rest. UTF-32 content without byte order mark is reported as binary
+	 * content. If the sniff window contains only ASCII characters but the end
+	 * of the content is not yet reached, or if the sniff window is valid
+	 * UTF-8, then UTF-8 is chosen. uchardet is used in the other cases,
+	 * see gtef_file_loader_get_encoding_detection_method().
+	 *
+	 * Set to -1 to determine the encoding on the whole content.
+	 *
+	 * Since: 2.0
+	 */
+	properties[PROP_SNIFF_SIZE] =
+		g_param_spec_int64 ("sniff-size",
+				    "Sniff Size",
+				    "",
+				    -1,
+				    G_MAXINT64,
+				    DEFAULT_SNIFF_SIZE,
+				    G_PARAM_READWRITE |
 				    G_PARAM_CONSTRUCT |
 				    G_PARAM_STATIC_STRINGS);
 
+	/**
+	 * GtefFileLoader:escape-invalid-chars:
+	 *
+	 * Whether to load the content even if it contains invalid sequences for
+	 * the character encoding. If %TRUE, each invalid byte is replaced by
+	 * its hexadecimal value escaped with a backslash, for example "\FF",
+	 * and the escaped text is tagged as invalid in the #GtefBuffer. If
+	 * %FALSE, an invalid sequence is an error.
+	 *
+	 * Since: 2.0
+	 */
+	properties[PROP_ESCAPE_INVALID_CHARS] =
+		g_param_spec_boolean ("escape-invalid-chars",
+				      "Escape Invalid Chars",
+				      "",
+				      FALSE,
+				      G_PARAM_READWRITE |
+				      G_PARAM_CONSTRUCT |
+				      G_PARAM_STATIC_STRINGS);
+
+	/**
+	 * GtefFileLoader:follow:
+	 *
+	 * Whether to keep the state at the end of a successful load
+	 * operation, so that the next gtef_file_loader_load_async() reads only
+	 * the content appended to the file since. Useful for a log file that
+	 * grows.
+	 *
+	 * An incomplete character or a lone \r at the end of the content is
+	 * then not inserted, it is kept until the next load. A gzip-compressed
+	 * file is always loaded entirely.
+	 *
+	 * Since: 2.0
+	 */
+	properties[PROP_FOLLOW] =
+		g_param_spec_boolean ("follow",
+				      "Follow",
+				      "",
+				      FALSE,
+				      G_PARAM_READWRITE |
+				      G_PARAM_CONSTRUCT |
+				      G_PARAM_STATIC_STRINGS);
+
+	/**
+	 * GtefFileLoader:patch-buffer:
+	 *
+	 * Whether to keep the buffer content during the load operation, and to
+	 * replace at the end only the lines that differ from the new content,
+	 * instead of emptying the buffer and inserting all the content. The
+	 * text marks on the unchanged lines stay in place, and the cost of
+	 * modifying the buffer is proportional to the size of the changes.
+	 *
+	 * The whole new content is then kept in memory until the end of the
+	 * load operation, and the buffer shows the old content meanwhile. An
+	 * empty buffer is filled as usual.
+	 *
+	 * Since: 2.0
+	 */
+	properties[PROP_PATCH_BUFFER] =
+		g_param_spec_boolean ("patch-buffer",
+				      "Patch Buffer",
+				      "",
+				      FALSE,
+				      G_PARAM_READWRITE |
+				      G_PARAM_CONSTRUCT |
+				      G_PARAM_STATIC_STRINGS);
+
 	g_object_class_install_properties (object_class, N_PROPERTIES, properties);
 }
 
@@ -518,6 +1085,7 @@ gtef_file_loader_init (GtefFileLoader *loader)
 	priv = gtef_file_loader_get_instance_private (loader);
 
 	priv->detected_newline_type = GTEF_NEWLINE_TYPE_DEFAULT;
+	priv->chunk_size = GTEF_FILE_CONTENT_LOADER_DEFAULT_CHUNK_SIZE;
 }
 
 /**
@@ -688,12 +1256,10 @@ gtef_file_loader_set_chunk_size (GtefFileLoader *loader,
 
 	priv = gtef_file_loader_get_instance_private (loader);
 
-	if (priv->chunk_size == chunk_size)
-	{
-		return;
-	}
-
-	priv->chunk_size = chunk_size;
+	/* Even with the same value, the chunk size is now explicit, so the
+	 * content loader is updated in any case.
+	 */
+	priv->chunk_size_set = TRUE;
 
 	if (priv->task != NULL)
 	{
@@ -708,94 +1274,2144 @@ gtef_file_loader_set_chunk_size (GtefFileLoader *loader,
 		}
 	}
 
-	g_object_notify_by_pspec (G_OBJECT (loader), properties[PROP_CHUNK_SIZE]);
+	if (priv->chunk_size != chunk_size)
+	{
+		priv->chunk_size = chunk_size;
+		g_object_notify_by_pspec (G_OBJECT (loader), properties[PROP_CHUNK_SIZE]);
+	}
 }
 
-static void
-insert_content (GtkTextBuffer *buffer,
-		const gchar   *str,
-		gsize          length)
+/**
+ * gtef_file_loader_get_sniff_size:
+ * @loader: a #GtefFileLoader.
+ *
+ * Returns: the sniff size, or -1 if the whole content is used to determine the
+ * encoding.
+ * Since: 2.0
+ */
+gint64
+gtef_file_loader_get_sniff_size (GtefFileLoader *loader)
 {
-	GtkTextIter end;
-	GtkTextIter start;
+	GtefFileLoaderPrivate *priv;
 
-	gtk_text_buffer_get_end_iter (buffer, &end);
-	gtk_text_buffer_insert (buffer, &end, str, length);
+	g_return_val_if_fail (GTEF_IS_FILE_LOADER (loader), DEFAULT_SNIFF_SIZE);
 
-	/* Keep cursor at the start, to avoid signal emissions for each chunk. */
-	gtk_text_buffer_get_start_iter (buffer, &start);
-	gtk_text_buffer_place_cursor (buffer, &start);
+	priv = gtef_file_loader_get_instance_private (loader);
+	return priv->sniff_size;
 }
 
-static void
-content_converted_cb (const gchar *str,
-		      gsize        length,
-		      gpointer     user_data)
+/**
+ * gtef_file_loader_set_sniff_size:
+ * @loader: a #GtefFileLoader.
+ * @sniff_size: the new sniff size, or -1 to use the whole content.
+ *
+ * Sets the #GtefFileLoader:sniff-size property.
+ *
+ * Since: 2.0
+ */
+void
+gtef_file_loader_set_sniff_size (GtefFileLoader *loader,
+				 gint64          sniff_size)
 {
-	GTask *task = G_TASK (user_data);
-	GtefFileLoader *loader;
 	GtefFileLoaderPrivate *priv;
-	TaskData *task_data;
-	gchar *my_str;
-	gsize my_length;
 
-	loader = g_task_get_source_object (task);
-	priv = gtef_file_loader_get_instance_private (loader);
+	g_return_if_fail (GTEF_IS_FILE_LOADER (loader));
+	g_return_if_fail (sniff_size >= -1);
 
-	task_data = g_task_get_task_data (task);
+	priv = gtef_file_loader_get_instance_private (loader);
 
-	/* I normally know what I'm doing. */
-	my_str = (gchar *) str;
-	my_length = length;
+	g_return_if_fail (priv->task == NULL);
 
-	/* Insert \r\n in one block. */
-	if (task_data->insert_carriage_return)
+	if (priv->sniff_size != sniff_size)
 	{
-		if (my_str[0] == '\n')
-		{
-			g_assert (my_length > 0);
+		priv->sniff_size = sniff_size;
+		g_object_notify_by_pspec (G_OBJECT (loader), properties[PROP_SNIFF_SIZE]);
+	}
+}
+
+/**
+ * gtef_file_loader_get_escape_invalid_chars:
+ * @loader: a #GtefFileLoader.
+ *
+ * Returns: whether invalid characters are escaped.
+ * Since: 2.0
+ */
+gboolean
+gtef_file_loader_get_escape_invalid_chars (GtefFileLoader *loader)
+{
+	GtefFileLoaderPrivate *priv;
+
+	g_return_val_if_fail (GTEF_IS_FILE_LOADER (loader), FALSE);
+
+	priv = gtef_file_loader_get_instance_private (loader);
+	return priv->escape_invalid_chars;
+}
+
+/**
+ * gtef_file_loader_set_escape_invalid_chars:
+ * @loader: a #GtefFileLoader.
+ * @escape_invalid_chars: the new value.
+ *
+ * Sets the #GtefFileLoader:escape-invalid-chars property.
+ *
+ * Since: 2.0
+ */
+void
+gtef_file_loader_set_escape_invalid_chars (GtefFileLoader *loader,
+					   gboolean        escape_invalid_chars)
+{
+	GtefFileLoaderPrivate *priv;
+
+	g_return_if_fail (GTEF_IS_FILE_LOADER (loader));
+
+	priv = gtef_file_loader_get_instance_private (loader);
+
+	g_return_if_fail (priv->task == NULL);
+
+	escape_invalid_chars = escape_invalid_chars != FALSE;
+
+	if (priv->escape_invalid_chars != escape_invalid_chars)
+	{
+		priv->escape_invalid_chars = escape_invalid_chars;
+		g_object_notify_by_pspec (G_OBJECT (loader), properties[PROP_ESCAPE_INVALID_CHARS]);
+	}
+}
+
+/**
+ * gtef_file_loader_get_follow:
+ * @loader: a #GtefFileLoader.
+ *
+ * Returns: whether the follow mode is enabled.
+ * Since: 2.0
+ */
+gboolean
+gtef_file_loader_get_follow (GtefFileLoader *loader)
+{
+	GtefFileLoaderPrivate *priv;
+
+	g_return_val_if_fail (GTEF_IS_FILE_LOADER (loader), FALSE);
+
+	priv = gtef_file_loader_get_instance_private (loader);
+	return priv->follow;
+}
+
+/**
+ * gtef_file_loader_set_follow:
+ * @loader: a #GtefFileLoader.
+ * @follow: the new value.
+ *
+ * Sets the #GtefFileLoader:follow property. Disabling the follow mode forgets
+ * the state of the previous load, the next load reads the whole content.
+ *
+ * Since: 2.0
+ */
+void
+gtef_file_loader_set_follow (GtefFileLoader *loader,
+			     gboolean        follow)
+{
+	GtefFileLoaderPrivate *priv;
+
+	g_return_if_fail (GTEF_IS_FILE_LOADER (loader));
+
+	priv = gtef_file_loader_get_instance_private (loader);
+
+	g_return_if_fail (priv->task == NULL);
+
+	follow = follow != FALSE;
+
+	if (priv->follow != follow)
+	{
+		priv->follow = follow;
+
+		follow_state_free (priv->follow_state);
+		priv->follow_state = NULL;
+
+		g_object_notify_by_pspec (G_OBJECT (loader), properties[PROP_FOLLOW]);
+	}
+}
+
+/**
+ * gtef_file_loader_get_patch_buffer:
+ * @loader: a #GtefFileLoader.
+ *
+ * Returns: whether only the changed lines of the buffer are replaced.
+ * Since: 2.0
+ */
+gboolean
+gtef_file_loader_get_patch_buffer (GtefFileLoader *loader)
+{
+	GtefFileLoaderPrivate *priv;
+
+	g_return_val_if_fail (GTEF_IS_FILE_LOADER (loader), FALSE);
+
+	priv = gtef_file_loader_get_instance_private (loader);
+	return priv->patch_buffer;
+}
+
+/**
+ * gtef_file_loader_set_patch_buffer:
+ * @loader: a #GtefFileLoader.
+ * @patch_buffer: the new value.
+ *
+ * Sets the #GtefFileLoader:patch-buffer property.
+ *
+ * Since: 2.0
+ */
+void
+gtef_file_loader_set_patch_buffer (GtefFileLoader *loader,
+				   gboolean        patch_buffer)
+{
+	GtefFileLoaderPrivate *priv;
+
+	g_return_if_fail (GTEF_IS_FILE_LOADER (loader));
+
+	priv = gtef_file_loader_get_instance_private (loader);
+
+	g_return_if_fail (priv->task == NULL);
+
+	patch_buffer = patch_buffer != FALSE;
+
+	if (priv->patch_buffer != patch_buffer)
+	{
+		priv->patch_buffer = patch_buffer;
+		g_object_notify_by_pspec (G_OBJECT (loader), properties[PROP_PATCH_BUFFER]);
+	}
+}
+
+static void
+block_free (Block *block)
+{
+	if (block != NULL)
+	{
+		g_bytes_unref (block->text);
+
+		if (block->invalid_ranges != NULL)
+		{
+			g_array_unref (block->invalid_ranges);
+		}
+
+		g_free (block);
+	}
+}
+
+static void
+decoder_free (gpointer data)
+{
+	Decoder *decoder = data;
+
+	if (decoder == NULL)
+	{
+		return;
+	}
+
+	g_main_context_unref (decoder->main_context);
+	g_async_queue_unref (decoder->input);
+
+	g_mutex_clear (&decoder->mutex);
+	g_cond_clear (&decoder->cond);
+	g_queue_free_full (decoder->output, (GDestroyNotify)block_free);
+
+	gtef_encoding_free (decoder->encoding);
+
+	if (decoder->sniff_content != NULL)
+	{
+		g_byte_array_unref (decoder->sniff_content);
+	}
+
+	g_clear_object (&decoder->converter);
+	g_string_free (decoder->pending_text, TRUE);
+
+	if (decoder->compression_sniff != NULL)
+	{
+		g_byte_array_unref (decoder->compression_sniff);
+	}
+
+	g_clear_object (&decoder->decompressor);
+
+	if (decoder->content_hash != NULL)
+	{
+		_gtef_content_hash_free (decoder->content_hash);
+	}
+
+	if (decoder->old_text != NULL)
+	{
+		g_bytes_unref (decoder->old_text);
+	}
+
+	if (decoder->new_text != NULL)
+	{
+		g_string_free (decoder->new_text, TRUE);
+	}
+
+	if (decoder->new_invalid_ranges != NULL)
+	{
+		g_array_unref (decoder->new_invalid_ranges);
+	}
+
+	if (decoder->hunks != NULL)
+	{
+		g_array_unref (decoder->hunks);
+	}
+
+	g_free (decoder->removed_newline);
+
+	g_free (decoder);
+}
+
+static Decoder *
+decoder_new (GTask              *loader_task,
+	     gint64              sniff_size,
+	     gint64              max_size,
+	     gboolean            escape_invalid_chars,
+	     const GtefEncoding *known_encoding)
+{
+	Decoder *decoder;
+
+	decoder = g_new0 (Decoder, 1);
+
+	/* The encoding detection is skipped. */
+	if (known_encoding != NULL)
+	{
+		decoder->encoding = gtef_encoding_copy (known_encoding);
+		decoder->encoding_detection_method = GTEF_ENCODING_DETECTION_METHOD_METADATA;
+	}
+
+	decoder->loader_task = loader_task;
+	decoder->main_context = g_main_context_ref_thread_default ();
+	decoder->sniff_size = sniff_size;
+	decoder->max_size = max_size;
+	decoder->escape_invalid_chars = escape_invalid_chars;
+
+	decoder->input = g_async_queue_new_full ((GDestroyNotify)g_bytes_unref);
+
+	g_mutex_init (&decoder->mutex);
+	g_cond_init (&decoder->cond);
+	decoder->output = g_queue_new ();
+
+	decoder->sniff_content = g_byte_array_new ();
+	decoder->pending_text = g_string_new (NULL);
+	decoder->compression_sniff = g_byte_array_new ();
+	decoder->compression_type = GTEF_COMPRESSION_TYPE_NONE;
+
+	return decoder;
+}
+
+/* Called in the main thread. Takes ownership of @chunk. Returns whether the
+ * input queue is full, in which case the reading of the content must be
+ * paused until input_drained_cb() is called. @input_length is set to the
+ * number of chunks in the queue.
+ */
+static gboolean
+decoder_push_raw (Decoder *decoder,
+		  GBytes  *chunk,
+		  guint   *input_length)
+{
+	gint length;
+
+	g_mutex_lock (&decoder->mutex);
+
+	g_async_queue_push (decoder->input, chunk);
+
+	/* Negative if the worker thread waits for input. */
+	length = MAX (0, g_async_queue_length (decoder->input));
+
+	if (length >= MAX_PENDING_CHUNKS)
+	{
+		decoder->input_paused = TRUE;
+	}
+
+	g_mutex_unlock (&decoder->mutex);
+
+	*input_length = length;
+	return length >= MAX_PENDING_CHUNKS;
+}
+
+static gboolean
+decoder_is_input_paused (Decoder *decoder)
+{
+	gboolean input_paused;
+
+	g_mutex_lock (&decoder->mutex);
+	input_paused = decoder->input_paused;
+	g_mutex_unlock (&decoder->mutex);
+
+	return input_paused;
+}
+
+/* Called in the main thread. */
+static void
+decoder_end_input (Decoder *decoder)
+{
+	g_async_queue_push (decoder->input, g_bytes_new (NULL, 0));
+}
+
+/* Called in the main thread. */
+static void
+decoder_abort (Decoder *decoder)
+{
+	g_mutex_lock (&decoder->mutex);
+	decoder->aborted = TRUE;
+	g_cond_broadcast (&decoder->cond);
+	g_mutex_unlock (&decoder->mutex);
+
+	/* Wake up the worker thread if it waits for input. */
+	decoder_end_input (decoder);
+}
+
+static gboolean
+decoder_is_aborted (Decoder *decoder)
+{
+	gboolean aborted;
+
+	g_mutex_lock (&decoder->mutex);
+	aborted = decoder->aborted;
+	g_mutex_unlock (&decoder->mutex);
+
+	return aborted;
+}
+
+/* Called in the main thread. Returns NULL if there is no Block currently. */
+static Block *
+decoder_pop_block (Decoder *decoder)
+{
+	Block *block;
+
+	g_mutex_lock (&decoder->mutex);
+	block = g_queue_pop_head (decoder->output);
+	g_cond_broadcast (&decoder->cond);
+	g_mutex_unlock (&decoder->mutex);
+
+	return block;
+}
+
+static gboolean
+decoder_has_blocks (Decoder *decoder)
+{
+	gboolean has_blocks;
+
+	g_mutex_lock (&decoder->mutex);
+	has_blocks = !g_queue_is_empty (decoder->output);
+	g_mutex_unlock (&decoder->mutex);
+
+	return has_blocks;
+}
+
+/* Prototypes */
+static gboolean blocks_available_cb (gpointer user_data);
+static gboolean input_drained_cb (gpointer user_data);
+
+/* Called in the worker thread, after popping a raw chunk. If the reading of
+ * the content is paused, resumes it once half of the input queue has been
+ * consumed, so that the next chunks are read while the rest is decoded.
+ */
+static void
+decoder_check_input_drained (Decoder *decoder)
+{
+	gboolean drained = FALSE;
+
+	g_mutex_lock (&decoder->mutex);
+
+	if (decoder->input_paused &&
+	    g_async_queue_length (decoder->input) <= MAX_PENDING_CHUNKS / 2)
+	{
+		decoder->input_paused = FALSE;
+		drained = TRUE;
+	}
+
+	g_mutex_unlock (&decoder->mutex);
+
+	if (drained)
+	{
+		g_main_context_invoke_full (decoder->main_context,
+					    G_PRIORITY_DEFAULT,
+					    input_drained_cb,
+					    g_object_ref (decoder->loader_task),
+					    g_object_unref);
+	}
+}
+
+/* Called in the worker thread, with the patch-buffer mode. Appends @text to
+ * the new_text, and converts @invalid_ranges to character offsets.
+ */
+static void
+decoder_collect_text (Decoder     *decoder,
+		      const gchar *text,
+		      gsize        length,
+		      GArray      *invalid_ranges)
+{
+	gsize byte_offset = 0;
+
+	if (invalid_ranges != NULL)
+	{
+		guint i;
+
+		if (decoder->new_invalid_ranges == NULL)
+		{
+			decoder->new_invalid_ranges = g_array_new (FALSE, FALSE, sizeof (InvalidRange));
+		}
+
+		for (i = 0; i < invalid_ranges->len; i++)
+		{
+			InvalidRange *block_range;
+			InvalidRange range;
+
+			block_range = &g_array_index (invalid_ranges, InvalidRange, i);
+
+			decoder->new_text_n_chars += g_utf8_strlen (text + byte_offset,
+								    block_range->start - byte_offset);
+			byte_offset = block_range->start;
+
+			range.start = decoder->new_text_n_chars;
+			range.length = block_range->length;
+			g_array_append_val (decoder->new_invalid_ranges, range);
+		}
+	}
+
+	decoder->new_text_n_chars += g_utf8_strlen (text + byte_offset, length - byte_offset);
+	g_string_append_len (decoder->new_text, text, length);
+}
+
+/* Called in the worker thread. Takes ownership of @text and @invalid_ranges. */
+static void
+decoder_push_bytes (Decoder *decoder,
+		    GBytes  *text,
+		    GArray  *invalid_ranges)
+{
+	Block *block;
+	gboolean was_empty;
+
+	/* A Block never ends with a \r followed by a \n, see
+	 * get_block_length().
+	 */
+	{
+		gsize length;
+		const gchar *str;
+
+		str = g_bytes_get_data (text, &length);
+		_gtef_utils_count_newlines (str,
+					    length,
+					    &decoder->newline_counts[GTEF_NEWLINE_TYPE_LF],
+					    &decoder->newline_counts[GTEF_NEWLINE_TYPE_CR],
+					    &decoder->newline_counts[GTEF_NEWLINE_TYPE_CR_LF]);
+
+		if (decoder->new_text != NULL)
+		{
+			decoder_collect_text (decoder, str, length, invalid_ranges);
+
+			g_bytes_unref (text);
+			text = g_bytes_new (NULL, 0);
+
+			if (invalid_ranges != NULL)
+			{
+				g_array_unref (invalid_ranges);
+				invalid_ranges = NULL;
+			}
+		}
+	}
+
+	block = g_new0 (Block, 1);
+	block->text = text;
+	block->invalid_ranges = invalid_ranges;
+	block->n_raw_bytes = decoder->n_bytes_fed;
+
+	g_mutex_lock (&decoder->mutex);
+
+	while (decoder->output->length >= MAX_PENDING_BLOCKS &&
+	       !decoder->aborted)
+	{
+		g_cond_wait (&decoder->cond, &decoder->mutex);
+	}
+
+	was_empty = g_queue_is_empty (decoder->output);
+	g_queue_push_tail (decoder->output, block);
+
+	g_mutex_unlock (&decoder->mutex);
+
+	/* If the queue was not empty, the main thread is already inserting the
+	 * Blocks.
+	 */
+	if (was_empty)
+	{
+		g_main_context_invoke_full (decoder->main_context,
+					    G_PRIORITY_DEFAULT_IDLE,
+					    blocks_available_cb,
+					    g_object_ref (decoder->loader_task),
+					    g_object_unref);
+	}
+}
+
+/* Called in the worker thread. */
+static void
+decoder_push_block (Decoder     *decoder,
+		    const gchar *text,
+		    gsize        length)
+{
+	decoder_push_bytes (decoder, g_bytes_new (text, length), NULL);
+}
+
+/* Called in the worker thread. Escapes @bytes, and pushes them with the
+ * pending text in one Block. A \r at the end of the pending text is not
+ * followed by a \n, so it can be pushed too.
+ */
+static void
+decoder_push_invalid_bytes (Decoder     *decoder,
+			    const gchar *bytes,
+			    gsize        length)
+{
+	GString *pending_text = decoder->pending_text;
+	GArray *invalid_ranges;
+	InvalidRange range;
+	gsize i;
+
+	range.start = pending_text->len;
+
+	for (i = 0; i < length; i++)
+	{
+		g_string_append_printf (pending_text, "\\%02X", (guint8) bytes[i]);
+	}
+
+	range.length = pending_text->len - range.start;
+
+	invalid_ranges = g_array_sized_new (FALSE, FALSE, sizeof (InvalidRange), 1);
+	g_array_append_val (invalid_ranges, range);
+
+	decoder_push_bytes (decoder,
+			    g_bytes_new (pending_text->str, pending_text->len),
+			    invalid_ranges);
+
+	g_string_truncate (pending_text, 0);
+}
+
+/* Called in the worker thread, by the GtefEncodingConverter. */
+static void
+invalid_sequence_cb (const gchar *bytes,
+		     gsize        length,
+		     gpointer     user_data)
+{
+	Decoder *decoder = user_data;
+
+	decoder_push_invalid_bytes (decoder, bytes, length);
+}
+
+/* Returns the length of the next Block to push, from @text. */
+static gsize
+get_block_length (const gchar *text,
+		  gsize        length)
+{
+	gsize block_length;
+
+	if (length <= BLOCK_SIZE)
+	{
+		block_length = length;
+	}
+	else
+	{
+		block_length = BLOCK_SIZE;
+
+		/* Do not split a multi-byte character. */
+		while (block_length > 0 &&
+		       (text[block_length] & 0xC0) == 0x80)
+		{
+			block_length--;
+		}
+	}
+
+	/* The \r\n must be inserted in one block, because of a bug in
+	 * GtkTextBuffer:
+	 * https://bugzilla.gnome.org/show_bug.cgi?id=631468
+	 */
+	if (block_length > 0 &&
+	    text[block_length - 1] == '\r')
+	{
+		block_length--;
+	}
+
+	return block_length;
+}
+
+/* Called in the worker thread. */
+static void
+content_converted_cb (const gchar *str,
+		      gsize        length,
+		      gpointer     user_data)
+{
+	Decoder *decoder = user_data;
+	GString *pending_text = decoder->pending_text;
+	gsize offset = 0;
+
+	g_string_append_len (pending_text, str, length);
+
+	while (offset < pending_text->len)
+	{
+		gsize block_length;
+
+		block_length = get_block_length (pending_text->str + offset,
+						 pending_text->len - offset);
+
+		if (block_length == 0)
+		{
+			/* Only a \r remains, wait for the next character. */
+			break;
+		}
+
+		decoder_push_block (decoder, pending_text->str + offset, block_length);
+		offset += block_length;
+	}
+
+	g_string_erase (pending_text, 0, offset);
+}
+
+/* Returns whether @sniff_content is valid UTF-8. If @complete is %FALSE, the
+ * sniff window can end in the middle of a multi-byte character.
+ */
+static gboolean
+sniff_content_is_utf8 (GByteArray *sniff_content,
+		       gboolean    complete)
+{
+	const gchar *str;
+	const gchar *end;
+	gboolean partial_char;
+
+	str = (const gchar *) sniff_content->data;
+
+	if (_gtef_utils_utf8_validate (str, sniff_content->len, &end, &partial_char))
+	{
+		return TRUE;
+	}
+
+	return !complete && partial_char;
+}
+
+/* Returns the charset announced by the byte order mark at the start of @data,
+ * or %NULL. The BOM is kept in the content: for UTF-16 and UTF-32 the
+ * converter uses it to know the byte order.
+ */
+static const gchar *
+get_bom_charset (const guchar *data,
+		 gsize         length)
+{
+	/* A UTF-16LE BOM is a prefix of a UTF-32LE BOM. */
+	if (length >= 4 &&
+	    ((data[0] == 0xFF && data[1] == 0xFE && data[2] == 0x00 && data[3] == 0x00) ||
+	     (data[0] == 0x00 && data[1] == 0x00 && data[2] == 0xFE && data[3] == 0xFF)))
+	{
+		return "UTF-32";
+	}
+
+	if (length >= 3 &&
+	    data[0] == 0xEF && data[1] == 0xBB && data[2] == 0xBF)
+	{
+		return "UTF-8";
+	}
+
+	if (length >= 2 &&
+	    ((data[0] == 0xFF && data[1] == 0xFE) ||
+	     (data[0] == 0xFE && data[1] == 0xFF)))
+	{
+		return "UTF-16";
+	}
+
+	return NULL;
+}
+
+/* Called in the worker thread, each time the sniff window grows. Checks the
+ * BOM once the first four bytes are available, and looks for binary content
+ * in the new bytes. The BOM, if any, determines the encoding. Without BOM,
+ * UTF-32 has a zero 16-bit code unit in each character, so it is considered
+ * as binary content.
+ * @complete: whether the sniff window contains all the content.
+ */
+static gboolean
+classify_sniff_content (Decoder   *decoder,
+			gboolean   complete,
+			GError   **error)
+{
+	GByteArray *sniff_content = decoder->sniff_content;
+	gsize length;
+
+	if (decoder->encoding != NULL)
+	{
+		return TRUE;
+	}
+
+	if (!decoder->bom_checked)
+	{
+		const gchar *charset;
+
+		if (sniff_content->len < 4 && !complete)
+		{
+			return TRUE;
+		}
+
+		decoder->bom_checked = TRUE;
+
+		charset = get_bom_charset (sniff_content->data, sniff_content->len);
+		if (charset != NULL)
+		{
+			decoder->encoding = gtef_encoding_new (charset);
+			decoder->encoding_detection_method = GTEF_ENCODING_DETECTION_METHOD_BOM;
+			return TRUE;
+		}
+	}
+
+	/* Only whole code units, an odd byte is checked with the next chunk. */
+	length = (sniff_content->len - decoder->binary_checked_length) & ~(gsize) 1;
+
+	if (_gtef_utils_find_nul_code_unit ((const gchar *) sniff_content->data + decoder->binary_checked_length,
+					    length) < length)
+	{
+		g_set_error_literal (error,
+				     GTEF_FILE_LOADER_ERROR,
+				     GTEF_FILE_LOADER_ERROR_BINARY_CONTENT,
+				     _("The file contains binary data, it is not a text file."));
+		return FALSE;
+	}
+
+	decoder->binary_checked_length += length;
+	return TRUE;
+}
+
+/* Pure ASCII content can be in a 7-bit encoding based on escape sequences, like
+ * ISO-2022-JP or HZ-GB-2312. uchardet recognizes them.
+ */
+static gboolean
+has_escape_sequences (const gchar *str,
+		      gsize        length)
+{
+	return (memchr (str, 0x1B, length) != NULL ||
+		g_strstr_len (str, length, "~{") != NULL);
+}
+
+/* Called in the worker thread, when there is no BOM. uchardet is run only when
+ * the cheaper checks can't decide, and on a bounded sample.
+ * @complete: whether the sniff window contains all the content.
+ */
+static gboolean
+determine_encoding (Decoder   *decoder,
+		    gboolean   complete,
+		    GError   **error)
+{
+	const gchar *data;
+	gsize length;
+	gsize ascii_length;
+	gsize sample_start;
+	uchardet_t ud;
+	const gchar *charset;
+
+	g_assert (decoder->encoding == NULL);
+
+	data = (const gchar *) decoder->sniff_content->data;
+	length = decoder->sniff_content->len;
+
+	ascii_length = _gtef_utils_get_ascii_prefix_length (data, length);
+
+	if (ascii_length == length)
+	{
+		if (!has_escape_sequences (data, length))
+		{
+			/* If only the beginning of the content is pure ASCII,
+			 * it doesn't say much about the rest of the content.
+			 * Take the superset that is the most likely, UTF-8.
+			 */
+			if (complete && length > 0)
+			{
+				decoder->encoding = gtef_encoding_new ("ASCII");
+			}
+			else
+			{
+				decoder->encoding = gtef_encoding_new_utf8 ();
+			}
+
+			decoder->encoding_detection_method = GTEF_ENCODING_DETECTION_METHOD_ASCII;
+			return TRUE;
+		}
+
+		sample_start = 0;
+	}
+	else if (sniff_content_is_utf8 (decoder->sniff_content, complete))
+	{
+		decoder->encoding = gtef_encoding_new_utf8 ();
+		decoder->encoding_detection_method = GTEF_ENCODING_DETECTION_METHOD_UTF8_VALIDATION;
+		return TRUE;
+	}
+	else
+	{
+		/* Aligned for UTF-16 without BOM. UTF-32 without BOM doesn't
+		 * get here, it is reported as binary content.
+		 */
+		sample_start = ascii_length & ~(gsize) 1;
+	}
+
+	ud = uchardet_new ();
+
+	uchardet_handle_data (ud,
+			      data + sample_start,
+			      MIN (length - sample_start, UCHARDET_SAMPLE_SIZE));
+
+	uchardet_data_end (ud);
+
+	charset = uchardet_get_charset (ud);
+
+	if (charset != NULL &&
+	    charset[0] != '\0' &&
+	    (complete || g_ascii_strcasecmp (charset, "ASCII") != 0))
+	{
+		decoder->encoding = gtef_encoding_new (charset);
+		decoder->encoding_detection_method = GTEF_ENCODING_DETECTION_METHOD_UCHARDET;
+	}
+	else if (ascii_length == length)
+	{
+		decoder->encoding = gtef_encoding_new_utf8 ();
+		decoder->encoding_detection_method = GTEF_ENCODING_DETECTION_METHOD_ASCII;
+	}
+
+	uchardet_delete (ud);
+
+	if (decoder->encoding == NULL)
+	{
+		g_set_error_literal (error,
+				     GTEF_FILE_LOADER_ERROR,
+				     GTEF_FILE_LOADER_ERROR_ENCODING_AUTO_DETECTION_FAILED,
+				     _("It is not possible to detect the character encoding automatically."));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void
+set_illegal_sequence_error (GError **error)
+{
+	g_set_error_literal (error,
+			     G_CONVERT_ERROR,
+			     G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+			     _("The input data contains an invalid sequence."));
+}
+
+/* Called in the worker thread. Pushes the valid UTF-8 text of @bytes, between
+ * @offset and @offset + @length, without copying it. A trailing \r is kept in
+ * pending_text.
+ */
+static void
+decoder_push_utf8_slices (Decoder *decoder,
+			  GBytes  *bytes,
+			  gsize    offset,
+			  gsize    length)
+{
+	const gchar *data;
+
+	data = g_bytes_get_data (bytes, NULL);
+
+	while (length > 0)
+	{
+		gsize block_length;
+
+		block_length = get_block_length (data + offset, length);
+
+		if (block_length == 0)
+		{
+			g_assert (length == 1);
+			g_string_append_c (decoder->pending_text, '\r');
+			break;
+		}
+
+		decoder_push_bytes (decoder,
+				    g_bytes_new_from_bytes (bytes, offset, block_length),
+				    NULL);
+
+		offset += block_length;
+		length -= block_length;
+	}
+}
+
+/* Called in the worker thread. */
+static gboolean
+decoder_feed_utf8 (Decoder  *decoder,
+		   GBytes   *chunk,
+		   GError  **error)
+{
+	GString *pending_text = decoder->pending_text;
+	const gchar *data;
+	gsize size;
+	gsize offset = 0;
+	const gchar *end;
+	gsize valid_end;
+	gboolean partial_char;
+
+	data = g_bytes_get_data (chunk, &size);
+
+	/* First complete the pending text with the beginning of the chunk. A
+	 * character is at most 4 bytes.
+	 */
+	if (pending_text->len > 0)
+	{
+		gsize old_length = pending_text->len;
+		gsize n_bytes = MIN (size, 4);
+		gsize valid_length;
+
+		g_string_append_len (pending_text, data, n_bytes);
+
+		if (!_gtef_utils_utf8_validate (pending_text->str,
+						pending_text->len,
+						&end,
+						&partial_char) &&
+		    !partial_char)
+		{
+			gsize invalid_pos = end - pending_text->str;
+
+			if (!decoder->escape_invalid_chars)
+			{
+				set_illegal_sequence_error (error);
+				return FALSE;
+			}
+
+			if (invalid_pos < old_length)
+			{
+				/* The incomplete character was invalid. The
+				 * bytes following the invalid one are fed
+				 * again, with the chunk.
+				 */
+				GByteArray *rest;
+				GBytes *rest_bytes;
+				gchar invalid_byte = pending_text->str[invalid_pos];
+				gboolean ok;
+
+				rest = g_byte_array_sized_new (old_length - invalid_pos - 1 + size);
+				g_byte_array_append (rest,
+						     (const guint8 *) pending_text->str + invalid_pos + 1,
+						     old_length - invalid_pos - 1);
+				g_byte_array_append (rest, (const guint8 *) data, size);
+				rest_bytes = g_byte_array_free_to_bytes (rest);
+
+				g_string_truncate (pending_text, invalid_pos);
+				decoder_push_invalid_bytes (decoder, &invalid_byte, 1);
+
+				ok = decoder_feed_utf8 (decoder, rest_bytes, error);
+				g_bytes_unref (rest_bytes);
+				return ok;
+			}
+
+			/* The invalid byte is in the chunk, it is escaped
+			 * below. A \r just before it can be pushed.
+			 */
+			valid_length = invalid_pos;
+		}
+		else
+		{
+			valid_length = end - pending_text->str;
+
+			if (valid_length > 0 &&
+			    pending_text->str[valid_length - 1] == '\r')
+			{
+				valid_length--;
+			}
+
+			if (valid_length <= old_length)
+			{
+				/* The chunk is too small to complete the
+				 * character.
+				 */
+				g_assert (n_bytes == size);
+				return TRUE;
+			}
+		}
+
+		decoder_push_block (decoder, pending_text->str, valid_length);
+
+		offset = valid_length - old_length;
+		g_string_truncate (pending_text, 0);
+	}
+
+	while (!_gtef_utils_utf8_validate (data + offset,
+					   size - offset,
+					   &end,
+					   &partial_char) &&
+	       !partial_char)
+	{
+		if (!decoder->escape_invalid_chars)
+		{
+			set_illegal_sequence_error (error);
+			return FALSE;
+		}
+
+		valid_end = end - data;
+		decoder_push_utf8_slices (decoder, chunk, offset, valid_end - offset);
+		decoder_push_invalid_bytes (decoder, data + valid_end, 1);
+
+		offset = valid_end + 1;
+	}
+
+	valid_end = end - data;
+	decoder_push_utf8_slices (decoder, chunk, offset, valid_end - offset);
+
+	/* Keep the incomplete character for the next chunk. */
+	g_string_append_len (pending_text, data + valid_end, size - valid_end);
+
+	return TRUE;
+}
+
+/* ASCII is a subset of UTF-8, so the conversion can be skipped too. */
+static gboolean
+can_skip_conversion (const GtefEncoding *encoding)
+{
+	return (gtef_encoding_is_utf8 (encoding) ||
+		g_ascii_strcasecmp (gtef_encoding_get_charset (encoding), "ASCII") == 0);
+}
+
+/* Called in the worker thread. Determines the encoding, opens the converter
+ * (if needed) and converts the sniffed content. The next chunks can then be
+ * fed directly to the converter.
+ */
+static gboolean
+decoder_start_conversion (Decoder   *decoder,
+			  gboolean   complete,
+			  GError   **error)
+{
+	GByteArray *sniff_content;
+	gboolean ok;
+
+	g_assert (decoder->converter == NULL);
+	g_assert (!decoder->utf8_fast_path);
+
+	if (!classify_sniff_content (decoder, complete, error))
+	{
+		return FALSE;
+	}
+
+	if (decoder->encoding == NULL &&
+	    !determine_encoding (decoder, complete, error))
+	{
+		return FALSE;
+	}
+
+	if (can_skip_conversion (decoder->encoding))
+	{
+		GBytes *bytes;
+
+		decoder->utf8_fast_path = TRUE;
+
+		sniff_content = decoder->sniff_content;
+		decoder->sniff_content = NULL;
+
+		bytes = g_byte_array_free_to_bytes (sniff_content);
+
+		ok = TRUE;
+		if (g_bytes_get_size (bytes) > 0)
+		{
+			ok = decoder_feed_utf8 (decoder, bytes, error);
+		}
+
+		g_bytes_unref (bytes);
+		return ok;
+	}
+
+	decoder->converter = _gtef_encoding_converter_new (ENCODING_CONVERTER_BUFFER_SIZE);
+
+	_gtef_encoding_converter_set_callback (decoder->converter,
+					       content_converted_cb,
+					       decoder);
+
+	if (decoder->escape_invalid_chars)
+	{
+		_gtef_encoding_converter_set_invalid_sequence_callback (decoder->converter,
+									invalid_sequence_cb,
+									decoder);
+	}
+
+	if (!_gtef_encoding_converter_open (decoder->converter,
+					    "UTF-8",
+					    gtef_encoding_get_charset (decoder->encoding),
+					    error))
+	{
+		return FALSE;
+	}
+
+	sniff_content = decoder->sniff_content;
+	decoder->sniff_content = NULL;
+
+	ok = TRUE;
+	if (sniff_content->len > 0)
+	{
+		ok = _gtef_encoding_converter_feed (decoder->converter,
+						    (const gchar *) sniff_content->data,
+						    sniff_content->len,
+						    error);
+	}
+
+	g_byte_array_unref (sniff_content);
+	return ok;
+}
+
+/* Called in the worker thread. */
+static gboolean
+decoder_feed (Decoder  *decoder,
+	      GBytes   *chunk,
+	      GError  **error)
+{
+	gconstpointer data;
+	gsize size;
+
+	data = g_bytes_get_data (chunk, &size);
+	g_assert (size > 0);
+
+	if (decoder->utf8_fast_path)
+	{
+		return decoder_feed_utf8 (decoder, chunk, error);
+	}
+
+	if (decoder->converter != NULL)
+	{
+		return _gtef_encoding_converter_feed (decoder->converter, data, size, error);
+	}
+
+	g_byte_array_append (decoder->sniff_content, data, size);
+
+	if (!classify_sniff_content (decoder, FALSE, error))
+	{
+		return FALSE;
+	}
+
+	if (decoder->encoding == NULL &&
+	    (decoder->sniff_size < 0 ||
+	     decoder->sniff_content->len < (guint64) decoder->sniff_size))
+	{
+		/* Continue sniffing. */
+		return TRUE;
+	}
+
+	return decoder_start_conversion (decoder, FALSE, error);
+}
+
+/* Called in the worker thread. */
+static gboolean
+decoder_end (Decoder  *decoder,
+	     GError  **error)
+{
+	/* The content is smaller than the sniff size. With the follow mode, the
+	 * content can continue, e.g. pure ASCII is not a reliable guess.
+	 */
+	if (decoder->converter == NULL &&
+	    !decoder->utf8_fast_path &&
+	    !decoder_start_conversion (decoder, !decoder->follow, error))
+	{
+		return FALSE;
+	}
+
+	/* The incomplete input is kept, it can be completed by the content
+	 * appended later to the file.
+	 */
+	if (decoder->follow &&
+	    decoder->compression_type == GTEF_COMPRESSION_TYPE_NONE)
+	{
+		if (decoder->converter != NULL)
+		{
+			_gtef_encoding_converter_flush (decoder->converter);
+		}
+
+		return TRUE;
+	}
+
+	if (decoder->converter != NULL &&
+	    !_gtef_encoding_converter_close (decoder->converter, error))
+	{
+		return FALSE;
+	}
+
+	/* A lone \r at the end of the content, or an incomplete character. */
+	if (decoder->pending_text->len > 0)
+	{
+		const gchar *end;
+
+		if (!_gtef_utils_utf8_validate (decoder->pending_text->str,
+						decoder->pending_text->len,
+						&end,
+						NULL))
+		{
+			if (decoder->escape_invalid_chars)
+			{
+				gsize valid_length = end - decoder->pending_text->str;
+				gsize n_bytes = decoder->pending_text->len - valid_length;
+				gchar *incomplete_char;
+
+				/* Copied, because the pending text is modified. */
+				incomplete_char = g_strndup (end, n_bytes);
+				g_string_truncate (decoder->pending_text, valid_length);
+
+				decoder_push_invalid_bytes (decoder, incomplete_char, n_bytes);
+				g_free (incomplete_char);
+				return TRUE;
+			}
+
+			g_set_error_literal (error,
+					     G_CONVERT_ERROR,
+					     G_CONVERT_ERROR_PARTIAL_INPUT,
+					     _("The input data ends with an incomplete multi-byte sequence."));
+			return FALSE;
+		}
+
+		decoder_push_block (decoder,
+				    decoder->pending_text->str,
+				    decoder->pending_text->len);
+		g_string_truncate (decoder->pending_text, 0);
+	}
+
+	return TRUE;
+}
+
+static void
+set_too_big_error (Decoder  *decoder,
+		   GError  **error)
+{
+	gchar *max_size_str;
+
+	max_size_str = g_format_size (decoder->max_size);
+
+	g_set_error (error,
+		     GTEF_FILE_LOADER_ERROR,
+		     GTEF_FILE_LOADER_ERROR_TOO_BIG,
+		     _("The file is too big. Maximum %s can be loaded."),
+		     max_size_str);
+
+	g_free (max_size_str);
+}
+
+/* Called in the worker thread. Runs @data through the decompressor, and feeds
+ * the decompressed content to the rest of the pipeline. With @at_end, flushes
+ * the decompressor.
+ */
+static gboolean
+decoder_decompress (Decoder       *decoder,
+		    const guint8  *data,
+		    gsize          size,
+		    gboolean       at_end,
+		    GError       **error)
+{
+	guint8 outbuf[DECOMPRESSION_BUFFER_SIZE];
+
+	while (size > 0 || at_end)
+	{
+		GConverterResult result;
+		gsize bytes_read = 0;
+		gsize bytes_written = 0;
+
+		result = g_converter_convert (decoder->decompressor,
+					      data, size,
+					      outbuf, sizeof (outbuf),
+					      at_end ? G_CONVERTER_INPUT_AT_END : G_CONVERTER_NO_FLAGS,
+					      &bytes_read,
+					      &bytes_written,
+					      error);
+
+		if (result == G_CONVERTER_ERROR)
+		{
+			return FALSE;
+		}
+
+		data += bytes_read;
+		size -= bytes_read;
+
+		if (bytes_written > 0)
+		{
+			GBytes *decompressed;
+			gboolean ok;
+
+			decoder->n_uncompressed_bytes += bytes_written;
+
+			if (decoder->max_size >= 0 &&
+			    decoder->n_uncompressed_bytes > decoder->max_size)
+			{
+				set_too_big_error (decoder, error);
+				return FALSE;
+			}
+
+			decompressed = g_bytes_new (outbuf, bytes_written);
+			ok = decoder_feed (decoder, decompressed, error);
+			g_bytes_unref (decompressed);
+
+			if (!ok)
+			{
+				return FALSE;
+			}
+		}
+
+		if (decoder_is_aborted (decoder))
+		{
+			return TRUE;
+		}
+
+		if (result == G_CONVERTER_FINISHED)
+		{
+			/* Several gzip members can be concatenated, for example
+			 * with "gzip -c file >> file.gz".
+			 */
+			if (size == 0)
+			{
+				break;
+			}
+
+			g_converter_reset (decoder->decompressor);
+		}
+	}
+
+	return TRUE;
+}
+
+/* Called in the worker thread. */
+static void
+decoder_determine_compression (Decoder *decoder)
+{
+	GByteArray *sniff = decoder->compression_sniff;
+
+	if (sniff->len >= 2 &&
+	    sniff->data[0] == 0x1f &&
+	    sniff->data[1] == 0x8b)
+	{
+		decoder->compression_type = GTEF_COMPRESSION_TYPE_GZIP;
+		decoder->decompressor = G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP));
+	}
+	else
+	{
+		decoder->compression_type = GTEF_COMPRESSION_TYPE_NONE;
+	}
+}
+
+/* Called in the worker thread. Feeds the sniffed bytes to the rest of the
+ * pipeline, once the compression type is known.
+ */
+static gboolean
+decoder_flush_compression_sniff (Decoder  *decoder,
+				 gboolean  at_end,
+				 GError  **error)
+{
+	GBytes *bytes;
+	gboolean ok = TRUE;
+
+	decoder_determine_compression (decoder);
+
+	bytes = g_byte_array_free_to_bytes (decoder->compression_sniff);
+	decoder->compression_sniff = NULL;
+
+	if (decoder->decompressor != NULL)
+	{
+		ok = decoder_decompress (decoder,
+					 g_bytes_get_data (bytes, NULL),
+					 g_bytes_get_size (bytes),
+					 at_end,
+					 error);
+	}
+	else if (g_bytes_get_size (bytes) > 0)
+	{
+		ok = decoder_feed (decoder, bytes, error);
+	}
+
+	g_bytes_unref (bytes);
+	return ok;
+}
+
+/* Called in the worker thread, for each raw chunk. */
+static gboolean
+decoder_feed_raw (Decoder  *decoder,
+		  GBytes   *chunk,
+		  GError  **error)
+{
+	gconstpointer data;
+	gsize size;
+
+	data = g_bytes_get_data (chunk, &size);
+	decoder->n_bytes_fed += size;
+
+	if (decoder->content_hash != NULL)
+	{
+		_gtef_content_hash_update (decoder->content_hash, data, size);
+	}
+
+	if (decoder->compression_sniff != NULL)
+	{
+		g_byte_array_append (decoder->compression_sniff, data, size);
+
+		if (decoder->compression_sniff->len < COMPRESSION_SNIFF_SIZE)
+		{
+			return TRUE;
+		}
+
+		return decoder_flush_compression_sniff (decoder, FALSE, error);
+	}
+
+	if (decoder->decompressor != NULL)
+	{
+		return decoder_decompress (decoder, data, size, FALSE, error);
+	}
+
+	return decoder_feed (decoder, chunk, error);
+}
+
+/* Called in the worker thread. */
+static gboolean
+decoder_end_raw (Decoder  *decoder,
+		 GError  **error)
+{
+	/* The content is smaller than the compression sniff size. */
+	if (decoder->compression_sniff != NULL)
+	{
+		if (!decoder_flush_compression_sniff (decoder, TRUE, error))
+		{
+			return FALSE;
+		}
+	}
+	else if (decoder->decompressor != NULL)
+	{
+		if (!decoder_decompress (decoder, NULL, 0, TRUE, error))
+		{
+			return FALSE;
+		}
+	}
+
+	return decoder_end (decoder, error);
+}
+
+/* Like remove_trailing_newline_if_needed(), on @text. The line terminators are
+ * the same as in a GtkTextBuffer.
+ */
+static gchar *
+remove_trailing_newline (GString *text)
+{
+	const gchar *end = text->str + text->len;
+	gsize newline_length = 0;
+	gchar *removed_newline;
+
+	if (text->len >= 2 &&
+	    end[-2] == '\r' &&
+	    end[-1] == '\n')
+	{
+		newline_length = 2;
+	}
+	else if (text->len >= 1 &&
+		 (end[-1] == '\n' || end[-1] == '\r'))
+	{
+		newline_length = 1;
+	}
+	else if (text->len >= 3 &&
+		 memcmp (end - 3, "\xE2\x80\xA9", 3) == 0)
+	{
+		/* U+2029 PARAGRAPH SEPARATOR */
+		newline_length = 3;
+	}
+
+	if (newline_length == 0)
+	{
+		return NULL;
+	}
+
+	removed_newline = g_strndup (end - newline_length, newline_length);
+	g_string_truncate (text, text->len - newline_length);
+
+	return removed_newline;
+}
+
+/* Called in the worker thread, at the end of the content, with the
+ * patch-buffer mode.
+ */
+static void
+decoder_compute_patch (Decoder *decoder)
+{
+	const gchar *old_text;
+	gsize old_length;
+	gsize byte_offset = 0;
+	glong char_offset = 0;
+	guint i;
+
+	if (decoder->remove_trailing_newline)
+	{
+		decoder->removed_newline = remove_trailing_newline (decoder->new_text);
+	}
+
+	old_text = g_bytes_get_data (decoder->old_text, &old_length);
+
+	decoder->hunks = _gtef_line_diff_compute (old_text,
+						  old_length,
+						  decoder->new_text->str,
+						  decoder->new_text->len,
+						  MAX_PATCH_COST);
+
+	/* The buffer is modified with character offsets. The hunks are in
+	 * order, so the old text is traversed only once.
+	 */
+	for (i = 0; i < decoder->hunks->len; i++)
+	{
+		GtefLineDiffHunk *hunk = &g_array_index (decoder->hunks, GtefLineDiffHunk, i);
+
+		char_offset += g_utf8_strlen (old_text + byte_offset, hunk->old_start - byte_offset);
+		byte_offset = hunk->old_start;
+		hunk->old_start = char_offset;
+
+		char_offset += g_utf8_strlen (old_text + byte_offset, hunk->old_end - byte_offset);
+		byte_offset = hunk->old_end;
+		hunk->old_end = char_offset;
+	}
+}
+
+static void
+decode_thread (GTask        *decoder_task,
+	       gpointer      source_object,
+	       gpointer      task_data,
+	       GCancellable *cancellable)
+{
+	Decoder *decoder = task_data;
+	gboolean end_of_input = FALSE;
+	GError *error = NULL;
+
+	while (TRUE)
+	{
+		GBytes *chunk;
+		gboolean ok = TRUE;
+
+		chunk = g_async_queue_pop (decoder->input);
+		decoder_check_input_drained (decoder);
+
+		if (g_bytes_get_size (chunk) == 0)
+		{
+			end_of_input = TRUE;
+		}
+		else
+		{
+			ok = decoder_feed_raw (decoder, chunk, &error);
+		}
+
+		g_bytes_unref (chunk);
+
+		if (end_of_input || !ok)
+		{
+			break;
+		}
+
+		if (decoder_is_aborted (decoder) ||
+		    g_cancellable_set_error_if_cancelled (cancellable, &error))
+		{
+			break;
+		}
+	}
+
+	if (end_of_input &&
+	    error == NULL &&
+	    !decoder_is_aborted (decoder) &&
+	    decoder_end_raw (decoder, &error) &&
+	    decoder->new_text != NULL)
+	{
+		decoder_compute_patch (decoder);
+	}
+
+	if (error != NULL)
+	{
+		g_task_return_error (decoder_task, error);
+	}
+	else
+	{
+		g_task_return_boolean (decoder_task, TRUE);
+	}
+}
+
+static void
+insert_content (GtkTextBuffer *buffer,
+		const gchar   *str,
+		gsize          length,
+		gboolean       appending)
+{
+	GtkTextIter end;
+	GtkTextIter start;
+
+	gtk_text_buffer_get_end_iter (buffer, &end);
+	gtk_text_buffer_insert (buffer, &end, str, length);
+
+	/* When appending, the cursor is left where the user has placed it. If
+	 * it is at the end, it stays at the end.
+	 */
+	if (appending)
+	{
+		return;
+	}
+
+	/* Keep cursor at the start, to avoid signal emissions for each chunk. */
+	gtk_text_buffer_get_start_iter (buffer, &start);
+	gtk_text_buffer_place_cursor (buffer, &start);
+}
+
+/* Called in the main thread, before inserting @block at the end of the
+ * buffer. Converts the InvalidRanges of @block to character offsets.
+ */
+static void
+add_invalid_ranges (TaskData      *task_data,
+		    GtkTextBuffer *buffer,
+		    Block         *block)
+{
+	const gchar *text;
+	gsize byte_offset = 0;
+	gsize char_offset;
+	guint i;
+
+	if (block->invalid_ranges == NULL)
+	{
+		return;
+	}
+
+	if (task_data->invalid_ranges == NULL)
+	{
+		task_data->invalid_ranges = g_array_new (FALSE, FALSE, sizeof (InvalidRange));
+	}
+
+	text = g_bytes_get_data (block->text, NULL);
+	char_offset = gtk_text_buffer_get_char_count (buffer);
+
+	for (i = 0; i < block->invalid_ranges->len; i++)
+	{
+		InvalidRange *block_range;
+		InvalidRange *last_range = NULL;
+		InvalidRange range;
+
+		block_range = &g_array_index (block->invalid_ranges, InvalidRange, i);
+
+		char_offset += g_utf8_strlen (text + byte_offset, block_range->start - byte_offset);
+		byte_offset = block_range->start;
+
+		range.start = char_offset;
+		range.length = block_range->length;
+
+		if (task_data->invalid_ranges->len > 0)
+		{
+			last_range = &g_array_index (task_data->invalid_ranges,
+						     InvalidRange,
+						     task_data->invalid_ranges->len - 1);
+		}
+
+		/* Merge contiguous ranges, to apply the tag fewer times. */
+		if (last_range != NULL &&
+		    last_range->start + last_range->length == range.start)
+		{
+			last_range->length += range.length;
+		}
+		else
+		{
+			g_array_append_val (task_data->invalid_ranges, range);
+		}
+	}
+}
+
+/* Called in the main thread, at the end of the load operation. Tags all the
+ * escaped invalid characters in one pass.
+ */
+static void
+apply_invalid_ranges (TaskData   *task_data,
+		      GtefBuffer *buffer)
+{
+	GtkTextIter start;
+	gsize offset = 0;
+	guint i;
+
+	if (task_data->invalid_ranges == NULL)
+	{
+		return;
+	}
+
+	gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (buffer), &start);
+
+	for (i = 0; i < task_data->invalid_ranges->len; i++)
+	{
+		InvalidRange *range;
+		GtkTextIter end;
+
+		range = &g_array_index (task_data->invalid_ranges, InvalidRange, i);
+
+		gtk_text_iter_forward_chars (&start, range->start - offset);
+
+		end = start;
+		gtk_text_iter_forward_chars (&end, range->length);
+
+		_gtef_buffer_set_as_invalid_character (buffer, &start, &end);
+
+		start = end;
+		offset = range->start + range->length;
+	}
+}
+
+/* Called in the main thread, at the end of the load operation with the
+ * patch-buffer mode. Replaces the lines that have changed, starting from the
+ * end so that the offsets of the previous hunks stay valid. Returns the removed
+ * trailing newline, like remove_trailing_newline_if_needed().
+ */
+static gchar *
+apply_patch (GtefFileLoader *loader,
+	     TaskData       *task_data)
+{
+	GtefFileLoaderPrivate *priv = gtef_file_loader_get_instance_private (loader);
+	GtkTextBuffer *buffer = GTK_TEXT_BUFFER (priv->buffer);
+	Decoder *decoder = task_data->decoder;
+	const gchar *new_text = decoder->new_text->str;
+	guint i;
+
+	/* The invalid characters are tagged on the new content. The tags on
+	 * the unchanged lines are already there.
+	 */
+	if (task_data->invalid_ranges != NULL)
+	{
+		g_array_unref (task_data->invalid_ranges);
+	}
+
+	task_data->invalid_ranges = decoder->new_invalid_ranges;
+	decoder->new_invalid_ranges = NULL;
+
+	/* Modified by something else during the load, the hunks don't apply. */
+	if (priv->buffer_stamp != task_data->old_buffer_stamp)
+	{
+		gtk_text_buffer_set_text (buffer, new_text, decoder->new_text->len);
+		return g_strdup (decoder->removed_newline);
+	}
+
+	for (i = decoder->hunks->len; i > 0; i--)
+	{
+		GtefLineDiffHunk *hunk;
+		GtkTextIter start;
+		GtkTextIter end;
+
+		hunk = &g_array_index (decoder->hunks, GtefLineDiffHunk, i - 1);
+
+		gtk_text_buffer_get_iter_at_offset (buffer, &start, hunk->old_start);
+
+		if (hunk->old_end > hunk->old_start)
+		{
+			gtk_text_buffer_get_iter_at_offset (buffer, &end, hunk->old_end);
+			gtk_text_buffer_delete (buffer, &start, &end);
+		}
+
+		if (hunk->new_end > hunk->new_start)
+		{
+			gtk_text_buffer_insert (buffer,
+						&start,
+						new_text + hunk->new_start,
+						hunk->new_end - hunk->new_start);
+		}
+	}
+
+	return g_strdup (decoder->removed_newline);
+}
+
+/* The content has been modified in a way that keeps the same validity key, or
+ * the metadata are wrong. The content is read again, with the encoding
+ * detection this time.
+ */
+static void
+retry_without_cached_encoding (GTask *task)
+{
+	GtefFileLoader *loader;
+	TaskData *task_data;
+
+	loader = g_task_get_source_object (task);
+	task_data = g_task_get_task_data (task);
+
+	if (task_data->insert_source_id != 0)
+	{
+		g_source_remove (task_data->insert_source_id);
+		task_data->insert_source_id = 0;
+	}
+
+	g_clear_error (&task_data->error);
+	g_clear_object (&task_data->decoder_task);
+	task_data->decoder = NULL;
+
+	gtef_encoding_free (task_data->cached_encoding);
+	task_data->cached_encoding = NULL;
+	task_data->use_cached_encoding = FALSE;
+
+	if (task_data->invalid_ranges != NULL)
+	{
+		g_array_set_size (task_data->invalid_ranges, 0);
+	}
+
+	g_byte_array_set_size (task_data->tail, 0);
+	task_data->end_offset = 0;
+
+	task_data->reading_done = FALSE;
+	task_data->decoder_done = FALSE;
+
+	/* With the patch-buffer mode, the buffer has not been modified. */
+	if (!task_data->patching)
+	{
+		empty_buffer (loader);
+	}
 
-			insert_content (GTK_TEXT_BUFFER (priv->buffer), "\r\n", 2);
-			my_str++;
-			my_length--;
-		}
-		else
-		{
-			insert_content (GTK_TEXT_BUFFER (priv->buffer), "\r", 1);
-		}
+	load_content (task);
+}
+
+/* With the follow mode, the file has been truncated or rewritten since the
+ * previous load. The whole content is loaded again, with the encoding
+ * detection.
+ */
+static void
+restart_full_load (GTask *task)
+{
+	GtefFileLoader *loader;
+	TaskData *task_data;
+
+	loader = g_task_get_source_object (task);
+	task_data = g_task_get_task_data (task);
+
+	g_assert (task_data->decoder == NULL);
+
+	follow_state_free (task_data->follow_state);
+	task_data->follow_state = NULL;
+
+	g_clear_pointer (&task_data->tail_check, (GDestroyNotify)g_bytes_unref);
+	task_data->tail_check_pos = 0;
+	task_data->tail_mismatch = FALSE;
+	task_data->appending = FALSE;
+
+	g_byte_array_set_size (task_data->tail, 0);
+	task_data->end_offset = 0;
+
+	reset (loader);
+	prepare_buffer (task);
+	load_content (task);
+}
+
+/* Keeps what is needed to continue the load operation later, with the follow
+ * mode. Takes ownership of @removed_newline.
+ */
+static void
+save_follow_state (GTask *task,
+		   gchar *removed_newline)
+{
+	GtefFileLoader *loader;
+	GtefFileLoaderPrivate *priv;
+	TaskData *task_data;
+	FollowState *state;
+
+	loader = g_task_get_source_object (task);
+	priv = gtef_file_loader_get_instance_private (loader);
+
+	task_data = g_task_get_task_data (task);
+
+	g_assert (priv->follow_state == NULL);
+
+	if (!priv->follow ||
+	    task_data->follow_pending_text == NULL ||
+	    priv->detected_compression_type != GTEF_COMPRESSION_TYPE_NONE)
+	{
+		g_free (removed_newline);
+		return;
+	}
+
+	state = g_new0 (FollowState, 1);
+
+	state->offset = task_data->end_offset;
+	state->tail = g_bytes_new (task_data->tail->data, task_data->tail->len);
+	state->file_id = g_strdup (_gtef_file_content_loader_get_file_id (task_data->content_loader));
+
+	state->converter = task_data->follow_converter;
+	task_data->follow_converter = NULL;
+
+	state->pending_text = task_data->follow_pending_text;
+	task_data->follow_pending_text = NULL;
+
+	state->removed_newline = removed_newline;
+	state->buffer_stamp = priv->buffer_stamp;
+
+	priv->follow_state = state;
+}
+
+/* Returns the task if all the operations have finished, i.e. reading the
+ * content, decoding it and inserting it into the buffer. An error can be
+ * returned earlier.
+ */
+static void
+check_completion (GTask *task)
+{
+	GtefFileLoader *loader;
+	GtefFileLoaderPrivate *priv;
+	TaskData *task_data;
+	gchar *removed_newline = NULL;
+
+	loader = g_task_get_source_object (task);
+	priv = gtef_file_loader_get_instance_private (loader);
+
+	task_data = g_task_get_task_data (task);
+
+	if (task_data->returned ||
+	    !task_data->reading_done ||
+	    !task_data->decoder_done)
+	{
+		return;
+	}
+
+	if (task_data->error == NULL &&
+	    task_data->decoder != NULL &&
+	    decoder_has_blocks (task_data->decoder))
+	{
+		return;
+	}
+
+	if (task_data->error != NULL &&
+	    task_data->error->domain == G_CONVERT_ERROR &&
+	    task_data->use_cached_encoding)
+	{
+		retry_without_cached_encoding (task);
+		return;
+	}
+
+	task_data->returned = TRUE;
+
+	if (task_data->insert_source_id != 0)
+	{
+		g_source_remove (task_data->insert_source_id);
+		task_data->insert_source_id = 0;
+	}
+
+	if (task_data->error != NULL)
+	{
+		GError *error = task_data->error;
 
-		task_data->insert_carriage_return = FALSE;
+		task_data->error = NULL;
+		g_task_return_error (task, error);
+		return;
 	}
 
-	if (my_length == 0)
+	if (priv->buffer == NULL)
 	{
+		g_task_return_boolean (task, FALSE);
 		return;
 	}
 
-	if (my_str[my_length - 1] == '\r')
+	if (task_data->patching)
+	{
+		removed_newline = apply_patch (loader, task_data);
+	}
+
+	apply_invalid_ranges (task_data, priv->buffer);
+	detect_newline_type (loader);
+
+	if (!task_data->patching)
+	{
+		removed_newline = remove_trailing_newline_if_needed (loader);
+	}
+
+	save_follow_state (task, removed_newline);
+
+	g_task_return_boolean (task, TRUE);
+}
+
+/* Keeps the first error, and stops the other operations. Takes ownership of
+ * @error.
+ */
+static void
+set_error (GTask  *task,
+	   GError *error)
+{
+	TaskData *task_data;
+
+	task_data = g_task_get_task_data (task);
+
+	if (task_data->error == NULL)
+	{
+		task_data->error = error;
+	}
+	else
+	{
+		g_error_free (error);
+	}
+
+	if (task_data->decoder != NULL)
+	{
+		decoder_abort (task_data->decoder);
+	}
+}
+
+static gboolean
+insert_blocks_cb (gpointer user_data)
+{
+	GTask *task = G_TASK (user_data);
+	GtefFileLoader *loader;
+	GtefFileLoaderPrivate *priv;
+	TaskData *task_data;
+	gint64 start_time;
+
+	loader = g_task_get_source_object (task);
+	priv = gtef_file_loader_get_instance_private (loader);
+
+	task_data = g_task_get_task_data (task);
+
+	start_time = g_get_monotonic_time ();
+
+	do
 	{
-		my_str[my_length - 1] = '\0';
-		my_length--;
+		Block *block;
+
+		block = decoder_pop_block (task_data->decoder);
+
+		if (block == NULL)
+		{
+			task_data->insert_source_id = 0;
+			check_completion (task);
+			return G_SOURCE_REMOVE;
+		}
 
-		/* Insert \r the next time. */
-		task_data->insert_carriage_return = TRUE;
+		/* With the patch-buffer mode, the Block is empty. */
+		if (priv->buffer != NULL &&
+		    task_data->error == NULL &&
+		    !task_data->patching)
+		{
+			gsize length;
+			const gchar *text;
+
+			add_invalid_ranges (task_data, GTK_TEXT_BUFFER (priv->buffer), block);
+
+			text = g_bytes_get_data (block->text, &length);
+			insert_content (GTK_TEXT_BUFFER (priv->buffer),
+					text,
+					length,
+					task_data->appending);
+		}
+
+		if (task_data->progress_cb != NULL &&
+		    task_data->total_size > 0)
+		{
+			task_data->progress_cb (MIN (block->n_raw_bytes, task_data->total_size),
+						task_data->total_size,
+						task_data->progress_cb_data);
+		}
+
+		block_free (block);
 	}
+	while (g_get_monotonic_time () - start_time < INSERTION_TIME_BUDGET);
+
+	return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+blocks_available_cb (gpointer user_data)
+{
+	GTask *task = G_TASK (user_data);
+	TaskData *task_data;
+
+	task_data = g_task_get_task_data (task);
 
-	if (my_length != 0)
+	if (!task_data->returned &&
+	    task_data->insert_source_id == 0)
 	{
-		insert_content (GTK_TEXT_BUFFER (priv->buffer), my_str, my_length);
+		task_data->insert_source_id = g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+							       insert_blocks_cb,
+							       g_object_ref (task),
+							       g_object_unref);
 	}
+
+	return G_SOURCE_REMOVE;
 }
 
 static void
-convert_and_insert_content (GTask *task)
+decoder_done_cb (GObject      *source_object,
+		 GAsyncResult *result,
+		 gpointer      user_data)
 {
+	GTask *task = G_TASK (user_data);
 	GtefFileLoader *loader;
 	GtefFileLoaderPrivate *priv;
 	TaskData *task_data;
-	GtefEncodingConverter *converter = NULL;
-	GQueue *content;
-	GList *l;
 	GError *error = NULL;
 
 	loader = g_task_get_source_object (task);
@@ -803,130 +3419,349 @@ convert_and_insert_content (GTask *task)
 
 	task_data = g_task_get_task_data (task);
 
-	if (priv->buffer == NULL)
+	g_task_propagate_boolean (G_TASK (result), &error);
+
+	if (error != NULL)
 	{
-		g_task_return_boolean (task, FALSE);
+		set_error (task, error);
+	}
+	else if (task_data->appending)
+	{
+		guint i;
+
+		for (i = 0; i < G_N_ELEMENTS (priv->newline_counts); i++)
+		{
+			priv->newline_counts[i] += task_data->decoder->newline_counts[i];
+		}
+	}
+	else if (task_data->decoder->encoding != NULL)
+	{
+		/* reset() must have been called before launching the task. */
+		g_assert (priv->detected_encoding == NULL);
+		priv->detected_encoding = gtef_encoding_copy (task_data->decoder->encoding);
+		priv->detected_compression_type = task_data->decoder->compression_type;
+		priv->encoding_detection_method = task_data->decoder->encoding_detection_method;
+
+		memcpy (priv->newline_counts,
+			task_data->decoder->newline_counts,
+			sizeof (priv->newline_counts));
+	}
+
+	/* The worker thread has finished, the Decoder state can be taken. */
+	if (error == NULL)
+	{
+		g_assert (task_data->content_hash == NULL);
+		task_data->content_hash = task_data->decoder->content_hash;
+		task_data->decoder->content_hash = NULL;
+	}
+
+	if (error == NULL &&
+	    task_data->decoder->follow)
+	{
+		task_data->follow_converter = task_data->decoder->converter;
+		task_data->decoder->converter = NULL;
+
+		task_data->follow_pending_text = task_data->decoder->pending_text;
+		task_data->decoder->pending_text = g_string_new (NULL);
+	}
+
+	task_data->decoder_done = TRUE;
+
+	/* The input is not consumed anymore. If the reading is paused, the
+	 * next chunk stops it with the error.
+	 */
+	if (!task_data->reading_done)
+	{
+		_gtef_file_content_loader_resume (task_data->content_loader);
+	}
+
+	check_completion (task);
+
+	g_object_unref (task);
+}
+
+/* Called in the main thread, before launching the worker thread. The Decoder
+ * continues the conversion where the previous load operation has stopped.
+ */
+static void
+decoder_continue (Decoder     *decoder,
+		  FollowState *state)
+{
+	g_clear_pointer (&decoder->sniff_content, (GDestroyNotify)g_byte_array_unref);
+	g_clear_pointer (&decoder->compression_sniff, (GDestroyNotify)g_byte_array_unref);
+
+	g_string_free (decoder->pending_text, TRUE);
+	decoder->pending_text = state->pending_text;
+	state->pending_text = g_string_new (NULL);
+
+	if (state->converter == NULL)
+	{
+		decoder->utf8_fast_path = TRUE;
 		return;
 	}
 
-	converter = _gtef_encoding_converter_new (ENCODING_CONVERTER_BUFFER_SIZE);
+	decoder->converter = state->converter;
+	state->converter = NULL;
 
-	_gtef_encoding_converter_set_callback (converter,
+	_gtef_encoding_converter_set_callback (decoder->converter,
 					       content_converted_cb,
-					       task);
+					       decoder);
 
-	g_assert (priv->detected_encoding != NULL);
-	_gtef_encoding_converter_open (converter,
-				       "UTF-8",
-				       gtef_encoding_get_charset (priv->detected_encoding),
-				       &error);
-	if (error != NULL)
+	if (decoder->escape_invalid_chars)
 	{
-		g_task_return_error (task, error);
-		goto out;
+		_gtef_encoding_converter_set_invalid_sequence_callback (decoder->converter,
+									invalid_sequence_cb,
+									decoder);
+	}
+	else
+	{
+		_gtef_encoding_converter_set_invalid_sequence_callback (decoder->converter,
+									NULL,
+									NULL);
 	}
+}
+
+static void
+launch_decoder (GTask *task)
+{
+	GtefFileLoader *loader;
+	GtefFileLoaderPrivate *priv;
+	TaskData *task_data;
+	const GtefEncoding *known_encoding = NULL;
+
+	loader = g_task_get_source_object (task);
+	priv = gtef_file_loader_get_instance_private (loader);
+
+	task_data = g_task_get_task_data (task);
 
-	content = _gtef_file_content_loader_get_content (task_data->content_loader);
+	g_assert (task_data->decoder_task == NULL);
 
-	for (l = content->head; l != NULL; l = l->next)
+	g_free (task_data->validity_key);
+	task_data->validity_key = _gtef_file_content_loader_get_validity_key (task_data->content_loader);
+
+	task_data->use_cached_encoding = (task_data->cached_encoding != NULL &&
+					  g_strcmp0 (task_data->validity_key, task_data->cached_validity_key) == 0);
+
+	if (task_data->appending)
+	{
+		known_encoding = priv->detected_encoding;
+	}
+	else if (task_data->use_cached_encoding)
 	{
-		GBytes *chunk = l->data;
+		known_encoding = task_data->cached_encoding;
+	}
+
+	task_data->decoder = decoder_new (task,
+					  priv->sniff_size,
+					  priv->max_size,
+					  priv->escape_invalid_chars,
+					  known_encoding);
 
-		g_assert (chunk != NULL);
-		g_assert (g_bytes_get_size (chunk) > 0);
+	task_data->decoder->follow = priv->follow;
+
+	if (task_data->patching)
+	{
+		Decoder *decoder = task_data->decoder;
 
-		_gtef_encoding_converter_feed (converter,
-					       g_bytes_get_data (chunk, NULL),
-					       g_bytes_get_size (chunk),
-					       &error);
+		decoder->old_text = g_bytes_ref (task_data->old_text);
+		decoder->new_text = g_string_new (NULL);
 
-		if (error != NULL)
+		if (priv->buffer != NULL)
 		{
-			g_task_return_error (task, error);
-			goto out;
+			decoder->remove_trailing_newline =
+				gtk_source_buffer_get_implicit_trailing_newline (GTK_SOURCE_BUFFER (priv->buffer));
 		}
 	}
 
-	_gtef_encoding_converter_close (converter, &error);
-	if (error != NULL)
+	if (task_data->appending)
 	{
-		g_task_return_error (task, error);
-		goto out;
+		decoder_continue (task_data->decoder, task_data->follow_state);
 	}
 
-	if (task_data->insert_carriage_return)
+	task_data->decoder->content_hash = task_data->content_hash;
+	task_data->content_hash = NULL;
+
+	/* No source object: the last unref of the decoder task can happen in
+	 * the worker thread, and the GtefFileLoader must be finalized in the
+	 * main thread.
+	 */
+	task_data->decoder_task = g_task_new (NULL,
+					      g_task_get_cancellable (task),
+					      decoder_done_cb,
+					      g_object_ref (task));
+
+	g_task_set_task_data (task_data->decoder_task,
+			      task_data->decoder,
+			      decoder_free);
+
+	g_task_run_in_thread (task_data->decoder_task, decode_thread);
+}
+
+/* Compares the beginning of @chunk with the tail_check. Returns the rest of
+ * @chunk, or %NULL if there is no rest or if the bytes are different, in which
+ * case tail_mismatch is set.
+ */
+static GBytes *
+consume_tail_check (TaskData *task_data,
+		    GBytes   *chunk)
+{
+	const guint8 *data;
+	gsize size;
+	const guint8 *expected;
+	gsize expected_size;
+	gsize n_bytes;
+
+	data = g_bytes_get_data (chunk, &size);
+	expected = g_bytes_get_data (task_data->tail_check, &expected_size);
+
+	n_bytes = MIN (size, expected_size - task_data->tail_check_pos);
+
+	if (memcmp (data, expected + task_data->tail_check_pos, n_bytes) != 0)
 	{
-		insert_content (GTK_TEXT_BUFFER (priv->buffer), "\r", 1);
-		task_data->insert_carriage_return = FALSE;
+		task_data->tail_mismatch = TRUE;
+		return NULL;
 	}
 
-	/* The order is important here: if the buffer contains only one line, we
-	 * must remove the trailing newline *after* detecting the newline type.
-	 */
-	detect_newline_type (loader);
-	remove_trailing_newline_if_needed (loader);
+	task_data->tail_check_pos += n_bytes;
 
-	g_task_return_boolean (task, TRUE);
+	if (task_data->tail_check_pos == expected_size)
+	{
+		g_clear_pointer (&task_data->tail_check, (GDestroyNotify)g_bytes_unref);
+	}
+
+	if (n_bytes == size)
+	{
+		return NULL;
+	}
 
-out:
-	g_clear_object (&converter);
+	return g_bytes_new_from_bytes (chunk, n_bytes, size - n_bytes);
 }
 
+/* Keeps the last FOLLOW_TAIL_SIZE bytes read. */
 static void
-determine_encoding (GTask *task)
+update_tail (GByteArray *tail,
+	     GBytes     *chunk)
+{
+	const guint8 *data;
+	gsize size;
+
+	data = g_bytes_get_data (chunk, &size);
+
+	if (size >= FOLLOW_TAIL_SIZE)
+	{
+		g_byte_array_set_size (tail, 0);
+		g_byte_array_append (tail, data + size - FOLLOW_TAIL_SIZE, FOLLOW_TAIL_SIZE);
+		return;
+	}
+
+	g_byte_array_append (tail, data, size);
+
+	if (tail->len > FOLLOW_TAIL_SIZE)
+	{
+		g_byte_array_remove_range (tail, 0, tail->len - FOLLOW_TAIL_SIZE);
+	}
+}
+
+static gboolean
+content_chunk_cb (GBytes   *chunk,
+		  gpointer  user_data,
+		  GError  **error)
 {
+	GTask *task = G_TASK (user_data);
 	GtefFileLoader *loader;
 	GtefFileLoaderPrivate *priv;
 	TaskData *task_data;
-	uchardet_t ud;
-	const gchar *charset;
-	GQueue *content;
-	GList *l;
+	GBytes *content;
+	guint input_length;
 
 	loader = g_task_get_source_object (task);
 	priv = gtef_file_loader_get_instance_private (loader);
 
 	task_data = g_task_get_task_data (task);
 
-	ud = uchardet_new ();
+	/* Stop reading, the error will be returned. */
+	if (task_data->error != NULL)
+	{
+		g_propagate_error (error, g_error_copy (task_data->error));
+		return FALSE;
+	}
+
+	if (task_data->tail_check != NULL)
+	{
+		content = consume_tail_check (task_data, chunk);
+
+		if (task_data->tail_mismatch)
+		{
+			/* Not returned, the whole content is loaded again. */
+			g_set_error_literal (error,
+					     G_IO_ERROR,
+					     G_IO_ERROR_FAILED,
+					     "The file has been rewritten.");
+			return FALSE;
+		}
+
+		if (content == NULL)
+		{
+			return TRUE;
+		}
+	}
+	else
+	{
+		content = g_bytes_ref (chunk);
+	}
+
+	task_data->end_offset += g_bytes_get_size (content);
+	update_tail (task_data->tail, content);
 
-	content = _gtef_file_content_loader_get_content (task_data->content_loader);
+	if (task_data->decoder == NULL)
+	{
+		launch_decoder (task);
+	}
 
-	for (l = content->head; l != NULL; l = l->next)
+	if (decoder_push_raw (task_data->decoder, content, &input_length))
 	{
-		GBytes *chunk = l->data;
+		_gtef_file_content_loader_pause (task_data->content_loader);
+	}
 
-		g_assert (chunk != NULL);
-		g_assert (g_bytes_get_size (chunk) > 0);
+	priv->max_input_length = MAX (priv->max_input_length, input_length);
 
-		uchardet_handle_data (ud,
-				      g_bytes_get_data (chunk, NULL),
-				      g_bytes_get_size (chunk));
-	}
+	return TRUE;
+}
 
-	uchardet_data_end (ud);
+/* Called in the main thread, when the worker thread has consumed enough raw
+ * chunks after a pause of the reading.
+ */
+static gboolean
+input_drained_cb (gpointer user_data)
+{
+	GTask *task = G_TASK (user_data);
+	TaskData *task_data;
 
-	/* reset() must have been called before launching the task. */
-	g_assert (priv->detected_encoding == NULL);
+	task_data = g_task_get_task_data (task);
 
-	charset = uchardet_get_charset (ud);
-	if (charset != NULL && charset[0] != '\0')
+	/* The call can come from a previous Decoder, when the content is read
+	 * again. The reading must stay paused if the current Decoder input
+	 * queue is full.
+	 */
+	if (task_data->content_loader != NULL &&
+	    (task_data->decoder == NULL ||
+	     !decoder_is_input_paused (task_data->decoder)))
 	{
-		priv->detected_encoding = gtef_encoding_new (charset);
+		_gtef_file_content_loader_resume (task_data->content_loader);
 	}
 
-	uchardet_delete (ud);
+	return G_SOURCE_REMOVE;
+}
 
-	if (priv->detected_encoding == NULL)
-	{
-		g_task_return_new_error (task,
-					 GTEF_FILE_LOADER_ERROR,
-					 GTEF_FILE_LOADER_ERROR_ENCODING_AUTO_DETECTION_FAILED,
-					 _("It is not possible to detect the character encoding automatically."));
-		return;
-	}
+static void
+read_progress_cb (goffset  current_num_bytes,
+		  goffset  total_num_bytes,
+		  gpointer user_data)
+{
+	TaskData *task_data = user_data;
 
-	convert_and_insert_content (task);
+	/* Progress is reported when the content is inserted. */
+	task_data->total_size = total_num_bytes;
 }
 
 static void
@@ -1002,24 +3837,53 @@ load_content_cb (GObject      *source_object,
 
 	_gtef_file_content_loader_load_finish (content_loader, result, &error);
 
+	/* The file has been rewritten, or it has been truncated after the
+	 * check of its size.
+	 */
+	if (task_data->appending &&
+	    (task_data->tail_mismatch ||
+	     (error == NULL && task_data->tail_check != NULL)))
+	{
+		g_clear_error (&error);
+		restart_full_load (task);
+		return;
+	}
+
+	if (error != NULL &&
+	    g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_MOUNTED) &&
+	    !task_data->tried_mount &&
+	    task_data->decoder == NULL)
+	{
+		recover_not_mounted (task);
+		g_error_free (error);
+		return;
+	}
+
+	task_data->reading_done = TRUE;
+
 	if (error != NULL)
 	{
-		if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_MOUNTED) &&
-		    !task_data->tried_mount)
-		{
-			recover_not_mounted (task);
-			g_error_free (error);
-		}
-		else
+		set_error (task, error);
+	}
+	else
+	{
+		/* Even for an empty file, the decoder determines the
+		 * encoding.
+		 */
+		if (task_data->decoder == NULL)
 		{
-			g_task_return_error (task, error);
+			launch_decoder (task);
 		}
+
+		decoder_end_input (task_data->decoder);
 	}
-	else
+
+	if (task_data->decoder == NULL)
 	{
-		/* Finished reading, next operation. */
-		determine_encoding (task);
+		task_data->decoder_done = TRUE;
 	}
+
+	check_completion (task);
 }
 
 static void
@@ -1037,22 +3901,93 @@ load_content (GTask *task)
 	g_clear_object (&task_data->content_loader);
 	task_data->content_loader = _gtef_file_content_loader_new_from_file (priv->location);
 
+	g_clear_pointer (&task_data->content_hash, (GDestroyNotify)_gtef_content_hash_free);
+
+	if (!task_data->appending &&
+	    priv->file != NULL &&
+	    gtef_file_get_compute_checksum (priv->file))
+	{
+		task_data->content_hash = _gtef_content_hash_new ();
+	}
+
+	_gtef_file_content_loader_set_chunk_callback (task_data->content_loader,
+						      content_chunk_cb,
+						      task);
+
 	_gtef_file_content_loader_set_max_size (task_data->content_loader,
 						priv->max_size);
 
-	_gtef_file_content_loader_set_chunk_size (task_data->content_loader,
-						  priv->chunk_size);
+	if (priv->chunk_size_set)
+	{
+		_gtef_file_content_loader_set_chunk_size (task_data->content_loader,
+							  priv->chunk_size);
+	}
+
+	if (task_data->appending)
+	{
+		FollowState *state = task_data->follow_state;
+
+		_gtef_file_content_loader_set_start_offset (task_data->content_loader,
+							    state->offset - g_bytes_get_size (state->tail));
+
+		/* A followed file, typically a log, can be truncated at any
+		 * time by a rotation. The mapped chunks are read later by the
+		 * worker thread, which would crash with SIGBUS.
+		 */
+		_gtef_file_content_loader_set_use_mmap (task_data->content_loader, FALSE);
+	}
 
 	_gtef_file_content_loader_load_async (task_data->content_loader,
 					      g_task_get_priority (task),
 					      g_task_get_cancellable (task),
-					      task_data->progress_cb,
-					      task_data->progress_cb_data,
-					      NULL, /* Call the GDestroyNotify just once. */
+					      read_progress_cb,
+					      task_data,
+					      NULL,
 					      load_content_cb,
 					      task);
 }
 
+/* With the patch-buffer mode, the buffer is kept as is, its text is compared
+ * to the new content at the end. Otherwise, or if the buffer is empty, the
+ * content is inserted Block by Block into the emptied buffer.
+ */
+static void
+prepare_buffer (GTask *task)
+{
+	GtefFileLoader *loader;
+	GtefFileLoaderPrivate *priv;
+	TaskData *task_data;
+	GtkTextIter start;
+	GtkTextIter end;
+	gchar *text;
+
+	loader = g_task_get_source_object (task);
+	priv = gtef_file_loader_get_instance_private (loader);
+
+	task_data = g_task_get_task_data (task);
+
+	g_clear_pointer (&task_data->old_text, (GDestroyNotify)g_bytes_unref);
+	task_data->patching = FALSE;
+
+	if (!priv->patch_buffer ||
+	    priv->buffer == NULL ||
+	    gtk_text_buffer_get_char_count (GTK_TEXT_BUFFER (priv->buffer)) == 0)
+	{
+		empty_buffer (loader);
+		return;
+	}
+
+	/* With the hidden text and the embedded objects, so that the character
+	 * offsets are the same as in the buffer.
+	 */
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (priv->buffer), &start, &end);
+	text = gtk_text_buffer_get_slice (GTK_TEXT_BUFFER (priv->buffer), &start, &end, TRUE);
+
+	task_data->old_text = g_bytes_new_take (text, strlen (text));
+	task_data->old_buffer_stamp = priv->buffer_stamp;
+	task_data->patching = TRUE;
+}
+
 static void
 start_loading (GTask *task)
 {
@@ -1071,8 +4006,7 @@ start_loading (GTask *task)
 	gtk_source_buffer_begin_not_undoable_action (GTK_SOURCE_BUFFER (priv->buffer));
 	gtk_text_buffer_begin_user_action (GTK_TEXT_BUFFER (priv->buffer));
 
-	empty_buffer (loader);
-
+	prepare_buffer (task);
 	load_content (task);
 }
 
@@ -1081,18 +4015,25 @@ finish_loading (GTask *task)
 {
 	GtefFileLoader *loader;
 	GtefFileLoaderPrivate *priv;
+	TaskData *task_data;
 	GtkTextIter start;
 
 	loader = g_task_get_source_object (task);
 	priv = gtef_file_loader_get_instance_private (loader);
 
+	task_data = g_task_get_task_data (task);
+
 	if (priv->buffer == NULL)
 	{
 		return;
 	}
 
-	gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (priv->buffer), &start);
-	gtk_text_buffer_place_cursor (GTK_TEXT_BUFFER (priv->buffer), &start);
+	if (!task_data->appending &&
+	    !task_data->patching)
+	{
+		gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (priv->buffer), &start);
+		gtk_text_buffer_place_cursor (GTK_TEXT_BUFFER (priv->buffer), &start);
+	}
 
 	gtk_text_buffer_end_user_action (GTK_TEXT_BUFFER (priv->buffer));
 	gtk_source_buffer_end_not_undoable_action (GTK_SOURCE_BUFFER (priv->buffer));
@@ -1109,6 +4050,205 @@ reset (GtefFileLoader *loader)
 	priv->detected_encoding = NULL;
 
 	priv->detected_newline_type = GTEF_NEWLINE_TYPE_DEFAULT;
+	priv->detected_compression_type = GTEF_COMPRESSION_TYPE_NONE;
+	priv->encoding_detection_method = GTEF_ENCODING_DETECTION_METHOD_NONE;
+	memset (priv->newline_counts, 0, sizeof (priv->newline_counts));
+	priv->max_input_length = 0;
+}
+
+static void
+read_cached_encoding (GtefFileLoader *loader,
+		      TaskData       *task_data)
+{
+	GtefFileLoaderPrivate *priv = gtef_file_loader_get_instance_private (loader);
+	GtefFileMetadata *metadata;
+	gchar *charset;
+
+	if (priv->file == NULL)
+	{
+		return;
+	}
+
+	metadata = gtef_file_get_file_metadata (priv->file);
+
+	charset = gtef_file_metadata_get (metadata, METADATA_KEY_ENCODING);
+	task_data->cached_validity_key = gtef_file_metadata_get (metadata, METADATA_KEY_VALIDITY_KEY);
+
+	if (charset != NULL &&
+	    charset[0] != '\0' &&
+	    task_data->cached_validity_key != NULL)
+	{
+		task_data->cached_encoding = gtef_encoding_new (charset);
+	}
+
+	g_free (charset);
+}
+
+static void
+write_cached_encoding (GtefFileLoader *loader,
+		       TaskData       *task_data)
+{
+	GtefFileLoaderPrivate *priv = gtef_file_loader_get_instance_private (loader);
+	GtefFileMetadata *metadata;
+
+	g_assert (priv->file != NULL);
+
+	metadata = gtef_file_get_file_metadata (priv->file);
+
+	/* Without validity key, the values could not be trusted. */
+	if (task_data->validity_key == NULL)
+	{
+		gtef_file_metadata_set (metadata, METADATA_KEY_ENCODING, NULL);
+		gtef_file_metadata_set (metadata, METADATA_KEY_NEWLINE_TYPE, NULL);
+		gtef_file_metadata_set (metadata, METADATA_KEY_VALIDITY_KEY, NULL);
+		return;
+	}
+
+	gtef_file_metadata_set (metadata,
+				METADATA_KEY_ENCODING,
+				gtef_encoding_get_charset (priv->detected_encoding));
+
+	gtef_file_metadata_set (metadata,
+				METADATA_KEY_NEWLINE_TYPE,
+				newline_type_names[priv->detected_newline_type]);
+
+	gtef_file_metadata_set (metadata,
+				METADATA_KEY_VALIDITY_KEY,
+				task_data->validity_key);
+}
+
+/* The content appended to the file since the previous load is inserted at the
+ * end of the buffer.
+ */
+static void
+start_appending (GTask *task)
+{
+	GtefFileLoader *loader;
+	GtefFileLoaderPrivate *priv;
+	TaskData *task_data;
+	FollowState *state;
+
+	loader = g_task_get_source_object (task);
+	priv = gtef_file_loader_get_instance_private (loader);
+
+	task_data = g_task_get_task_data (task);
+	state = task_data->follow_state;
+
+	task_data->appending = TRUE;
+	task_data->end_offset = state->offset;
+	g_byte_array_append (task_data->tail,
+			     g_bytes_get_data (state->tail, NULL),
+			     g_bytes_get_size (state->tail));
+
+	if (g_bytes_get_size (state->tail) > 0)
+	{
+		task_data->tail_check = g_bytes_ref (state->tail);
+	}
+
+	gtk_source_buffer_begin_not_undoable_action (GTK_SOURCE_BUFFER (priv->buffer));
+	gtk_text_buffer_begin_user_action (GTK_TEXT_BUFFER (priv->buffer));
+
+	if (state->removed_newline != NULL)
+	{
+		GtkTextIter end;
+
+		gtk_text_buffer_get_end_iter (GTK_TEXT_BUFFER (priv->buffer), &end);
+		gtk_text_buffer_insert (GTK_TEXT_BUFFER (priv->buffer), &end, state->removed_newline, -1);
+	}
+
+	load_content (task);
+}
+
+/* Returns whether the file has only grown since the previous load, as far as
+ * can be known without reading it. The last bytes of the previous load are
+ * compared when reading.
+ */
+static gboolean
+can_append (GtefFileLoader *loader,
+	    FollowState    *state,
+	    GFileInfo      *info)
+{
+	GtefFileLoaderPrivate *priv = gtef_file_loader_get_instance_private (loader);
+	const gchar *file_id;
+
+	if (priv->buffer == NULL ||
+	    gtk_text_buffer_get_modified (GTK_TEXT_BUFFER (priv->buffer)) ||
+	    priv->buffer_stamp != state->buffer_stamp)
+	{
+		return FALSE;
+	}
+
+	/* Truncated. */
+	if (!g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_STANDARD_SIZE) ||
+	    g_file_info_get_size (info) < state->offset)
+	{
+		return FALSE;
+	}
+
+	/* Replaced by another file. */
+	file_id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
+	if (g_strcmp0 (file_id, state->file_id) != 0)
+	{
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void
+query_follow_info_cb (GObject      *source_object,
+		      GAsyncResult *result,
+		      gpointer      user_data)
+{
+	GFile *location = G_FILE (source_object);
+	GTask *task = G_TASK (user_data);
+	GtefFileLoader *loader;
+	TaskData *task_data;
+	GFileInfo *info;
+
+	loader = g_task_get_source_object (task);
+	task_data = g_task_get_task_data (task);
+
+	/* On error, e.g. if the file has been removed, the normal load
+	 * operation reports it.
+	 */
+	info = g_file_query_info_finish (location, result, NULL);
+
+	if (info != NULL &&
+	    can_append (loader, task_data->follow_state, info))
+	{
+		start_appending (task);
+	}
+	else
+	{
+		follow_state_free (task_data->follow_state);
+		task_data->follow_state = NULL;
+
+		reset (loader);
+		read_cached_encoding (loader, task_data);
+		start_loading (task);
+	}
+
+	g_clear_object (&info);
+}
+
+static void
+query_follow_info (GTask *task)
+{
+	GtefFileLoader *loader;
+	GtefFileLoaderPrivate *priv;
+
+	loader = g_task_get_source_object (task);
+	priv = gtef_file_loader_get_instance_private (loader);
+
+	g_file_query_info_async (priv->location,
+				 G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+				 G_FILE_ATTRIBUTE_ID_FILE,
+				 G_FILE_QUERY_INFO_NONE,
+				 g_task_get_priority (task),
+				 g_task_get_cancellable (task),
+				 query_follow_info_cb,
+				 task);
 }
 
 /**
@@ -1164,8 +4304,6 @@ gtef_file_loader_load_async (GtefFileLoader        *loader,
 
 	g_return_if_fail (priv->location != NULL);
 
-	reset (loader);
-
 	priv->task = g_task_new (loader, cancellable, callback, user_data);
 	g_task_set_priority (priv->task, io_priority);
 
@@ -1176,6 +4314,19 @@ gtef_file_loader_load_async (GtefFileLoader        *loader,
 	task_data->progress_cb_data = progress_callback_data;
 	task_data->progress_cb_notify = progress_callback_notify;
 
+	/* Follow mode, see if only the appended content can be read. */
+	if (priv->follow_state != NULL)
+	{
+		task_data->follow_state = priv->follow_state;
+		priv->follow_state = NULL;
+
+		query_follow_info (priv->task);
+		return;
+	}
+
+	reset (loader);
+	read_cached_encoding (loader, task_data);
+
 	start_loading (priv->task);
 }
 
@@ -1220,15 +4371,30 @@ gtef_file_loader_load_finish (GtefFileLoader  *loader,
 
 		_gtef_file_set_encoding (priv->file, priv->detected_encoding);
 		_gtef_file_set_newline_type (priv->file, priv->detected_newline_type);
-		_gtef_file_set_compression_type (priv->file, GTEF_COMPRESSION_TYPE_NONE);
+		_gtef_file_set_compression_type (priv->file, priv->detected_compression_type);
 		_gtef_file_set_externally_modified (priv->file, FALSE);
 		_gtef_file_set_deleted (priv->file, FALSE);
 
 		etag = _gtef_file_content_loader_get_etag (task_data->content_loader);
 		_gtef_file_set_etag (priv->file, etag);
 
+		if (task_data->content_hash != NULL)
+		{
+			gchar *checksum;
+
+			checksum = _gtef_content_hash_get_string (task_data->content_hash);
+			_gtef_file_set_checksum (priv->file, checksum);
+			g_free (checksum);
+		}
+		else
+		{
+			_gtef_file_set_checksum (priv->file, NULL);
+		}
+
 		readonly = _gtef_file_content_loader_get_readonly (task_data->content_loader);
 		_gtef_file_set_readonly (priv->file, readonly);
+
+		write_cached_encoding (loader, task_data);
 	}
 
 	g_clear_object (&priv->task);
@@ -1258,7 +4424,8 @@ gtef_file_loader_get_encoding (GtefFileLoader *loader)
  * gtef_file_loader_get_newline_type:
  * @loader: a #GtefFileLoader.
  *
- * Returns: the detected newline type.
+ * Returns: the detected newline type. If the content has mixed line endings,
+ * the most frequent newline type.
  * Since: 2.0
  */
 GtefNewlineType
@@ -1272,6 +4439,100 @@ gtef_file_loader_get_newline_type (GtefFileLoader *loader)
 	return priv->detected_newline_type;
 }
 
+/**
+ * gtef_file_loader_get_newline_count:
+ * @loader: a #GtefFileLoader.
+ * @newline_type: a #GtefNewlineType.
+ *
+ * Gets the number of newlines of type @newline_type in the whole content, as
+ * counted during the last successful load operation. A \r\n is counted only
+ * as %GTEF_NEWLINE_TYPE_CR_LF.
+ *
+ * If more than one newline type has a non-zero count, the file has mixed line
+ * endings. gtef_file_loader_get_newline_type() returns the most frequent
+ * newline type.
+ *
+ * Returns: the number of newlines of type @newline_type.
+ * Since: 2.0
+ */
+guint64
+gtef_file_loader_get_newline_count (GtefFileLoader  *loader,
+				    GtefNewlineType  newline_type)
+{
+	GtefFileLoaderPrivate *priv;
+
+	g_return_val_if_fail (GTEF_IS_FILE_LOADER (loader), 0);
+	g_return_val_if_fail (newline_type == GTEF_NEWLINE_TYPE_LF ||
+			      newline_type == GTEF_NEWLINE_TYPE_CR ||
+			      newline_type == GTEF_NEWLINE_TYPE_CR_LF, 0);
+
+	priv = gtef_file_loader_get_instance_private (loader);
+	return priv->newline_counts[newline_type];
+}
+
+/**
+ * gtef_file_loader_get_compression_type:
+ * @loader: a #GtefFileLoader.
+ *
+ * Gets the compression type detected during the last successful load
+ * operation. A gzip-compressed file is recognized by its first bytes, not by
+ * its name, and is decompressed while it is loaded.
+ *
+ * Returns: the detected compression type.
+ * Since: 2.0
+ */
+GtefCompressionType
+gtef_file_loader_get_compression_type (GtefFileLoader *loader)
+{
+	GtefFileLoaderPrivate *priv;
+
+	g_return_val_if_fail (GTEF_IS_FILE_LOADER (loader), GTEF_COMPRESSION_TYPE_NONE);
+
+	priv = gtef_file_loader_get_instance_private (loader);
+	return priv->detected_compression_type;
+}
+
+/**
+ * gtef_file_loader_get_encoding_detection_method:
+ * @loader: a #GtefFileLoader.
+ *
+ * Gets which stage of the encoding detection has taken the decision during the
+ * last successful load operation. uchardet is run only if the content has no
+ * BOM and is neither pure ASCII nor valid UTF-8.
+ *
+ * Returns: the encoding detection method.
+ * Since: 2.0
+ */
+GtefEncodingDetectionMethod
+gtef_file_loader_get_encoding_detection_method (GtefFileLoader *loader)
+{
+	GtefFileLoaderPrivate *priv;
+
+	g_return_val_if_fail (GTEF_IS_FILE_LOADER (loader), GTEF_ENCODING_DETECTION_METHOD_NONE);
+
+	priv = gtef_file_loader_get_instance_private (loader);
+	return priv->encoding_detection_method;
+}
+
+/* For the unit tests. */
+guint
+_gtef_file_loader_get_max_pending_chunks (void)
+{
+	return MAX_PENDING_CHUNKS;
+}
+
+/* For the unit tests. */
+guint
+_gtef_file_loader_get_max_input_length (GtefFileLoader *loader)
+{
+	GtefFileLoaderPrivate *priv;
+
+	g_return_val_if_fail (GTEF_IS_FILE_LOADER (loader), 0);
+
+	priv = gtef_file_loader_get_instance_private (loader);
+	return priv->max_input_length;
+}
+
 /* For the unit tests. */
 gint64
 _gtef_file_loader_get_encoding_converter_buffer_size (void)
@@ -42,6 +42,8 @@ G_DECLARE_DERIVABLE_TYPE (GtefFileLoader, gtef_file_loader,
  * @GTEF_FILE_LOADER_ERROR_TOO_BIG: The file is too big.
  * @GTEF_FILE_LOADER_ERROR_ENCODING_AUTO_DETECTION_FAILED: It is not possible to
  *   detect the encoding automatically.
+ * @GTEF_FILE_LOADER_ERROR_BINARY_CONTENT: The content is not text, or is in
+ *   UTF-32 without byte order mark. Since 2.0.
  *
  * An error code used with the %GTEF_FILE_LOADER_ERROR domain.
  *
@@ -50,9 +52,38 @@ G_DECLARE_DERIVABLE_TYPE (GtefFileLoader, gtef_file_loader,
 typedef enum _GtefFileLoaderError
 {
 	GTEF_FILE_LOADER_ERROR_TOO_BIG,
-	GTEF_FILE_LOADER_ERROR_ENCODING_AUTO_DETECTION_FAILED
+	GTEF_FILE_LOADER_ERROR_ENCODING_AUTO_DETECTION_FAILED,
+	GTEF_FILE_LOADER_ERROR_BINARY_CONTENT
 } GtefFileLoaderError;
 
+/**
+ * GtefEncodingDetectionMethod:
+ * @GTEF_ENCODING_DETECTION_METHOD_NONE: no encoding has been detected yet.
+ * @GTEF_ENCODING_DETECTION_METHOD_BOM: the content starts with a byte order
+ *   mark.
+ * @GTEF_ENCODING_DETECTION_METHOD_ASCII: the sniffed content is pure ASCII.
+ * @GTEF_ENCODING_DETECTION_METHOD_UTF8_VALIDATION: the sniffed content is
+ *   valid UTF-8 and contains non-ASCII characters.
+ * @GTEF_ENCODING_DETECTION_METHOD_UCHARDET: the encoding has been guessed by
+ *   uchardet.
+ * @GTEF_ENCODING_DETECTION_METHOD_METADATA: the detection has been skipped, the
+ *   encoding stored in the #GtefFileMetadata by a previous load is still valid.
+ *
+ * The stage of the encoding detection that has taken the decision, see
+ * gtef_file_loader_get_encoding_detection_method().
+ *
+ * Since: 2.0
+ */
+typedef enum _GtefEncodingDetectionMethod
+{
+	GTEF_ENCODING_DETECTION_METHOD_NONE,
+	GTEF_ENCODING_DETECTION_METHOD_BOM,
+	GTEF_ENCODING_DETECTION_METHOD_ASCII,
+	GTEF_ENCODING_DETECTION_METHOD_UTF8_VALIDATION,
+	GTEF_ENCODING_DETECTION_METHOD_UCHARDET,
+	GTEF_ENCODING_DETECTION_METHOD_METADATA
+} GtefEncodingDetectionMethod;
+
 struct _GtefFileLoaderClass
 {
 	GObjectClass parent_class;
@@ -81,6 +112,26 @@ gint64			gtef_file_loader_get_chunk_size				(GtefFileLoader *loader);
 void			gtef_file_loader_set_chunk_size				(GtefFileLoader *loader,
 										 gint64          chunk_size);
 
+gint64			gtef_file_loader_get_sniff_size				(GtefFileLoader *loader);
+
+void			gtef_file_loader_set_sniff_size				(GtefFileLoader *loader,
+										 gint64          sniff_size);
+
+gboolean		gtef_file_loader_get_escape_invalid_chars		(GtefFileLoader *loader);
+
+void			gtef_file_loader_set_escape_invalid_chars		(GtefFileLoader *loader,
+										 gboolean        escape_invalid_chars);
+
+gboolean		gtef_file_loader_get_follow				(GtefFileLoader *loader);
+
+void			gtef_file_loader_set_follow				(GtefFileLoader *loader,
+										 gboolean        follow);
+
+gboolean		gtef_file_loader_get_patch_buffer			(GtefFileLoader *loader);
+
+void			gtef_file_loader_set_patch_buffer			(GtefFileLoader *loader,
+										 gboolean        patch_buffer);
+
 void			gtef_file_loader_load_async				(GtefFileLoader        *loader,
 										 gint                   io_priority,
 										 GCancellable          *cancellable,
@@ -98,6 +149,20 @@ const GtefEncoding *	gtef_file_loader_get_encoding				(GtefFileLoader *loader);
 
 GtefNewlineType		gtef_file_loader_get_newline_type			(GtefFileLoader *loader);
 
+guint64			gtef_file_loader_get_newline_count			(GtefFileLoader  *loader,
+										 GtefNewlineType  newline_type);
+
+GtefCompressionType	gtef_file_loader_get_compression_type			(GtefFileLoader *loader);
+
+GtefEncodingDetectionMethod
+			gtef_file_loader_get_encoding_detection_method		(GtefFileLoader *loader);
+
+G_GNUC_INTERNAL
+guint			_gtef_file_loader_get_max_pending_chunks		(void);
+
+G_GNUC_INTERNAL
+guint			_gtef_file_loader_get_max_input_length			(GtefFileLoader *loader);
+
 G_GNUC_INTERNAL
 gint64			_gtef_file_loader_get_encoding_converter_buffer_size	(void);
 
@@ -0,0 +1,1607 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "gtef-file-pager.h"
+#include <string.h>
+#include <glib/gi18n-lib.h>
+#include "gtef-encoding.h"
+#include "gtef-encoding-converter.h"
+#include "gtef-file.h"
+#include "gtef-line-index.h"
+#include "gtef-utf16-converter.h"
+#include "gtef-utils.h"
+
+/**
+ * SECTION:file-pager
+ * @Short_description: Read-only paged view of a big file
+ * @Title: GtefFilePager
+ * @See_also: #GtefFileLoader
+ *
+ * The #GtefFileLoader loads the whole content in the #GtefBuffer, so it
+ * refuses files bigger than #GtefFileLoader:max-size. A #GtefFilePager permits
+ * instead to view a file of any size, for example a log file of several
+ * gigabytes, with a bounded memory usage.
+ *
+ * gtef_file_pager_open_async() reads the whole file once in a worker thread,
+ * to build a sparse index of the line offsets. Then only a window of
+ * #GtefFilePager:window-size lines is loaded in the #GtkTextBuffer of the
+ * #GtefView. When the view is scrolled near the start or the end of the
+ * window, an adjacent window is loaded, also in a worker thread. To jump to a
+ * line anywhere in the file, call gtef_file_pager_goto_line(), or
+ * gtef_view_goto_line() which uses the #GtefFilePager attached to the view.
+ *
+ * The line numbers of the #GtkTextBuffer are relative to the window, add
+ * gtef_file_pager_get_window_start() to have the line numbers in the file.
+ *
+ * The view is made non-editable. The content must be in an ASCII-compatible
+ * encoding: the #GtefFile:encoding if already known, or UTF-8 otherwise. The
+ * invalid bytes are escaped with their hexadecimal value, like with
+ * #GtefFileLoader:escape-invalid-chars. Compressed files are not supported.
+ */
+
+/* One offset stored every INDEX_INTERVAL lines. */
+#define INDEX_INTERVAL 1024
+
+#define READ_CHUNK_SIZE (64 * 1024)
+
+/* For the rare files with very long lines, the window has less lines. The
+ * lines at the start of the window are then dropped if needed, so that the
+ * window contains the anchor line.
+ */
+#define MAX_WINDOW_BYTES (16 * 1024 * 1024)
+
+#define DEFAULT_WINDOW_SIZE 10000
+#define MIN_WINDOW_SIZE 100
+
+typedef struct _GtefFilePagerPrivate GtefFilePagerPrivate;
+typedef struct _IndexData IndexData;
+typedef struct _WindowData WindowData;
+
+struct _GtefFilePagerPrivate
+{
+	/* Weak refs */
+	GtefView *view;
+	GtefFile *file;
+
+	GFile *location;
+
+	/* NULL for UTF-8. */
+	gchar *charset;
+
+	/* NULL until the file is opened. */
+	GtefLineIndex *index;
+
+	GCancellable *cancellable;
+	GTask *open_task;
+
+	GtkAdjustment *vadjustment;
+	gulong vadjustment_value_changed_handler_id;
+	guint check_scroll_idle_id;
+
+	/* The window currently in the buffer. */
+	gint64 window_start;
+	gint64 window_n_lines;
+
+	gint window_size;
+	gsize max_window_bytes;
+
+	/* The window to load when the current load is done. */
+	WindowData *next_window;
+
+	guint window_loading : 1;
+};
+
+/* Accessed by the worker thread. */
+struct _IndexData
+{
+	GFile *location;
+	GtefLineIndex *index;
+};
+
+/* Accessed by the worker thread, until the task is done. */
+struct _WindowData
+{
+	GFile *location;
+	gchar *charset;
+
+	guint64 checkpoint_line;
+	guint64 checkpoint_offset;
+	guint64 start_line;
+	guint64 n_lines;
+	gsize max_bytes;
+
+	/* The line to show, counting from the start of the file. */
+	guint64 anchor_line;
+	guint place_cursor : 1;
+
+	/* Results */
+	gchar *text;
+	guint64 n_lines_read;
+};
+
+enum
+{
+	PROP_0,
+	PROP_VIEW,
+	PROP_FILE,
+	PROP_WINDOW_SIZE,
+	PROP_N_LINES,
+	PROP_WINDOW_START,
+	N_PROPERTIES
+};
+
+static GParamSpec *properties[N_PROPERTIES];
+
+G_DEFINE_TYPE_WITH_PRIVATE (GtefFilePager, gtef_file_pager, G_TYPE_OBJECT)
+
+static void check_scroll (GtefFilePager *pager);
+
+static void
+index_data_free (gpointer data)
+{
+	IndexData *index_data = data;
+
+	if (index_data != NULL)
+	{
+		g_object_unref (index_data->location);
+		_gtef_line_index_free (index_data->index);
+		g_free (index_data);
+	}
+}
+
+static void
+window_data_free (WindowData *window_data)
+{
+	if (window_data != NULL)
+	{
+		g_clear_object (&window_data->location);
+		g_free (window_data->charset);
+		g_free (window_data->text);
+		g_free (window_data);
+	}
+}
+
+static void
+vadjustment_value_changed_cb (GtkAdjustment *vadjustment,
+			      GtefFilePager *pager)
+{
+	check_scroll (pager);
+}
+
+static void
+set_vadjustment (GtefFilePager *pager,
+		 GtkAdjustment *vadjustment)
+{
+	GtefFilePagerPrivate *priv = gtef_file_pager_get_instance_private (pager);
+
+	if (priv->vadjustment == vadjustment)
+	{
+		return;
+	}
+
+	if (priv->vadjustment != NULL)
+	{
+		g_signal_handler_disconnect (priv->vadjustment,
+					     priv->vadjustment_value_changed_handler_id);
+		priv->vadjustment_value_changed_handler_id = 0;
+		g_clear_object (&priv->vadjustment);
+	}
+
+	if (vadjustment != NULL)
+	{
+		priv->vadjustment = g_object_ref (vadjustment);
+		priv->vadjustment_value_changed_handler_id =
+			g_signal_connect (vadjustment,
+					  "value-changed",
+					  G_CALLBACK (vadjustment_value_changed_cb),
+					  pager);
+	}
+}
+
+static void
+vadjustment_notify_cb (GtkScrollable *view,
+		       GParamSpec    *pspec,
+		       GtefFilePager *pager)
+{
+	set_vadjustment (pager, gtk_scrollable_get_vadjustment (view));
+}
+
+static void
+set_view (GtefFilePager *pager,
+	  GtefView      *view)
+{
+	GtefFilePagerPrivate *priv = gtef_file_pager_get_instance_private (pager);
+
+	g_return_if_fail (GTEF_IS_VIEW (view));
+
+	g_assert (priv->view == NULL);
+	priv->view = view;
+
+	g_object_add_weak_pointer (G_OBJECT (priv->view),
+				   (gpointer *) &priv->view);
+
+	gtk_text_view_set_editable (GTK_TEXT_VIEW (view), FALSE);
+	_gtef_view_set_file_pager (view, pager);
+
+	g_signal_connect_object (view,
+				 "notify::vadjustment",
+				 G_CALLBACK (vadjustment_notify_cb),
+				 pager,
+				 0);
+
+	set_vadjustment (pager, gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (view)));
+}
+
+static void
+gtef_file_pager_get_property (GObject    *object,
+			      guint       prop_id,
+			      GValue     *value,
+			      GParamSpec *pspec)
+{
+	GtefFilePager *pager = GTEF_FILE_PAGER (object);
+
+	switch (prop_id)
+	{
+		case PROP_VIEW:
+			g_value_set_object (value, gtef_file_pager_get_view (pager));
+			break;
+
+		case PROP_FILE:
+			g_value_set_object (value, gtef_file_pager_get_file (pager));
+			break;
+
+		case PROP_WINDOW_SIZE:
+			g_value_set_int (value, gtef_file_pager_get_window_size (pager));
+			break;
+
+		case PROP_N_LINES:
+			g_value_set_int64 (value, gtef_file_pager_get_n_lines (pager));
+			break;
+
+		case PROP_WINDOW_START:
+			g_value_set_int64 (value, gtef_file_pager_get_window_start (pager));
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+			break;
+	}
+}
+
+static void
+gtef_file_pager_set_property (GObject      *object,
+			      guint         prop_id,
+			      const GValue *value,
+			      GParamSpec   *pspec)
+{
+	GtefFilePager *pager = GTEF_FILE_PAGER (object);
+	GtefFilePagerPrivate *priv = gtef_file_pager_get_instance_private (pager);
+
+	switch (prop_id)
+	{
+		case PROP_VIEW:
+			set_view (pager, g_value_get_object (value));
+			break;
+
+		case PROP_FILE:
+			g_assert (priv->file == NULL);
+			priv->file = g_value_get_object (value);
+			g_object_add_weak_pointer (G_OBJECT (priv->file),
+						   (gpointer *) &priv->file);
+			break;
+
+		case PROP_WINDOW_SIZE:
+			gtef_file_pager_set_window_size (pager, g_value_get_int (value));
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+			break;
+	}
+}
+
+static void
+gtef_file_pager_dispose (GObject *object)
+{
+	GtefFilePager *pager = GTEF_FILE_PAGER (object);
+	GtefFilePagerPrivate *priv = gtef_file_pager_get_instance_private (pager);
+
+	set_vadjustment (pager, NULL);
+
+	if (priv->check_scroll_idle_id != 0)
+	{
+		g_source_remove (priv->check_scroll_idle_id);
+		priv->check_scroll_idle_id = 0;
+	}
+
+	if (priv->cancellable != NULL)
+	{
+		g_cancellable_cancel (priv->cancellable);
+		g_clear_object (&priv->cancellable);
+	}
+
+	if (priv->view != NULL)
+	{
+		if (_gtef_view_get_file_pager (priv->view) == pager)
+		{
+			_gtef_view_set_file_pager (priv->view, NULL);
+		}
+
+		g_object_remove_weak_pointer (G_OBJECT (priv->view),
+					      (gpointer *) &priv->view);
+		priv->view = NULL;
+	}
+
+	if (priv->file != NULL)
+	{
+		g_object_remove_weak_pointer (G_OBJECT (priv->file),
+					      (gpointer *) &priv->file);
+		priv->file = NULL;
+	}
+
+	g_clear_object (&priv->location);
+	g_clear_object (&priv->open_task);
+
+	G_OBJECT_CLASS (gtef_file_pager_parent_class)->dispose (object);
+}
+
+static void
+gtef_file_pager_finalize (GObject *object)
+{
+	GtefFilePagerPrivate *priv = gtef_file_pager_get_instance_private (GTEF_FILE_PAGER (object));
+
+	g_free (priv->charset);
+	_gtef_line_index_free (priv->index);
+	window_data_free (priv->next_window);
+
+	G_OBJECT_CLASS (gtef_file_pager_parent_class)->finalize (object);
+}
+
+static void
+gtef_file_pager_class_init (GtefFilePagerClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+	object_class->get_property = gtef_file_pager_get_property;
+	object_class->set_property = gtef_file_pager_set_property;
+	object_class->dispose = gtef_file_pager_dispose;
+	object_class->finalize = gtef_file_pager_finalize;
+
+	/**
+	 * GtefFilePager:view:
+	 *
+	 * The #GtefView to show the content in. The #GtefFilePager object has
+	 * a weak reference to the view.
+	 *
+	 * Since: 2.0
+	 */
+	properties[PROP_VIEW] =
+		g_param_spec_object ("view",
+				     "GtefView",
+				     "",
+				     GTEF_TYPE_VIEW,
+				     G_PARAM_READWRITE |
+				     G_PARAM_CONSTRUCT_ONLY |
+				     G_PARAM_STATIC_STRINGS);
+
+	/**
+	 * GtefFilePager:file:
+	 *
+	 * The #GtefFile. The #GtefFilePager object has a weak reference to the
+	 * file.
+	 *
+	 * Since: 2.0
+	 */
+	properties[PROP_FILE] =
+		g_param_spec_object ("file",
+				     "GtefFile",
+				     "",
+				     GTEF_TYPE_FILE,
+				     G_PARAM_READWRITE |
+				     G_PARAM_CONSTRUCT_ONLY |
+				     G_PARAM_STATIC_STRINGS);
+
+	/**
+	 * GtefFilePager:window-size:
+	 *
+	 * The number of lines loaded in the buffer. Windows with very long
+	 * lines can have less lines, a window is never bigger than 16 MB.
+	 *
+	 * Since: 2.0
+	 */
+	properties[PROP_WINDOW_SIZE] =
+		g_param_spec_int ("window-size",
+				  "Window Size",
+				  "",
+				  MIN_WINDOW_SIZE,
+				  G_MAXINT,
+				  DEFAULT_WINDOW_SIZE,
+				  G_PARAM_READWRITE |
+				  G_PARAM_CONSTRUCT |
+				  G_PARAM_STATIC_STRINGS);
+
+	/**
+	 * GtefFilePager:n-lines:
+	 *
+	 * The number of lines of the file, or -1 if the file is not yet
+	 * opened.
+	 *
+	 * Since: 2.0
+	 */
+	properties[PROP_N_LINES] =
+		g_param_spec_int64 ("n-lines",
+				    "Number of Lines",
+				    "",
+				    -1,
+				    G_MAXINT64,
+				    -1,
+				    G_PARAM_READABLE |
+				    G_PARAM_STATIC_STRINGS);
+
+	/**
+	 * GtefFilePager:window-start:
+	 *
+	 * The line of the file, counting from 0, which is the first line of
+	 * the buffer.
+	 *
+	 * Since: 2.0
+	 */
+	properties[PROP_WINDOW_START] =
+		g_param_spec_int64 ("window-start",
+				    "Window Start",
+				    "",
+				    0,
+				    G_MAXINT64,
+				    0,
+				    G_PARAM_READABLE |
+				    G_PARAM_STATIC_STRINGS);
+
+	g_object_class_install_properties (object_class, N_PROPERTIES, properties);
+}
+
+static void
+gtef_file_pager_init (GtefFilePager *pager)
+{
+	GtefFilePagerPrivate *priv = gtef_file_pager_get_instance_private (pager);
+
+	priv->cancellable = g_cancellable_new ();
+	priv->max_window_bytes = MAX_WINDOW_BYTES;
+}
+
+/**
+ * gtef_file_pager_new:
+ * @view: the #GtefView to show the content in.
+ * @file: the #GtefFile.
+ *
+ * Creates a new #GtefFilePager and attaches it to @view. The
+ * #GtefFile:location must be set.
+ *
+ * Returns: a new #GtefFilePager object.
+ * Since: 2.0
+ */
+GtefFilePager *
+gtef_file_pager_new (GtefView *view,
+		     GtefFile *file)
+{
+	g_return_val_if_fail (GTEF_IS_VIEW (view), NULL);
+	g_return_val_if_fail (GTEF_IS_FILE (file), NULL);
+
+	return g_object_new (GTEF_TYPE_FILE_PAGER,
+			     "view", view,
+			     "file", file,
+			     NULL);
+}
+
+/**
+ * gtef_file_pager_get_view:
+ * @pager: a #GtefFilePager.
+ *
+ * Returns: (transfer none) (nullable): the #GtefView.
+ * Since: 2.0
+ */
+GtefView *
+gtef_file_pager_get_view (GtefFilePager *pager)
+{
+	GtefFilePagerPrivate *priv;
+
+	g_return_val_if_fail (GTEF_IS_FILE_PAGER (pager), NULL);
+
+	priv = gtef_file_pager_get_instance_private (pager);
+	return priv->view;
+}
+
+/**
+ * gtef_file_pager_get_file:
+ * @pager: a #GtefFilePager.
+ *
+ * Returns: (transfer none) (nullable): the #GtefFile.
+ * Since: 2.0
+ */
+GtefFile *
+gtef_file_pager_get_file (GtefFilePager *pager)
+{
+	GtefFilePagerPrivate *priv;
+
+	g_return_val_if_fail (GTEF_IS_FILE_PAGER (pager), NULL);
+
+	priv = gtef_file_pager_get_instance_private (pager);
+	return priv->file;
+}
+
+/**
+ * gtef_file_pager_get_window_size:
+ * @pager: a #GtefFilePager.
+ *
+ * Returns: the value of the #GtefFilePager:window-size property.
+ * Since: 2.0
+ */
+gint
+gtef_file_pager_get_window_size (GtefFilePager *pager)
+{
+	GtefFilePagerPrivate *priv;
+
+	g_return_val_if_fail (GTEF_IS_FILE_PAGER (pager), DEFAULT_WINDOW_SIZE);
+
+	priv = gtef_file_pager_get_instance_private (pager);
+	return priv->window_size;
+}
+
+/**
+ * gtef_file_pager_set_window_size:
+ * @pager: a #GtefFilePager.
+ * @window_size: the new value.
+ *
+ * Sets the #GtefFilePager:window-size property. The new value is used for the
+ * next window loaded.
+ *
+ * Since: 2.0
+ */
+void
+gtef_file_pager_set_window_size (GtefFilePager *pager,
+				 gint           window_size)
+{
+	GtefFilePagerPrivate *priv;
+
+	g_return_if_fail (GTEF_IS_FILE_PAGER (pager));
+	g_return_if_fail (window_size >= MIN_WINDOW_SIZE);
+
+	priv = gtef_file_pager_get_instance_private (pager);
+
+	if (priv->window_size != window_size)
+	{
+		priv->window_size = window_size;
+		g_object_notify_by_pspec (G_OBJECT (pager), properties[PROP_WINDOW_SIZE]);
+	}
+}
+
+/*
+ * _gtef_file_pager_set_max_window_bytes:
+ * @pager: a #GtefFilePager.
+ * @max_window_bytes: the maximum size of a window, in bytes.
+ *
+ * For the unit tests, to have truncated windows with small files.
+ */
+void
+_gtef_file_pager_set_max_window_bytes (GtefFilePager *pager,
+				       gsize          max_window_bytes)
+{
+	GtefFilePagerPrivate *priv;
+
+	g_return_if_fail (GTEF_IS_FILE_PAGER (pager));
+	g_return_if_fail (max_window_bytes > 0);
+
+	priv = gtef_file_pager_get_instance_private (pager);
+	priv->max_window_bytes = max_window_bytes;
+}
+
+/**
+ * gtef_file_pager_get_n_lines:
+ * @pager: a #GtefFilePager.
+ *
+ * Returns: the value of the #GtefFilePager:n-lines property.
+ * Since: 2.0
+ */
+gint64
+gtef_file_pager_get_n_lines (GtefFilePager *pager)
+{
+	GtefFilePagerPrivate *priv;
+
+	g_return_val_if_fail (GTEF_IS_FILE_PAGER (pager), -1);
+
+	priv = gtef_file_pager_get_instance_private (pager);
+
+	if (priv->index == NULL)
+	{
+		return -1;
+	}
+
+	return _gtef_line_index_get_n_lines (priv->index);
+}
+
+/**
+ * gtef_file_pager_get_window_start:
+ * @pager: a #GtefFilePager.
+ *
+ * Returns: the value of the #GtefFilePager:window-start property.
+ * Since: 2.0
+ */
+gint64
+gtef_file_pager_get_window_start (GtefFilePager *pager)
+{
+	GtefFilePagerPrivate *priv;
+
+	g_return_val_if_fail (GTEF_IS_FILE_PAGER (pager), 0);
+
+	priv = gtef_file_pager_get_instance_private (pager);
+	return priv->window_start;
+}
+
+/* Window loading */
+
+static void
+append_escaped_bytes (GString     *string,
+		      const gchar *bytes,
+		      gsize        length)
+{
+	gsize i;
+
+	for (i = 0; i < length; i++)
+	{
+		g_string_append_printf (string, "\\%02X", (guchar) bytes[i]);
+	}
+}
+
+static void
+append_utf8 (GString     *string,
+	     const gchar *str,
+	     gsize        length)
+{
+	const gchar *p = str;
+	const gchar *end = str + length;
+
+	while (p < end)
+	{
+		const gchar *valid_end;
+		gboolean partial_char;
+
+		if (_gtef_utils_utf8_validate (p, end - p, &valid_end, &partial_char))
+		{
+			g_string_append_len (string, p, end - p);
+			break;
+		}
+
+		g_string_append_len (string, p, valid_end - p);
+
+		if (partial_char)
+		{
+			append_escaped_bytes (string, valid_end, end - valid_end);
+			break;
+		}
+
+		append_escaped_bytes (string, valid_end, 1);
+		p = valid_end + 1;
+	}
+}
+
+static void
+content_converted_cb (const gchar *str,
+		      gsize        length,
+		      gpointer     user_data)
+{
+	g_string_append_len (user_data, str, length);
+}
+
+static void
+invalid_sequence_cb (const gchar *bytes,
+		     gsize        length,
+		     gpointer     user_data)
+{
+	append_escaped_bytes (user_data, bytes, length);
+}
+
+/* Returns the content converted to UTF-8. */
+static gchar *
+decode_window (const gchar  *charset,
+	       const gchar  *content,
+	       gsize         length,
+	       GError      **error)
+{
+	GString *text;
+	GtefEncodingConverter *converter;
+	gboolean ok;
+
+	text = g_string_sized_new (length + 1);
+
+	if (charset == NULL)
+	{
+		append_utf8 (text, content, length);
+		return g_string_free (text, FALSE);
+	}
+
+	converter = _gtef_encoding_converter_new (-1);
+	_gtef_encoding_converter_set_callback (converter, content_converted_cb, text);
+	_gtef_encoding_converter_set_invalid_sequence_callback (converter, invalid_sequence_cb, text);
+
+	ok = (_gtef_encoding_converter_open (converter, "UTF-8", charset, error) &&
+	      _gtef_encoding_converter_feed (converter, content, length, error));
+
+	/* A window truncated in the middle of a line can end with an
+	 * incomplete character.
+	 */
+	if (ok)
+	{
+		_gtef_encoding_converter_close (converter, NULL);
+	}
+
+	g_object_unref (converter);
+
+	if (!ok)
+	{
+		g_string_free (text, TRUE);
+		return NULL;
+	}
+
+	return g_string_free (text, FALSE);
+}
+
+static void
+strip_trailing_newline (GByteArray *bytes)
+{
+	if (bytes->len > 0 && bytes->data[bytes->len - 1] == '\n')
+	{
+		g_byte_array_set_size (bytes, bytes->len - 1);
+
+		if (bytes->len > 0 && bytes->data[bytes->len - 1] == '\r')
+		{
+			g_byte_array_set_size (bytes, bytes->len - 1);
+		}
+	}
+}
+
+/* Removes the first complete lines of @bytes, at least @min_length bytes if
+ * there are enough complete lines. Returns the number of lines removed.
+ */
+static guint64
+remove_first_lines (GByteArray *bytes,
+		    gsize       min_length)
+{
+	const guint8 *end = bytes->data + bytes->len;
+	gsize length = 0;
+	guint64 n_lines = 0;
+
+	while (length < min_length)
+	{
+		const guint8 *newline;
+
+		newline = memchr (bytes->data + length, '\n', end - (bytes->data + length));
+		if (newline == NULL)
+		{
+			break;
+		}
+
+		length = newline + 1 - bytes->data;
+		n_lines++;
+	}
+
+	g_byte_array_remove_range (bytes, 0, length);
+	return n_lines;
+}
+
+/* Reads the window lines. The lines before the window, since the checkpoint,
+ * are skipped. If the window is truncated before the anchor line, the start
+ * of the window is moved forward.
+ */
+static gboolean
+read_window (WindowData    *window_data,
+	     GByteArray    *bytes,
+	     GCancellable  *cancellable,
+	     GError       **error)
+{
+	GFileInputStream *stream;
+	gchar *buffer;
+	guint64 n_lines_to_skip;
+	guint64 n_lines_read = 0;
+	gboolean window_complete = FALSE;
+	gboolean truncated = FALSE;
+	gboolean ok = TRUE;
+
+	stream = g_file_read (window_data->location, cancellable, error);
+	if (stream == NULL)
+	{
+		return FALSE;
+	}
+
+	if (window_data->checkpoint_offset > 0 &&
+	    !g_seekable_seek (G_SEEKABLE (stream),
+			      window_data->checkpoint_offset,
+			      G_SEEK_SET,
+			      cancellable,
+			      error))
+	{
+		g_object_unref (stream);
+		return FALSE;
+	}
+
+	buffer = g_malloc (READ_CHUNK_SIZE);
+	n_lines_to_skip = window_data->start_line - window_data->checkpoint_line;
+
+	while (!window_complete && !truncated)
+	{
+		gssize n_bytes_read;
+		const gchar *p;
+		const gchar *end;
+
+		n_bytes_read = g_input_stream_read (G_INPUT_STREAM (stream),
+						    buffer,
+						    READ_CHUNK_SIZE,
+						    cancellable,
+						    error);
+		if (n_bytes_read < 0)
+		{
+			ok = FALSE;
+			break;
+		}
+
+		/* End of file. */
+		if (n_bytes_read == 0)
+		{
+			break;
+		}
+
+		p = buffer;
+		end = buffer + n_bytes_read;
+
+		while (n_lines_to_skip > 0 && p < end)
+		{
+			const gchar *newline;
+
+			newline = memchr (p, '\n', end - p);
+			if (newline == NULL)
+			{
+				p = end;
+				break;
+			}
+
+			p = newline + 1;
+			n_lines_to_skip--;
+		}
+
+		while (p < end)
+		{
+			const gchar *newline;
+
+			newline = memchr (p, '\n', end - p);
+			if (newline == NULL)
+			{
+				g_byte_array_append (bytes, (const guint8 *) p, end - p);
+				break;
+			}
+
+			g_byte_array_append (bytes, (const guint8 *) p, newline + 1 - p);
+			p = newline + 1;
+			n_lines_read++;
+
+			if (n_lines_read == window_data->n_lines)
+			{
+				window_complete = TRUE;
+				break;
+			}
+		}
+
+		if (bytes->len >= window_data->max_bytes &&
+		    window_data->start_line + n_lines_read <= window_data->anchor_line)
+		{
+			guint64 n_lines_removed;
+
+			/* The anchor line is not yet complete, all the complete
+			 * lines are before it. Keep the second half.
+			 */
+			n_lines_removed = remove_first_lines (bytes, bytes->len - window_data->max_bytes / 2);
+			window_data->start_line += n_lines_removed;
+			n_lines_read -= n_lines_removed;
+		}
+
+		truncated = bytes->len >= window_data->max_bytes;
+	}
+
+	g_free (buffer);
+	g_object_unref (stream);
+
+	if (!ok)
+	{
+		return FALSE;
+	}
+
+	if (window_complete)
+	{
+		/* The newline of the last line would create an additional
+		 * empty line in the buffer.
+		 */
+		strip_trailing_newline (bytes);
+		window_data->n_lines_read = n_lines_read;
+	}
+	else if (truncated && n_lines_read > 0)
+	{
+		guint length = bytes->len;
+
+		/* Keep only the complete lines. */
+		while (bytes->data[length - 1] != '\n')
+		{
+			length--;
+		}
+
+		g_byte_array_set_size (bytes, length);
+		strip_trailing_newline (bytes);
+		window_data->n_lines_read = n_lines_read;
+	}
+	else if (truncated)
+	{
+		/* A single line bigger than the maximum, show only its
+		 * start.
+		 */
+		g_byte_array_set_size (bytes, window_data->max_bytes);
+		window_data->n_lines_read = 1;
+	}
+	else
+	{
+		/* End of file, the last line doesn't end with a newline (it
+		 * can be empty).
+		 */
+		window_data->n_lines_read = n_lines_read + 1;
+	}
+
+	return TRUE;
+}
+
+static void
+load_window_thread (GTask        *window_task,
+		    gpointer      source_object,
+		    gpointer      task_data,
+		    GCancellable *cancellable)
+{
+	WindowData *window_data = task_data;
+	GByteArray *bytes;
+	GError *error = NULL;
+
+	bytes = g_byte_array_new ();
+
+	if (!read_window (window_data, bytes, cancellable, &error))
+	{
+		g_task_return_error (window_task, error);
+		g_byte_array_unref (bytes);
+		return;
+	}
+
+	window_data->text = decode_window (window_data->charset,
+					   (const gchar *) bytes->data,
+					   bytes->len,
+					   &error);
+
+	g_byte_array_unref (bytes);
+
+	if (error != NULL)
+	{
+		g_task_return_error (window_task, error);
+		return;
+	}
+
+	g_task_return_boolean (window_task, TRUE);
+}
+
+static void
+show_anchor_line (GtefFilePager *pager,
+		  WindowData    *window_data)
+{
+	GtefFilePagerPrivate *priv = gtef_file_pager_get_instance_private (pager);
+	GtkTextBuffer *buffer;
+	GtkTextIter iter;
+	gint line;
+
+	buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (priv->view));
+
+	line = window_data->anchor_line - priv->window_start;
+	gtk_text_buffer_get_iter_at_line (buffer, &iter, line);
+
+	if (window_data->place_cursor)
+	{
+		gtk_text_buffer_place_cursor (buffer, &iter);
+		gtef_view_scroll_to_cursor (priv->view);
+	}
+	else
+	{
+		GtkTextMark *mark;
+
+		/* Keep the same line at the top, so that the scrolling is
+		 * seamless.
+		 */
+		mark = gtk_text_buffer_create_mark (buffer, NULL, &iter, TRUE);
+		gtk_text_view_scroll_to_mark (GTK_TEXT_VIEW (priv->view),
+					      mark,
+					      0.0,
+					      TRUE,
+					      0.0,
+					      0.0);
+		gtk_text_buffer_delete_mark (buffer, mark);
+	}
+}
+
+static void
+apply_window (GtefFilePager *pager,
+	      WindowData    *window_data)
+{
+	GtefFilePagerPrivate *priv = gtef_file_pager_get_instance_private (pager);
+	GtkTextBuffer *buffer;
+
+	if (priv->view == NULL)
+	{
+		return;
+	}
+
+	buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (priv->view));
+
+	gtk_source_buffer_begin_not_undoable_action (GTK_SOURCE_BUFFER (buffer));
+	gtk_text_buffer_set_text (buffer, window_data->text, -1);
+	gtk_source_buffer_end_not_undoable_action (GTK_SOURCE_BUFFER (buffer));
+	gtk_text_buffer_set_modified (buffer, FALSE);
+
+	priv->window_n_lines = window_data->n_lines_read;
+
+	if (priv->window_start != (gint64) window_data->start_line)
+	{
+		priv->window_start = window_data->start_line;
+		g_object_notify_by_pspec (G_OBJECT (pager), properties[PROP_WINDOW_START]);
+	}
+
+	show_anchor_line (pager, window_data);
+}
+
+static void launch_window_load (GtefFilePager *pager,
+				WindowData    *window_data);
+
+static void
+window_loaded_cb (GObject      *source_object,
+		  GAsyncResult *result,
+		  gpointer      user_data)
+{
+	GtefFilePager *pager = GTEF_FILE_PAGER (user_data);
+	GtefFilePagerPrivate *priv = gtef_file_pager_get_instance_private (pager);
+	GTask *window_task = G_TASK (result);
+	GError *error = NULL;
+
+	if (!g_task_propagate_boolean (window_task, &error))
+	{
+		if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+		{
+			g_error_free (error);
+		}
+		else if (priv->open_task != NULL)
+		{
+			g_task_return_error (priv->open_task, error);
+			g_clear_object (&priv->open_task);
+		}
+		else
+		{
+			g_warning ("GtefFilePager: failed to load a window: %s", error->message);
+			g_error_free (error);
+		}
+
+		goto out;
+	}
+
+	/* A more recent window is requested, this one is already outdated. */
+	if (priv->next_window != NULL && priv->open_task == NULL)
+	{
+		goto out;
+	}
+
+	apply_window (pager, g_task_get_task_data (window_task));
+
+	if (priv->open_task != NULL)
+	{
+		g_task_return_boolean (priv->open_task, TRUE);
+		g_clear_object (&priv->open_task);
+	}
+
+out:
+	priv->window_loading = FALSE;
+
+	if (priv->next_window != NULL &&
+	    !g_cancellable_is_cancelled (g_task_get_cancellable (window_task)))
+	{
+		WindowData *next_window = priv->next_window;
+
+		priv->next_window = NULL;
+		launch_window_load (pager, next_window);
+	}
+
+	g_object_unref (pager);
+}
+
+/* Takes ownership of @window_data. */
+static void
+launch_window_load (GtefFilePager *pager,
+		    WindowData    *window_data)
+{
+	GtefFilePagerPrivate *priv = gtef_file_pager_get_instance_private (pager);
+	GTask *window_task;
+
+	if (priv->window_loading)
+	{
+		window_data_free (priv->next_window);
+		priv->next_window = window_data;
+		return;
+	}
+
+	priv->window_loading = TRUE;
+
+	/* No source object: the last unref of the window task can happen in
+	 * the worker thread, and the GtefFilePager must be finalized in the
+	 * main thread.
+	 */
+	window_task = g_task_new (NULL,
+				  priv->cancellable,
+				  window_loaded_cb,
+				  g_object_ref (pager));
+
+	g_task_set_task_data (window_task,
+			      window_data,
+			      (GDestroyNotify) window_data_free);
+
+	g_task_run_in_thread (window_task, load_window_thread);
+	g_object_unref (window_task);
+}
+
+static gint64
+get_window_start_for_line (GtefFilePager *pager,
+			   gint64         line)
+{
+	GtefFilePagerPrivate *priv = gtef_file_pager_get_instance_private (pager);
+	gint64 n_lines;
+	gint64 window_n_lines;
+	gint64 window_start;
+
+	n_lines = _gtef_line_index_get_n_lines (priv->index);
+
+	/* With long lines, the windows are truncated, the number of lines of
+	 * the current window is then a better estimate.
+	 */
+	window_n_lines = priv->window_size;
+	if (priv->window_n_lines > 0)
+	{
+		window_n_lines = MIN (window_n_lines, priv->window_n_lines);
+	}
+
+	/* @line in the middle of the window. */
+	window_start = line - window_n_lines / 2;
+	window_start = MIN (window_start, n_lines - window_n_lines);
+	window_start = MAX (window_start, 0);
+
+	return window_start;
+}
+
+static void
+request_window (GtefFilePager *pager,
+		gint64         window_start,
+		gint64         anchor_line,
+		gboolean       place_cursor)
+{
+	GtefFilePagerPrivate *priv = gtef_file_pager_get_instance_private (pager);
+	WindowData *window_data;
+	guint64 n_lines;
+
+	g_assert (priv->index != NULL);
+
+	n_lines = _gtef_line_index_get_n_lines (priv->index);
+
+	window_data = g_new0 (WindowData, 1);
+	window_data->location = g_object_ref (priv->location);
+	window_data->charset = g_strdup (priv->charset);
+	window_data->start_line = window_start;
+	window_data->n_lines = MIN ((guint64) priv->window_size, n_lines - window_start);
+	window_data->max_bytes = priv->max_window_bytes;
+	window_data->anchor_line = anchor_line;
+	window_data->place_cursor = place_cursor != FALSE;
+
+	if (!_gtef_line_index_lookup (priv->index,
+				      window_start,
+				      &window_data->checkpoint_line,
+				      &window_data->checkpoint_offset))
+	{
+		g_assert_not_reached ();
+	}
+
+	launch_window_load (pager, window_data);
+}
+
+/* Scrolling */
+
+static gboolean
+check_scroll_idle_cb (gpointer user_data)
+{
+	GtefFilePager *pager = GTEF_FILE_PAGER (user_data);
+	GtefFilePagerPrivate *priv = gtef_file_pager_get_instance_private (pager);
+	GdkRectangle visible_rect;
+	GtkTextIter top_iter;
+	GtkTextIter bottom_iter;
+	gint64 top_line;
+	gint64 bottom_line;
+	gint64 margin;
+	gint64 n_lines;
+	gboolean near_window_start;
+	gboolean near_window_end;
+
+	priv->check_scroll_idle_id = 0;
+
+	/* Without being mapped, the view is not scrolled by the user. */
+	if (priv->view == NULL ||
+	    priv->index == NULL ||
+	    priv->window_loading ||
+	    !gtk_widget_get_mapped (GTK_WIDGET (priv->view)))
+	{
+		return G_SOURCE_REMOVE;
+	}
+
+	gtk_text_view_get_visible_rect (GTK_TEXT_VIEW (priv->view), &visible_rect);
+	gtk_text_view_get_line_at_y (GTK_TEXT_VIEW (priv->view),
+				     &top_iter,
+				     visible_rect.y,
+				     NULL);
+	gtk_text_view_get_line_at_y (GTK_TEXT_VIEW (priv->view),
+				     &bottom_iter,
+				     visible_rect.y + visible_rect.height,
+				     NULL);
+
+	top_line = gtk_text_iter_get_line (&top_iter);
+	bottom_line = gtk_text_iter_get_line (&bottom_iter);
+
+	n_lines = _gtef_line_index_get_n_lines (priv->index);
+	margin = priv->window_n_lines / 4;
+
+	near_window_start = (top_line < margin &&
+			     priv->window_start > 0);
+
+	near_window_end = (bottom_line >= priv->window_n_lines - margin &&
+			   priv->window_start + priv->window_n_lines < n_lines);
+
+	if (near_window_start || near_window_end)
+	{
+		gint64 anchor_line;
+		gint64 window_start;
+
+		anchor_line = priv->window_start + top_line;
+		window_start = get_window_start_for_line (pager, anchor_line);
+
+		/* Make progress even if the estimate is wrong. */
+		if (near_window_end && !near_window_start)
+		{
+			window_start = MAX (window_start, priv->window_start + 1);
+			anchor_line = MAX (anchor_line, window_start);
+		}
+		else if (near_window_start && !near_window_end)
+		{
+			window_start = MIN (window_start, priv->window_start - 1);
+		}
+
+		if (window_start != priv->window_start)
+		{
+			request_window (pager, window_start, anchor_line, FALSE);
+		}
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+check_scroll (GtefFilePager *pager)
+{
+	GtefFilePagerPrivate *priv = gtef_file_pager_get_instance_private (pager);
+
+	/* With a low priority, to have the scrolling done by the GtkTextView
+	 * validation, in particular after a new window is applied.
+	 */
+	if (priv->check_scroll_idle_id == 0 &&
+	    priv->index != NULL)
+	{
+		priv->check_scroll_idle_id = g_idle_add_full (G_PRIORITY_LOW,
+							      check_scroll_idle_cb,
+							      pager,
+							      NULL);
+	}
+}
+
+/* Opening */
+
+static gchar *
+get_charset (GtefFilePager  *pager,
+	     GError        **error)
+{
+	GtefFilePagerPrivate *priv = gtef_file_pager_get_instance_private (pager);
+	const GtefEncoding *encoding;
+	const gchar *charset;
+	gboolean big_endian;
+	gboolean with_bom;
+
+	if (priv->file == NULL)
+	{
+		return NULL;
+	}
+
+	encoding = gtef_file_get_encoding (priv->file);
+	if (encoding == NULL || gtef_encoding_is_utf8 (encoding))
+	{
+		return NULL;
+	}
+
+	charset = gtef_encoding_get_charset (encoding);
+
+	/* The line index works only for ASCII-compatible encodings. */
+	if (_gtef_utf16_charset_get_byte_order (charset, &big_endian, &with_bom) ||
+	    g_ascii_strncasecmp (charset, "UTF-32", 6) == 0 ||
+	    g_ascii_strncasecmp (charset, "UCS-", 4) == 0)
+	{
+		g_set_error (error,
+			     G_IO_ERROR,
+			     G_IO_ERROR_NOT_SUPPORTED,
+			     _("The character encoding “%s” is not supported to view a file by pages."),
+			     charset);
+		return NULL;
+	}
+
+	return g_strdup (charset);
+}
+
+static void
+build_index_thread (GTask        *index_task,
+		    gpointer      source_object,
+		    gpointer      task_data,
+		    GCancellable *cancellable)
+{
+	IndexData *index_data = task_data;
+	GFileInputStream *stream;
+	gchar *buffer;
+	GError *error = NULL;
+
+	stream = g_file_read (index_data->location, cancellable, &error);
+	if (stream == NULL)
+	{
+		g_task_return_error (index_task, error);
+		return;
+	}
+
+	buffer = g_malloc (READ_CHUNK_SIZE);
+
+	while (TRUE)
+	{
+		gssize n_bytes_read;
+
+		n_bytes_read = g_input_stream_read (G_INPUT_STREAM (stream),
+						    buffer,
+						    READ_CHUNK_SIZE,
+						    cancellable,
+						    &error);
+		if (n_bytes_read <= 0)
+		{
+			break;
+		}
+
+		_gtef_line_index_add_chunk (index_data->index, buffer, n_bytes_read);
+	}
+
+	g_free (buffer);
+	g_object_unref (stream);
+
+	if (error != NULL)
+	{
+		g_task_return_error (index_task, error);
+		return;
+	}
+
+	g_task_return_boolean (index_task, TRUE);
+}
+
+static void
+index_built_cb (GObject      *source_object,
+		GAsyncResult *result,
+		gpointer      user_data)
+{
+	GtefFilePager *pager = GTEF_FILE_PAGER (user_data);
+	GtefFilePagerPrivate *priv = gtef_file_pager_get_instance_private (pager);
+	GTask *index_task = G_TASK (result);
+	IndexData *index_data;
+	GError *error = NULL;
+
+	if (!g_task_propagate_boolean (index_task, &error))
+	{
+		if (priv->open_task != NULL)
+		{
+			g_task_return_error (priv->open_task, error);
+			g_clear_object (&priv->open_task);
+		}
+		else
+		{
+			g_error_free (error);
+		}
+
+		g_object_unref (pager);
+		return;
+	}
+
+	index_data = g_task_get_task_data (index_task);
+
+	_gtef_line_index_free (priv->index);
+	priv->index = index_data->index;
+	index_data->index = NULL;
+
+	g_object_notify_by_pspec (G_OBJECT (pager), properties[PROP_N_LINES]);
+
+	request_window (pager, 0, 0, TRUE);
+
+	g_object_unref (pager);
+}
+
+/**
+ * gtef_file_pager_open_async:
+ * @pager: a #GtefFilePager.
+ * @io_priority: the I/O priority of the request. E.g. %G_PRIORITY_LOW,
+ *   %G_PRIORITY_DEFAULT or %G_PRIORITY_HIGH.
+ * @cancellable: (nullable): optional #GCancellable object, %NULL to ignore.
+ * @callback: (scope async): a #GAsyncReadyCallback to call when the request is
+ *   satisfied.
+ * @user_data: user data to pass to @callback.
+ *
+ * Builds the line index of the file in a worker thread, and then loads the
+ * first window in the buffer. The operation is finished when the first window
+ * is loaded.
+ *
+ * See the #GAsyncResult documentation to know how to use this function.
+ *
+ * Since: 2.0
+ */
+void
+gtef_file_pager_open_async (GtefFilePager       *pager,
+			    gint                 io_priority,
+			    GCancellable        *cancellable,
+			    GAsyncReadyCallback  callback,
+			    gpointer             user_data)
+{
+	GtefFilePagerPrivate *priv;
+	GTask *index_task;
+	IndexData *index_data;
+	GError *error = NULL;
+
+	g_return_if_fail (GTEF_IS_FILE_PAGER (pager));
+	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+	priv = gtef_file_pager_get_instance_private (pager);
+
+	g_return_if_fail (priv->open_task == NULL);
+	g_return_if_fail (priv->file != NULL);
+	g_return_if_fail (gtef_file_get_location (priv->file) != NULL);
+
+	priv->open_task = g_task_new (pager, cancellable, callback, user_data);
+	g_task_set_priority (priv->open_task, io_priority);
+
+	g_free (priv->charset);
+	priv->charset = get_charset (pager, &error);
+
+	if (error != NULL)
+	{
+		g_task_return_error (priv->open_task, error);
+		g_clear_object (&priv->open_task);
+		return;
+	}
+
+	g_clear_object (&priv->location);
+	priv->location = g_object_ref (gtef_file_get_location (priv->file));
+
+	index_data = g_new0 (IndexData, 1);
+	index_data->location = g_object_ref (priv->location);
+	index_data->index = _gtef_line_index_new (INDEX_INTERVAL);
+
+	/* No source object: the last unref of the index task can happen in the
+	 * worker thread.
+	 */
+	index_task = g_task_new (NULL,
+				 cancellable != NULL ? cancellable : priv->cancellable,
+				 index_built_cb,
+				 g_object_ref (pager));
+
+	g_task_set_priority (index_task, io_priority);
+	g_task_set_task_data (index_task, index_data, index_data_free);
+	g_task_run_in_thread (index_task, build_index_thread);
+	g_object_unref (index_task);
+}
+
+/**
+ * gtef_file_pager_open_finish:
+ * @pager: a #GtefFilePager.
+ * @result: a #GAsyncResult.
+ * @error: a #GError, or %NULL.
+ *
+ * Finishes a file opening started with gtef_file_pager_open_async().
+ *
+ * Returns: whether the file was opened successfully.
+ * Since: 2.0
+ */
+gboolean
+gtef_file_pager_open_finish (GtefFilePager  *pager,
+			     GAsyncResult   *result,
+			     GError        **error)
+{
+	g_return_val_if_fail (GTEF_IS_FILE_PAGER (pager), FALSE);
+	g_return_val_if_fail (g_task_is_valid (result, pager), FALSE);
+
+	return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+/**
+ * gtef_file_pager_goto_line:
+ * @pager: a #GtefFilePager.
+ * @line: a line number of the file, counting from 0.
+ *
+ * Places the cursor at the start of @line, and scrolls to that position. If
+ * @line is not in the current window, the window around @line is first
+ * loaded, asynchronously. If @line doesn't exist, the last line is used.
+ *
+ * Returns: %TRUE if @line exists, %FALSE otherwise or if the file is not yet
+ *   opened.
+ * Since: 2.0
+ */
+gboolean
+gtef_file_pager_goto_line (GtefFilePager *pager,
+			   gint64         line)
+{
+	GtefFilePagerPrivate *priv;
+	gint64 n_lines;
+	gboolean line_exists;
+	WindowData window_data = { 0 };
+
+	g_return_val_if_fail (GTEF_IS_FILE_PAGER (pager), FALSE);
+	g_return_val_if_fail (line >= 0, FALSE);
+
+	priv = gtef_file_pager_get_instance_private (pager);
+
+	if (priv->index == NULL || priv->view == NULL)
+	{
+		return FALSE;
+	}
+
+	n_lines = _gtef_line_index_get_n_lines (priv->index);
+	line_exists = line < n_lines;
+	line = MIN (line, n_lines - 1);
+
+	if (!priv->window_loading &&
+	    line >= priv->window_start &&
+	    line < priv->window_start + priv->window_n_lines)
+	{
+		window_data.anchor_line = line;
+		window_data.place_cursor = TRUE;
+		show_anchor_line (pager, &window_data);
+	}
+	else
+	{
+		request_window (pager,
+				get_window_start_for_line (pager, line),
+				line,
+				TRUE);
+	}
+
+	return line_exists;
+}
@@ -0,0 +1,80 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GTEF_FILE_PAGER_H
+#define GTEF_FILE_PAGER_H
+
+#if !defined (GTEF_H_INSIDE) && !defined (GTEF_COMPILATION)
+#error "Only <gtef/gtef.h> can be included directly."
+#endif
+
+#include <gio/gio.h>
+#include <gtef/gtef-types.h>
+#include <gtef/gtef-view.h>
+
+G_BEGIN_DECLS
+
+#define GTEF_TYPE_FILE_PAGER (gtef_file_pager_get_type ())
+G_DECLARE_DERIVABLE_TYPE (GtefFilePager, gtef_file_pager,
+			  GTEF, FILE_PAGER,
+			  GObject)
+
+struct _GtefFilePagerClass
+{
+	GObjectClass parent_class;
+
+	gpointer padding[12];
+};
+
+GtefFilePager *		gtef_file_pager_new				(GtefView *view,
+									 GtefFile *file);
+
+GtefView *		gtef_file_pager_get_view			(GtefFilePager *pager);
+
+GtefFile *		gtef_file_pager_get_file			(GtefFilePager *pager);
+
+gint			gtef_file_pager_get_window_size			(GtefFilePager *pager);
+
+void			gtef_file_pager_set_window_size			(GtefFilePager *pager,
+									 gint           window_size);
+
+void			gtef_file_pager_open_async			(GtefFilePager       *pager,
+									 gint                 io_priority,
+									 GCancellable        *cancellable,
+									 GAsyncReadyCallback  callback,
+									 gpointer             user_data);
+
+gboolean		gtef_file_pager_open_finish			(GtefFilePager  *pager,
+									 GAsyncResult   *result,
+									 GError        **error);
+
+gint64			gtef_file_pager_get_n_lines			(GtefFilePager *pager);
+
+gint64			gtef_file_pager_get_window_start		(GtefFilePager *pager);
+
+gboolean		gtef_file_pager_goto_line			(GtefFilePager *pager,
+									 gint64         line);
+
+G_GNUC_INTERNAL
+void			_gtef_file_pager_set_max_window_bytes		(GtefFilePager *pager,
+									 gsize          max_window_bytes);
+
+G_END_DECLS
+
+#endif /* GTEF_FILE_PAGER_H */
@@ -22,12 +22,16 @@
 
 #include "config.h"
 #include "gtef-file-saver.h"
+#include <string.h>
 #include <glib/gi18n-lib.h>
 #include "gtef-file.h"
 #include "gtef-buffer-input-stream.h"
 #include "gtef-buffer.h"
+#include "gtef-checksum-converter.h"
+#include "gtef-content-hash.h"
 #include "gtef-encoding.h"
 #include "gtef-enum-types.h"
+#include "gtef-utf16-converter.h"
 
 /**
  * SECTION:file-saver
@@ -41,6 +45,21 @@
  * handling. If an error occurs, you can reconfigure the saver and relaunch the
  * operation with gtef_file_saver_save_async().
  *
+ * By default the content is read from the #GtefBuffer while it is written, so
+ * the buffer must not be modified until the end of the save operation. With
+ * %GTEF_FILE_SAVER_FLAGS_SNAPSHOT, the content is copied when the operation
+ * starts, and the encoding conversion, the compression and the writing are
+ * done in a worker thread, so the user can continue to edit the buffer. In
+ * that case the buffer is set as unmodified at the end only if it has not
+ * changed in the meantime.
+ *
+ * If #GtefFile:compute-checksum is %TRUE, a checksum of the bytes written is
+ * computed and stored in the #GtefFile, like when loading the file. With
+ * %GTEF_FILE_SAVER_FLAGS_SKIP_IF_UNCHANGED, the content is encoded in memory
+ * first, and the file is not written if its content on disk is already the
+ * same. This avoids changing the modification time of the file, which matters
+ * for example for build tools watching the files.
+ *
  * #GtefFileSaver is a fork of #GtkSourceFileSaver, the code has been a little
  * improved (but no major changes). See the description of #GtefFile for more
  * background on why a fork was needed.
@@ -58,7 +77,21 @@
 #define DEBUG(x)
 #endif
 
-#define WRITE_CHUNK_SIZE 8192
+/* The content is written by chunks, with two buffers: one buffer is filled
+ * from the GtefBufferInputStream while the other is written asynchronously.
+ * The chunk size starts small and grows while the writes are fast, and shrinks
+ * if a write is slow (e.g. on a slow network mount), to still report progress
+ * and react to cancellation regularly.
+ */
+#define N_WRITE_BUFFERS 2
+#define MIN_WRITE_CHUNK_SIZE (8 * 1024)
+#define MAX_WRITE_CHUNK_SIZE (1024 * 1024)
+#define MAX_REMOTE_WRITE_CHUNK_SIZE (256 * 1024)
+#define FAST_WRITE_DURATION (20 * G_TIME_SPAN_MILLISECOND)
+#define SLOW_WRITE_DURATION (200 * G_TIME_SPAN_MILLISECOND)
+
+/* Size of the chunks of a snapshot, see GTEF_FILE_SAVER_FLAGS_SNAPSHOT. */
+#define SNAPSHOT_CHUNK_SIZE (1024 * 1024)
 
 enum
 {
@@ -96,6 +129,24 @@ struct _GtefFileSaverPrivate
 	GTask *task;
 };
 
+typedef struct _WriteBuffer WriteBuffer;
+struct _WriteBuffer
+{
+	gchar *data;
+	gsize allocated_size;
+
+	/* Number of bytes read from the input stream, and number of those
+	 * bytes already written to the output stream.
+	 */
+	gsize length;
+	gsize written;
+
+	/* Position of the input stream after filling the buffer, in
+	 * characters, for reporting progress.
+	 */
+	gsize n_chars;
+};
+
 typedef struct _TaskData TaskData;
 struct _TaskData
 {
@@ -111,6 +162,13 @@ struct _TaskData
 	GtefBufferInputStream *input_stream;
 	GOutputStream *output_stream;
 
+	/* Computes the checksum of the bytes written to the
+	 * file_output_stream, it is at the bottom of the output_stream. Only
+	 * with GtefFile:compute-checksum, and if the snapshot is not already
+	 * encoded.
+	 */
+	GtefChecksumConverter *checksum_converter;
+
 	goffset total_size;
 	GFileProgressCallback progress_cb;
 	gpointer progress_cb_data;
@@ -122,16 +180,100 @@ struct _TaskData
 	 */
 	GError *error;
 
-	gssize chunk_bytes_read;
-	gssize chunk_bytes_written;
-	gchar chunk_buffer[WRITE_CHUNK_SIZE];
+	/* With GTEF_FILE_SAVER_FLAGS_SNAPSHOT: the content to write, already
+	 * read from the input stream, as a list of GBytes*. The input_stream
+	 * is then NULL.
+	 */
+	GPtrArray *snapshot;
+	goffset snapshot_size;
+
+	/* With GTEF_FILE_SAVER_FLAGS_SKIP_IF_UNCHANGED: the checksum of the
+	 * encoded content, and the etag of the file on disk if the content
+	 * is the same.
+	 */
+	gchar *encoded_checksum;
+	gchar *unchanged_etag;
+
+	WriteBuffer buffers[N_WRITE_BUFFERS];
+
+	/* The buffer being written. */
+	guint current_buffer;
+
+	gsize chunk_size;
+	gsize max_chunk_size;
+	gint64 write_start_time;
 
 	guint tried_mount : 1;
+	guint reading_done : 1;
+
+	/* Whether the snapshot is already encoded and compressed, with
+	 * GTEF_FILE_SAVER_FLAGS_SKIP_IF_UNCHANGED.
+	 */
+	guint snapshot_encoded : 1;
+
+	/* Whether the writing has been skipped because the file on disk has
+	 * already the same content, and in that case whether it is read-only.
+	 */
+	guint skipped : 1;
+	guint unchanged_readonly : 1;
+
+	/* With a snapshot, whether the buffer has changed since the snapshot
+	 * was taken.
+	 */
+	guint buffer_changed : 1;
+};
+
+/* Data of the worker thread writing a snapshot. */
+typedef struct _SnapshotWriter SnapshotWriter;
+struct _SnapshotWriter
+{
+	/* The saver task, kept alive by the user_data of the writer task
+	 * callback. Must be used only in the main thread.
+	 */
+	GTask *saver_task;
+	GMainContext *main_context;
+
+	GPtrArray *snapshot;
+	GOutputStream *output_stream;
+};
+
+typedef struct _SnapshotProgress SnapshotProgress;
+struct _SnapshotProgress
+{
+	GTask *saver_task;
+	goffset n_bytes_written;
+};
+
+/* Data of the worker thread encoding a snapshot, with
+ * GTEF_FILE_SAVER_FLAGS_SKIP_IF_UNCHANGED.
+ */
+typedef struct _SnapshotEncoder SnapshotEncoder;
+struct _SnapshotEncoder
+{
+	GPtrArray *snapshot;
+
+	/* The output_stream contains the memory_stream, plus the required
+	 * converter(s) for the encoding and the compression type.
+	 */
+	GOutputStream *memory_stream;
+	GOutputStream *output_stream;
+
+	GFile *location;
+
+	/* The checksum of the file on disk, if known. */
+	gchar *file_checksum;
+
+	/* Results, to take in the main thread. */
+	GBytes *encoded;
+	gchar *encoded_checksum;
+	gchar *unchanged_etag;
+	guint unchanged : 1;
+	guint unchanged_readonly : 1;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (GtefFileSaver, gtef_file_saver, G_TYPE_OBJECT)
 
-static void read_file_chunk (GTask *task);
+static void write_buffer (GTask *task);
 static void write_file_chunk (GTask *task);
 static void recover_not_mounted (GTask *task);
 
@@ -145,6 +287,7 @@ static void
 task_data_free (gpointer data)
 {
 	TaskData *task_data = data;
+	guint i;
 
 	if (task_data == NULL)
 	{
@@ -154,7 +297,20 @@ task_data_free (gpointer data)
 	g_clear_object (&task_data->file_output_stream);
 	g_clear_object (&task_data->input_stream);
 	g_clear_object (&task_data->output_stream);
+	g_clear_object (&task_data->checksum_converter);
 	g_clear_error (&task_data->error);
+	g_free (task_data->encoded_checksum);
+	g_free (task_data->unchanged_etag);
+
+	for (i = 0; i < N_WRITE_BUFFERS; i++)
+	{
+		g_free (task_data->buffers[i].data);
+	}
+
+	if (task_data->snapshot != NULL)
+	{
+		g_ptr_array_unref (task_data->snapshot);
+	}
 
 	if (task_data->progress_cb_notify != NULL)
 	{
@@ -628,6 +784,98 @@ write_complete (GTask *task)
 				     task);
 }
 
+static WriteBuffer *
+get_current_buffer (TaskData *task_data)
+{
+	return &task_data->buffers[task_data->current_buffer];
+}
+
+static WriteBuffer *
+get_next_buffer (TaskData *task_data)
+{
+	return &task_data->buffers[(task_data->current_buffer + 1) % N_WRITE_BUFFERS];
+}
+
+/* Grows the chunk size while the writes are fast, shrinks it if they are
+ * slow.
+ */
+static void
+adapt_chunk_size (TaskData *task_data,
+		  gint64    write_duration)
+{
+	if (write_duration < FAST_WRITE_DURATION)
+	{
+		task_data->chunk_size = MIN (task_data->chunk_size * 2,
+					     task_data->max_chunk_size);
+	}
+	else if (write_duration > SLOW_WRITE_DURATION)
+	{
+		task_data->chunk_size = MAX (task_data->chunk_size / 2,
+					     MIN_WRITE_CHUNK_SIZE);
+	}
+
+	DEBUG ({
+	       g_print ("Chunk size: %" G_GSIZE_FORMAT "\n", task_data->chunk_size);
+	});
+}
+
+/* Returns FALSE on error, with task_data->error set. */
+static gboolean
+fill_buffer (GTask       *task,
+	     WriteBuffer *buffer)
+{
+	TaskData *task_data;
+	gssize bytes_read;
+	GError *error = NULL;
+
+	DEBUG ({
+	       g_print ("%s\n", G_STRFUNC);
+	});
+
+	task_data = g_task_get_task_data (task);
+
+	buffer->length = 0;
+	buffer->written = 0;
+
+	if (task_data->reading_done)
+	{
+		return TRUE;
+	}
+
+	if (buffer->allocated_size < task_data->chunk_size)
+	{
+		g_free (buffer->data);
+		buffer->data = g_malloc (task_data->chunk_size);
+		buffer->allocated_size = task_data->chunk_size;
+	}
+
+	/* We use sync methods on doc stream since it is in memory. Using async
+	 * would be racy and we could end up with invalid iters.
+	 */
+	bytes_read = g_input_stream_read (G_INPUT_STREAM (task_data->input_stream),
+					  buffer->data,
+					  task_data->chunk_size,
+					  g_task_get_cancellable (task),
+					  &error);
+
+	if (error != NULL)
+	{
+		g_clear_error (&task_data->error);
+		task_data->error = error;
+		return FALSE;
+	}
+
+	if (bytes_read == 0)
+	{
+		task_data->reading_done = TRUE;
+	}
+
+	buffer->length = bytes_read;
+	buffer->n_chars = _gtef_buffer_input_stream_tell (task_data->input_stream);
+
+	return TRUE;
+}
+
 static void
 write_file_chunk_cb (GObject      *source_object,
 		     GAsyncResult *result,
@@ -636,6 +884,7 @@ write_file_chunk_cb (GObject      *source_object,
 	GOutputStream *output_stream = G_OUTPUT_STREAM (source_object);
 	GTask *task = G_TASK (user_data);
 	TaskData *task_data;
+	WriteBuffer *buffer;
 	gssize bytes_written;
 	GError *error = NULL;
 
@@ -644,6 +893,7 @@ write_file_chunk_cb (GObject      *source_object,
 	});
 
 	task_data = g_task_get_task_data (task);
+	buffer = get_current_buffer (task_data);
 
 	bytes_written = g_output_stream_write_finish (output_stream, result, &error);
 
@@ -663,234 +913,579 @@ write_file_chunk_cb (GObject      *source_object,
 		return;
 	}
 
-	task_data->chunk_bytes_written += bytes_written;
+	buffer->written += bytes_written;
 
 	/* Write again */
-	if (task_data->chunk_bytes_written < task_data->chunk_bytes_read)
+	if (buffer->written < buffer->length)
 	{
 		write_file_chunk (task);
 		return;
 	}
 
-	if (task_data->progress_cb != NULL)
+	/* Filling the next buffer has failed. */
+	if (task_data->error != NULL)
 	{
-		gsize total_chars_written;
+		cancel_output_stream (task);
+		return;
+	}
 
-		total_chars_written = _gtef_buffer_input_stream_tell (task_data->input_stream);
+	adapt_chunk_size (task_data, g_get_monotonic_time () - task_data->write_start_time);
 
-		task_data->progress_cb (total_chars_written,
+	if (task_data->progress_cb != NULL)
+	{
+		task_data->progress_cb (buffer->n_chars,
 					task_data->total_size,
 					task_data->progress_cb_data);
 	}
 
-	read_file_chunk (task);
+	task_data->current_buffer = (task_data->current_buffer + 1) % N_WRITE_BUFFERS;
+
+	/* Check if we finished reading and writing. */
+	if (get_current_buffer (task_data)->length == 0)
+	{
+		write_complete (task);
+		return;
+	}
+
+	write_buffer (task);
 }
 
 static void
 write_file_chunk (GTask *task)
 {
 	TaskData *task_data;
+	WriteBuffer *buffer;
 
 	DEBUG ({
 	       g_print ("%s\n", G_STRFUNC);
 	});
 
 	task_data = g_task_get_task_data (task);
+	buffer = get_current_buffer (task_data);
 
 	g_output_stream_write_async (task_data->output_stream,
-				     task_data->chunk_buffer + task_data->chunk_bytes_written,
-				     task_data->chunk_bytes_read - task_data->chunk_bytes_written,
+				     buffer->data + buffer->written,
+				     buffer->length - buffer->written,
 				     g_task_get_priority (task),
 				     g_task_get_cancellable (task),
 				     write_file_chunk_cb,
 				     task);
 }
 
+/* Writes the current buffer, and meanwhile fills the next one. */
 static void
-read_file_chunk (GTask *task)
+write_buffer (GTask *task)
 {
 	TaskData *task_data;
-	GError *error = NULL;
 
-	DEBUG ({
-	       g_print ("%s\n", G_STRFUNC);
-	});
+	task_data = g_task_get_task_data (task);
+
+	task_data->write_start_time = g_get_monotonic_time ();
+	write_file_chunk (task);
+
+	/* On error, task_data->error is handled when the write is finished. */
+	fill_buffer (task, get_next_buffer (task_data));
+}
+
+static void
+start_writing (GTask *task)
+{
+	GtefFileSaver *saver;
+	TaskData *task_data;
 
+	saver = g_task_get_source_object (task);
 	task_data = g_task_get_task_data (task);
 
-	task_data->chunk_bytes_written = 0;
+	task_data->chunk_size = MIN_WRITE_CHUNK_SIZE;
+	task_data->max_chunk_size = g_file_is_native (saver->priv->location) ?
+				    MAX_WRITE_CHUNK_SIZE :
+				    MAX_REMOTE_WRITE_CHUNK_SIZE;
 
-	/* We use sync methods on doc stream since it is in memory. Using async
-	 * would be racy and we could end up with invalid iters.
-	 */
-	task_data->chunk_bytes_read = g_input_stream_read (G_INPUT_STREAM (task_data->input_stream),
-							   task_data->chunk_buffer,
-							   WRITE_CHUNK_SIZE,
-							   g_task_get_cancellable (task),
-							   &error);
+	task_data->current_buffer = 0;
 
-	if (error != NULL)
+	if (!fill_buffer (task, get_current_buffer (task_data)))
 	{
-		g_clear_error (&task_data->error);
-		task_data->error = error;
 		cancel_output_stream (task);
 		return;
 	}
 
-	/* Check if we finished reading and writing. */
-	if (task_data->chunk_bytes_read == 0)
+	if (get_current_buffer (task_data)->length == 0)
 	{
 		write_complete (task);
 		return;
 	}
 
-	write_file_chunk (task);
+	write_buffer (task);
 }
 
 static void
-replace_file_cb (GObject      *source_object,
-		 GAsyncResult *result,
-		 gpointer      user_data)
+buffer_changed_cb (GtkTextBuffer *buffer,
+		   GTask         *task)
+{
+	TaskData *task_data;
+
+	task_data = g_task_get_task_data (task);
+	task_data->buffer_changed = TRUE;
+}
+
+/* Reads the whole input stream into task_data->snapshot, so that the buffer
+ * can be modified during the rest of the save operation. Returns FALSE if the
+ * task has returned an error.
+ */
+static gboolean
+take_snapshot (GTask *task)
 {
-	GFile *location = G_FILE (source_object);
-	GTask *task = G_TASK (user_data);
 	GtefFileSaver *saver;
 	TaskData *task_data;
-	GOutputStream *output_stream;
 	GError *error = NULL;
 
+	saver = g_task_get_source_object (task);
+	task_data = g_task_get_task_data (task);
+
 	DEBUG ({
 	       g_print ("%s\n", G_STRFUNC);
 	});
 
-	saver = g_task_get_source_object (task);
-	task_data = g_task_get_task_data (task);
-
-	g_clear_object (&task_data->file_output_stream);
-	task_data->file_output_stream = g_file_replace_finish (location, result, &error);
+	task_data->snapshot = g_ptr_array_new_with_free_func ((GDestroyNotify)g_bytes_unref);
+	task_data->snapshot_size = 0;
 
-	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_MOUNTED) &&
-	    !task_data->tried_mount)
-	{
-		recover_not_mounted (task);
-		g_error_free (error);
-		return;
-	}
-	else if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_WRONG_ETAG))
-	{
-		g_task_return_new_error (task,
-					 GTEF_FILE_SAVER_ERROR,
-					 GTEF_FILE_SAVER_ERROR_EXTERNALLY_MODIFIED,
-					 _("The file is externally modified."));
-		g_error_free (error);
-		return;
-	}
-	else if (error != NULL)
+	while (TRUE)
 	{
-		DEBUG ({
-		       g_print ("Opening file failed: %s\n", error->message);
-		});
+		gchar *chunk;
+		gssize bytes_read;
 
-		g_task_return_error (task, error);
-		return;
-	}
+		chunk = g_malloc (SNAPSHOT_CHUNK_SIZE);
 
-	if (saver->priv->compression_type == GTEF_COMPRESSION_TYPE_GZIP)
-	{
-		GZlibCompressor *compressor;
+		bytes_read = g_input_stream_read (G_INPUT_STREAM (task_data->input_stream),
+						  chunk,
+						  SNAPSHOT_CHUNK_SIZE,
+						  g_task_get_cancellable (task),
+						  &error);
 
-		DEBUG ({
-		       g_print ("Use gzip compressor\n");
-		});
+		if (bytes_read <= 0)
+		{
+			g_free (chunk);
+			break;
+		}
 
-		compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1);
+		g_ptr_array_add (task_data->snapshot,
+				 g_bytes_new_take (g_realloc (chunk, bytes_read), bytes_read));
+		task_data->snapshot_size += bytes_read;
+	}
 
-		output_stream = g_converter_output_stream_new (G_OUTPUT_STREAM (task_data->file_output_stream),
-							       G_CONVERTER (compressor));
+	g_input_stream_close (G_INPUT_STREAM (task_data->input_stream), NULL, NULL);
 
-		g_object_unref (compressor);
-	}
-	else
+	if (error != NULL)
 	{
-		output_stream = G_OUTPUT_STREAM (task_data->file_output_stream);
-		g_object_ref (output_stream);
+		g_task_return_error (task, error);
+		return FALSE;
 	}
 
-	g_return_if_fail (saver->priv->encoding != NULL);
+	/* The snapshot is now independent of the buffer. */
+	g_signal_connect_object (saver->priv->source_buffer,
+				 "changed",
+				 G_CALLBACK (buffer_changed_cb),
+				 task,
+				 0);
+
+	g_clear_object (&task_data->input_stream);
 
 	DEBUG ({
-	       g_print ("Encoding charset: %s\n",
-			gtef_encoding_get_charset (saver->priv->encoding));
+	       g_print ("Snapshot size: %" G_GOFFSET_FORMAT " bytes in %u chunks\n",
+			task_data->snapshot_size,
+			task_data->snapshot->len);
 	});
 
-	if (!gtef_encoding_is_utf8 (saver->priv->encoding))
-	{
-		GCharsetConverter *converter;
-
-		converter = g_charset_converter_new (gtef_encoding_get_charset (saver->priv->encoding),
-						     "UTF-8",
-						     &error);
-
-		if (error != NULL)
-		{
-			g_task_return_error (task, error);
-			g_object_unref (output_stream);
-			return;
-		}
+	return TRUE;
+}
 
-		g_clear_object (&task_data->output_stream);
-		task_data->output_stream = g_converter_output_stream_new (output_stream,
-									  G_CONVERTER (converter));
+static void
+snapshot_writer_free (gpointer data)
+{
+	SnapshotWriter *writer = data;
 
-		g_object_unref (converter);
-		g_object_unref (output_stream);
-	}
-	else
+	if (writer == NULL)
 	{
-		g_clear_object (&task_data->output_stream);
-		task_data->output_stream = G_OUTPUT_STREAM (output_stream);
+		return;
 	}
 
-	task_data->total_size = _gtef_buffer_input_stream_get_total_size (task_data->input_stream);
-
-	DEBUG ({
-	       g_print ("Total number of characters: %" G_GINT64_FORMAT "\n", task_data->total_size);
-	});
+	g_main_context_unref (writer->main_context);
+	g_ptr_array_unref (writer->snapshot);
+	g_object_unref (writer->output_stream);
 
-	read_file_chunk (task);
+	g_free (writer);
 }
 
 static void
-begin_write (GTask *task)
+snapshot_progress_free (gpointer data)
 {
-	GtefFileSaver *saver;
-	gboolean create_backup;
-	const gchar *etag;
+	SnapshotProgress *progress = data;
 
-	saver = g_task_get_source_object (task);
+	g_object_unref (progress->saver_task);
+	g_free (progress);
+}
 
-	create_backup = (saver->priv->flags & GTEF_FILE_SAVER_FLAGS_CREATE_BACKUP) != 0;
+/* Called in the main thread. */
+static gboolean
+snapshot_progress_cb (gpointer user_data)
+{
+	SnapshotProgress *progress = user_data;
+	TaskData *task_data;
 
-	DEBUG ({
-	       g_print ("Start replacing file contents\n");
-	       g_print ("Make backup: %s\n", create_backup ? "yes" : "no");
-	});
+	task_data = g_task_get_task_data (progress->saver_task);
 
-	if (saver->priv->flags & GTEF_FILE_SAVER_FLAGS_IGNORE_MODIFICATION_TIME)
-	{
-		etag = NULL;
-	}
-	else
+	if (task_data->progress_cb != NULL)
 	{
-		etag = _gtef_file_get_etag (saver->priv->file);
+		task_data->progress_cb (progress->n_bytes_written,
+					task_data->snapshot_size,
+					task_data->progress_cb_data);
 	}
 
-	g_file_replace_async (saver->priv->location,
-			      etag,
-			      create_backup,
-			      G_FILE_CREATE_NONE,
-			      g_task_get_priority (task),
-			      g_task_get_cancellable (task),
+	return G_SOURCE_REMOVE;
+}
+
+/* Called in the worker thread. */
+static void
+report_snapshot_progress (SnapshotWriter *writer,
+			  goffset         n_bytes_written)
+{
+	SnapshotProgress *progress;
+
+	progress = g_new0 (SnapshotProgress, 1);
+	progress->saver_task = g_object_ref (writer->saver_task);
+	progress->n_bytes_written = n_bytes_written;
+
+	g_main_context_invoke_full (writer->main_context,
+				    G_PRIORITY_DEFAULT,
+				    snapshot_progress_cb,
+				    progress,
+				    snapshot_progress_free);
+}
+
+/* Runs in a worker thread. The output stream, with the converters for the
+ * encoding and the compression, is used only by this thread until the end.
+ */
+static void
+write_snapshot_thread (GTask        *writer_task,
+		       gpointer      source_object,
+		       gpointer      task_data,
+		       GCancellable *cancellable)
+{
+	SnapshotWriter *writer = task_data;
+	goffset n_bytes_written = 0;
+	guint i;
+	GError *error = NULL;
+
+	for (i = 0; i < writer->snapshot->len; i++)
+	{
+		GBytes *chunk = g_ptr_array_index (writer->snapshot, i);
+		gconstpointer data;
+		gsize size;
+
+		data = g_bytes_get_data (chunk, &size);
+
+		if (!g_output_stream_write_all (writer->output_stream,
+						data,
+						size,
+						NULL,
+						cancellable,
+						&error))
+		{
+			break;
+		}
+
+		n_bytes_written += size;
+		report_snapshot_progress (writer, n_bytes_written);
+	}
+
+	if (error != NULL)
+	{
+		GCancellable *cancelled;
+
+		/* See the note about cancel_output_stream(). */
+		cancelled = g_cancellable_new ();
+		g_cancellable_cancel (cancelled);
+		g_output_stream_close (writer->output_stream, cancelled, NULL);
+		g_object_unref (cancelled);
+
+		g_task_return_error (writer_task, error);
+		return;
+	}
+
+	if (!g_output_stream_close (writer->output_stream, cancellable, &error))
+	{
+		g_task_return_error (writer_task, error);
+		return;
+	}
+
+	g_task_return_boolean (writer_task, TRUE);
+}
+
+static void
+write_snapshot_cb (GObject      *source_object,
+		   GAsyncResult *result,
+		   gpointer      user_data)
+{
+	GTask *task = G_TASK (user_data);
+	GError *error = NULL;
+
+	DEBUG ({
+	       g_print ("%s\n", G_STRFUNC);
+	});
+
+	if (g_task_propagate_boolean (G_TASK (result), &error))
+	{
+		g_task_return_boolean (task, TRUE);
+	}
+	else
+	{
+		g_task_return_error (task, error);
+	}
+
+	g_object_unref (task);
+}
+
+static void
+write_snapshot (GTask *task)
+{
+	TaskData *task_data;
+	SnapshotWriter *writer;
+	GTask *writer_task;
+
+	DEBUG ({
+	       g_print ("%s\n", G_STRFUNC);
+	});
+
+	task_data = g_task_get_task_data (task);
+
+	writer = g_new0 (SnapshotWriter, 1);
+	writer->saver_task = task;
+	writer->main_context = g_main_context_ref_thread_default ();
+	writer->snapshot = g_ptr_array_ref (task_data->snapshot);
+	writer->output_stream = g_object_ref (task_data->output_stream);
+
+	/* No source object: the last unref of the writer task can happen in
+	 * the worker thread, and the GtefFileSaver must be finalized in the
+	 * main thread.
+	 */
+	writer_task = g_task_new (NULL,
+				  g_task_get_cancellable (task),
+				  write_snapshot_cb,
+				  g_object_ref (task));
+
+	g_task_set_task_data (writer_task, writer, snapshot_writer_free);
+	g_task_run_in_thread (writer_task, write_snapshot_thread);
+	g_object_unref (writer_task);
+}
+
+/* Returns: (transfer full): a new output stream on top of @base_stream, with
+ * the converter(s) needed for the encoding and the compression type. %NULL on
+ * error.
+ */
+static GOutputStream *
+create_converter_stream (GtefFileSaver  *saver,
+			 GOutputStream  *base_stream,
+			 GError        **error)
+{
+	GOutputStream *output_stream;
+
+	g_return_val_if_fail (saver->priv->encoding != NULL, NULL);
+
+	if (saver->priv->compression_type == GTEF_COMPRESSION_TYPE_GZIP)
+	{
+		GZlibCompressor *compressor;
+
+		DEBUG ({
+		       g_print ("Use gzip compressor\n");
+		});
+
+		compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1);
+
+		output_stream = g_converter_output_stream_new (base_stream,
+							       G_CONVERTER (compressor));
+
+		g_object_unref (compressor);
+	}
+	else
+	{
+		output_stream = g_object_ref (base_stream);
+	}
+
+	DEBUG ({
+	       g_print ("Encoding charset: %s\n",
+			gtef_encoding_get_charset (saver->priv->encoding));
+	});
+
+	if (!gtef_encoding_is_utf8 (saver->priv->encoding))
+	{
+		const gchar *charset;
+		GConverter *converter;
+		GOutputStream *converter_stream;
+		gboolean big_endian;
+		gboolean with_bom;
+
+		charset = gtef_encoding_get_charset (saver->priv->encoding);
+
+		/* UTF-16 is converted without iconv, with the same output. */
+		if (_gtef_utf16_charset_get_byte_order (charset, &big_endian, &with_bom))
+		{
+			converter = G_CONVERTER (_gtef_utf16_converter_new (big_endian, with_bom));
+		}
+		else
+		{
+			converter = G_CONVERTER (g_charset_converter_new (charset, "UTF-8", error));
+
+			if (converter == NULL)
+			{
+				g_object_unref (output_stream);
+				return NULL;
+			}
+		}
+
+		converter_stream = g_converter_output_stream_new (output_stream, converter);
+
+		g_object_unref (converter);
+		g_object_unref (output_stream);
+
+		output_stream = converter_stream;
+	}
+
+	return output_stream;
+}
+
+static void
+replace_file_cb (GObject      *source_object,
+		 GAsyncResult *result,
+		 gpointer      user_data)
+{
+	GFile *location = G_FILE (source_object);
+	GTask *task = G_TASK (user_data);
+	GtefFileSaver *saver;
+	TaskData *task_data;
+	GOutputStream *output_stream;
+	GError *error = NULL;
+
+	DEBUG ({
+	       g_print ("%s\n", G_STRFUNC);
+	});
+
+	saver = g_task_get_source_object (task);
+	task_data = g_task_get_task_data (task);
+
+	g_clear_object (&task_data->file_output_stream);
+	task_data->file_output_stream = g_file_replace_finish (location, result, &error);
+
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_MOUNTED) &&
+	    !task_data->tried_mount)
+	{
+		recover_not_mounted (task);
+		g_error_free (error);
+		return;
+	}
+	else if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_WRONG_ETAG))
+	{
+		g_task_return_new_error (task,
+					 GTEF_FILE_SAVER_ERROR,
+					 GTEF_FILE_SAVER_ERROR_EXTERNALLY_MODIFIED,
+					 _("The file is externally modified."));
+		g_error_free (error);
+		return;
+	}
+	else if (error != NULL)
+	{
+		DEBUG ({
+		       g_print ("Opening file failed: %s\n", error->message);
+		});
+
+		g_task_return_error (task, error);
+		return;
+	}
+
+	g_return_if_fail (saver->priv->encoding != NULL);
+
+	g_clear_object (&task_data->checksum_converter);
+
+	/* The checksum is computed on the bytes written to the file, after the
+	 * encoding conversion and the compression. An encoded snapshot has
+	 * already its checksum.
+	 */
+	if (!task_data->snapshot_encoded &&
+	    gtef_file_get_compute_checksum (saver->priv->file))
+	{
+		task_data->checksum_converter = _gtef_checksum_converter_new ();
+
+		output_stream = g_converter_output_stream_new (G_OUTPUT_STREAM (task_data->file_output_stream),
+							       G_CONVERTER (task_data->checksum_converter));
+	}
+	else
+	{
+		output_stream = g_object_ref (task_data->file_output_stream);
+	}
+
+	g_clear_object (&task_data->output_stream);
+
+	if (task_data->snapshot_encoded)
+	{
+		task_data->output_stream = output_stream;
+	}
+	else
+	{
+		task_data->output_stream = create_converter_stream (saver, output_stream, &error);
+		g_object_unref (output_stream);
+
+		if (error != NULL)
+		{
+			g_task_return_error (task, error);
+			return;
+		}
+	}
+
+	if (task_data->snapshot != NULL)
+	{
+		write_snapshot (task);
+		return;
+	}
+
+	task_data->total_size = _gtef_buffer_input_stream_get_total_size (task_data->input_stream);
+
+	DEBUG ({
+	       g_print ("Total number of characters: %" G_GINT64_FORMAT "\n", task_data->total_size);
+	});
+
+	start_writing (task);
+}
+
+static void
+begin_write (GTask *task)
+{
+	GtefFileSaver *saver;
+	gboolean create_backup;
+	const gchar *etag;
+
+	saver = g_task_get_source_object (task);
+
+	create_backup = (saver->priv->flags & GTEF_FILE_SAVER_FLAGS_CREATE_BACKUP) != 0;
+
+	DEBUG ({
+	       g_print ("Start replacing file contents\n");
+	       g_print ("Make backup: %s\n", create_backup ? "yes" : "no");
+	});
+
+	if (saver->priv->flags & GTEF_FILE_SAVER_FLAGS_IGNORE_MODIFICATION_TIME)
+	{
+		etag = NULL;
+	}
+	else
+	{
+		etag = _gtef_file_get_etag (saver->priv->file);
+	}
+
+	g_file_replace_async (saver->priv->location,
+			      etag,
+			      create_backup,
+			      G_FILE_CREATE_NONE,
+			      g_task_get_priority (task),
+			      g_task_get_cancellable (task),
 			      replace_file_cb,
 			      task);
 }
@@ -955,6 +1550,334 @@ recover_not_mounted (GTask *task)
 	g_object_unref (mount_operation);
 }
 
+static void
+snapshot_encoder_free (gpointer data)
+{
+	SnapshotEncoder *encoder = data;
+
+	if (encoder == NULL)
+	{
+		return;
+	}
+
+	g_ptr_array_unref (encoder->snapshot);
+	g_object_unref (encoder->memory_stream);
+	g_object_unref (encoder->output_stream);
+	g_object_unref (encoder->location);
+	g_free (encoder->file_checksum);
+
+	if (encoder->encoded != NULL)
+	{
+		g_bytes_unref (encoder->encoded);
+	}
+
+	g_free (encoder->encoded_checksum);
+	g_free (encoder->unchanged_etag);
+
+	g_free (encoder);
+}
+
+/* Runs in the encoder worker thread. Returns whether the content of the file
+ * on disk is the same as @encoder->encoded. If the file cannot be read, for
+ * example if it doesn't exist yet, it is considered as different.
+ */
+static gboolean
+content_on_disk_is_unchanged (SnapshotEncoder *encoder,
+			      GCancellable    *cancellable)
+{
+	GFileInputStream *input_stream;
+	GFileInfo *info;
+	const guint8 *encoded_data;
+	gsize encoded_size;
+	guint8 *buffer;
+	gsize offset = 0;
+	gboolean unchanged = FALSE;
+
+	input_stream = g_file_read (encoder->location, cancellable, NULL);
+
+	if (input_stream == NULL)
+	{
+		return FALSE;
+	}
+
+	encoded_data = g_bytes_get_data (encoder->encoded, &encoded_size);
+	buffer = g_malloc (SNAPSHOT_CHUNK_SIZE);
+
+	while (TRUE)
+	{
+		gsize bytes_read;
+
+		if (!g_input_stream_read_all (G_INPUT_STREAM (input_stream),
+					      buffer,
+					      SNAPSHOT_CHUNK_SIZE,
+					      &bytes_read,
+					      cancellable,
+					      NULL))
+		{
+			goto out;
+		}
+
+		/* A bigger file has a different content, stop early. */
+		if (bytes_read > encoded_size - offset ||
+		    (bytes_read > 0 && memcmp (buffer, encoded_data + offset, bytes_read) != 0))
+		{
+			goto out;
+		}
+
+		offset += bytes_read;
+
+		if (bytes_read < SNAPSHOT_CHUNK_SIZE)
+		{
+			break;
+		}
+	}
+
+	if (offset != encoded_size)
+	{
+		goto out;
+	}
+
+	/* See query_info_on_file_input_stream() in GtefFileContentLoader for
+	 * why the etag is queried on the GFileInputStream.
+	 */
+	info = g_file_input_stream_query_info (input_stream,
+					       G_FILE_ATTRIBUTE_ETAG_VALUE,
+					       cancellable,
+					       NULL);
+
+	if (info == NULL)
+	{
+		goto out;
+	}
+
+	if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_ETAG_VALUE))
+	{
+		encoder->unchanged_etag = g_strdup (g_file_info_get_etag (info));
+	}
+
+	g_object_unref (info);
+
+	/* G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE cannot be queried from the
+	 * GFileInputStream.
+	 */
+	info = g_file_query_info (encoder->location,
+				  G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE,
+				  G_FILE_QUERY_INFO_NONE,
+				  cancellable,
+				  NULL);
+
+	if (info != NULL &&
+	    g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE))
+	{
+		encoder->unchanged_readonly = !g_file_info_get_attribute_boolean (info,
+										   G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE);
+	}
+
+	g_clear_object (&info);
+	unchanged = TRUE;
+
+out:
+	g_input_stream_close (G_INPUT_STREAM (input_stream), NULL, NULL);
+	g_object_unref (input_stream);
+	g_free (buffer);
+
+	return unchanged;
+}
+
+/* Runs in a worker thread. Encodes and compresses the snapshot in memory, to
+ * know the checksum of the file content before writing it, and compares the
+ * encoded content with the content of the file on disk.
+ */
+static void
+encode_snapshot_thread (GTask        *encoder_task,
+			gpointer      source_object,
+			gpointer      task_data,
+			GCancellable *cancellable)
+{
+	SnapshotEncoder *encoder = task_data;
+	guint i;
+	GError *error = NULL;
+
+	for (i = 0; i < encoder->snapshot->len; i++)
+	{
+		GBytes *chunk = g_ptr_array_index (encoder->snapshot, i);
+		gconstpointer data;
+		gsize size;
+
+		data = g_bytes_get_data (chunk, &size);
+
+		if (!g_output_stream_write_all (encoder->output_stream,
+						data,
+						size,
+						NULL,
+						cancellable,
+						&error))
+		{
+			g_task_return_error (encoder_task, error);
+			return;
+		}
+	}
+
+	if (!g_output_stream_close (encoder->output_stream, cancellable, &error))
+	{
+		g_task_return_error (encoder_task, error);
+		return;
+	}
+
+	encoder->encoded = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (encoder->memory_stream));
+	encoder->encoded_checksum = _gtef_content_hash_compute_for_data (g_bytes_get_data (encoder->encoded, NULL),
+									 g_bytes_get_size (encoder->encoded));
+
+	/* Don't read the file if its content is already known to be
+	 * different.
+	 */
+	if (encoder->file_checksum == NULL ||
+	    g_strcmp0 (encoder->file_checksum, encoder->encoded_checksum) == 0)
+	{
+		encoder->unchanged = content_on_disk_is_unchanged (encoder, cancellable);
+	}
+
+	g_task_return_boolean (encoder_task, TRUE);
+}
+
+static void
+encode_snapshot_cb (GObject      *source_object,
+		    GAsyncResult *result,
+		    gpointer      user_data)
+{
+	GTask *encoder_task = G_TASK (result);
+	GTask *task = G_TASK (user_data);
+	SnapshotEncoder *encoder;
+	TaskData *task_data;
+	gsize encoded_size;
+	gsize offset;
+	GError *error = NULL;
+
+	DEBUG ({
+	       g_print ("%s\n", G_STRFUNC);
+	});
+
+	if (!g_task_propagate_boolean (encoder_task, &error))
+	{
+		g_task_return_error (task, error);
+		g_object_unref (task);
+		return;
+	}
+
+	/* The worker thread has finished, the encoder results can be taken. */
+	encoder = g_task_get_task_data (encoder_task);
+	task_data = g_task_get_task_data (task);
+
+	task_data->encoded_checksum = encoder->encoded_checksum;
+	encoder->encoded_checksum = NULL;
+
+	/* Replace the snapshot by the encoded content, in chunks to report
+	 * the progress while writing.
+	 */
+	g_ptr_array_set_size (task_data->snapshot, 0);
+
+	encoded_size = g_bytes_get_size (encoder->encoded);
+
+	for (offset = 0; offset < encoded_size; offset += SNAPSHOT_CHUNK_SIZE)
+	{
+		g_ptr_array_add (task_data->snapshot,
+				 g_bytes_new_from_bytes (encoder->encoded,
+							 offset,
+							 MIN (SNAPSHOT_CHUNK_SIZE, encoded_size - offset)));
+	}
+
+	task_data->snapshot_size = encoded_size;
+	task_data->snapshot_encoded = TRUE;
+
+	DEBUG ({
+	       g_print ("Encoded size: %" G_GSIZE_FORMAT " bytes, checksum: %s\n",
+			encoded_size,
+			task_data->encoded_checksum);
+	});
+
+	if (encoder->unchanged)
+	{
+		DEBUG ({
+		       g_print ("Content unchanged, skip writing\n");
+		});
+
+		task_data->skipped = TRUE;
+		task_data->unchanged_etag = encoder->unchanged_etag;
+		encoder->unchanged_etag = NULL;
+		task_data->unchanged_readonly = encoder->unchanged_readonly;
+
+		g_task_return_boolean (task, TRUE);
+	}
+	else
+	{
+		begin_write (task);
+	}
+
+	g_object_unref (task);
+}
+
+/* Encodes the snapshot and compares it with the content of the file on disk
+ * in a worker thread, and writes the file only if they are different.
+ */
+static void
+encode_snapshot (GTask *task)
+{
+	GtefFileSaver *saver;
+	TaskData *task_data;
+	SnapshotEncoder *encoder;
+	GTask *encoder_task;
+	GOutputStream *memory_stream;
+	GOutputStream *output_stream;
+	GFile *file_location;
+	GError *error = NULL;
+
+	saver = g_task_get_source_object (task);
+	task_data = g_task_get_task_data (task);
+
+	DEBUG ({
+	       g_print ("%s\n", G_STRFUNC);
+	});
+
+	g_return_if_fail (saver->priv->encoding != NULL);
+
+	/* The converters are created here since they depend on the saver
+	 * properties, and are then used only by the worker thread.
+	 */
+	memory_stream = g_memory_output_stream_new_resizable ();
+	output_stream = create_converter_stream (saver, memory_stream, &error);
+
+	if (error != NULL)
+	{
+		g_object_unref (memory_stream);
+		g_task_return_error (task, error);
+		return;
+	}
+
+	encoder = g_new0 (SnapshotEncoder, 1);
+	encoder->snapshot = g_ptr_array_ref (task_data->snapshot);
+	encoder->memory_stream = memory_stream;
+	encoder->output_stream = output_stream;
+	encoder->location = g_object_ref (saver->priv->location);
+
+	file_location = gtef_file_get_location (saver->priv->file);
+
+	if (file_location != NULL &&
+	    g_file_equal (file_location, saver->priv->location))
+	{
+		encoder->file_checksum = g_strdup (_gtef_file_get_checksum (saver->priv->file));
+	}
+
+	/* No source object, see write_snapshot(). */
+	encoder_task = g_task_new (NULL,
+				   g_task_get_cancellable (task),
+				   encode_snapshot_cb,
+				   g_object_ref (task));
+
+	g_task_set_task_data (encoder_task, encoder, snapshot_encoder_free);
+	g_task_run_in_thread (encoder_task, encode_snapshot_thread);
+	g_object_unref (encoder_task);
+}
+
 GQuark
 gtef_file_saver_error_quark (void)
 {
@@ -1285,6 +2208,7 @@ gtef_file_saver_save_async (GtefFileSaver         *saver,
 	TaskData *task_data;
 	gboolean check_invalid_chars;
 	gboolean implicit_trailing_newline;
+	gboolean skip_if_unchanged;
 
 	g_return_if_fail (GTEF_IS_FILE_SAVER (saver));
 	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
@@ -1333,6 +2257,20 @@ gtef_file_saver_save_async (GtefFileSaver         *saver,
 								 saver->priv->newline_type,
 								 implicit_trailing_newline);
 
+	skip_if_unchanged = (saver->priv->flags & GTEF_FILE_SAVER_FLAGS_SKIP_IF_UNCHANGED) != 0;
+
+	if (((saver->priv->flags & GTEF_FILE_SAVER_FLAGS_SNAPSHOT) != 0 || skip_if_unchanged) &&
+	    !take_snapshot (saver->priv->task))
+	{
+		return;
+	}
+
+	if (skip_if_unchanged)
+	{
+		encode_snapshot (saver->priv->task);
+		return;
+	}
+
 	begin_write (saver->priv->task);
 }
 
@@ -1346,7 +2284,8 @@ gtef_file_saver_save_async (GtefFileSaver         *saver,
  *
  * If the file has been saved successfully, the following #GtefFile
  * properties will be updated: the location, the encoding, the newline type and
- * the compression type.
+ * the compression type. This is also the case if the writing has been skipped
+ * with %GTEF_FILE_SAVER_FLAGS_SKIP_IF_UNCHANGED.
  *
  * gtk_text_buffer_set_modified() is called with %FALSE if the file has been
  * saved successfully.
@@ -1359,19 +2298,18 @@ gtef_file_saver_save_finish (GtefFileSaver  *saver,
 			     GAsyncResult   *result,
 			     GError        **error)
 {
+	TaskData *task_data;
 	gboolean ok;
 
 	g_return_val_if_fail (GTEF_IS_FILE_SAVER (saver), FALSE);
 	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 	g_return_val_if_fail (g_task_is_valid (result, saver), FALSE);
 
+	task_data = g_task_get_task_data (G_TASK (result));
 	ok = g_task_propagate_boolean (G_TASK (result), error);
 
 	if (ok && saver->priv->file != NULL)
 	{
-		TaskData *task_data;
-		gchar *new_etag;
-
 		gtef_file_set_location (saver->priv->file,
 					saver->priv->location);
 
@@ -1386,15 +2324,45 @@ gtef_file_saver_save_finish (GtefFileSaver  *saver,
 
 		_gtef_file_set_externally_modified (saver->priv->file, FALSE);
 		_gtef_file_set_deleted (saver->priv->file, FALSE);
-		_gtef_file_set_readonly (saver->priv->file, FALSE);
 
-		task_data = g_task_get_task_data (G_TASK (result));
-		new_etag = g_file_output_stream_get_etag (task_data->file_output_stream);
-		_gtef_file_set_etag (saver->priv->file, new_etag);
-		g_free (new_etag);
+		if (task_data->skipped)
+		{
+			_gtef_file_set_readonly (saver->priv->file, task_data->unchanged_readonly);
+			_gtef_file_set_etag (saver->priv->file, task_data->unchanged_etag);
+		}
+		else
+		{
+			gchar *new_etag;
+
+			_gtef_file_set_readonly (saver->priv->file, FALSE);
+
+			new_etag = g_file_output_stream_get_etag (task_data->file_output_stream);
+			_gtef_file_set_etag (saver->priv->file, new_etag);
+			g_free (new_etag);
+		}
+
+		if (task_data->snapshot_encoded)
+		{
+			_gtef_file_set_checksum (saver->priv->file, task_data->encoded_checksum);
+		}
+		else if (task_data->checksum_converter != NULL)
+		{
+			gchar *checksum;
+
+			checksum = _gtef_checksum_converter_get_checksum (task_data->checksum_converter);
+			_gtef_file_set_checksum (saver->priv->file, checksum);
+			g_free (checksum);
+		}
+		else
+		{
+			_gtef_file_set_checksum (saver->priv->file, NULL);
+		}
 	}
 
-	if (ok && saver->priv->source_buffer != NULL)
+	/* With a snapshot, the buffer may have been modified meanwhile. */
+	if (ok &&
+	    saver->priv->source_buffer != NULL &&
+	    !task_data->buffer_changed)
 	{
 		gtk_text_buffer_set_modified (GTK_TEXT_BUFFER (saver->priv->source_buffer),
 					      FALSE);
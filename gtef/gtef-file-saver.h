@@ -67,6 +67,12 @@ typedef enum
  * @GTEF_FILE_SAVER_FLAGS_IGNORE_INVALID_CHARS: Ignore invalid characters.
  * @GTEF_FILE_SAVER_FLAGS_IGNORE_MODIFICATION_TIME: Save file despite external modifications.
  * @GTEF_FILE_SAVER_FLAGS_CREATE_BACKUP: Create a backup before saving the file.
+ * @GTEF_FILE_SAVER_FLAGS_SNAPSHOT: Take a snapshot of the buffer content when
+ *   the save operation starts, and write it in a worker thread. The buffer can
+ *   then be modified during the save operation. Since 2.0.
+ * @GTEF_FILE_SAVER_FLAGS_SKIP_IF_UNCHANGED: Encode the content in memory when
+ *   the save operation starts, like with %GTEF_FILE_SAVER_FLAGS_SNAPSHOT, and
+ *   don't write the file if its content on disk is already the same. Since 2.0.
  *
  * Flags to define the behavior of a #GtefFileSaver.
  * Since: 1.0
@@ -76,7 +82,9 @@ typedef enum
 	GTEF_FILE_SAVER_FLAGS_NONE			= 0,
 	GTEF_FILE_SAVER_FLAGS_IGNORE_INVALID_CHARS	= 1 << 0,
 	GTEF_FILE_SAVER_FLAGS_IGNORE_MODIFICATION_TIME	= 1 << 1,
-	GTEF_FILE_SAVER_FLAGS_CREATE_BACKUP		= 1 << 2
+	GTEF_FILE_SAVER_FLAGS_CREATE_BACKUP		= 1 << 2,
+	GTEF_FILE_SAVER_FLAGS_SNAPSHOT			= 1 << 3,
+	GTEF_FILE_SAVER_FLAGS_SKIP_IF_UNCHANGED		= 1 << 4
 } GtefFileSaverFlags;
 
 struct _GtefFileSaver
@@ -0,0 +1,993 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "gtef-file-watcher.h"
+#include "gtef-file.h"
+
+/**
+ * SECTION:file-watcher
+ * @Short_description: Keeps the on-disk state of files up to date
+ * @Title: GtefFileWatcher
+ * @See_also: #GtefFile
+ *
+ * #GtefFileWatcher is a singleton class that keeps up to date the
+ * externally-modified, deleted and read-only states of the #GtefFile's added
+ * with gtef_file_watcher_add_file(). See gtef_file_is_externally_modified(),
+ * gtef_file_is_deleted() and gtef_file_is_readonly().
+ *
+ * Instead of creating one #GFileMonitor per file, the #GtefFileWatcher
+ * creates one #GFileMonitor per directory containing at least one watched
+ * local file. So when lots of files of the same project are opened, only a few
+ * monitors are needed. The events received in a short period of time are
+ * coalesced, and the files are then checked in a worker thread, so the main
+ * thread never blocks on I/O.
+ *
+ * The locations that cannot be monitored, for example remote files, need to
+ * be checked explicitly with gtef_file_watcher_check_files_async(), for
+ * example when the application window gains the focus. All those files are
+ * checked in a single batch.
+ *
+ * The #GtefFileWatcher::file-changed signal is emitted when the state of a
+ * #GtefFile has changed, so that the application can show an infobar.
+ */
+
+/* Wait for this delay without events before checking the files. */
+#define DEBOUNCE_DELAY_MS 200
+
+/* But don't wait more than this delay after the first event, a file being
+ * continuously written to can send events for a long time.
+ */
+#define MAX_DEBOUNCE_DELAY_MS 1000
+
+typedef struct _GtefFileWatcherPrivate GtefFileWatcherPrivate;
+typedef struct _WatchedFile WatchedFile;
+typedef struct _DirMonitor DirMonitor;
+typedef struct _QueryData QueryData;
+
+struct _GtefFileWatcherPrivate
+{
+	/* Key: GtefFile, weak ref.
+	 * Value: owned WatchedFile.
+	 */
+	GHashTable *watched_files;
+
+	/* Key: owned GFile, a watched location.
+	 * Value: owned GPtrArray of GtefFile's, without refs (several GtefFile's
+	 * can have the same location).
+	 */
+	GHashTable *files_by_location;
+
+	/* Key: owned GFile, the parent directory of watched locations.
+	 * Value: owned DirMonitor.
+	 */
+	GHashTable *dir_monitors;
+
+	/* Set of GtefFile's, without refs, that need to be checked because of a
+	 * monitor event.
+	 */
+	GHashTable *pending_files;
+
+	GCancellable *cancellable;
+
+	guint debounce_timeout_id;
+	gint64 first_event_time;
+	gint64 last_event_time;
+
+	guint check_in_progress : 1;
+	guint use_monitors : 1;
+};
+
+struct _WatchedFile
+{
+	/* The location being watched. NULL if the GtefFile has no location. */
+	GFile *location;
+
+	/* The parent directory of @location, key in dir_monitors. NULL if the
+	 * location is not monitored.
+	 */
+	GFile *dir;
+
+	gulong notify_location_handler_id;
+};
+
+struct _DirMonitor
+{
+	GFileMonitor *monitor;
+
+	/* The number of WatchedFile's in the directory. */
+	guint n_files;
+};
+
+/* Accessed by the worker thread. */
+struct _QueryData
+{
+	GFile **locations;
+
+	/* The results, NULL elements when the query failed. */
+	GFileInfo **infos;
+
+	guint n_locations;
+};
+
+enum
+{
+	SIGNAL_FILE_CHANGED,
+	N_SIGNALS
+};
+
+static guint signals[N_SIGNALS];
+
+G_DEFINE_TYPE_WITH_PRIVATE (GtefFileWatcher, gtef_file_watcher, G_TYPE_OBJECT)
+
+static void schedule_pending_files_check (GtefFileWatcher *watcher);
+
+static void
+watched_file_free (gpointer data)
+{
+	WatchedFile *watched_file = data;
+
+	if (watched_file != NULL)
+	{
+		g_clear_object (&watched_file->location);
+		g_clear_object (&watched_file->dir);
+		g_free (watched_file);
+	}
+}
+
+static void
+dir_monitor_free (gpointer data)
+{
+	DirMonitor *dir_monitor = data;
+
+	if (dir_monitor != NULL)
+	{
+		g_file_monitor_cancel (dir_monitor->monitor);
+		g_object_unref (dir_monitor->monitor);
+		g_free (dir_monitor);
+	}
+}
+
+static QueryData *
+query_data_new (guint n_locations)
+{
+	QueryData *query_data;
+
+	query_data = g_new0 (QueryData, 1);
+	query_data->locations = g_new0 (GFile *, n_locations);
+	query_data->infos = g_new0 (GFileInfo *, n_locations);
+	query_data->n_locations = n_locations;
+
+	return query_data;
+}
+
+static void
+query_data_free (gpointer data)
+{
+	QueryData *query_data = data;
+	guint i;
+
+	if (query_data == NULL)
+	{
+		return;
+	}
+
+	for (i = 0; i < query_data->n_locations; i++)
+	{
+		g_clear_object (&query_data->locations[i]);
+		g_clear_object (&query_data->infos[i]);
+	}
+
+	g_free (query_data->locations);
+	g_free (query_data->infos);
+	g_free (query_data);
+}
+
+static void
+file_weak_notify_cb (gpointer  data,
+		     GObject  *where_the_object_was);
+
+static void
+gtef_file_watcher_dispose (GObject *object)
+{
+	GtefFileWatcherPrivate *priv = gtef_file_watcher_get_instance_private (GTEF_FILE_WATCHER (object));
+
+	if (priv->watched_files != NULL)
+	{
+		GHashTableIter iter;
+		gpointer key;
+		gpointer value;
+
+		g_hash_table_iter_init (&iter, priv->watched_files);
+		while (g_hash_table_iter_next (&iter, &key, &value))
+		{
+			GObject *file = key;
+			WatchedFile *watched_file = value;
+
+			g_signal_handler_disconnect (file, watched_file->notify_location_handler_id);
+			g_object_weak_unref (file, file_weak_notify_cb, object);
+		}
+
+		g_hash_table_remove_all (priv->watched_files);
+	}
+
+	if (priv->cancellable != NULL)
+	{
+		g_cancellable_cancel (priv->cancellable);
+		g_clear_object (&priv->cancellable);
+	}
+
+	if (priv->debounce_timeout_id != 0)
+	{
+		g_source_remove (priv->debounce_timeout_id);
+		priv->debounce_timeout_id = 0;
+	}
+
+	g_clear_pointer (&priv->pending_files, g_hash_table_unref);
+	g_clear_pointer (&priv->files_by_location, g_hash_table_unref);
+	g_clear_pointer (&priv->dir_monitors, g_hash_table_unref);
+
+	G_OBJECT_CLASS (gtef_file_watcher_parent_class)->dispose (object);
+}
+
+static void
+gtef_file_watcher_finalize (GObject *object)
+{
+	GtefFileWatcherPrivate *priv = gtef_file_watcher_get_instance_private (GTEF_FILE_WATCHER (object));
+
+	g_hash_table_unref (priv->watched_files);
+
+	G_OBJECT_CLASS (gtef_file_watcher_parent_class)->finalize (object);
+}
+
+static void
+gtef_file_watcher_class_init (GtefFileWatcherClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+	object_class->dispose = gtef_file_watcher_dispose;
+	object_class->finalize = gtef_file_watcher_finalize;
+
+	/**
+	 * GtefFileWatcher::file-changed:
+	 * @watcher: the #GtefFileWatcher emitting the signal.
+	 * @file: the #GtefFile whose state has changed.
+	 *
+	 * The ::file-changed signal is emitted when @file has been checked and
+	 * the value returned by gtef_file_is_externally_modified(),
+	 * gtef_file_is_deleted() or gtef_file_is_readonly() has changed.
+	 *
+	 * Since: 2.0
+	 */
+	signals[SIGNAL_FILE_CHANGED] =
+		g_signal_new ("file-changed",
+			      G_TYPE_FROM_CLASS (klass),
+			      G_SIGNAL_RUN_LAST,
+			      0,
+			      NULL, NULL, NULL,
+			      G_TYPE_NONE,
+			      1, GTEF_TYPE_FILE);
+}
+
+static void
+gtef_file_watcher_init (GtefFileWatcher *watcher)
+{
+	GtefFileWatcherPrivate *priv = gtef_file_watcher_get_instance_private (watcher);
+
+	priv->watched_files = g_hash_table_new_full (NULL, NULL, NULL, watched_file_free);
+
+	priv->files_by_location = g_hash_table_new_full ((GHashFunc) g_file_hash,
+							 (GEqualFunc) g_file_equal,
+							 g_object_unref,
+							 (GDestroyNotify) g_ptr_array_unref);
+
+	priv->dir_monitors = g_hash_table_new_full ((GHashFunc) g_file_hash,
+						    (GEqualFunc) g_file_equal,
+						    g_object_unref,
+						    dir_monitor_free);
+
+	priv->pending_files = g_hash_table_new (NULL, NULL);
+
+	priv->cancellable = g_cancellable_new ();
+	priv->use_monitors = TRUE;
+}
+
+/**
+ * gtef_file_watcher_get_instance:
+ *
+ * Returns: (transfer none): the #GtefFileWatcher singleton instance.
+ * Since: 2.0
+ */
+GtefFileWatcher *
+gtef_file_watcher_get_instance (void)
+{
+	static GtefFileWatcher *instance = NULL;
+
+	if (G_UNLIKELY (instance == NULL))
+	{
+		instance = g_object_new (GTEF_TYPE_FILE_WATCHER, NULL);
+	}
+
+	return instance;
+}
+
+static void
+queue_location (GtefFileWatcher *watcher,
+		GFile           *location)
+{
+	GtefFileWatcherPrivate *priv = gtef_file_watcher_get_instance_private (watcher);
+	GPtrArray *files;
+	guint i;
+
+	if (location == NULL)
+	{
+		return;
+	}
+
+	files = g_hash_table_lookup (priv->files_by_location, location);
+	if (files == NULL)
+	{
+		return;
+	}
+
+	for (i = 0; i < files->len; i++)
+	{
+		g_hash_table_add (priv->pending_files, g_ptr_array_index (files, i));
+	}
+}
+
+static void
+monitor_changed_cb (GFileMonitor      *monitor,
+		    GFile             *file,
+		    GFile             *other_file,
+		    GFileMonitorEvent  event_type,
+		    GtefFileWatcher   *watcher)
+{
+	/* Whatever the event, the files are queried again. With a rename or a
+	 * move, both locations are concerned.
+	 */
+	queue_location (watcher, file);
+	queue_location (watcher, other_file);
+
+	schedule_pending_files_check (watcher);
+}
+
+static gboolean
+is_monitorable (GtefFileWatcher *watcher,
+		GFile           *location)
+{
+	GtefFileWatcherPrivate *priv = gtef_file_watcher_get_instance_private (watcher);
+
+	/* Only local files, creating a monitor for a remote directory can
+	 * block and is not reliable.
+	 */
+	return priv->use_monitors && g_file_has_uri_scheme (location, "file");
+}
+
+static void
+watch_location (GtefFileWatcher *watcher,
+		GtefFile        *file,
+		WatchedFile     *watched_file)
+{
+	GtefFileWatcherPrivate *priv = gtef_file_watcher_get_instance_private (watcher);
+	GFile *location;
+	GPtrArray *files;
+	GFile *dir;
+	DirMonitor *dir_monitor;
+
+	g_assert (watched_file->location == NULL);
+	g_assert (watched_file->dir == NULL);
+
+	location = gtef_file_get_location (file);
+	if (location == NULL)
+	{
+		return;
+	}
+
+	watched_file->location = g_object_ref (location);
+
+	files = g_hash_table_lookup (priv->files_by_location, location);
+	if (files == NULL)
+	{
+		files = g_ptr_array_new ();
+		g_hash_table_insert (priv->files_by_location,
+				     g_object_ref (location),
+				     files);
+	}
+
+	g_ptr_array_add (files, file);
+
+	if (!is_monitorable (watcher, location))
+	{
+		return;
+	}
+
+	dir = g_file_get_parent (location);
+	if (dir == NULL)
+	{
+		return;
+	}
+
+	dir_monitor = g_hash_table_lookup (priv->dir_monitors, dir);
+
+	if (dir_monitor == NULL)
+	{
+		GFileMonitor *monitor;
+
+		/* If the directory doesn't exist, or if there is no
+		 * monitoring backend, the file can still be checked with
+		 * gtef_file_watcher_check_files_async().
+		 */
+		monitor = g_file_monitor_directory (dir,
+						    G_FILE_MONITOR_WATCH_MOVES,
+						    NULL,
+						    NULL);
+		if (monitor == NULL)
+		{
+			g_object_unref (dir);
+			return;
+		}
+
+		g_signal_connect (monitor,
+				  "changed",
+				  G_CALLBACK (monitor_changed_cb),
+				  watcher);
+
+		dir_monitor = g_new0 (DirMonitor, 1);
+		dir_monitor->monitor = monitor;
+
+		g_hash_table_insert (priv->dir_monitors,
+				     g_object_ref (dir),
+				     dir_monitor);
+	}
+
+	dir_monitor->n_files++;
+	watched_file->dir = dir;
+}
+
+/* @file can be finalized, it is not dereferenced. */
+static void
+unwatch_location (GtefFileWatcher *watcher,
+		  gpointer         file,
+		  WatchedFile     *watched_file)
+{
+	GtefFileWatcherPrivate *priv = gtef_file_watcher_get_instance_private (watcher);
+	GPtrArray *files;
+
+	g_hash_table_remove (priv->pending_files, file);
+
+	if (watched_file->location == NULL)
+	{
+		return;
+	}
+
+	files = g_hash_table_lookup (priv->files_by_location, watched_file->location);
+	g_assert (files != NULL);
+
+	g_ptr_array_remove_fast (files, file);
+	if (files->len == 0)
+	{
+		g_hash_table_remove (priv->files_by_location, watched_file->location);
+	}
+
+	if (watched_file->dir != NULL)
+	{
+		DirMonitor *dir_monitor;
+
+		dir_monitor = g_hash_table_lookup (priv->dir_monitors, watched_file->dir);
+		g_assert (dir_monitor != NULL);
+		g_assert (dir_monitor->n_files > 0);
+
+		dir_monitor->n_files--;
+		if (dir_monitor->n_files == 0)
+		{
+			g_hash_table_remove (priv->dir_monitors, watched_file->dir);
+		}
+	}
+
+	g_clear_object (&watched_file->location);
+	g_clear_object (&watched_file->dir);
+}
+
+static void
+location_notify_cb (GtefFile        *file,
+		    GParamSpec      *pspec,
+		    GtefFileWatcher *watcher)
+{
+	GtefFileWatcherPrivate *priv = gtef_file_watcher_get_instance_private (watcher);
+	WatchedFile *watched_file;
+
+	watched_file = g_hash_table_lookup (priv->watched_files, file);
+	g_return_if_fail (watched_file != NULL);
+
+	unwatch_location (watcher, file, watched_file);
+	watch_location (watcher, file, watched_file);
+}
+
+static void
+file_weak_notify_cb (gpointer  data,
+		     GObject  *where_the_object_was)
+{
+	GtefFileWatcher *watcher = GTEF_FILE_WATCHER (data);
+	GtefFileWatcherPrivate *priv = gtef_file_watcher_get_instance_private (watcher);
+	WatchedFile *watched_file;
+
+	watched_file = g_hash_table_lookup (priv->watched_files, where_the_object_was);
+	g_return_if_fail (watched_file != NULL);
+
+	unwatch_location (watcher, where_the_object_was, watched_file);
+	g_hash_table_remove (priv->watched_files, where_the_object_was);
+}
+
+/**
+ * gtef_file_watcher_add_file:
+ * @watcher: the #GtefFileWatcher.
+ * @file: a #GtefFile.
+ *
+ * Starts watching @file. The #GtefFileWatcher doesn't keep a reference on
+ * @file, it is removed automatically when finalized. When the
+ * #GtefFile:location changes, the new location is watched.
+ *
+ * Since: 2.0
+ */
+void
+gtef_file_watcher_add_file (GtefFileWatcher *watcher,
+			    GtefFile        *file)
+{
+	GtefFileWatcherPrivate *priv;
+	WatchedFile *watched_file;
+
+	g_return_if_fail (GTEF_IS_FILE_WATCHER (watcher));
+	g_return_if_fail (GTEF_IS_FILE (file));
+
+	priv = gtef_file_watcher_get_instance_private (watcher);
+
+	if (g_hash_table_contains (priv->watched_files, file))
+	{
+		return;
+	}
+
+	watched_file = g_new0 (WatchedFile, 1);
+	g_hash_table_insert (priv->watched_files, file, watched_file);
+
+	g_object_weak_ref (G_OBJECT (file), file_weak_notify_cb, watcher);
+
+	watched_file->notify_location_handler_id =
+		g_signal_connect (file,
+				  "notify::location",
+				  G_CALLBACK (location_notify_cb),
+				  watcher);
+
+	watch_location (watcher, file, watched_file);
+}
+
+/**
+ * gtef_file_watcher_remove_file:
+ * @watcher: the #GtefFileWatcher.
+ * @file: a #GtefFile.
+ *
+ * Stops watching @file. If @file is not watched, this function does nothing.
+ *
+ * Since: 2.0
+ */
+void
+gtef_file_watcher_remove_file (GtefFileWatcher *watcher,
+			       GtefFile        *file)
+{
+	GtefFileWatcherPrivate *priv;
+	WatchedFile *watched_file;
+
+	g_return_if_fail (GTEF_IS_FILE_WATCHER (watcher));
+	g_return_if_fail (GTEF_IS_FILE (file));
+
+	priv = gtef_file_watcher_get_instance_private (watcher);
+
+	watched_file = g_hash_table_lookup (priv->watched_files, file);
+	if (watched_file == NULL)
+	{
+		return;
+	}
+
+	unwatch_location (watcher, file, watched_file);
+
+	g_signal_handler_disconnect (file, watched_file->notify_location_handler_id);
+	g_object_weak_unref (G_OBJECT (file), file_weak_notify_cb, watcher);
+
+	g_hash_table_remove (priv->watched_files, file);
+}
+
+/**
+ * gtef_file_watcher_is_monitored:
+ * @watcher: the #GtefFileWatcher.
+ * @file: a #GtefFile.
+ *
+ * Returns: whether the #GtefFile:location of @file is monitored, i.e. whether
+ * its state is kept up to date without calling
+ * gtef_file_watcher_check_files_async().
+ * Since: 2.0
+ */
+gboolean
+gtef_file_watcher_is_monitored (GtefFileWatcher *watcher,
+				GtefFile        *file)
+{
+	GtefFileWatcherPrivate *priv;
+	WatchedFile *watched_file;
+
+	g_return_val_if_fail (GTEF_IS_FILE_WATCHER (watcher), FALSE);
+	g_return_val_if_fail (GTEF_IS_FILE (file), FALSE);
+
+	priv = gtef_file_watcher_get_instance_private (watcher);
+
+	watched_file = g_hash_table_lookup (priv->watched_files, file);
+
+	return watched_file != NULL && watched_file->dir != NULL;
+}
+
+static void
+query_thread (GTask        *query_task,
+	      gpointer      source_object,
+	      gpointer      task_data,
+	      GCancellable *cancellable)
+{
+	QueryData *query_data = task_data;
+	guint i;
+
+	for (i = 0; i < query_data->n_locations; i++)
+	{
+		GError *error = NULL;
+
+		query_data->infos[i] = g_file_query_info (query_data->locations[i],
+							  _GTEF_FILE_CHECK_ATTRIBUTES,
+							  G_FILE_QUERY_INFO_NONE,
+							  cancellable,
+							  &error);
+
+		if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+		{
+			g_task_return_error (query_task, error);
+			return;
+		}
+
+		/* Like gtef_file_check_file_on_disk(), an error means that
+		 * the file is deleted.
+		 */
+		g_clear_error (&error);
+	}
+
+	g_task_return_boolean (query_task, TRUE);
+}
+
+static void
+query_done_cb (GObject      *source_object,
+	       GAsyncResult *result,
+	       gpointer      user_data)
+{
+	GTask *query_task = G_TASK (result);
+	GTask *task = G_TASK (user_data);
+	GtefFileWatcher *watcher;
+	GPtrArray *files;
+	QueryData *query_data;
+	GError *error = NULL;
+	guint i;
+
+	if (!g_task_propagate_boolean (query_task, &error))
+	{
+		g_task_return_error (task, error);
+		g_object_unref (task);
+		return;
+	}
+
+	watcher = g_task_get_source_object (task);
+	files = g_task_get_task_data (task);
+	query_data = g_task_get_task_data (query_task);
+
+	g_assert (files->len == query_data->n_locations);
+
+	for (i = 0; i < files->len; i++)
+	{
+		GtefFile *file = g_ptr_array_index (files, i);
+		GFile *location;
+
+		/* The location can have changed in the meantime. */
+		location = gtef_file_get_location (file);
+		if (location == NULL ||
+		    !g_file_equal (location, query_data->locations[i]))
+		{
+			continue;
+		}
+
+		if (_gtef_file_update_from_info (file, query_data->infos[i]))
+		{
+			g_signal_emit (watcher, signals[SIGNAL_FILE_CHANGED], 0, file);
+		}
+	}
+
+	g_task_return_boolean (task, TRUE);
+	g_object_unref (task);
+}
+
+/* Takes ownership of @files, an array of GtefFile's with a location. */
+static void
+check_files (GtefFileWatcher     *watcher,
+	     GPtrArray           *files,
+	     gint                 io_priority,
+	     GCancellable        *cancellable,
+	     GAsyncReadyCallback  callback,
+	     gpointer             user_data)
+{
+	GTask *task;
+	GTask *query_task;
+	QueryData *query_data;
+	guint i;
+
+	task = g_task_new (watcher, cancellable, callback, user_data);
+	g_task_set_priority (task, io_priority);
+	g_task_set_task_data (task, files, (GDestroyNotify) g_ptr_array_unref);
+
+	if (files->len == 0)
+	{
+		g_task_return_boolean (task, TRUE);
+		g_object_unref (task);
+		return;
+	}
+
+	query_data = query_data_new (files->len);
+
+	for (i = 0; i < files->len; i++)
+	{
+		GtefFile *file = g_ptr_array_index (files, i);
+
+		query_data->locations[i] = g_object_ref (gtef_file_get_location (file));
+	}
+
+	/* One worker thread for the whole batch, instead of one async query
+	 * per file.
+	 *
+	 * No source object, and the GtefFile's are not in the task data: the
+	 * last unref of the query task can happen in the worker thread.
+	 */
+	query_task = g_task_new (NULL, cancellable, query_done_cb, task);
+	g_task_set_priority (query_task, io_priority);
+	g_task_set_task_data (query_task, query_data, query_data_free);
+	g_task_run_in_thread (query_task, query_thread);
+	g_object_unref (query_task);
+}
+
+static GPtrArray *
+new_files_array (void)
+{
+	return g_ptr_array_new_with_free_func (g_object_unref);
+}
+
+static void
+pending_files_check_done_cb (GObject      *source_object,
+			     GAsyncResult *result,
+			     gpointer      user_data)
+{
+	GtefFileWatcher *watcher = GTEF_FILE_WATCHER (source_object);
+	GtefFileWatcherPrivate *priv = gtef_file_watcher_get_instance_private (watcher);
+	GError *error = NULL;
+
+	g_task_propagate_boolean (G_TASK (result), &error);
+
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+	{
+		g_error_free (error);
+		return;
+	}
+
+	g_clear_error (&error);
+
+	priv->check_in_progress = FALSE;
+
+	/* Events received during the check. */
+	if (g_hash_table_size (priv->pending_files) > 0 &&
+	    priv->debounce_timeout_id == 0)
+	{
+		schedule_pending_files_check (watcher);
+	}
+}
+
+static void
+check_pending_files (GtefFileWatcher *watcher)
+{
+	GtefFileWatcherPrivate *priv = gtef_file_watcher_get_instance_private (watcher);
+	GPtrArray *files;
+	GHashTableIter iter;
+	gpointer key;
+
+	g_assert (!priv->check_in_progress);
+
+	files = new_files_array ();
+
+	g_hash_table_iter_init (&iter, priv->pending_files);
+	while (g_hash_table_iter_next (&iter, &key, NULL))
+	{
+		GtefFile *file = key;
+
+		if (gtef_file_get_location (file) != NULL)
+		{
+			g_ptr_array_add (files, g_object_ref (file));
+		}
+	}
+
+	g_hash_table_remove_all (priv->pending_files);
+
+	priv->check_in_progress = TRUE;
+
+	check_files (watcher,
+		     files,
+		     G_PRIORITY_LOW,
+		     priv->cancellable,
+		     pending_files_check_done_cb,
+		     NULL);
+}
+
+static gboolean
+debounce_timeout_cb (gpointer user_data)
+{
+	GtefFileWatcher *watcher = GTEF_FILE_WATCHER (user_data);
+	GtefFileWatcherPrivate *priv = gtef_file_watcher_get_instance_private (watcher);
+	gint64 now;
+
+	now = g_get_monotonic_time ();
+
+	if (now - priv->last_event_time < DEBOUNCE_DELAY_MS * G_TIME_SPAN_MILLISECOND &&
+	    now - priv->first_event_time < MAX_DEBOUNCE_DELAY_MS * G_TIME_SPAN_MILLISECOND)
+	{
+		return G_SOURCE_CONTINUE;
+	}
+
+	priv->debounce_timeout_id = 0;
+
+	/* If a check is in progress, the pending files are checked when it is
+	 * done.
+	 */
+	if (!priv->check_in_progress &&
+	    g_hash_table_size (priv->pending_files) > 0)
+	{
+		check_pending_files (watcher);
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+schedule_pending_files_check (GtefFileWatcher *watcher)
+{
+	GtefFileWatcherPrivate *priv = gtef_file_watcher_get_instance_private (watcher);
+
+	if (g_hash_table_size (priv->pending_files) == 0)
+	{
+		return;
+	}
+
+	priv->last_event_time = g_get_monotonic_time ();
+
+	if (priv->debounce_timeout_id == 0)
+	{
+		priv->first_event_time = priv->last_event_time;
+		priv->debounce_timeout_id = g_timeout_add (DEBOUNCE_DELAY_MS,
+							   debounce_timeout_cb,
+							   watcher);
+	}
+}
+
+/**
+ * gtef_file_watcher_check_files_async:
+ * @watcher: the #GtefFileWatcher.
+ * @io_priority: the I/O priority of the request. E.g. %G_PRIORITY_LOW,
+ *   %G_PRIORITY_DEFAULT or %G_PRIORITY_HIGH.
+ * @cancellable: (nullable): optional #GCancellable object, %NULL to ignore.
+ * @callback: (scope async): a #GAsyncReadyCallback to call when the request is
+ *   satisfied.
+ * @user_data: user data to pass to @callback.
+ *
+ * Checks, in a single batch, the watched files whose location is not
+ * monitored. See gtef_file_watcher_is_monitored(). The
+ * #GtefFileWatcher::file-changed signal is emitted for each file whose state
+ * has changed, before @callback is called.
+ *
+ * See the #GAsyncResult documentation to know how to use this function.
+ *
+ * Since: 2.0
+ */
+void
+gtef_file_watcher_check_files_async (GtefFileWatcher     *watcher,
+				     gint                 io_priority,
+				     GCancellable        *cancellable,
+				     GAsyncReadyCallback  callback,
+				     gpointer             user_data)
+{
+	GtefFileWatcherPrivate *priv;
+	GPtrArray *files;
+	GHashTableIter iter;
+	gpointer key;
+	gpointer value;
+
+	g_return_if_fail (GTEF_IS_FILE_WATCHER (watcher));
+	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+	priv = gtef_file_watcher_get_instance_private (watcher);
+
+	files = new_files_array ();
+
+	g_hash_table_iter_init (&iter, priv->watched_files);
+	while (g_hash_table_iter_next (&iter, &key, &value))
+	{
+		GtefFile *file = key;
+		WatchedFile *watched_file = value;
+
+		if (watched_file->location != NULL &&
+		    watched_file->dir == NULL)
+		{
+			g_ptr_array_add (files, g_object_ref (file));
+		}
+	}
+
+	check_files (watcher, files, io_priority, cancellable, callback, user_data);
+}
+
+/**
+ * gtef_file_watcher_check_files_finish:
+ * @watcher: the #GtefFileWatcher.
+ * @result: a #GAsyncResult.
+ * @error: a #GError, or %NULL.
+ *
+ * Finishes the check started with gtef_file_watcher_check_files_async().
+ *
+ * Returns: whether the files have been checked successfully.
+ * Since: 2.0
+ */
+gboolean
+gtef_file_watcher_check_files_finish (GtefFileWatcher  *watcher,
+				      GAsyncResult     *result,
+				      GError          **error)
+{
+	g_return_val_if_fail (GTEF_IS_FILE_WATCHER (watcher), FALSE);
+	g_return_val_if_fail (g_task_is_valid (result, watcher), FALSE);
+
+	return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+/* For the unit tests: the locations watched afterwards are not monitored. */
+void
+_gtef_file_watcher_set_use_monitors (GtefFileWatcher *watcher,
+				     gboolean         use_monitors)
+{
+	GtefFileWatcherPrivate *priv;
+
+	g_return_if_fail (GTEF_IS_FILE_WATCHER (watcher));
+
+	priv = gtef_file_watcher_get_instance_private (watcher);
+
+	priv->use_monitors = use_monitors != FALSE;
+}
+
+guint
+_gtef_file_watcher_get_n_monitors (GtefFileWatcher *watcher)
+{
+	GtefFileWatcherPrivate *priv;
+
+	g_return_val_if_fail (GTEF_IS_FILE_WATCHER (watcher), 0);
+
+	priv = gtef_file_watcher_get_instance_private (watcher);
+
+	return g_hash_table_size (priv->dir_monitors);
+}
@@ -0,0 +1,75 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef GTEF_FILE_WATCHER_H
+#define GTEF_FILE_WATCHER_H
+
+#if !defined (GTEF_H_INSIDE) && !defined (GTEF_COMPILATION)
+#error "Only <gtef/gtef.h> can be included directly."
+#endif
+
+#include <gio/gio.h>
+#include <gtef/gtef-types.h>
+
+G_BEGIN_DECLS
+
+#define GTEF_TYPE_FILE_WATCHER (gtef_file_watcher_get_type ())
+G_DECLARE_DERIVABLE_TYPE (GtefFileWatcher, gtef_file_watcher,
+			  GTEF, FILE_WATCHER,
+			  GObject)
+
+struct _GtefFileWatcherClass
+{
+	GObjectClass parent_class;
+
+	gpointer padding[12];
+};
+
+GtefFileWatcher *	gtef_file_watcher_get_instance		(void);
+
+void			gtef_file_watcher_add_file		(GtefFileWatcher *watcher,
+								 GtefFile        *file);
+
+void			gtef_file_watcher_remove_file		(GtefFileWatcher *watcher,
+								 GtefFile        *file);
+
+gboolean		gtef_file_watcher_is_monitored		(GtefFileWatcher *watcher,
+								 GtefFile        *file);
+
+void			gtef_file_watcher_check_files_async	(GtefFileWatcher     *watcher,
+								 gint                 io_priority,
+								 GCancellable        *cancellable,
+								 GAsyncReadyCallback  callback,
+								 gpointer             user_data);
+
+gboolean		gtef_file_watcher_check_files_finish	(GtefFileWatcher  *watcher,
+								 GAsyncResult     *result,
+								 GError          **error);
+
+G_GNUC_INTERNAL
+void			_gtef_file_watcher_set_use_monitors	(GtefFileWatcher *watcher,
+								 gboolean         use_monitors);
+
+G_GNUC_INTERNAL
+guint			_gtef_file_watcher_get_n_monitors	(GtefFileWatcher *watcher);
+
+G_END_DECLS
+
+#endif /* GTEF_FILE_WATCHER_H */
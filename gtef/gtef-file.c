@@ -20,6 +20,7 @@
 #include "config.h"
 #include "gtef-file.h"
 #include <glib/gi18n-lib.h>
+#include "gtef-content-hash.h"
 #include "gtef-encoding.h"
 #include "gtef-file-metadata.h"
 #include "gtef-utils.h"
@@ -48,6 +49,9 @@
  * be folded back to GtkSourceView in a later version.
  */
 
+/* Size of the reads to compute the checksum of a file. */
+#define CHECKSUM_READ_SIZE (64 * 1024)
+
 typedef struct _GtefFilePrivate GtefFilePrivate;
 
 struct _GtefFilePrivate
@@ -71,6 +75,12 @@ struct _GtefFilePrivate
 	 */
 	gchar *etag;
 
+	/* Checksum of the content of 'location', as last loaded or saved, see
+	 * gtef-content-hash.c. NULL if unknown.
+	 */
+	gchar *checksum;
+
+	guint compute_checksum : 1;
 	guint externally_modified : 1;
 	guint deleted : 1;
 	guint readonly : 1;
@@ -85,6 +95,7 @@ enum
 	PROP_COMPRESSION_TYPE,
 	PROP_READ_ONLY,
 	PROP_SHORT_NAME,
+	PROP_COMPUTE_CHECKSUM,
 	N_PROPERTIES
 };
 
@@ -179,6 +190,10 @@ gtef_file_get_property (GObject    *object,
 			g_value_set_string (value, gtef_file_get_short_name (file));
 			break;
 
+		case PROP_COMPUTE_CHECKSUM:
+			g_value_set_boolean (value, gtef_file_get_compute_checksum (file));
+			break;
+
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 			break;
@@ -199,6 +214,10 @@ gtef_file_set_property (GObject      *object,
 			gtef_file_set_location (file, g_value_get_object (value));
 			break;
 
+		case PROP_COMPUTE_CHECKSUM:
+			gtef_file_set_compute_checksum (file, g_value_get_boolean (value));
+			break;
+
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 			break;
@@ -230,6 +249,7 @@ gtef_file_finalize (GObject *object)
 	gtef_encoding_free (priv->encoding);
 	g_free (priv->short_name);
 	g_free (priv->etag);
+	g_free (priv->checksum);
 
 	if (priv->untitled_number > 0)
 	{
@@ -344,6 +364,22 @@ gtef_file_class_init (GtefFileClass *klass)
 				     G_PARAM_READABLE |
 				     G_PARAM_STATIC_STRINGS);
 
+	/**
+	 * GtefFile:compute-checksum:
+	 *
+	 * Whether to compute a checksum of the content on file loading and
+	 * saving. See gtef_file_set_compute_checksum().
+	 *
+	 * Since: 2.0
+	 */
+	properties[PROP_COMPUTE_CHECKSUM] =
+		g_param_spec_boolean ("compute-checksum",
+				      "Compute Checksum",
+				      "",
+				      FALSE,
+				      G_PARAM_READWRITE |
+				      G_PARAM_STATIC_STRINGS);
+
 	g_object_class_install_properties (object_class, N_PROPERTIES, properties);
 }
 
@@ -514,10 +550,13 @@ gtef_file_set_location (GtefFile *file,
 	{
 		g_object_notify_by_pspec (G_OBJECT (file), properties[PROP_LOCATION]);
 
-		/* The etag is for the old location. */
+		/* The etag and the checksum are for the old location. */
 		g_free (priv->etag);
 		priv->etag = NULL;
 
+		g_free (priv->checksum);
+		priv->checksum = NULL;
+
 		priv->externally_modified = FALSE;
 		priv->deleted = FALSE;
 
@@ -785,6 +824,102 @@ _gtef_file_set_etag (GtefFile    *file,
 	priv->etag = g_strdup (etag);
 }
 
+const gchar *
+_gtef_file_get_checksum (GtefFile *file)
+{
+	GtefFilePrivate *priv;
+
+	if (file == NULL)
+	{
+		return NULL;
+	}
+
+	g_return_val_if_fail (GTEF_IS_FILE (file), NULL);
+
+	priv = gtef_file_get_instance_private (file);
+	return priv->checksum;
+}
+
+/*
+ * _gtef_file_set_checksum:
+ * @file: (nullable): a #GtefFile.
+ * @checksum: (nullable): the checksum of the whole content of the location,
+ *   or %NULL if it is not known.
+ */
+void
+_gtef_file_set_checksum (GtefFile    *file,
+			 const gchar *checksum)
+{
+	GtefFilePrivate *priv;
+
+	if (file == NULL)
+	{
+		return;
+	}
+
+	g_return_if_fail (GTEF_IS_FILE (file));
+
+	priv = gtef_file_get_instance_private (file);
+
+	g_free (priv->checksum);
+	priv->checksum = g_strdup (checksum);
+}
+
+/**
+ * gtef_file_set_compute_checksum:
+ * @file: a #GtefFile.
+ * @compute_checksum: the new value.
+ *
+ * Sets whether a checksum of the whole content is computed by #GtefFileLoader
+ * and #GtefFileSaver operations. The checksum is needed by
+ * gtef_file_check_content_on_disk(). It is disabled by default, since the
+ * whole content needs to be hashed, which has a cost for big files.
+ *
+ * With %GTEF_FILE_SAVER_FLAGS_SKIP_IF_UNCHANGED, the checksum of the saved
+ * content is known anyway, so it is kept in any case.
+ *
+ * The checksum becomes known only on the next file loading or saving.
+ *
+ * Since: 2.0
+ */
+void
+gtef_file_set_compute_checksum (GtefFile *file,
+				gboolean  compute_checksum)
+{
+	GtefFilePrivate *priv;
+
+	g_return_if_fail (GTEF_IS_FILE (file));
+
+	priv = gtef_file_get_instance_private (file);
+
+	compute_checksum = compute_checksum != FALSE;
+
+	if (priv->compute_checksum != compute_checksum)
+	{
+		priv->compute_checksum = compute_checksum;
+		g_object_notify_by_pspec (G_OBJECT (file), properties[PROP_COMPUTE_CHECKSUM]);
+	}
+}
+
+/**
+ * gtef_file_get_compute_checksum:
+ * @file: a #GtefFile.
+ *
+ * Returns: whether a checksum of the content is computed on file loading and
+ * saving. See gtef_file_set_compute_checksum().
+ * Since: 2.0
+ */
+gboolean
+gtef_file_get_compute_checksum (GtefFile *file)
+{
+	GtefFilePrivate *priv;
+
+	g_return_val_if_fail (GTEF_IS_FILE (file), FALSE);
+
+	priv = gtef_file_get_instance_private (file);
+	return priv->compute_checksum;
+}
+
 /**
  * gtef_file_is_local:
  * @file: a #GtefFile.
@@ -812,6 +947,71 @@ gtef_file_is_local (GtefFile *file)
 	return g_file_has_uri_scheme (priv->location, "file");
 }
 
+/*
+ * _gtef_file_update_from_info:
+ * @file: a #GtefFile.
+ * @info: (nullable): a #GFileInfo with the %G_FILE_ATTRIBUTE_ETAG_VALUE and
+ *   %G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE attributes, or %NULL if the query on
+ *   the #GtefFile:location failed.
+ *
+ * Updates the externally-modified, deleted and read-only states of @file with
+ * the result of a query on its location.
+ *
+ * Returns: whether one of the states has changed.
+ */
+gboolean
+_gtef_file_update_from_info (GtefFile  *file,
+			     GFileInfo *info)
+{
+	GtefFilePrivate *priv;
+	gboolean old_externally_modified;
+	gboolean old_deleted;
+	gboolean old_readonly;
+
+	g_return_val_if_fail (GTEF_IS_FILE (file), FALSE);
+	g_return_val_if_fail (info == NULL || G_IS_FILE_INFO (info), FALSE);
+
+	priv = gtef_file_get_instance_private (file);
+
+	old_externally_modified = priv->externally_modified;
+	old_deleted = priv->deleted;
+	old_readonly = priv->readonly;
+
+	if (info == NULL)
+	{
+		priv->deleted = TRUE;
+		return !old_deleted;
+	}
+
+	priv->deleted = FALSE;
+
+	if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_ETAG_VALUE) &&
+	    priv->etag != NULL)
+	{
+		const gchar *etag;
+
+		etag = g_file_info_get_etag (info);
+
+		/* The etag can be the same again, for example when a check
+		 * has been done while the file was being saved.
+		 */
+		priv->externally_modified = g_strcmp0 (priv->etag, etag) != 0;
+	}
+
+	if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE))
+	{
+		gboolean readonly;
+
+		readonly = !g_file_info_get_attribute_boolean (info, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE);
+
+		_gtef_file_set_readonly (file, readonly);
+	}
+
+	return (old_externally_modified != priv->externally_modified ||
+		old_deleted != priv->deleted ||
+		old_readonly != priv->readonly);
+}
+
 /**
  * gtef_file_check_file_on_disk:
  * @file: a #GtefFile.
@@ -820,8 +1020,9 @@ gtef_file_is_local (GtefFile *file)
  * modified, or has been deleted, and whether the file is read-only.
  *
  * #GtefFile doesn't create a #GFileMonitor to track those properties, so
- * this function needs to be called instead. Creating lots of #GFileMonitor's
- * would take lots of resources.
+ * this function needs to be called instead. To keep many files up to date
+ * without blocking, see #GtefFileWatcher, which monitors the directories
+ * containing the files.
  *
  * Since this function is synchronous, it is advised to call it only on local
  * files. See gtef_file_is_local().
@@ -844,43 +1045,363 @@ gtef_file_check_file_on_disk (GtefFile *file)
 	}
 
 	info = g_file_query_info (priv->location,
-				  G_FILE_ATTRIBUTE_ETAG_VALUE ","
-				  G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE,
+				  _GTEF_FILE_CHECK_ATTRIBUTES,
 				  G_FILE_QUERY_INFO_NONE,
 				  NULL,
 				  NULL);
 
-	if (info == NULL)
+	_gtef_file_update_from_info (file, info);
+
+	g_clear_object (&info);
+}
+
+/* Data of a gtef_file_check_content_on_disk() operation. */
+typedef struct _ContentCheck ContentCheck;
+struct _ContentCheck
+{
+	GFile *location;
+
+	/* Results. */
+	GFileInfo *info;
+	gchar *checksum;
+
+	/* Whether the checksum needs to be computed. */
+	guint with_checksum : 1;
+};
+
+static ContentCheck *
+content_check_new (GtefFile *file)
+{
+	GtefFilePrivate *priv = gtef_file_get_instance_private (file);
+	ContentCheck *check;
+
+	check = g_new0 (ContentCheck, 1);
+	check->location = g_object_ref (priv->location);
+	check->with_checksum = priv->checksum != NULL;
+
+	return check;
+}
+
+static void
+content_check_free (gpointer data)
+{
+	ContentCheck *check = data;
+
+	if (check == NULL)
 	{
-		priv->deleted = TRUE;
 		return;
 	}
 
-	priv->deleted = FALSE;
+	g_object_unref (check->location);
+	g_clear_object (&check->info);
+	g_free (check->checksum);
+	g_free (check);
+}
 
-	if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_ETAG_VALUE) &&
-	    priv->etag != NULL)
+/* Returns the checksum of the content of @location, or %NULL on error. */
+static gchar *
+compute_checksum (GFile         *location,
+		  GCancellable  *cancellable,
+		  GError       **error)
+{
+	GFileInputStream *input_stream;
+	GtefContentHash *hash;
+	guchar *buffer;
+	gchar *result = NULL;
+	gssize bytes_read;
+
+	input_stream = g_file_read (location, cancellable, error);
+
+	if (input_stream == NULL)
 	{
-		const gchar *etag;
+		return NULL;
+	}
 
-		etag = g_file_info_get_etag (info);
+	hash = _gtef_content_hash_new ();
+	buffer = g_malloc (CHECKSUM_READ_SIZE);
 
-		if (g_strcmp0 (priv->etag, etag) != 0)
-		{
-			priv->externally_modified = TRUE;
-		}
+	while ((bytes_read = g_input_stream_read (G_INPUT_STREAM (input_stream),
+						  buffer,
+						  CHECKSUM_READ_SIZE,
+						  cancellable,
+						  error)) > 0)
+	{
+		_gtef_content_hash_update (hash, buffer, bytes_read);
 	}
 
-	if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE))
+	if (bytes_read == 0)
 	{
-		gboolean readonly;
+		result = _gtef_content_hash_get_string (hash);
+	}
 
-		readonly = !g_file_info_get_attribute_boolean (info, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE);
+	g_input_stream_close (G_INPUT_STREAM (input_stream), NULL, NULL);
+	g_object_unref (input_stream);
+	_gtef_content_hash_free (hash);
+	g_free (buffer);
 
-		_gtef_file_set_readonly (file, readonly);
+	return result;
+}
+
+/* Does the I/O of a content check, can be run in a worker thread. Returns
+ * FALSE only if the operation has been cancelled. Other errors are part of
+ * the results: a failed query means that the file is deleted, and if the
+ * content cannot be read the result of the etag comparison is kept.
+ */
+static gboolean
+content_check_run (ContentCheck  *check,
+		   GCancellable  *cancellable,
+		   GError       **error)
+{
+	GError *my_error = NULL;
+
+	check->info = g_file_query_info (check->location,
+					 _GTEF_FILE_CHECK_ATTRIBUTES,
+					 G_FILE_QUERY_INFO_NONE,
+					 cancellable,
+					 &my_error);
+
+	if (check->info == NULL || !check->with_checksum)
+	{
+		goto out;
+	}
+
+	check->checksum = compute_checksum (check->location, cancellable, &my_error);
+
+out:
+	if (g_error_matches (my_error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+	{
+		g_propagate_error (error, my_error);
+		return FALSE;
+	}
+
+	g_clear_error (&my_error);
+	return TRUE;
+}
+
+/* Applies the results of a content check, in the main thread. */
+static void
+content_check_apply (GtefFile     *file,
+		     ContentCheck *check)
+{
+	GtefFilePrivate *priv = gtef_file_get_instance_private (file);
+
+	/* The location has changed meanwhile. */
+	if (priv->location == NULL ||
+	    !g_file_equal (priv->location, check->location))
+	{
+		return;
+	}
+
+	_gtef_file_update_from_info (file, check->info);
+
+	if (check->info == NULL ||
+	    check->checksum == NULL ||
+	    priv->checksum == NULL)
+	{
+		return;
+	}
+
+	priv->externally_modified = g_strcmp0 (priv->checksum, check->checksum) != 0;
+
+	if (!priv->externally_modified &&
+	    g_file_info_has_attribute (check->info, G_FILE_ATTRIBUTE_ETAG_VALUE))
+	{
+		_gtef_file_set_etag (file, g_file_info_get_etag (check->info));
+	}
+}
+
+/**
+ * gtef_file_check_content_on_disk:
+ * @file: a #GtefFile.
+ *
+ * Like gtef_file_check_file_on_disk(), but the externally-modified state is
+ * determined by comparing the content of the file on disk with the content
+ * last loaded or saved, instead of by comparing the entity tags. It is useful
+ * on file systems where the modification time is not reliable, for example
+ * with a coarse granularity, or when the file is touched without being
+ * changed.
+ *
+ * The whole file is read, so this function is more expensive than
+ * gtef_file_check_file_on_disk(). If the content is unchanged, the new entity
+ * tag of the file is kept, so that the next #GtefFileSaver operation doesn't
+ * fail with %GTEF_FILE_SAVER_ERROR_EXTERNALLY_MODIFIED.
+ *
+ * If the checksum of the content last loaded or saved is not known, for
+ * example if #GtefFile:compute-checksum is %FALSE or after a #GtefFileLoader
+ * operation that loaded only the appended content, this function does the
+ * same as gtef_file_check_file_on_disk().
+ *
+ * Since this function is synchronous, it is advised to call it only on local
+ * files. See gtef_file_is_local(). See also
+ * gtef_file_check_content_on_disk_async().
+ *
+ * Since: 2.0
+ */
+void
+gtef_file_check_content_on_disk (GtefFile *file)
+{
+	GtefFilePrivate *priv;
+	ContentCheck *check;
+
+	g_return_if_fail (GTEF_IS_FILE (file));
+
+	priv = gtef_file_get_instance_private (file);
+
+	if (priv->location == NULL)
+	{
+		return;
+	}
+
+	check = content_check_new (file);
+	content_check_run (check, NULL, NULL);
+	content_check_apply (file, check);
+	content_check_free (check);
+}
+
+/* Runs in a worker thread. */
+static void
+check_content_thread (GTask        *check_task,
+		      gpointer      source_object,
+		      gpointer      task_data,
+		      GCancellable *cancellable)
+{
+	ContentCheck *check = task_data;
+	GError *error = NULL;
+
+	if (content_check_run (check, cancellable, &error))
+	{
+		g_task_return_boolean (check_task, TRUE);
+	}
+	else
+	{
+		g_task_return_error (check_task, error);
+	}
+}
+
+static void
+check_content_thread_cb (GObject      *source_object,
+			 GAsyncResult *result,
+			 gpointer      user_data)
+{
+	GTask *check_task = G_TASK (result);
+	GTask *task = G_TASK (user_data);
+	GError *error = NULL;
+
+	if (g_task_propagate_boolean (check_task, &error))
+	{
+		g_task_return_boolean (task, TRUE);
+	}
+	else
+	{
+		g_task_return_error (task, error);
+	}
+
+	g_object_unref (task);
+}
+
+/**
+ * gtef_file_check_content_on_disk_async:
+ * @file: a #GtefFile.
+ * @io_priority: the I/O priority of the request. E.g. %G_PRIORITY_LOW,
+ *   %G_PRIORITY_DEFAULT or %G_PRIORITY_HIGH.
+ * @cancellable: (nullable): optional #GCancellable object, %NULL to ignore.
+ * @callback: (scope async): a #GAsyncReadyCallback to call when the request is
+ *   satisfied.
+ * @user_data: user data to pass to @callback.
+ *
+ * The asynchronous version of gtef_file_check_content_on_disk(). The file is
+ * queried and read in a worker thread.
+ *
+ * See the #GAsyncResult documentation to know how to use this function.
+ *
+ * Since: 2.0
+ */
+void
+gtef_file_check_content_on_disk_async (GtefFile            *file,
+				       gint                 io_priority,
+				       GCancellable        *cancellable,
+				       GAsyncReadyCallback  callback,
+				       gpointer             user_data)
+{
+	GtefFilePrivate *priv;
+	GTask *task;
+	GTask *check_task;
+	ContentCheck *check;
+
+	g_return_if_fail (GTEF_IS_FILE (file));
+	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+	priv = gtef_file_get_instance_private (file);
+
+	task = g_task_new (file, cancellable, callback, user_data);
+	g_task_set_priority (task, io_priority);
+
+	if (priv->location == NULL)
+	{
+		g_task_return_boolean (task, TRUE);
+		g_object_unref (task);
+		return;
+	}
+
+	/* The results are owned by the task, which is kept alive until the
+	 * worker thread has finished.
+	 */
+	check = content_check_new (file);
+	g_task_set_task_data (task, check, content_check_free);
+
+	/* No source object: the last unref of the check task can happen in
+	 * the worker thread, and the GtefFile must be finalized in the main
+	 * thread.
+	 */
+	check_task = g_task_new (NULL,
+				 cancellable,
+				 check_content_thread_cb,
+				 task);
+
+	g_task_set_priority (check_task, io_priority);
+	g_task_set_task_data (check_task, check, NULL);
+	g_task_run_in_thread (check_task, check_content_thread);
+	g_object_unref (check_task);
+}
+
+/**
+ * gtef_file_check_content_on_disk_finish:
+ * @file: a #GtefFile.
+ * @result: a #GAsyncResult.
+ * @error: a #GError, or %NULL.
+ *
+ * Finishes an operation started with gtef_file_check_content_on_disk_async().
+ * If it is successful, the externally-modified, deleted and read-only states
+ * of @file are updated, like with gtef_file_check_content_on_disk(). The
+ * states are not updated if the #GtefFile:location has changed meanwhile.
+ *
+ * Returns: %FALSE if the operation has been cancelled, %TRUE otherwise.
+ * Since: 2.0
+ */
+gboolean
+gtef_file_check_content_on_disk_finish (GtefFile      *file,
+					GAsyncResult  *result,
+					GError       **error)
+{
+	ContentCheck *check;
+
+	g_return_val_if_fail (GTEF_IS_FILE (file), FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+	g_return_val_if_fail (g_task_is_valid (result, file), FALSE);
+
+	if (!g_task_propagate_boolean (G_TASK (result), error))
+	{
+		return FALSE;
+	}
+
+	check = g_task_get_task_data (G_TASK (result));
+
+	if (check != NULL)
+	{
+		content_check_apply (file, check);
 	}
 
-	g_object_unref (info);
+	return TRUE;
 }
 
 void
@@ -904,7 +1425,7 @@ _gtef_file_set_externally_modified (GtefFile *file,
  * #GtefFile:location is %NULL, returns %FALSE.
  *
  * To have an up-to-date value, you must first call
- * gtef_file_check_file_on_disk().
+ * gtef_file_check_file_on_disk(), or watch the file with a #GtefFileWatcher.
  *
  * Returns: whether the file is externally modified.
  * Since: 1.0
@@ -941,7 +1462,7 @@ _gtef_file_set_deleted (GtefFile *file,
  * #GtefFile:location is %NULL, returns %FALSE.
  *
  * To have an up-to-date value, you must first call
- * gtef_file_check_file_on_disk().
+ * gtef_file_check_file_on_disk(), or watch the file with a #GtefFileWatcher.
  *
  * Returns: whether the file has been deleted.
  * Since: 1.0
@@ -984,7 +1505,7 @@ _gtef_file_set_readonly (GtefFile *file,
  * #GtefFile:location is %NULL, returns %FALSE.
  *
  * To have an up-to-date value, you must first call
- * gtef_file_check_file_on_disk().
+ * gtef_file_check_file_on_disk(), or watch the file with a #GtefFileWatcher.
  *
  * Returns: whether the file is read-only.
  * Since: 1.0
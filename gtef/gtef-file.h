@@ -118,8 +118,25 @@ void		 	gtef_file_set_mount_operation_factory	(GtefFile                  *file,
 								 gpointer                   user_data,
 								 GDestroyNotify             notify);
 
+void			gtef_file_set_compute_checksum		(GtefFile *file,
+								 gboolean  compute_checksum);
+
+gboolean		gtef_file_get_compute_checksum		(GtefFile *file);
+
 void		 	gtef_file_check_file_on_disk		(GtefFile *file);
 
+void		 	gtef_file_check_content_on_disk		(GtefFile *file);
+
+void			gtef_file_check_content_on_disk_async	(GtefFile            *file,
+								 gint                 io_priority,
+								 GCancellable        *cancellable,
+								 GAsyncReadyCallback  callback,
+								 gpointer             user_data);
+
+gboolean		gtef_file_check_content_on_disk_finish	(GtefFile      *file,
+								 GAsyncResult  *result,
+								 GError       **error);
+
 gboolean	 	gtef_file_is_local			(GtefFile *file);
 
 gboolean	 	gtef_file_is_externally_modified	(GtefFile *file);
@@ -153,6 +170,13 @@ G_GNUC_INTERNAL
 void			_gtef_file_set_etag			(GtefFile    *file,
 								 const gchar *etag);
 
+G_GNUC_INTERNAL
+const gchar *		_gtef_file_get_checksum			(GtefFile *file);
+
+G_GNUC_INTERNAL
+void			_gtef_file_set_checksum			(GtefFile    *file,
+								 const gchar *checksum);
+
 G_GNUC_INTERNAL
 void			_gtef_file_set_externally_modified	(GtefFile *file,
 								 gboolean  externally_modified);
@@ -165,6 +189,13 @@ G_GNUC_INTERNAL
 void			_gtef_file_set_readonly			(GtefFile *file,
 								 gboolean  readonly);
 
+/* The attributes to query for _gtef_file_update_from_info(). */
+#define _GTEF_FILE_CHECK_ATTRIBUTES G_FILE_ATTRIBUTE_ETAG_VALUE "," G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE
+
+G_GNUC_INTERNAL
+gboolean		_gtef_file_update_from_info		(GtefFile  *file,
+								 GFileInfo *info);
+
 G_END_DECLS
 
 #endif /* GTEF_FILE_H */
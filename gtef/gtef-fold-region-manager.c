@@ -0,0 +1,685 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gtef-fold-region-manager.h"
+#include "gtef-fold-region.h"
+
+/**
+ * SECTION:fold-region-manager
+ * @Short_description: Index of the fold regions of a GtkTextBuffer
+ * @Title: GtefFoldRegionManager
+ * @See_also: #GtefFoldRegion, #GtefGutterRendererFolds
+ *
+ * #GtefFoldRegionManager keeps all the #GtefFoldRegion's of a #GtkTextBuffer.
+ * There is one #GtefFoldRegionManager per buffer, created on demand by
+ * gtef_fold_region_manager_get_from_buffer(). The #GtefFoldRegion's register
+ * themselves, there is nothing to do to add or remove a region.
+ *
+ * The regions covering or starting at a certain line can be retrieved
+ * efficiently, even with thousands of regions. It is used by
+ * #GtefGutterRendererFolds to know the folding state of each line.
+ *
+ * All the folded regions of a buffer share the same #GtkTextTag, with the
+ * #GtkTextTag:invisible property. When a region is unfolded, the text stays
+ * invisible where it is still covered by another folded region.
+ */
+
+/* The regions are stored in an interval tree: a treap ordered by the position
+ * of the start mark, where each node also knows the region with the furthest
+ * end mark in its subtree. When the buffer is modified, the marks move but
+ * never cross each other, so the tree stays valid without being updated.
+ *
+ * A node is found from its region with the nodes hash table, and is removed by
+ * rotating it down to a leaf, with the parent pointers, so that no comparison
+ * is needed; which is important since the marks of the region may already be
+ * gone.
+ */
+
+typedef struct _Node Node;
+
+struct _Node
+{
+	/* Unowned. */
+	GtefFoldRegion *region;
+
+	/* The region in this subtree with the furthest end. */
+	GtefFoldRegion *max_end_region;
+
+	guint32 priority;
+
+	Node *parent;
+	Node *left;
+	Node *right;
+};
+
+struct _GtefFoldRegionManagerPrivate
+{
+	/* Unowned, the buffer owns the manager. */
+	GtkTextBuffer *buffer;
+
+	/* The tag for the folded regions, created when needed. */
+	GtkTextTag *tag;
+
+	Node *root;
+
+	/* GtefFoldRegion -> owned Node */
+	GHashTable *nodes;
+};
+
+enum
+{
+	SIGNAL_CHANGED,
+	N_SIGNALS
+};
+
+#define MANAGER_KEY "gtef-fold-region-manager-key"
+
+static guint signals[N_SIGNALS];
+
+G_DEFINE_TYPE_WITH_PRIVATE (GtefFoldRegionManager, gtef_fold_region_manager, G_TYPE_OBJECT)
+
+static void
+get_start_iter (GtefFoldRegion *region,
+		GtkTextIter    *iter)
+{
+	GtkTextIter end;
+
+	gtef_fold_region_get_bounds (region, iter, &end);
+}
+
+static void
+get_end_iter (GtefFoldRegion *region,
+	      GtkTextIter    *iter)
+{
+	GtkTextIter start;
+
+	gtef_fold_region_get_bounds (region, &start, iter);
+}
+
+static gint
+get_start_line (GtefFoldRegion *region)
+{
+	GtkTextIter iter;
+
+	get_start_iter (region, &iter);
+	return gtk_text_iter_get_line (&iter);
+}
+
+static gint
+get_end_line (GtefFoldRegion *region)
+{
+	GtkTextIter iter;
+
+	get_end_iter (region, &iter);
+	return gtk_text_iter_get_line (&iter);
+}
+
+/* The range of text hidden when the region is folded: from the next line after
+ * the start to the next line after the end.
+ */
+static void
+get_hidden_range (GtefFoldRegion *region,
+		  GtkTextIter    *start,
+		  GtkTextIter    *end)
+{
+	gtef_fold_region_get_bounds (region, start, end);
+
+	gtk_text_iter_forward_line (start);
+	gtk_text_iter_forward_line (end);
+}
+
+static void
+node_update (Node *node)
+{
+	GtkTextIter max_end;
+	Node *children[2];
+	gint i;
+
+	node->max_end_region = node->region;
+	get_end_iter (node->region, &max_end);
+
+	children[0] = node->left;
+	children[1] = node->right;
+
+	for (i = 0; i < 2; i++)
+	{
+		GtkTextIter end;
+
+		if (children[i] == NULL)
+		{
+			continue;
+		}
+
+		get_end_iter (children[i]->max_end_region, &end);
+
+		if (gtk_text_iter_compare (&end, &max_end) > 0)
+		{
+			node->max_end_region = children[i]->max_end_region;
+			max_end = end;
+		}
+	}
+}
+
+static void
+update_to_root (Node *node)
+{
+	for (; node != NULL; node = node->parent)
+	{
+		node_update (node);
+	}
+}
+
+static void
+replace_child (GtefFoldRegionManager *manager,
+	       Node                  *parent,
+	       Node                  *old_child,
+	       Node                  *new_child)
+{
+	if (new_child != NULL)
+	{
+		new_child->parent = parent;
+	}
+
+	if (parent == NULL)
+	{
+		manager->priv->root = new_child;
+	}
+	else if (parent->left == old_child)
+	{
+		parent->left = new_child;
+	}
+	else
+	{
+		parent->right = new_child;
+	}
+}
+
+/* Moves @node one level up, in place of its parent. */
+static void
+rotate_up (GtefFoldRegionManager *manager,
+	   Node                  *node)
+{
+	Node *parent = node->parent;
+
+	g_assert (parent != NULL);
+
+	replace_child (manager, parent->parent, parent, node);
+
+	if (parent->left == node)
+	{
+		parent->left = node->right;
+		if (parent->left != NULL)
+		{
+			parent->left->parent = parent;
+		}
+
+		node->right = parent;
+	}
+	else
+	{
+		parent->right = node->left;
+		if (parent->right != NULL)
+		{
+			parent->right->parent = parent;
+		}
+
+		node->left = parent;
+	}
+
+	parent->parent = node;
+
+	node_update (parent);
+	node_update (node);
+}
+
+static void
+tree_insert (GtefFoldRegionManager *manager,
+	     Node                  *node)
+{
+	GtkTextIter start;
+	Node *parent = NULL;
+	Node **link = &manager->priv->root;
+
+	get_start_iter (node->region, &start);
+
+	while (*link != NULL)
+	{
+		GtkTextIter cur_start;
+
+		parent = *link;
+		get_start_iter (parent->region, &cur_start);
+
+		if (gtk_text_iter_compare (&start, &cur_start) < 0)
+		{
+			link = &parent->left;
+		}
+		else
+		{
+			link = &parent->right;
+		}
+	}
+
+	*link = node;
+	node->parent = parent;
+	update_to_root (node);
+
+	while (node->parent != NULL &&
+	       node->priority > node->parent->priority)
+	{
+		rotate_up (manager, node);
+	}
+}
+
+static void
+tree_remove (GtefFoldRegionManager *manager,
+	     Node                  *node)
+{
+	Node *child;
+	Node *parent;
+
+	while (node->left != NULL && node->right != NULL)
+	{
+		if (node->left->priority > node->right->priority)
+		{
+			rotate_up (manager, node->left);
+		}
+		else
+		{
+			rotate_up (manager, node->right);
+		}
+	}
+
+	child = node->left != NULL ? node->left : node->right;
+	parent = node->parent;
+
+	replace_child (manager, parent, node, child);
+	update_to_root (parent);
+}
+
+/* Appends to @list, in reverse order, the regions of the subtree overlapping
+ * the lines from @start_line to @end_line.
+ */
+static GList *
+collect_regions (Node   *node,
+		 gint    start_line,
+		 gint    end_line,
+		 GList  *list)
+{
+	if (node == NULL)
+	{
+		return list;
+	}
+
+	/* No region ends after start_line in this subtree. */
+	if (get_end_line (node->max_end_region) < start_line)
+	{
+		return list;
+	}
+
+	list = collect_regions (node->left, start_line, end_line, list);
+
+	/* The regions in the right subtree start even later. */
+	if (get_start_line (node->region) > end_line)
+	{
+		return list;
+	}
+
+	if (get_end_line (node->region) >= start_line)
+	{
+		list = g_list_prepend (list, node->region);
+	}
+
+	return collect_regions (node->right, start_line, end_line, list);
+}
+
+static void
+gtef_fold_region_manager_finalize (GObject *object)
+{
+	GtefFoldRegionManager *manager = GTEF_FOLD_REGION_MANAGER (object);
+
+	/* The buffer is being finalized, the regions are no longer in it. */
+	g_hash_table_unref (manager->priv->nodes);
+
+	G_OBJECT_CLASS (gtef_fold_region_manager_parent_class)->finalize (object);
+}
+
+static void
+gtef_fold_region_manager_class_init (GtefFoldRegionManagerClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+	object_class->finalize = gtef_fold_region_manager_finalize;
+
+	/**
+	 * GtefFoldRegionManager::changed:
+	 * @manager: the #GtefFoldRegionManager emitting the signal.
+	 *
+	 * The ::changed signal is emitted when a region is added, removed,
+	 * folded or unfolded, or when its bounds are set.
+	 *
+	 * Since: 2.0
+	 */
+	signals[SIGNAL_CHANGED] =
+		g_signal_new ("changed",
+			      G_TYPE_FROM_CLASS (klass),
+			      G_SIGNAL_RUN_LAST,
+			      0,
+			      NULL, NULL, NULL,
+			      G_TYPE_NONE, 0);
+}
+
+static void
+gtef_fold_region_manager_init (GtefFoldRegionManager *manager)
+{
+	manager->priv = gtef_fold_region_manager_get_instance_private (manager);
+
+	manager->priv->nodes = g_hash_table_new_full (g_direct_hash,
+						      g_direct_equal,
+						      NULL,
+						      g_free);
+}
+
+/**
+ * gtef_fold_region_manager_get_from_buffer:
+ * @buffer: a #GtkTextBuffer.
+ *
+ * Returns the #GtefFoldRegionManager of @buffer, creating it if it doesn't
+ * exist yet. The manager lives as long as @buffer.
+ *
+ * Returns: (transfer none): the #GtefFoldRegionManager of @buffer.
+ * Since: 2.0
+ */
+GtefFoldRegionManager *
+gtef_fold_region_manager_get_from_buffer (GtkTextBuffer *buffer)
+{
+	GtefFoldRegionManager *manager;
+
+	g_return_val_if_fail (GTK_IS_TEXT_BUFFER (buffer), NULL);
+
+	manager = _gtef_fold_region_manager_lookup (buffer);
+
+	if (manager == NULL)
+	{
+		manager = g_object_new (GTEF_TYPE_FOLD_REGION_MANAGER, NULL);
+		manager->priv->buffer = buffer;
+
+		g_object_set_data_full (G_OBJECT (buffer),
+					MANAGER_KEY,
+					manager,
+					g_object_unref);
+	}
+
+	return manager;
+}
+
+/* Returns: (transfer none) (nullable): the manager of @buffer, if it exists. */
+GtefFoldRegionManager *
+_gtef_fold_region_manager_lookup (GtkTextBuffer *buffer)
+{
+	g_return_val_if_fail (GTK_IS_TEXT_BUFFER (buffer), NULL);
+
+	return g_object_get_data (G_OBJECT (buffer), MANAGER_KEY);
+}
+
+/**
+ * gtef_fold_region_manager_get_buffer:
+ * @manager: a #GtefFoldRegionManager.
+ *
+ * Returns: (transfer none): the #GtkTextBuffer of @manager.
+ * Since: 2.0
+ */
+GtkTextBuffer *
+gtef_fold_region_manager_get_buffer (GtefFoldRegionManager *manager)
+{
+	g_return_val_if_fail (GTEF_IS_FOLD_REGION_MANAGER (manager), NULL);
+
+	return manager->priv->buffer;
+}
+
+/**
+ * gtef_fold_region_manager_get_n_regions:
+ * @manager: a #GtefFoldRegionManager.
+ *
+ * Returns: the number of #GtefFoldRegion's in the buffer.
+ * Since: 2.0
+ */
+guint
+gtef_fold_region_manager_get_n_regions (GtefFoldRegionManager *manager)
+{
+	g_return_val_if_fail (GTEF_IS_FOLD_REGION_MANAGER (manager), 0);
+
+	return g_hash_table_size (manager->priv->nodes);
+}
+
+/**
+ * gtef_fold_region_manager_get_regions_in_range:
+ * @manager: a #GtefFoldRegionManager.
+ * @start_line: the first line.
+ * @end_line: the last line.
+ *
+ * Gets the regions overlapping the lines from @start_line to @end_line,
+ * inclusive. The regions are ordered by their start position.
+ *
+ * The time complexity is O(log n + k), n being the number of regions in the
+ * buffer and k the number of regions returned.
+ *
+ * Returns: (transfer container) (element-type GtefFoldRegion): the list of
+ *   regions.
+ * Since: 2.0
+ */
+GList *
+gtef_fold_region_manager_get_regions_in_range (GtefFoldRegionManager *manager,
+					       gint                   start_line,
+					       gint                   end_line)
+{
+	GList *list;
+
+	g_return_val_if_fail (GTEF_IS_FOLD_REGION_MANAGER (manager), NULL);
+	g_return_val_if_fail (start_line <= end_line, NULL);
+
+	list = collect_regions (manager->priv->root, start_line, end_line, NULL);
+
+	return g_list_reverse (list);
+}
+
+/**
+ * gtef_fold_region_manager_get_regions_at_line:
+ * @manager: a #GtefFoldRegionManager.
+ * @line: a line number.
+ *
+ * Gets the regions covering @line, from the start line to the end line of the
+ * region, inclusive. The regions are ordered by their start position, so the
+ * outer regions come first.
+ *
+ * Returns: (transfer container) (element-type GtefFoldRegion): the list of
+ *   regions.
+ * Since: 2.0
+ */
+GList *
+gtef_fold_region_manager_get_regions_at_line (GtefFoldRegionManager *manager,
+					      gint                   line)
+{
+	return gtef_fold_region_manager_get_regions_in_range (manager, line, line);
+}
+
+/**
+ * gtef_fold_region_manager_get_regions_starting_at_line:
+ * @manager: a #GtefFoldRegionManager.
+ * @line: a line number.
+ *
+ * Returns: (transfer container) (element-type GtefFoldRegion): the list of
+ *   regions starting at @line.
+ * Since: 2.0
+ */
+GList *
+gtef_fold_region_manager_get_regions_starting_at_line (GtefFoldRegionManager *manager,
+						       gint                   line)
+{
+	GList *list;
+	GList *l;
+
+	list = gtef_fold_region_manager_get_regions_at_line (manager, line);
+
+	l = list;
+	while (l != NULL)
+	{
+		GList *next = l->next;
+
+		if (get_start_line (l->data) != line)
+		{
+			list = g_list_delete_link (list, l);
+		}
+
+		l = next;
+	}
+
+	return list;
+}
+
+/* @fold_region must have its bounds set. */
+void
+_gtef_fold_region_manager_add_region (GtefFoldRegionManager *manager,
+				      GtefFoldRegion        *fold_region)
+{
+	Node *node;
+
+	g_return_if_fail (GTEF_IS_FOLD_REGION_MANAGER (manager));
+	g_return_if_fail (GTEF_IS_FOLD_REGION (fold_region));
+	g_return_if_fail (!g_hash_table_contains (manager->priv->nodes, fold_region));
+
+	node = g_new0 (Node, 1);
+	node->region = fold_region;
+	node->max_end_region = fold_region;
+	node->priority = g_random_int ();
+
+	g_hash_table_insert (manager->priv->nodes, fold_region, node);
+	tree_insert (manager, node);
+
+	g_signal_emit (manager, signals[SIGNAL_CHANGED], 0);
+}
+
+void
+_gtef_fold_region_manager_remove_region (GtefFoldRegionManager *manager,
+					 GtefFoldRegion        *fold_region)
+{
+	Node *node;
+
+	g_return_if_fail (GTEF_IS_FOLD_REGION_MANAGER (manager));
+	g_return_if_fail (GTEF_IS_FOLD_REGION (fold_region));
+
+	node = g_hash_table_lookup (manager->priv->nodes, fold_region);
+	if (node == NULL)
+	{
+		return;
+	}
+
+	tree_remove (manager, node);
+	g_hash_table_remove (manager->priv->nodes, fold_region);
+
+	g_signal_emit (manager, signals[SIGNAL_CHANGED], 0);
+}
+
+void
+_gtef_fold_region_manager_fold_region (GtefFoldRegionManager *manager,
+				       GtefFoldRegion        *fold_region)
+{
+	GtkTextIter start;
+	GtkTextIter end;
+
+	g_return_if_fail (GTEF_IS_FOLD_REGION_MANAGER (manager));
+	g_return_if_fail (GTEF_IS_FOLD_REGION (fold_region));
+
+	if (manager->priv->tag == NULL)
+	{
+		manager->priv->tag = gtk_text_buffer_create_tag (manager->priv->buffer,
+								 NULL,
+								 "invisible", TRUE,
+								 NULL);
+	}
+
+	get_hidden_range (fold_region, &start, &end);
+	gtk_text_buffer_apply_tag (manager->priv->buffer, manager->priv->tag, &start, &end);
+
+	g_signal_emit (manager, signals[SIGNAL_CHANGED], 0);
+}
+
+/* Shows the text hidden by @fold_region, except where another folded region
+ * still hides it.
+ */
+void
+_gtef_fold_region_manager_unfold_region (GtefFoldRegionManager *manager,
+					 GtefFoldRegion        *fold_region)
+{
+	GtkTextIter start;
+	GtkTextIter end;
+	GList *overlapping_regions;
+	GList *l;
+
+	g_return_if_fail (GTEF_IS_FOLD_REGION_MANAGER (manager));
+	g_return_if_fail (GTEF_IS_FOLD_REGION (fold_region));
+
+	if (manager->priv->tag == NULL)
+	{
+		return;
+	}
+
+	get_hidden_range (fold_region, &start, &end);
+	gtk_text_buffer_remove_tag (manager->priv->buffer, manager->priv->tag, &start, &end);
+
+	overlapping_regions = gtef_fold_region_manager_get_regions_in_range (manager,
+									     get_start_line (fold_region),
+									     get_end_line (fold_region));
+
+	for (l = overlapping_regions; l != NULL; l = l->next)
+	{
+		GtefFoldRegion *other_region = l->data;
+		GtkTextIter other_start;
+		GtkTextIter other_end;
+
+		if (other_region == fold_region ||
+		    !gtef_fold_region_get_folded (other_region))
+		{
+			continue;
+		}
+
+		get_hidden_range (other_region, &other_start, &other_end);
+
+		/* Intersection with the unfolded range. */
+		if (gtk_text_iter_compare (&other_start, &start) < 0)
+		{
+			other_start = start;
+		}
+		if (gtk_text_iter_compare (&other_end, &end) > 0)
+		{
+			other_end = end;
+		}
+
+		if (gtk_text_iter_compare (&other_start, &other_end) < 0)
+		{
+			gtk_text_buffer_apply_tag (manager->priv->buffer,
+						   manager->priv->tag,
+						   &other_start,
+						   &other_end);
+		}
+	}
+
+	g_list_free (overlapping_regions);
+
+	g_signal_emit (manager, signals[SIGNAL_CHANGED], 0);
+}
@@ -0,0 +1,97 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GTEF_FOLD_REGION_MANAGER_H
+#define GTEF_FOLD_REGION_MANAGER_H
+
+#if !defined (GTEF_H_INSIDE) && !defined (GTEF_COMPILATION)
+#error "Only <gtef/gtef.h> can be included directly."
+#endif
+
+#include <gtk/gtk.h>
+#include <gtef/gtef-types.h>
+
+G_BEGIN_DECLS
+
+#define GTEF_TYPE_FOLD_REGION_MANAGER             (gtef_fold_region_manager_get_type ())
+#define GTEF_FOLD_REGION_MANAGER(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), GTEF_TYPE_FOLD_REGION_MANAGER, GtefFoldRegionManager))
+#define GTEF_FOLD_REGION_MANAGER_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST ((klass), GTEF_TYPE_FOLD_REGION_MANAGER, GtefFoldRegionManagerClass))
+#define GTEF_IS_FOLD_REGION_MANAGER(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GTEF_TYPE_FOLD_REGION_MANAGER))
+#define GTEF_IS_FOLD_REGION_MANAGER_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass), GTEF_TYPE_FOLD_REGION_MANAGER))
+#define GTEF_FOLD_REGION_MANAGER_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj), GTEF_TYPE_FOLD_REGION_MANAGER, GtefFoldRegionManagerClass))
+
+typedef struct _GtefFoldRegionManagerClass    GtefFoldRegionManagerClass;
+typedef struct _GtefFoldRegionManagerPrivate  GtefFoldRegionManagerPrivate;
+
+struct _GtefFoldRegionManager
+{
+	GObject parent;
+
+	GtefFoldRegionManagerPrivate *priv;
+};
+
+struct _GtefFoldRegionManagerClass
+{
+	GObjectClass parent_class;
+
+	gpointer padding[12];
+};
+
+GType		gtef_fold_region_manager_get_type			(void) G_GNUC_CONST;
+
+GtefFoldRegionManager *
+		gtef_fold_region_manager_get_from_buffer		(GtkTextBuffer         *buffer);
+
+GtkTextBuffer *	gtef_fold_region_manager_get_buffer			(GtefFoldRegionManager *manager);
+
+guint		gtef_fold_region_manager_get_n_regions			(GtefFoldRegionManager *manager);
+
+GList *		gtef_fold_region_manager_get_regions_in_range		(GtefFoldRegionManager *manager,
+									 gint                   start_line,
+									 gint                   end_line);
+
+GList *		gtef_fold_region_manager_get_regions_at_line		(GtefFoldRegionManager *manager,
+									 gint                   line);
+
+GList *		gtef_fold_region_manager_get_regions_starting_at_line	(GtefFoldRegionManager *manager,
+									 gint                   line);
+
+G_GNUC_INTERNAL
+GtefFoldRegionManager *
+		_gtef_fold_region_manager_lookup			(GtkTextBuffer         *buffer);
+
+G_GNUC_INTERNAL
+void		_gtef_fold_region_manager_add_region			(GtefFoldRegionManager *manager,
+									 GtefFoldRegion        *fold_region);
+
+G_GNUC_INTERNAL
+void		_gtef_fold_region_manager_remove_region			(GtefFoldRegionManager *manager,
+									 GtefFoldRegion        *fold_region);
+
+G_GNUC_INTERNAL
+void		_gtef_fold_region_manager_fold_region			(GtefFoldRegionManager *manager,
+									 GtefFoldRegion        *fold_region);
+
+G_GNUC_INTERNAL
+void		_gtef_fold_region_manager_unfold_region			(GtefFoldRegionManager *manager,
+									 GtefFoldRegion        *fold_region);
+
+G_END_DECLS
+
+#endif /* GTEF_FOLD_REGION_MANAGER_H */
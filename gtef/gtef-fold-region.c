@@ -18,6 +18,7 @@
  */
 
 #include "gtef-fold-region.h"
+#include "gtef-fold-region-manager.h"
 
 /**
  * SECTION:fold-region
@@ -30,6 +31,9 @@
  * property is applied to the folded region. The actual start and end position
  * of this #GtkTextTag is respectively at the next new line after the start and
  * end position of the bounds handed over to gtef_fold_region_set_bounds().
+ *
+ * The fold regions of a buffer are kept by its #GtefFoldRegionManager, and
+ * share the same #GtkTextTag.
  */
 
 enum
@@ -46,72 +50,16 @@ struct _GtefFoldRegionPrivate
 {
 	GtkTextBuffer *buffer;
 
-	/* A reference to the tag table where the tag is added. The sole
-	 * purpose is to remove the tag in dispose(). We can not rely on
-	 * 'buffer' since it is a weak reference.
-	 */
-	GtkTextTagTable *tag_table;
-	GtkTextTag *tag;
-
 	GtkTextMark *start_mark;
 	GtkTextMark *end_mark;
+
+	guint folded : 1;
 };
 
 static GParamSpec *properties[N_PROPERTIES];
 
 G_DEFINE_TYPE_WITH_PRIVATE (GtefFoldRegion, gtef_fold_region, G_TYPE_OBJECT)
 
-static void
-apply_tag (GtefFoldRegion *fold_region)
-{
-	GtefFoldRegionPrivate *priv = gtef_fold_region_get_instance_private (fold_region);
-	GtkTextIter start_iter;
-	GtkTextIter end_iter;
-
-	g_assert (priv->tag == NULL);
-	g_assert (priv->tag_table == NULL);
-	g_assert (priv->start_mark != NULL);
-	g_assert (priv->end_mark != NULL);
-	g_assert (priv->buffer != NULL);
-
-	priv->tag = gtk_text_buffer_create_tag (priv->buffer,
-						NULL,
-						"invisible", TRUE,
-						NULL);
-
-	priv->tag_table = gtk_text_buffer_get_tag_table (priv->buffer);
-
-	g_object_ref (priv->tag);
-	g_object_ref (priv->tag_table);
-
-	gtk_text_buffer_get_iter_at_mark (priv->buffer,
-					  &start_iter,
-					  priv->start_mark);
-
-	gtk_text_buffer_get_iter_at_mark (priv->buffer,
-					  &end_iter,
-					  priv->end_mark);
-
-	gtk_text_iter_forward_line (&start_iter);
-	gtk_text_iter_forward_line (&end_iter);
-
-	gtk_text_buffer_apply_tag (priv->buffer,
-				   priv->tag,
-				   &start_iter,
-				   &end_iter);
-}
-
-static void
-destroy_tag (GtefFoldRegion *fold_region)
-{
-	GtefFoldRegionPrivate *priv = gtef_fold_region_get_instance_private (fold_region);
-
-	gtk_text_tag_table_remove (priv->tag_table, priv->tag);
-
-	g_clear_object (&priv->tag);
-	g_clear_object (&priv->tag_table);
-}
-
 static void
 gtef_fold_region_get_property (GObject    *object,
                                guint       prop_id,
@@ -170,17 +118,24 @@ gtef_fold_region_dispose (GObject *object)
 	GtefFoldRegion *fold_region = GTEF_FOLD_REGION (object);
 	GtefFoldRegionPrivate *priv = gtef_fold_region_get_instance_private (fold_region);
 
-	if (priv->tag != NULL &&
-	    priv->tag_table != NULL)
+	if (priv->buffer != NULL)
 	{
-		gtk_text_tag_table_remove (priv->tag_table, priv->tag);
+		if (priv->start_mark != NULL &&
+		    priv->end_mark != NULL)
+		{
+			GtefFoldRegionManager *manager;
 
-		g_clear_object (&priv->tag);
-		g_clear_object (&priv->tag_table);
-	}
+			manager = _gtef_fold_region_manager_lookup (priv->buffer);
+
+			if (priv->folded)
+			{
+				priv->folded = FALSE;
+				_gtef_fold_region_manager_unfold_region (manager, fold_region);
+			}
+
+			_gtef_fold_region_manager_remove_region (manager, fold_region);
+		}
 
-	if (priv->buffer != NULL)
-	{
 		if (priv->start_mark != NULL)
 		{
 			gtk_text_buffer_delete_mark (priv->buffer, priv->start_mark);
@@ -317,7 +272,7 @@ gtef_fold_region_get_folded (GtefFoldRegion *fold_region)
 
 	priv = gtef_fold_region_get_instance_private (fold_region);
 
-	return priv->tag != NULL;
+	return priv->folded;
 }
 
 /**
@@ -334,6 +289,7 @@ gtef_fold_region_set_folded (GtefFoldRegion *fold_region,
 			     gboolean        folded)
 {
 	GtefFoldRegionPrivate *priv;
+	GtefFoldRegionManager *manager;
 
 	g_return_if_fail (GTEF_IS_FOLD_REGION (fold_region));
 
@@ -356,13 +312,16 @@ gtef_fold_region_set_folded (GtefFoldRegion *fold_region,
 		return;
 	}
 
+	manager = gtef_fold_region_manager_get_from_buffer (priv->buffer);
+	priv->folded = folded;
+
 	if (folded)
 	{
-		apply_tag (fold_region);
+		_gtef_fold_region_manager_fold_region (manager, fold_region);
 	}
 	else
 	{
-		destroy_tag (fold_region);
+		_gtef_fold_region_manager_unfold_region (manager, fold_region);
 	}
 
 	g_object_notify_by_pspec (G_OBJECT (fold_region), properties[PROP_FOLDED]);
@@ -428,6 +387,7 @@ gtef_fold_region_set_bounds (GtefFoldRegion    *fold_region,
 			     const GtkTextIter *end)
 {
 	GtefFoldRegionPrivate *priv;
+	GtefFoldRegionManager *manager;
 
 	g_return_if_fail (GTEF_IS_FOLD_REGION (fold_region));
 	g_return_if_fail (start != NULL);
@@ -441,6 +401,20 @@ gtef_fold_region_set_bounds (GtefFoldRegion    *fold_region,
 		return;
 	}
 
+	manager = gtef_fold_region_manager_get_from_buffer (priv->buffer);
+
+	/* The position in the manager is determined by the bounds. */
+	if (priv->start_mark != NULL &&
+	    priv->end_mark != NULL)
+	{
+		if (priv->folded)
+		{
+			_gtef_fold_region_manager_unfold_region (manager, fold_region);
+		}
+
+		_gtef_fold_region_manager_remove_region (manager, fold_region);
+	}
+
 	if (priv->start_mark != NULL)
 	{
 		gtk_text_buffer_move_mark (priv->buffer, priv->start_mark, start);
@@ -459,10 +433,10 @@ gtef_fold_region_set_bounds (GtefFoldRegion    *fold_region,
 		priv->end_mark = gtk_text_buffer_create_mark (priv->buffer, NULL, end, FALSE);
 	}
 
-	if (priv->tag != NULL &&
-	    priv->tag_table != NULL)
+	_gtef_fold_region_manager_add_region (manager, fold_region);
+
+	if (priv->folded)
 	{
-		destroy_tag (fold_region);
-		apply_tag (fold_region);
+		_gtef_fold_region_manager_fold_region (manager, fold_region);
 	}
 }
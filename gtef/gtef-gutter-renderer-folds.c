@@ -19,6 +19,8 @@
  */
 
 #include "gtef-gutter-renderer-folds.h"
+#include "gtef-fold-region.h"
+#include "gtef-fold-region-manager.h"
 
 /**
  * SECTION:gutter-renderer-folds
@@ -26,7 +28,12 @@
  * @Title: GtefGutterRendererFolds
  *
  * #GtefGutterRendererFolds is a basic gutter renderer for code folding. It
- * handles only the drawing, and has a flat view of the folding tree.
+ * has a flat view of the folding tree.
+ *
+ * By default the folding state of each line is taken from the
+ * #GtefFoldRegionManager of the buffer, and clicking on a sign folds or
+ * unfolds the region. A subclass can instead call
+ * gtef_gutter_renderer_folds_set_state() in its draw method.
  */
 
 /* The square size for drawing the box around the minus and plus signs. To be
@@ -35,11 +42,39 @@
  */
 #define SQUARE_SIZE 9
 
+/* The number of combinations of the GtefGutterRendererFoldsState flags. */
+#define N_GLYPHS 16
+
 typedef struct _GtefGutterRendererFoldsPrivate GtefGutterRendererFoldsPrivate;
 
 struct _GtefGutterRendererFoldsPrivate
 {
 	GtefGutterRendererFoldsState folding_state;
+
+	/* The manager of the view's buffer. */
+	GtefFoldRegionManager *manager;
+
+	/* The states of the lines being drawn, computed in begin() from the
+	 * manager. The first element is for first_line.
+	 */
+	GArray *line_states;
+	gint first_line;
+
+	/* The signs and lines of each state, drawn once and then painted on
+	 * each cell. The glyphs are valid for one cell size, device scale and
+	 * color.
+	 */
+	cairo_surface_t *glyphs[N_GLYPHS];
+	gint glyphs_width;
+	gint glyphs_height;
+	gdouble glyphs_x_scale;
+	gdouble glyphs_y_scale;
+	GdkRGBA glyphs_color;
+
+	/* Whether gtef_gutter_renderer_folds_set_state() has been called for
+	 * the cell being drawn.
+	 */
+	guint state_set : 1;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (GtefGutterRendererFolds,
@@ -163,36 +198,177 @@ split_cell_area (const GdkRectangle *cell_area,
 }
 
 static void
-gtef_gutter_renderer_folds_draw (GtkSourceGutterRenderer      *renderer,
-			         cairo_t                      *cr,
-			         GdkRectangle                 *background_area,
-			         GdkRectangle                 *cell_area,
-			         GtkTextIter                  *start,
-			         GtkTextIter                  *end,
-			         GtkSourceGutterRendererState  state)
+manager_changed_cb (GtefFoldRegionManager   *manager,
+		    GtefGutterRendererFolds *self)
 {
-	GtefGutterRendererFolds *self;
-	GtefGutterRendererFoldsPrivate *priv;
-	GtefGutterRendererFoldsState folding_state;
-	GdkRectangle top_area;
-	GdkRectangle middle_area;
-	GdkRectangle bottom_area;
+	gtk_source_gutter_renderer_queue_draw (GTK_SOURCE_GUTTER_RENDERER (self));
+}
 
-	self = GTEF_GUTTER_RENDERER_FOLDS (renderer);
-	priv = gtef_gutter_renderer_folds_get_instance_private (self);
+static void
+set_manager (GtefGutterRendererFolds *self,
+	     GtefFoldRegionManager   *manager)
+{
+	GtefGutterRendererFoldsPrivate *priv = gtef_gutter_renderer_folds_get_instance_private (self);
 
-	/* Chain up to draw background */
-	if (GTK_SOURCE_GUTTER_RENDERER_CLASS (gtef_gutter_renderer_folds_parent_class)->draw != NULL)
+	if (priv->manager == manager)
 	{
-		GTK_SOURCE_GUTTER_RENDERER_CLASS (gtef_gutter_renderer_folds_parent_class)->draw (renderer,
-												  cr,
-												  background_area,
-												  cell_area,
-												  start,
-												  end,
-												  state);
+		return;
+	}
+
+	if (priv->manager != NULL)
+	{
+		g_signal_handlers_disconnect_by_func (priv->manager, manager_changed_cb, self);
+		g_clear_object (&priv->manager);
+	}
+
+	if (manager != NULL)
+	{
+		priv->manager = g_object_ref (manager);
+
+		g_signal_connect_object (manager,
+					 "changed",
+					 G_CALLBACK (manager_changed_cb),
+					 self,
+					 0);
+	}
+}
+
+static void
+update_manager (GtefGutterRendererFolds *self)
+{
+	GtkTextView *view;
+	GtefFoldRegionManager *manager = NULL;
+
+	view = gtk_source_gutter_renderer_get_view (GTK_SOURCE_GUTTER_RENDERER (self));
+
+	if (view != NULL)
+	{
+		manager = gtef_fold_region_manager_get_from_buffer (gtk_text_view_get_buffer (view));
+	}
+
+	set_manager (self, manager);
+}
+
+static void
+add_region_states (GtefGutterRendererFolds *self,
+		   GtefFoldRegion          *fold_region,
+		   gint                     last_line)
+{
+	GtefGutterRendererFoldsPrivate *priv = gtef_gutter_renderer_folds_get_instance_private (self);
+	GtkTextIter start_iter;
+	GtkTextIter end_iter;
+	gint start_line;
+	gint end_line;
+	gint line;
+
+	if (!gtef_fold_region_get_bounds (fold_region, &start_iter, &end_iter))
+	{
+		return;
+	}
+
+	start_line = gtk_text_iter_get_line (&start_iter);
+	end_line = gtk_text_iter_get_line (&end_iter);
+
+	for (line = MAX (start_line, priv->first_line); line <= MIN (end_line, last_line); line++)
+	{
+		GtefGutterRendererFoldsState *state;
+
+		state = &g_array_index (priv->line_states,
+					GtefGutterRendererFoldsState,
+					line - priv->first_line);
+
+		if (line == start_line)
+		{
+			*state |= gtef_fold_region_get_folded (fold_region) ?
+				  GTEF_GUTTER_RENDERER_FOLDS_STATE_START_FOLDED :
+				  GTEF_GUTTER_RENDERER_FOLDS_STATE_START_OPENED;
+		}
+		else if (line == end_line)
+		{
+			*state |= GTEF_GUTTER_RENDERER_FOLDS_STATE_END;
+		}
+		else
+		{
+			*state |= GTEF_GUTTER_RENDERER_FOLDS_STATE_CONTINUE;
+		}
+	}
+}
+
+/* Computes the states of the lines to draw, with one query to the manager. */
+static void
+gtef_gutter_renderer_folds_begin (GtkSourceGutterRenderer *renderer,
+				  cairo_t                 *cr,
+				  GdkRectangle            *background_area,
+				  GdkRectangle            *cell_area,
+				  GtkTextIter             *start,
+				  GtkTextIter             *end)
+{
+	GtefGutterRendererFolds *self = GTEF_GUTTER_RENDERER_FOLDS (renderer);
+	GtefGutterRendererFoldsPrivate *priv = gtef_gutter_renderer_folds_get_instance_private (self);
+	gint last_line;
+	GList *regions;
+	GList *l;
+
+	if (GTK_SOURCE_GUTTER_RENDERER_CLASS (gtef_gutter_renderer_folds_parent_class)->begin != NULL)
+	{
+		GTK_SOURCE_GUTTER_RENDERER_CLASS (gtef_gutter_renderer_folds_parent_class)->begin (renderer,
+												   cr,
+												   background_area,
+												   cell_area,
+												   start,
+												   end);
+	}
+
+	g_array_set_size (priv->line_states, 0);
+
+	if (priv->manager == NULL ||
+	    gtef_fold_region_manager_get_n_regions (priv->manager) == 0)
+	{
+		return;
+	}
+
+	priv->first_line = gtk_text_iter_get_line (start);
+	last_line = gtk_text_iter_get_line (end);
+
+	/* The new elements are cleared to GTEF_GUTTER_RENDERER_FOLDS_STATE_NONE. */
+	g_array_set_size (priv->line_states, last_line - priv->first_line + 1);
+
+	regions = gtef_fold_region_manager_get_regions_in_range (priv->manager,
+								 priv->first_line,
+								 last_line);
+
+	for (l = regions; l != NULL; l = l->next)
+	{
+		add_region_states (self, l->data, last_line);
+	}
+
+	g_list_free (regions);
+}
+
+static GtefGutterRendererFoldsState
+get_line_state (GtefGutterRendererFolds *self,
+		gint                     line)
+{
+	GtefGutterRendererFoldsPrivate *priv = gtef_gutter_renderer_folds_get_instance_private (self);
+	gint index = line - priv->first_line;
+
+	if (index < 0 || index >= (gint) priv->line_states->len)
+	{
+		return GTEF_GUTTER_RENDERER_FOLDS_STATE_NONE;
 	}
 
+	return g_array_index (priv->line_states, GtefGutterRendererFoldsState, index);
+}
+
+static void
+draw_state (cairo_t                      *cr,
+	    const GdkRectangle           *cell_area,
+	    GtefGutterRendererFoldsState  folding_state)
+{
+	GdkRectangle top_area;
+	GdkRectangle middle_area;
+	GdkRectangle bottom_area;
+
 	if (!split_cell_area (cell_area,
 			      &top_area,
 			      &middle_area,
@@ -205,8 +381,6 @@ gtef_gutter_renderer_folds_draw (GtkSourceGutterRenderer      *renderer,
 	cairo_set_line_cap (cr, CAIRO_LINE_CAP_SQUARE);
 	cairo_set_line_width (cr, 1.0);
 
-	folding_state = priv->folding_state;
-
 	/* Top area */
 
 	if (folding_state & GTEF_GUTTER_RENDERER_FOLDS_STATE_CONTINUE ||
@@ -250,6 +424,280 @@ gtef_gutter_renderer_folds_draw (GtkSourceGutterRenderer      *renderer,
 	cairo_restore (cr);
 }
 
+static void
+clear_glyphs (GtefGutterRendererFolds *self)
+{
+	GtefGutterRendererFoldsPrivate *priv = gtef_gutter_renderer_folds_get_instance_private (self);
+	gint i;
+
+	for (i = 0; i < N_GLYPHS; i++)
+	{
+		if (priv->glyphs[i] != NULL)
+		{
+			cairo_surface_destroy (priv->glyphs[i]);
+			priv->glyphs[i] = NULL;
+		}
+	}
+}
+
+/* Returns the glyph to paint for @folding_state, or %NULL if it must be drawn
+ * directly: when the source is not a plain color, or when @cr is scaled or
+ * rotated.
+ */
+static cairo_surface_t *
+get_glyph (GtefGutterRendererFolds      *self,
+	   cairo_t                      *cr,
+	   const GdkRectangle           *cell_area,
+	   GtefGutterRendererFoldsState  folding_state)
+{
+	GtefGutterRendererFoldsPrivate *priv = gtef_gutter_renderer_folds_get_instance_private (self);
+	cairo_surface_t *target;
+	cairo_matrix_t matrix;
+	GdkRGBA color;
+	gdouble x_scale;
+	gdouble y_scale;
+	GdkRectangle glyph_area;
+	cairo_t *glyph_cr;
+
+	if (folding_state >= N_GLYPHS ||
+	    cairo_pattern_get_type (cairo_get_source (cr)) != CAIRO_PATTERN_TYPE_SOLID)
+	{
+		return NULL;
+	}
+
+	cairo_get_matrix (cr, &matrix);
+	if (matrix.xx != 1.0 || matrix.yy != 1.0 ||
+	    matrix.xy != 0.0 || matrix.yx != 0.0 ||
+	    matrix.x0 != (gint) matrix.x0 ||
+	    matrix.y0 != (gint) matrix.y0)
+	{
+		return NULL;
+	}
+
+	cairo_pattern_get_rgba (cairo_get_source (cr),
+				&color.red,
+				&color.green,
+				&color.blue,
+				&color.alpha);
+
+	target = cairo_get_target (cr);
+	cairo_surface_get_device_scale (target, &x_scale, &y_scale);
+
+	if (priv->glyphs_width != cell_area->width ||
+	    priv->glyphs_height != cell_area->height ||
+	    priv->glyphs_x_scale != x_scale ||
+	    priv->glyphs_y_scale != y_scale ||
+	    !gdk_rgba_equal (&priv->glyphs_color, &color))
+	{
+		clear_glyphs (self);
+
+		priv->glyphs_width = cell_area->width;
+		priv->glyphs_height = cell_area->height;
+		priv->glyphs_x_scale = x_scale;
+		priv->glyphs_y_scale = y_scale;
+		priv->glyphs_color = color;
+	}
+
+	if (priv->glyphs[folding_state] != NULL)
+	{
+		return priv->glyphs[folding_state];
+	}
+
+	/* The similar surface has the same device scale as the target. */
+	priv->glyphs[folding_state] = cairo_surface_create_similar (target,
+								    CAIRO_CONTENT_COLOR_ALPHA,
+								    cell_area->width,
+								    cell_area->height);
+
+	glyph_area.x = 0;
+	glyph_area.y = 0;
+	glyph_area.width = cell_area->width;
+	glyph_area.height = cell_area->height;
+
+	glyph_cr = cairo_create (priv->glyphs[folding_state]);
+	gdk_cairo_set_source_rgba (glyph_cr, &color);
+	draw_state (glyph_cr, &glyph_area, folding_state);
+	cairo_destroy (glyph_cr);
+
+	return priv->glyphs[folding_state];
+}
+
+static void
+gtef_gutter_renderer_folds_draw (GtkSourceGutterRenderer      *renderer,
+			         cairo_t                      *cr,
+			         GdkRectangle                 *background_area,
+			         GdkRectangle                 *cell_area,
+			         GtkTextIter                  *start,
+			         GtkTextIter                  *end,
+			         GtkSourceGutterRendererState  state)
+{
+	GtefGutterRendererFolds *self;
+	GtefGutterRendererFoldsPrivate *priv;
+	GtefGutterRendererFoldsState folding_state;
+	cairo_surface_t *glyph;
+
+	self = GTEF_GUTTER_RENDERER_FOLDS (renderer);
+	priv = gtef_gutter_renderer_folds_get_instance_private (self);
+
+	/* Chain up to draw background */
+	if (GTK_SOURCE_GUTTER_RENDERER_CLASS (gtef_gutter_renderer_folds_parent_class)->draw != NULL)
+	{
+		GTK_SOURCE_GUTTER_RENDERER_CLASS (gtef_gutter_renderer_folds_parent_class)->draw (renderer,
+												  cr,
+												  background_area,
+												  cell_area,
+												  start,
+												  end,
+												  state);
+	}
+
+	if (priv->state_set)
+	{
+		folding_state = priv->folding_state;
+		priv->state_set = FALSE;
+	}
+	else
+	{
+		folding_state = get_line_state (self, gtk_text_iter_get_line (start));
+	}
+
+	if (folding_state == GTEF_GUTTER_RENDERER_FOLDS_STATE_NONE ||
+	    cell_area->height < SQUARE_SIZE ||
+	    cell_area->width < SQUARE_SIZE)
+	{
+		return;
+	}
+
+	glyph = get_glyph (self, cr, cell_area, folding_state);
+
+	if (glyph == NULL)
+	{
+		draw_state (cr, cell_area, folding_state);
+		return;
+	}
+
+	cairo_save (cr);
+	cairo_set_source_surface (cr, glyph, cell_area->x, cell_area->y);
+	gdk_cairo_rectangle (cr, cell_area);
+	cairo_fill (cr);
+	cairo_restore (cr);
+}
+
+static void
+gtef_gutter_renderer_folds_end (GtkSourceGutterRenderer *renderer)
+{
+	GtefGutterRendererFoldsPrivate *priv;
+
+	priv = gtef_gutter_renderer_folds_get_instance_private (GTEF_GUTTER_RENDERER_FOLDS (renderer));
+	g_array_set_size (priv->line_states, 0);
+
+	if (GTK_SOURCE_GUTTER_RENDERER_CLASS (gtef_gutter_renderer_folds_parent_class)->end != NULL)
+	{
+		GTK_SOURCE_GUTTER_RENDERER_CLASS (gtef_gutter_renderer_folds_parent_class)->end (renderer);
+	}
+}
+
+static GtefFoldRegion *
+get_region_starting_at_iter (GtefGutterRendererFolds *self,
+			     GtkTextIter             *iter)
+{
+	GtefGutterRendererFoldsPrivate *priv = gtef_gutter_renderer_folds_get_instance_private (self);
+	GtefFoldRegion *fold_region = NULL;
+	GList *regions;
+
+	if (priv->manager == NULL)
+	{
+		return NULL;
+	}
+
+	regions = gtef_fold_region_manager_get_regions_starting_at_line (priv->manager,
+									 gtk_text_iter_get_line (iter));
+
+	/* The outermost region. */
+	if (regions != NULL)
+	{
+		fold_region = regions->data;
+	}
+
+	g_list_free (regions);
+	return fold_region;
+}
+
+static gboolean
+gtef_gutter_renderer_folds_query_activatable (GtkSourceGutterRenderer *renderer,
+					      GtkTextIter             *iter,
+					      GdkRectangle            *area,
+					      GdkEvent                *event)
+{
+	return get_region_starting_at_iter (GTEF_GUTTER_RENDERER_FOLDS (renderer), iter) != NULL;
+}
+
+static void
+gtef_gutter_renderer_folds_activate (GtkSourceGutterRenderer *renderer,
+				     GtkTextIter             *iter,
+				     GdkRectangle            *area,
+				     GdkEvent                *event)
+{
+	GtefFoldRegion *fold_region;
+
+	fold_region = get_region_starting_at_iter (GTEF_GUTTER_RENDERER_FOLDS (renderer), iter);
+
+	if (fold_region != NULL)
+	{
+		gtef_fold_region_set_folded (fold_region,
+					     !gtef_fold_region_get_folded (fold_region));
+	}
+}
+
+static void
+gtef_gutter_renderer_folds_change_view (GtkSourceGutterRenderer *renderer,
+					GtkTextView             *old_view)
+{
+	if (GTK_SOURCE_GUTTER_RENDERER_CLASS (gtef_gutter_renderer_folds_parent_class)->change_view != NULL)
+	{
+		GTK_SOURCE_GUTTER_RENDERER_CLASS (gtef_gutter_renderer_folds_parent_class)->change_view (renderer,
+													 old_view);
+	}
+
+	/* The glyphs are similar to the surfaces of the old view. */
+	clear_glyphs (GTEF_GUTTER_RENDERER_FOLDS (renderer));
+
+	update_manager (GTEF_GUTTER_RENDERER_FOLDS (renderer));
+}
+
+static void
+gtef_gutter_renderer_folds_change_buffer (GtkSourceGutterRenderer *renderer,
+					  GtkTextBuffer           *old_buffer)
+{
+	if (GTK_SOURCE_GUTTER_RENDERER_CLASS (gtef_gutter_renderer_folds_parent_class)->change_buffer != NULL)
+	{
+		GTK_SOURCE_GUTTER_RENDERER_CLASS (gtef_gutter_renderer_folds_parent_class)->change_buffer (renderer,
+													   old_buffer);
+	}
+
+	update_manager (GTEF_GUTTER_RENDERER_FOLDS (renderer));
+}
+
+static void
+gtef_gutter_renderer_folds_dispose (GObject *object)
+{
+	set_manager (GTEF_GUTTER_RENDERER_FOLDS (object), NULL);
+	clear_glyphs (GTEF_GUTTER_RENDERER_FOLDS (object));
+
+	G_OBJECT_CLASS (gtef_gutter_renderer_folds_parent_class)->dispose (object);
+}
+
+static void
+gtef_gutter_renderer_folds_finalize (GObject *object)
+{
+	GtefGutterRendererFoldsPrivate *priv;
+
+	priv = gtef_gutter_renderer_folds_get_instance_private (GTEF_GUTTER_RENDERER_FOLDS (object));
+	g_array_free (priv->line_states, TRUE);
+
+	G_OBJECT_CLASS (gtef_gutter_renderer_folds_parent_class)->finalize (object);
+}
+
 static void
 gtef_gutter_renderer_folds_constructed (GObject *object)
 {
@@ -268,13 +716,24 @@ gtef_gutter_renderer_folds_class_init (GtefGutterRendererFoldsClass *klass)
 	GtkSourceGutterRendererClass *renderer_class = GTK_SOURCE_GUTTER_RENDERER_CLASS (klass);
 
 	object_class->constructed = gtef_gutter_renderer_folds_constructed;
+	object_class->dispose = gtef_gutter_renderer_folds_dispose;
+	object_class->finalize = gtef_gutter_renderer_folds_finalize;
 
+	renderer_class->begin = gtef_gutter_renderer_folds_begin;
 	renderer_class->draw = gtef_gutter_renderer_folds_draw;
+	renderer_class->end = gtef_gutter_renderer_folds_end;
+	renderer_class->query_activatable = gtef_gutter_renderer_folds_query_activatable;
+	renderer_class->activate = gtef_gutter_renderer_folds_activate;
+	renderer_class->change_view = gtef_gutter_renderer_folds_change_view;
+	renderer_class->change_buffer = gtef_gutter_renderer_folds_change_buffer;
 }
 
 static void
 gtef_gutter_renderer_folds_init (GtefGutterRendererFolds *self)
 {
+	GtefGutterRendererFoldsPrivate *priv = gtef_gutter_renderer_folds_get_instance_private (self);
+
+	priv->line_states = g_array_new (FALSE, TRUE, sizeof (GtefGutterRendererFoldsState));
 }
 
 /**
@@ -294,7 +753,8 @@ gtef_gutter_renderer_folds_new (void)
  * @self: a #GtefGutterRendererFolds.
  * @state: a #GtefGutterRendererFoldsState.
  *
- * Sets the folding state of the next cell to be drawn.
+ * Sets the folding state of the next cell to be drawn, instead of the state
+ * computed from the #GtefFoldRegionManager.
  *
  * This function is intended to be called from a subclass' draw method before
  * chaining-up to its parent's draw method.
@@ -311,4 +771,5 @@ gtef_gutter_renderer_folds_set_state (GtefGutterRendererFolds 	   *self,
 
 	priv = gtef_gutter_renderer_folds_get_instance_private (self);
 	priv->folding_state = state;
+	priv->state_set = TRUE;
 }
@@ -0,0 +1,1282 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gtef-indentation-folding.h"
+#include <string.h>
+#include "gtef-fold-region.h"
+#include "gtef-fold-region-manager.h"
+#include "gtef-iter.h"
+#include "gtef-utils.h"
+
+/**
+ * SECTION:indentation-folding
+ * @Short_description: Fold regions computed from the indentation
+ * @Title: GtefIndentationFolding
+ * @See_also: #GtefFoldRegion, #GtefFoldRegionManager
+ *
+ * #GtefIndentationFolding creates and updates the #GtefFoldRegion's of a
+ * #GtkTextBuffer from the indentation of the lines: a region starts at a line
+ * followed by more indented lines, and ends at the last of them. Lines
+ * containing only spaces don't end a region.
+ *
+ * The indentation is determined like gtef_iter_get_line_indentation() does,
+ * the tab characters going to the next multiple of
+ * #GtefIndentationFolding:tab-width.
+ *
+ * The regions are first computed in a separate thread, which is also the case
+ * after big changes in the buffer, for example when a file is loaded. While
+ * the regions are being computed, #GtefIndentationFolding:computing is %TRUE.
+ * Then the regions are updated incrementally when the buffer is modified; the
+ * existing #GtefFoldRegion objects are kept, so a folded region stays folded.
+ */
+
+/* The indentation of each line is kept in an array. When the buffer is
+ * modified, the lines between the start and the end of the change are
+ * re-read. The regions that can change are then:
+ * - the regions starting in the changed lines;
+ * - the regions covering the last non-blank line before the change, found with
+ *   the GtefFoldRegionManager, and that line itself;
+ * The regions starting after the change depend only on the following lines, so
+ * they don't change.
+ *
+ * Finding the end of a region is a scan of the indentation array. For a region
+ * starting before the change, the lines after the change and up to the
+ * previous end of the region are known to be in the region, so the scan
+ * continues after the previous end.
+ */
+
+/* A blank line, containing only spaces. */
+#define BLANK_LINE (-1)
+
+#define DEFAULT_TAB_WIDTH 8
+
+/* If more lines are inserted or deleted at once, all the regions are computed
+ * again in a separate thread.
+ */
+#define MAX_INCREMENTAL_N_LINES 1000
+
+/* Delay before a full computation, to not compute the regions of a
+ * partially-loaded file.
+ */
+#define FULL_COMPUTATION_DELAY_MS 100
+
+typedef struct _RegionBounds RegionBounds;
+typedef struct _Computation Computation;
+
+struct _RegionBounds
+{
+	gint start_line;
+	gint end_line;
+};
+
+struct _Computation
+{
+	gchar *text;
+	guint tab_width;
+	guint64 generation;
+
+	/* Results. */
+	GArray *indents;
+	GArray *bounds;
+};
+
+struct _GtefIndentationFoldingPrivate
+{
+	/* Weak reference. */
+	GtkTextBuffer *buffer;
+
+	/* Indentation width of each line in columns, or BLANK_LINE. Not valid
+	 * while computing is TRUE.
+	 */
+	GArray *indents;
+
+	/* Set of the owned GtefFoldRegion's created by this object. */
+	GHashTable *regions;
+
+	guint tab_width;
+
+	/* For the change being done in the buffer. */
+	gint change_start_line;
+	gint change_end_line;
+
+	/* Incremented at each change, to know if a full computation is still
+	 * valid.
+	 */
+	guint64 generation;
+
+	GCancellable *cancellable;
+	guint full_computation_timeout_id;
+
+	/* A full computation is scheduled or running. */
+	guint computing : 1;
+
+	/* A full computation is running in a thread. */
+	guint computation_running : 1;
+};
+
+enum
+{
+	PROP_0,
+	PROP_BUFFER,
+	PROP_TAB_WIDTH,
+	PROP_COMPUTING,
+	N_PROPERTIES
+};
+
+static GParamSpec *properties[N_PROPERTIES];
+
+G_DEFINE_TYPE_WITH_PRIVATE (GtefIndentationFolding, gtef_indentation_folding, G_TYPE_OBJECT)
+
+static void schedule_full_computation (GtefIndentationFolding *folding);
+
+/* Returns the width of the spaces at the start of @str, and sets @text_start
+ * to the first other character, or to @end.
+ */
+static gint
+get_indentation_width (const gchar  *str,
+		       const gchar  *end,
+		       guint         tab_width,
+		       const gchar **text_start)
+{
+	const gchar *p;
+	gint width = 0;
+
+	for (p = str; p < end; p = g_utf8_next_char (p))
+	{
+		if (*p == ' ')
+		{
+			width++;
+		}
+		else if (*p == '\t')
+		{
+			width += tab_width - (width % tab_width);
+		}
+		else if (g_unichar_isspace (g_utf8_get_char (p)))
+		{
+			width++;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	*text_start = p;
+	return width;
+}
+
+/* Runs in the computation thread. */
+static GArray *
+compute_indents (const gchar *text,
+		 guint        tab_width)
+{
+	GArray *indents;
+	gsize length;
+	gsize pos = 0;
+
+	indents = g_array_new (FALSE, FALSE, sizeof (gint));
+	length = strlen (text);
+
+	while (TRUE)
+	{
+		gsize line_end = pos;
+		gsize next_line_start;
+		const gchar *text_start;
+		gint indent;
+
+		/* Find the line terminator, like GtkTextBuffer. */
+		while (TRUE)
+		{
+			line_end += _gtef_utils_find_line_terminator (text + line_end,
+								      length - line_end,
+								      FALSE);
+
+			if (line_end >= length)
+			{
+				next_line_start = length;
+				break;
+			}
+
+			if (text[line_end] == '\n')
+			{
+				next_line_start = line_end + 1;
+				break;
+			}
+
+			if (text[line_end] == '\r')
+			{
+				next_line_start = line_end + (text[line_end + 1] == '\n' ? 2 : 1);
+				break;
+			}
+
+			/* U+2029 PARAGRAPH SEPARATOR */
+			if ((guchar) text[line_end + 1] == 0x80 &&
+			    (guchar) text[line_end + 2] == 0xA9)
+			{
+				next_line_start = line_end + 3;
+				break;
+			}
+
+			line_end++;
+		}
+
+		indent = get_indentation_width (text + pos, text + line_end, tab_width, &text_start);
+		if (text_start == text + line_end)
+		{
+			indent = BLANK_LINE;
+		}
+
+		g_array_append_val (indents, indent);
+
+		if (line_end >= length)
+		{
+			break;
+		}
+
+		pos = next_line_start;
+	}
+
+	return indents;
+}
+
+/* Runs in the computation thread. Computes all the regions in one pass, with
+ * a stack of the lines whose region is not yet ended.
+ */
+static GArray *
+compute_all_regions (GArray *indents)
+{
+	GArray *bounds;
+	GArray *stack;
+	gint prev_non_blank_line = -1;
+	gint line;
+
+	bounds = g_array_new (FALSE, FALSE, sizeof (RegionBounds));
+	stack = g_array_new (FALSE, FALSE, sizeof (gint));
+
+	for (line = 0; line <= (gint) indents->len; line++)
+	{
+		gint indent;
+
+		/* After the last line, end all the regions. */
+		if (line == (gint) indents->len)
+		{
+			indent = BLANK_LINE - 1;
+		}
+		else
+		{
+			indent = g_array_index (indents, gint, line);
+
+			if (indent == BLANK_LINE)
+			{
+				continue;
+			}
+		}
+
+		while (stack->len > 0)
+		{
+			gint top_line = g_array_index (stack, gint, stack->len - 1);
+
+			if (g_array_index (indents, gint, top_line) < indent)
+			{
+				break;
+			}
+
+			g_array_set_size (stack, stack->len - 1);
+
+			if (prev_non_blank_line > top_line)
+			{
+				RegionBounds region_bounds;
+
+				region_bounds.start_line = top_line;
+				region_bounds.end_line = prev_non_blank_line;
+				g_array_append_val (bounds, region_bounds);
+			}
+		}
+
+		g_array_append_val (stack, line);
+		prev_non_blank_line = line;
+	}
+
+	g_array_free (stack, TRUE);
+	return bounds;
+}
+
+static void
+computation_free (gpointer data)
+{
+	Computation *computation = data;
+
+	if (computation != NULL)
+	{
+		g_free (computation->text);
+
+		if (computation->indents != NULL)
+		{
+			g_array_unref (computation->indents);
+		}
+
+		if (computation->bounds != NULL)
+		{
+			g_array_unref (computation->bounds);
+		}
+
+		g_free (computation);
+	}
+}
+
+static void
+computation_thread (GTask        *task,
+		    gpointer      source_object,
+		    gpointer      task_data,
+		    GCancellable *cancellable)
+{
+	Computation *computation = task_data;
+
+	computation->indents = compute_indents (computation->text, computation->tab_width);
+
+	if (g_task_return_error_if_cancelled (task))
+	{
+		return;
+	}
+
+	computation->bounds = compute_all_regions (computation->indents);
+	g_task_return_boolean (task, TRUE);
+}
+
+static void
+set_computing (GtefIndentationFolding *folding,
+	       gboolean                computing)
+{
+	computing = computing != FALSE;
+
+	if (folding->priv->computing != computing)
+	{
+		folding->priv->computing = computing;
+		g_object_notify_by_pspec (G_OBJECT (folding), properties[PROP_COMPUTING]);
+	}
+}
+
+static GtefFoldRegionManager *
+get_manager (GtefIndentationFolding *folding)
+{
+	return gtef_fold_region_manager_get_from_buffer (folding->priv->buffer);
+}
+
+/* Returns the first region of @set starting at @line. */
+static GtefFoldRegion *
+lookup_region (GtefIndentationFolding *folding,
+	       GHashTable             *set,
+	       gint                    line)
+{
+	GtefFoldRegion *fold_region = NULL;
+	GList *regions;
+	GList *l;
+
+	regions = gtef_fold_region_manager_get_regions_starting_at_line (get_manager (folding), line);
+
+	for (l = regions; l != NULL; l = l->next)
+	{
+		if (g_hash_table_contains (set, l->data))
+		{
+			fold_region = l->data;
+			break;
+		}
+	}
+
+	g_list_free (regions);
+	return fold_region;
+}
+
+/* Removes the region from the buffer, even if someone else has a reference. */
+static void
+destroy_region (GHashTable     *set,
+		GtefFoldRegion *fold_region)
+{
+	g_hash_table_steal (set, fold_region);
+	g_object_run_dispose (G_OBJECT (fold_region));
+	g_object_unref (fold_region);
+}
+
+static void
+destroy_all_regions (GHashTable *set)
+{
+	GHashTableIter iter;
+	gpointer fold_region;
+
+	g_hash_table_iter_init (&iter, set);
+	while (g_hash_table_iter_next (&iter, &fold_region, NULL))
+	{
+		g_hash_table_iter_steal (&iter);
+		g_object_run_dispose (G_OBJECT (fold_region));
+		g_object_unref (fold_region);
+	}
+}
+
+/* Creates, moves or destroys the region starting at @start_line. @end_line is
+ * -1 if there is no region.
+ */
+static void
+update_region (GtefIndentationFolding *folding,
+	       gint                    start_line,
+	       gint                    end_line)
+{
+	GtefFoldRegion *fold_region;
+	GtkTextIter start;
+	GtkTextIter end;
+
+	fold_region = lookup_region (folding, folding->priv->regions, start_line);
+
+	if (end_line < 0)
+	{
+		if (fold_region != NULL)
+		{
+			destroy_region (folding->priv->regions, fold_region);
+		}
+
+		return;
+	}
+
+	gtk_text_buffer_get_iter_at_line (folding->priv->buffer, &start, start_line);
+	gtk_text_buffer_get_iter_at_line (folding->priv->buffer, &end, end_line);
+
+	if (fold_region == NULL)
+	{
+		fold_region = gtef_fold_region_new (folding->priv->buffer, &start, &end);
+		g_hash_table_add (folding->priv->regions, fold_region);
+	}
+	else
+	{
+		GtkTextIter cur_start;
+		GtkTextIter cur_end;
+
+		gtef_fold_region_get_bounds (fold_region, &cur_start, &cur_end);
+
+		if (gtk_text_iter_get_line (&cur_end) != end_line)
+		{
+			gtef_fold_region_set_bounds (fold_region, &start, &end);
+		}
+	}
+}
+
+static void
+apply_full_computation (GtefIndentationFolding *folding,
+			Computation            *computation)
+{
+	GHashTable *old_regions;
+	guint i;
+
+	g_warn_if_fail (computation->indents->len ==
+			(guint) gtk_text_buffer_get_line_count (folding->priv->buffer));
+
+	/* Keep the existing regions that still start at the same line. */
+	old_regions = folding->priv->regions;
+	folding->priv->regions = g_hash_table_new_full (g_direct_hash, g_direct_equal, g_object_unref, NULL);
+
+	for (i = 0; i < computation->bounds->len; i++)
+	{
+		RegionBounds *region_bounds;
+		GtefFoldRegion *fold_region;
+
+		region_bounds = &g_array_index (computation->bounds, RegionBounds, i);
+
+		fold_region = lookup_region (folding, old_regions, region_bounds->start_line);
+		if (fold_region != NULL)
+		{
+			g_hash_table_steal (old_regions, fold_region);
+			g_hash_table_add (folding->priv->regions, fold_region);
+		}
+
+		update_region (folding, region_bounds->start_line, region_bounds->end_line);
+	}
+
+	destroy_all_regions (old_regions);
+	g_hash_table_unref (old_regions);
+
+	g_array_unref (folding->priv->indents);
+	folding->priv->indents = g_array_ref (computation->indents);
+
+	set_computing (folding, FALSE);
+}
+
+static void
+computation_done_cb (GObject      *source_object,
+		     GAsyncResult *result,
+		     gpointer      user_data)
+{
+	GtefIndentationFolding *folding = GTEF_INDENTATION_FOLDING (user_data);
+	Computation *computation;
+
+	folding->priv->computation_running = FALSE;
+
+	computation = g_task_get_task_data (G_TASK (result));
+
+	if (!g_task_propagate_boolean (G_TASK (result), NULL) ||
+	    folding->priv->buffer == NULL)
+	{
+		goto out;
+	}
+
+	/* The buffer has been modified in the meantime. */
+	if (computation->generation != folding->priv->generation)
+	{
+		schedule_full_computation (folding);
+		goto out;
+	}
+
+	apply_full_computation (folding, computation);
+
+out:
+	g_object_unref (folding);
+}
+
+static gboolean
+full_computation_timeout_cb (gpointer user_data)
+{
+	GtefIndentationFolding *folding = GTEF_INDENTATION_FOLDING (user_data);
+	Computation *computation;
+	GtkTextIter start;
+	GtkTextIter end;
+	GTask *task;
+
+	folding->priv->full_computation_timeout_id = 0;
+
+	if (folding->priv->buffer == NULL)
+	{
+		set_computing (folding, FALSE);
+		return G_SOURCE_REMOVE;
+	}
+
+	/* The text is copied, the thread doesn't access the buffer. */
+	gtk_text_buffer_get_bounds (folding->priv->buffer, &start, &end);
+
+	computation = g_new0 (Computation, 1);
+	computation->text = gtk_text_buffer_get_text (folding->priv->buffer, &start, &end, TRUE);
+	computation->tab_width = folding->priv->tab_width;
+	computation->generation = folding->priv->generation;
+
+	/* No source object: the last unref of the task can happen in the
+	 * thread.
+	 */
+	task = g_task_new (NULL,
+			   folding->priv->cancellable,
+			   computation_done_cb,
+			   g_object_ref (folding));
+
+	g_task_set_task_data (task, computation, computation_free);
+	g_task_run_in_thread (task, computation_thread);
+	g_object_unref (task);
+
+	folding->priv->computation_running = TRUE;
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+schedule_full_computation (GtefIndentationFolding *folding)
+{
+	set_computing (folding, TRUE);
+
+	/* The result will be outdated, another computation is scheduled when
+	 * it is done.
+	 */
+	if (folding->priv->computation_running)
+	{
+		return;
+	}
+
+	if (folding->priv->full_computation_timeout_id != 0)
+	{
+		g_source_remove (folding->priv->full_computation_timeout_id);
+	}
+
+	folding->priv->full_computation_timeout_id =
+		g_timeout_add (FULL_COMPUTATION_DELAY_MS,
+			       full_computation_timeout_cb,
+			       folding);
+}
+
+static gint
+get_line_indent (GtefIndentationFolding *folding,
+		 gint                    line)
+{
+	return g_array_index (folding->priv->indents, gint, line);
+}
+
+static gint
+read_line_indent (GtefIndentationFolding *folding,
+		  gint                    line)
+{
+	GtkTextIter line_start;
+	GtkTextIter leading_end;
+	gchar *indentation;
+	const gchar *text_start;
+	gint indent;
+
+	gtk_text_buffer_get_iter_at_line (folding->priv->buffer, &line_start, line);
+	_gtef_iter_get_leading_spaces_end_boundary (&line_start, &leading_end);
+
+	if (gtk_text_iter_ends_line (&leading_end))
+	{
+		return BLANK_LINE;
+	}
+
+	indentation = gtk_text_iter_get_slice (&line_start, &leading_end);
+	indent = get_indentation_width (indentation,
+					indentation + strlen (indentation),
+					folding->priv->tab_width,
+					&text_start);
+	g_free (indentation);
+
+	return indent;
+}
+
+/* Scans the lines from @from_line, @last_line being the last line known to be
+ * in the region starting at @start_line. Returns the end line of the region,
+ * or -1 if there is no region.
+ */
+static gint
+scan_region_end (GtefIndentationFolding *folding,
+		 gint                    start_line,
+		 gint                    from_line,
+		 gint                    last_line)
+{
+	gint start_indent;
+	gint n_lines;
+	gint line;
+
+	start_indent = get_line_indent (folding, start_line);
+	n_lines = folding->priv->indents->len;
+
+	for (line = from_line; line < n_lines; line++)
+	{
+		gint indent = get_line_indent (folding, line);
+
+		if (indent == BLANK_LINE)
+		{
+			continue;
+		}
+
+		if (indent <= start_indent)
+		{
+			break;
+		}
+
+		last_line = line;
+	}
+
+	return last_line > start_line ? last_line : -1;
+}
+
+/* For a region starting before the changed lines, and that ended at
+ * @old_end_line, covering the last non-blank line before the change.
+ */
+static gint
+compute_region_end_around_change (GtefIndentationFolding *folding,
+				  gint                    start_line,
+				  gint                    old_end_line,
+				  gint                    prev_non_blank_line,
+				  gint                    change_start_line,
+				  gint                    change_end_line)
+{
+	gint start_indent;
+	gint last_line;
+	gint line;
+
+	start_indent = get_line_indent (folding, start_line);
+	last_line = prev_non_blank_line;
+
+	for (line = change_start_line; line <= change_end_line; line++)
+	{
+		gint indent = get_line_indent (folding, line);
+
+		if (indent == BLANK_LINE)
+		{
+			continue;
+		}
+
+		if (indent <= start_indent)
+		{
+			return last_line > start_line ? last_line : -1;
+		}
+
+		last_line = line;
+	}
+
+	/* The lines up to the old end are unchanged and in the region. */
+	if (old_end_line > change_end_line)
+	{
+		return scan_region_end (folding, start_line, old_end_line + 1, old_end_line);
+	}
+
+	return scan_region_end (folding, start_line, change_end_line + 1, last_line);
+}
+
+/* If @start_line_kept is TRUE, the region starting at @change_start_line, if
+ * any, was computed for the same line before the change. Its end is kept if
+ * the indentation of the line didn't change, instead of scanning the whole
+ * region again.
+ */
+static void
+update_lines (GtefIndentationFolding *folding,
+	      gint                    change_start_line,
+	      gint                    change_end_line,
+	      gboolean                start_line_kept)
+{
+	gint old_start_indent;
+	gint prev_non_blank_line;
+	gint line;
+
+	old_start_indent = get_line_indent (folding, change_start_line);
+
+	for (line = change_start_line; line <= change_end_line; line++)
+	{
+		g_array_index (folding->priv->indents, gint, line) = read_line_indent (folding, line);
+	}
+
+	prev_non_blank_line = change_start_line - 1;
+	while (prev_non_blank_line >= 0 &&
+	       get_line_indent (folding, prev_non_blank_line) == BLANK_LINE)
+	{
+		prev_non_blank_line--;
+	}
+
+	if (prev_non_blank_line >= 0)
+	{
+		GList *regions;
+		GList *l;
+		gboolean prev_line_done = FALSE;
+
+		regions = gtef_fold_region_manager_get_regions_at_line (get_manager (folding),
+									prev_non_blank_line);
+
+		for (l = regions; l != NULL; l = l->next)
+		{
+			GtefFoldRegion *fold_region = l->data;
+			GtkTextIter start;
+			GtkTextIter end;
+			gint start_line;
+			gint end_line;
+
+			if (!g_hash_table_contains (folding->priv->regions, fold_region))
+			{
+				continue;
+			}
+
+			gtef_fold_region_get_bounds (fold_region, &start, &end);
+			start_line = gtk_text_iter_get_line (&start);
+
+			end_line = compute_region_end_around_change (folding,
+								     start_line,
+								     gtk_text_iter_get_line (&end),
+								     prev_non_blank_line,
+								     change_start_line,
+								     change_end_line);
+
+			update_region (folding, start_line, end_line);
+
+			if (start_line == prev_non_blank_line)
+			{
+				prev_line_done = TRUE;
+			}
+		}
+
+		g_list_free (regions);
+
+		/* The lines in between are blank. */
+		if (!prev_line_done)
+		{
+			update_region (folding,
+				       prev_non_blank_line,
+				       scan_region_end (folding,
+							prev_non_blank_line,
+							change_start_line,
+							prev_non_blank_line));
+		}
+	}
+
+	for (line = change_start_line; line <= change_end_line; line++)
+	{
+		gint indent = get_line_indent (folding, line);
+		GtefFoldRegion *fold_region = NULL;
+		gint end_line = -1;
+
+		if (indent == BLANK_LINE)
+		{
+			update_region (folding, line, -1);
+			continue;
+		}
+
+		if (line == change_start_line &&
+		    start_line_kept &&
+		    indent == old_start_indent)
+		{
+			fold_region = lookup_region (folding, folding->priv->regions, line);
+		}
+
+		if (fold_region != NULL)
+		{
+			GtkTextIter start;
+			GtkTextIter end;
+
+			gtef_fold_region_get_bounds (fold_region, &start, &end);
+
+			end_line = compute_region_end_around_change (folding,
+								     line,
+								     gtk_text_iter_get_line (&end),
+								     line,
+								     line + 1,
+								     change_end_line);
+		}
+		else
+		{
+			end_line = scan_region_end (folding, line, line + 1, line);
+		}
+
+		update_region (folding, line, end_line);
+	}
+}
+
+static void
+insert_text_before_cb (GtkTextBuffer          *buffer,
+		       GtkTextIter            *location,
+		       const gchar            *text,
+		       gint                    length,
+		       GtefIndentationFolding *folding)
+{
+	folding->priv->change_start_line = gtk_text_iter_get_line (location);
+}
+
+static void
+insert_text_after_cb (GtkTextBuffer          *buffer,
+		      GtkTextIter            *location,
+		      const gchar            *text,
+		      gint                    length,
+		      GtefIndentationFolding *folding)
+{
+	gint start_line;
+	gint end_line;
+	gint n_inserted_lines;
+
+	folding->priv->generation++;
+
+	if (folding->priv->computing)
+	{
+		schedule_full_computation (folding);
+		return;
+	}
+
+	/* The location is at the end of the inserted text. */
+	start_line = folding->priv->change_start_line;
+	end_line = gtk_text_iter_get_line (location);
+	n_inserted_lines = end_line - start_line;
+
+	if (n_inserted_lines > MAX_INCREMENTAL_N_LINES)
+	{
+		schedule_full_computation (folding);
+		return;
+	}
+
+	if (n_inserted_lines > 0)
+	{
+		gint *new_lines;
+
+		new_lines = g_new0 (gint, n_inserted_lines);
+		g_array_insert_vals (folding->priv->indents, start_line + 1, new_lines, n_inserted_lines);
+		g_free (new_lines);
+	}
+
+	update_lines (folding, start_line, end_line, TRUE);
+}
+
+static void
+delete_range_before_cb (GtkTextBuffer          *buffer,
+			GtkTextIter            *start,
+			GtkTextIter            *end,
+			GtefIndentationFolding *folding)
+{
+	folding->priv->change_start_line = gtk_text_iter_get_line (start);
+	folding->priv->change_end_line = gtk_text_iter_get_line (end);
+}
+
+static void
+delete_range_after_cb (GtkTextBuffer          *buffer,
+		       GtkTextIter            *start,
+		       GtkTextIter            *end,
+		       GtefIndentationFolding *folding)
+{
+	gint line;
+	gint n_deleted_lines;
+
+	folding->priv->generation++;
+
+	if (folding->priv->computing)
+	{
+		schedule_full_computation (folding);
+		return;
+	}
+
+	line = folding->priv->change_start_line;
+	n_deleted_lines = folding->priv->change_end_line - line;
+
+	if (n_deleted_lines > MAX_INCREMENTAL_N_LINES)
+	{
+		schedule_full_computation (folding);
+		return;
+	}
+
+	if (n_deleted_lines > 0)
+	{
+		GtefFoldRegion *fold_region;
+
+		g_array_remove_range (folding->priv->indents, line + 1, n_deleted_lines);
+
+		/* The regions of the deleted lines now start at @line, keep
+		 * only one.
+		 */
+		fold_region = lookup_region (folding, folding->priv->regions, line);
+		if (fold_region != NULL)
+		{
+			GList *regions;
+			GList *l;
+
+			regions = gtef_fold_region_manager_get_regions_starting_at_line (get_manager (folding), line);
+
+			for (l = regions; l != NULL; l = l->next)
+			{
+				if (l->data != fold_region &&
+				    g_hash_table_contains (folding->priv->regions, l->data))
+				{
+					destroy_region (folding->priv->regions, l->data);
+				}
+			}
+
+			g_list_free (regions);
+		}
+	}
+
+	/* When lines are joined, the region kept at @line may come from a
+	 * deleted line.
+	 */
+	update_lines (folding, line, line, n_deleted_lines == 0);
+}
+
+static void
+set_buffer (GtefIndentationFolding *folding,
+	    GtkTextBuffer          *buffer)
+{
+	g_assert (folding->priv->buffer == NULL);
+
+	folding->priv->buffer = buffer;
+	g_object_add_weak_pointer (G_OBJECT (buffer),
+				   (gpointer *) &folding->priv->buffer);
+
+	g_signal_connect_object (buffer,
+				 "insert-text",
+				 G_CALLBACK (insert_text_before_cb),
+				 folding,
+				 0);
+
+	g_signal_connect_object (buffer,
+				 "insert-text",
+				 G_CALLBACK (insert_text_after_cb),
+				 folding,
+				 G_CONNECT_AFTER);
+
+	g_signal_connect_object (buffer,
+				 "delete-range",
+				 G_CALLBACK (delete_range_before_cb),
+				 folding,
+				 0);
+
+	g_signal_connect_object (buffer,
+				 "delete-range",
+				 G_CALLBACK (delete_range_after_cb),
+				 folding,
+				 G_CONNECT_AFTER);
+}
+
+static void
+gtef_indentation_folding_get_property (GObject    *object,
+				       guint       prop_id,
+				       GValue     *value,
+				       GParamSpec *pspec)
+{
+	GtefIndentationFolding *folding = GTEF_INDENTATION_FOLDING (object);
+
+	switch (prop_id)
+	{
+		case PROP_BUFFER:
+			g_value_set_object (value, gtef_indentation_folding_get_buffer (folding));
+			break;
+
+		case PROP_TAB_WIDTH:
+			g_value_set_uint (value, gtef_indentation_folding_get_tab_width (folding));
+			break;
+
+		case PROP_COMPUTING:
+			g_value_set_boolean (value, gtef_indentation_folding_get_computing (folding));
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+			break;
+	}
+}
+
+static void
+gtef_indentation_folding_set_property (GObject      *object,
+				       guint         prop_id,
+				       const GValue *value,
+				       GParamSpec   *pspec)
+{
+	GtefIndentationFolding *folding = GTEF_INDENTATION_FOLDING (object);
+
+	switch (prop_id)
+	{
+		case PROP_BUFFER:
+			set_buffer (folding, g_value_get_object (value));
+			break;
+
+		case PROP_TAB_WIDTH:
+			gtef_indentation_folding_set_tab_width (folding, g_value_get_uint (value));
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+			break;
+	}
+}
+
+static void
+gtef_indentation_folding_constructed (GObject *object)
+{
+	G_OBJECT_CLASS (gtef_indentation_folding_parent_class)->constructed (object);
+
+	schedule_full_computation (GTEF_INDENTATION_FOLDING (object));
+}
+
+static void
+gtef_indentation_folding_dispose (GObject *object)
+{
+	GtefIndentationFolding *folding = GTEF_INDENTATION_FOLDING (object);
+
+	g_cancellable_cancel (folding->priv->cancellable);
+
+	if (folding->priv->full_computation_timeout_id != 0)
+	{
+		g_source_remove (folding->priv->full_computation_timeout_id);
+		folding->priv->full_computation_timeout_id = 0;
+	}
+
+	if (folding->priv->buffer != NULL)
+	{
+		g_signal_handlers_disconnect_by_data (folding->priv->buffer, folding);
+
+		destroy_all_regions (folding->priv->regions);
+
+		g_object_remove_weak_pointer (G_OBJECT (folding->priv->buffer),
+					      (gpointer *) &folding->priv->buffer);
+		folding->priv->buffer = NULL;
+	}
+
+	G_OBJECT_CLASS (gtef_indentation_folding_parent_class)->dispose (object);
+}
+
+static void
+gtef_indentation_folding_finalize (GObject *object)
+{
+	GtefIndentationFolding *folding = GTEF_INDENTATION_FOLDING (object);
+
+	g_array_unref (folding->priv->indents);
+	g_hash_table_unref (folding->priv->regions);
+	g_object_unref (folding->priv->cancellable);
+
+	G_OBJECT_CLASS (gtef_indentation_folding_parent_class)->finalize (object);
+}
+
+static void
+gtef_indentation_folding_class_init (GtefIndentationFoldingClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+	object_class->get_property = gtef_indentation_folding_get_property;
+	object_class->set_property = gtef_indentation_folding_set_property;
+	object_class->constructed = gtef_indentation_folding_constructed;
+	object_class->dispose = gtef_indentation_folding_dispose;
+	object_class->finalize = gtef_indentation_folding_finalize;
+
+	/**
+	 * GtefIndentationFolding:buffer:
+	 *
+	 * The #GtkTextBuffer. The #GtefIndentationFolding object has a weak
+	 * reference to the buffer.
+	 *
+	 * Since: 2.0
+	 */
+	properties[PROP_BUFFER] =
+		g_param_spec_object ("buffer",
+				     "Buffer",
+				     "",
+				     GTK_TYPE_TEXT_BUFFER,
+				     G_PARAM_READWRITE |
+				     G_PARAM_CONSTRUCT_ONLY |
+				     G_PARAM_STATIC_STRINGS);
+
+	/**
+	 * GtefIndentationFolding:tab-width:
+	 *
+	 * The width of a tab character, in columns, to compare the
+	 * indentations.
+	 *
+	 * Since: 2.0
+	 */
+	properties[PROP_TAB_WIDTH] =
+		g_param_spec_uint ("tab-width",
+				   "Tab Width",
+				   "",
+				   1,
+				   G_MAXUINT8,
+				   DEFAULT_TAB_WIDTH,
+				   G_PARAM_READWRITE |
+				   G_PARAM_STATIC_STRINGS);
+
+	/**
+	 * GtefIndentationFolding:computing:
+	 *
+	 * Whether all the regions are being computed, for example after the
+	 * buffer has been filled. When it is %FALSE, the regions are up to date.
+	 *
+	 * Since: 2.0
+	 */
+	properties[PROP_COMPUTING] =
+		g_param_spec_boolean ("computing",
+				      "Computing",
+				      "",
+				      FALSE,
+				      G_PARAM_READABLE |
+				      G_PARAM_STATIC_STRINGS);
+
+	g_object_class_install_properties (object_class, N_PROPERTIES, properties);
+}
+
+static void
+gtef_indentation_folding_init (GtefIndentationFolding *folding)
+{
+	folding->priv = gtef_indentation_folding_get_instance_private (folding);
+
+	folding->priv->indents = g_array_new (FALSE, FALSE, sizeof (gint));
+	folding->priv->regions = g_hash_table_new_full (g_direct_hash, g_direct_equal, g_object_unref, NULL);
+	folding->priv->tab_width = DEFAULT_TAB_WIDTH;
+	folding->priv->cancellable = g_cancellable_new ();
+}
+
+/**
+ * gtef_indentation_folding_new:
+ * @buffer: a #GtkTextBuffer.
+ *
+ * Returns: a new #GtefIndentationFolding for @buffer.
+ * Since: 2.0
+ */
+GtefIndentationFolding *
+gtef_indentation_folding_new (GtkTextBuffer *buffer)
+{
+	g_return_val_if_fail (GTK_IS_TEXT_BUFFER (buffer), NULL);
+
+	return g_object_new (GTEF_TYPE_INDENTATION_FOLDING,
+			     "buffer", buffer,
+			     NULL);
+}
+
+/**
+ * gtef_indentation_folding_get_buffer:
+ * @folding: a #GtefIndentationFolding.
+ *
+ * Returns: (transfer none) (nullable): the #GtefIndentationFolding:buffer.
+ * Since: 2.0
+ */
+GtkTextBuffer *
+gtef_indentation_folding_get_buffer (GtefIndentationFolding *folding)
+{
+	g_return_val_if_fail (GTEF_IS_INDENTATION_FOLDING (folding), NULL);
+
+	return folding->priv->buffer;
+}
+
+/**
+ * gtef_indentation_folding_get_tab_width:
+ * @folding: a #GtefIndentationFolding.
+ *
+ * Returns: the #GtefIndentationFolding:tab-width.
+ * Since: 2.0
+ */
+guint
+gtef_indentation_folding_get_tab_width (GtefIndentationFolding *folding)
+{
+	g_return_val_if_fail (GTEF_IS_INDENTATION_FOLDING (folding), DEFAULT_TAB_WIDTH);
+
+	return folding->priv->tab_width;
+}
+
+/**
+ * gtef_indentation_folding_set_tab_width:
+ * @folding: a #GtefIndentationFolding.
+ * @tab_width: the new tab width.
+ *
+ * Sets the #GtefIndentationFolding:tab-width. All the regions are computed
+ * again.
+ *
+ * Since: 2.0
+ */
+void
+gtef_indentation_folding_set_tab_width (GtefIndentationFolding *folding,
+					guint                   tab_width)
+{
+	g_return_if_fail (GTEF_IS_INDENTATION_FOLDING (folding));
+	g_return_if_fail (tab_width > 0);
+
+	if (folding->priv->tab_width == tab_width)
+	{
+		return;
+	}
+
+	folding->priv->tab_width = tab_width;
+
+	if (folding->priv->buffer != NULL)
+	{
+		folding->priv->generation++;
+		schedule_full_computation (folding);
+	}
+
+	g_object_notify_by_pspec (G_OBJECT (folding), properties[PROP_TAB_WIDTH]);
+}
+
+/**
+ * gtef_indentation_folding_get_computing:
+ * @folding: a #GtefIndentationFolding.
+ *
+ * Returns: the #GtefIndentationFolding:computing.
+ * Since: 2.0
+ */
+gboolean
+gtef_indentation_folding_get_computing (GtefIndentationFolding *folding)
+{
+	g_return_val_if_fail (GTEF_IS_INDENTATION_FOLDING (folding), FALSE);
+
+	return folding->priv->computing;
+}
@@ -0,0 +1,72 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GTEF_INDENTATION_FOLDING_H
+#define GTEF_INDENTATION_FOLDING_H
+
+#if !defined (GTEF_H_INSIDE) && !defined (GTEF_COMPILATION)
+#error "Only <gtef/gtef.h> can be included directly."
+#endif
+
+#include <gtk/gtk.h>
+#include <gtef/gtef-types.h>
+
+G_BEGIN_DECLS
+
+#define GTEF_TYPE_INDENTATION_FOLDING             (gtef_indentation_folding_get_type ())
+#define GTEF_INDENTATION_FOLDING(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), GTEF_TYPE_INDENTATION_FOLDING, GtefIndentationFolding))
+#define GTEF_INDENTATION_FOLDING_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST ((klass), GTEF_TYPE_INDENTATION_FOLDING, GtefIndentationFoldingClass))
+#define GTEF_IS_INDENTATION_FOLDING(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GTEF_TYPE_INDENTATION_FOLDING))
+#define GTEF_IS_INDENTATION_FOLDING_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass), GTEF_TYPE_INDENTATION_FOLDING))
+#define GTEF_INDENTATION_FOLDING_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj), GTEF_TYPE_INDENTATION_FOLDING, GtefIndentationFoldingClass))
+
+typedef struct _GtefIndentationFoldingClass    GtefIndentationFoldingClass;
+typedef struct _GtefIndentationFoldingPrivate  GtefIndentationFoldingPrivate;
+
+struct _GtefIndentationFolding
+{
+	GObject parent;
+
+	GtefIndentationFoldingPrivate *priv;
+};
+
+struct _GtefIndentationFoldingClass
+{
+	GObjectClass parent_class;
+
+	gpointer padding[12];
+};
+
+GType		gtef_indentation_folding_get_type		(void) G_GNUC_CONST;
+
+GtefIndentationFolding *
+		gtef_indentation_folding_new			(GtkTextBuffer          *buffer);
+
+GtkTextBuffer *	gtef_indentation_folding_get_buffer		(GtefIndentationFolding *folding);
+
+guint		gtef_indentation_folding_get_tab_width		(GtefIndentationFolding *folding);
+
+void		gtef_indentation_folding_set_tab_width		(GtefIndentationFolding *folding,
+								 guint                   tab_width);
+
+gboolean	gtef_indentation_folding_get_computing		(GtefIndentationFolding *folding);
+
+G_END_DECLS
+
+#endif /* GTEF_INDENTATION_FOLDING_H */
@@ -28,14 +28,14 @@
  */
 
 /* Get the boundary, on @iter's line, between leading spaces (indentation) and
- * the text.
+ * the text. For a line containing only spaces, it is the end of the line.
  *
  * Copied from gtksourceiter.c:
  * _gtk_source_iter_get_leading_spaces_end_boundary().
  */
-static void
-get_leading_spaces_end_boundary (const GtkTextIter *iter,
-				 GtkTextIter       *leading_end)
+void
+_gtef_iter_get_leading_spaces_end_boundary (const GtkTextIter *iter,
+					    GtkTextIter       *leading_end)
 {
 	g_return_if_fail (iter != NULL);
 	g_return_if_fail (leading_end != NULL);
@@ -43,7 +43,7 @@ get_leading_spaces_end_boundary (const GtkTextIter *iter,
 	*leading_end = *iter;
 	gtk_text_iter_set_line_offset (leading_end, 0);
 
-	while (!gtk_text_iter_is_end (leading_end))
+	while (!gtk_text_iter_ends_line (leading_end))
 	{
 		gunichar ch = gtk_text_iter_get_char (leading_end);
 
@@ -81,7 +81,7 @@ gtef_iter_get_line_indentation (const GtkTextIter *iter)
 	line_start = *iter;
 	gtk_text_iter_set_line_offset (&line_start, 0);
 
-	get_leading_spaces_end_boundary (iter, &leading_end);
+	_gtef_iter_get_leading_spaces_end_boundary (iter, &leading_end);
 
 	return gtk_text_iter_get_text (&line_start, &leading_end);
 }
@@ -30,6 +30,10 @@ G_BEGIN_DECLS
 
 gchar *		gtef_iter_get_line_indentation		(const GtkTextIter *iter);
 
+G_GNUC_INTERNAL
+void		_gtef_iter_get_leading_spaces_end_boundary	(const GtkTextIter *iter,
+								 GtkTextIter       *leading_end);
+
 G_END_DECLS
 
 #endif /* GTEF_ITER_H */
@@ -0,0 +1,448 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gtef-line-diff.h"
+#include <string.h>
+
+/* A line-level diff between two texts, to modify only the changed lines of a
+ * GtkTextBuffer. Lines are terminated by \n. With \r\n, the \r is part of the
+ * line. A text with only \r newlines is one big line: the result is still
+ * correct, only coarser.
+ *
+ * The common lines at the start and at the end are skipped first, which is
+ * enough for most small edits. The remaining lines are numbered, equal lines
+ * having the same number, and the shortest edit script is searched on the
+ * numbers with the Myers algorithm, in O((N+M)D) time where D is the number of
+ * inserted and deleted lines. If D exceeds @max_cost, the remaining lines are
+ * replaced in one hunk, the memory needed being in O(D²).
+ */
+
+typedef struct
+{
+	const gchar *str;
+	gsize length;
+} Line;
+
+/* A run of equal lines, in line numbers. */
+typedef struct
+{
+	gint old_start;
+	gint new_start;
+	gint length;
+} Snake;
+
+/* Index in the trace of the furthest reaching x on the diagonal @k after @d
+ * edits. For each d, the diagonals -d, -d+2, ..., d are stored.
+ */
+#define TRACE_INDEX(d, k) ((d) * ((d) + 1) / 2 + ((k) + (d)) / 2)
+
+static GArray *
+split_lines (const gchar *text,
+	     gsize        length)
+{
+	GArray *lines;
+	const gchar *p;
+	const gchar *end;
+
+	lines = g_array_new (FALSE, FALSE, sizeof (Line));
+
+	p = text;
+	end = text + length;
+
+	while (p < end)
+	{
+		const gchar *newline;
+		Line line;
+
+		newline = memchr (p, '\n', end - p);
+
+		line.str = p;
+		line.length = newline != NULL ? (gsize) (newline - p) + 1 : (gsize) (end - p);
+		g_array_append_val (lines, line);
+
+		p += line.length;
+	}
+
+	return lines;
+}
+
+static guint
+line_hash (gconstpointer key)
+{
+	const Line *line = key;
+	guint32 hash = 2166136261u;
+	gsize i;
+
+	/* FNV-1a */
+	for (i = 0; i < line->length; i++)
+	{
+		hash ^= (guint8) line->str[i];
+		hash *= 16777619;
+	}
+
+	return hash;
+}
+
+static gboolean
+line_equal (gconstpointer a,
+	    gconstpointer b)
+{
+	const Line *line_a = a;
+	const Line *line_b = b;
+
+	return (line_a->length == line_b->length &&
+		memcmp (line_a->str, line_b->str, line_a->length) == 0);
+}
+
+static void
+add_snake (GArray *snakes,
+	   gint    old_start,
+	   gint    new_start,
+	   gint    length)
+{
+	Snake snake;
+
+	if (length == 0)
+	{
+		return;
+	}
+
+	snake.old_start = old_start;
+	snake.new_start = new_start;
+	snake.length = length;
+	g_array_append_val (snakes, snake);
+}
+
+/* Finds the Snakes of a shortest edit script from @a to @b, and appends them
+ * to @snakes in reverse order. Returns %FALSE if more than @max_cost edits are
+ * needed.
+ */
+static gboolean
+find_snakes (const guint *a,
+	     gint         n,
+	     const guint *b,
+	     gint         m,
+	     gint         max_cost,
+	     GArray      *snakes)
+{
+	gint max_d;
+	gint offset;
+	gint *v;
+	GArray *trace;
+	gint found_d = -1;
+	gint d;
+	gint k;
+	gint x;
+	gint y;
+
+	max_d = MIN (n + m, max_cost);
+
+	/* v[k] is stored at v[offset + k], for k in [-max_d - 1, max_d + 1]. */
+	offset = max_d + 1;
+	v = g_new0 (gint, 2 * max_d + 3);
+
+	trace = g_array_new (FALSE, FALSE, sizeof (gint));
+
+	for (d = 0; d <= max_d && found_d == -1; d++)
+	{
+		for (k = -d; k <= d; k += 2)
+		{
+			if (k == -d ||
+			    (k != d && v[offset + k - 1] < v[offset + k + 1]))
+			{
+				/* Insertion of a line of @b. */
+				x = v[offset + k + 1];
+			}
+			else
+			{
+				/* Deletion of a line of @a. */
+				x = v[offset + k - 1] + 1;
+			}
+
+			y = x - k;
+
+			while (x < n && y < m && a[x] == b[y])
+			{
+				x++;
+				y++;
+			}
+
+			v[offset + k] = x;
+			g_array_append_val (trace, x);
+
+			if (x >= n && y >= m)
+			{
+				found_d = d;
+				break;
+			}
+		}
+	}
+
+	g_free (v);
+
+	if (found_d == -1)
+	{
+		g_array_unref (trace);
+		return FALSE;
+	}
+
+	/* Follow the path backwards, from (n, m). */
+	x = n;
+	y = m;
+
+	for (d = found_d; d > 0; d--)
+	{
+		const gint *prev_v = (const gint *) trace->data;
+		gint prev_k;
+		gint prev_x;
+		gint start_x;
+
+		k = x - y;
+
+		if (k == -d ||
+		    (k != d && prev_v[TRACE_INDEX (d - 1, k - 1)] < prev_v[TRACE_INDEX (d - 1, k + 1)]))
+		{
+			prev_k = k + 1;
+			prev_x = prev_v[TRACE_INDEX (d - 1, prev_k)];
+			start_x = prev_x;
+		}
+		else
+		{
+			prev_k = k - 1;
+			prev_x = prev_v[TRACE_INDEX (d - 1, prev_k)];
+			start_x = prev_x + 1;
+		}
+
+		add_snake (snakes, start_x, start_x - k, x - start_x);
+
+		x = prev_x;
+		y = prev_x - prev_k;
+	}
+
+	/* The lines equal at the start, x == y. */
+	add_snake (snakes, 0, 0, x);
+
+	g_array_unref (trace);
+	return TRUE;
+}
+
+static void
+add_hunk (GArray *hunks,
+	  gsize   old_start,
+	  gsize   old_end,
+	  gsize   new_start,
+	  gsize   new_end)
+{
+	GtefLineDiffHunk hunk;
+
+	if (old_start == old_end &&
+	    new_start == new_end)
+	{
+		return;
+	}
+
+	hunk.old_start = old_start;
+	hunk.old_end = old_end;
+	hunk.new_start = new_start;
+	hunk.new_end = new_end;
+	g_array_append_val (hunks, hunk);
+}
+
+/* Appends to @hunks, in line numbers, the differences between the lines
+ * [old_start, old_end) of @old_lines and the lines [new_start, new_end) of
+ * @new_lines.
+ */
+static void
+diff_lines (GArray *old_lines,
+	    gint    old_start,
+	    gint    old_end,
+	    GArray *new_lines,
+	    gint    new_start,
+	    gint    new_end,
+	    gint    max_cost,
+	    GArray *hunks)
+{
+	gint n = old_end - old_start;
+	gint m = new_end - new_start;
+	GHashTable *numbers;
+	guint *a;
+	guint *b;
+	guint next_number = 1;
+	GArray *snakes;
+	gint old_pos = 0;
+	gint new_pos = 0;
+	gint i;
+
+	if (n == 0 || m == 0)
+	{
+		add_hunk (hunks, old_start, old_end, new_start, new_end);
+		return;
+	}
+
+	numbers = g_hash_table_new (line_hash, line_equal);
+	a = g_new (guint, n);
+	b = g_new (guint, m);
+
+	for (i = 0; i < n; i++)
+	{
+		Line *line = &g_array_index (old_lines, Line, old_start + i);
+
+		a[i] = GPOINTER_TO_UINT (g_hash_table_lookup (numbers, line));
+
+		if (a[i] == 0)
+		{
+			a[i] = next_number++;
+			g_hash_table_insert (numbers, line, GUINT_TO_POINTER (a[i]));
+		}
+	}
+
+	for (i = 0; i < m; i++)
+	{
+		Line *line = &g_array_index (new_lines, Line, new_start + i);
+
+		/* A line not present in the old text never matches. */
+		b[i] = GPOINTER_TO_UINT (g_hash_table_lookup (numbers, line));
+	}
+
+	snakes = g_array_new (FALSE, FALSE, sizeof (Snake));
+
+	if (!find_snakes (a, n, b, m, max_cost, snakes))
+	{
+		g_array_set_size (snakes, 0);
+	}
+
+	for (i = (gint) snakes->len - 1; i >= 0; i--)
+	{
+		Snake *snake = &g_array_index (snakes, Snake, i);
+
+		add_hunk (hunks,
+			  old_start + old_pos,
+			  old_start + snake->old_start,
+			  new_start + new_pos,
+			  new_start + snake->new_start);
+
+		old_pos = snake->old_start + snake->length;
+		new_pos = snake->new_start + snake->length;
+	}
+
+	add_hunk (hunks,
+		  old_start + old_pos,
+		  old_end,
+		  new_start + new_pos,
+		  new_end);
+
+	g_array_unref (snakes);
+	g_hash_table_unref (numbers);
+	g_free (a);
+	g_free (b);
+}
+
+static gsize
+get_line_offset (GArray      *lines,
+		 gsize        line_num,
+		 const gchar *text,
+		 gsize        length)
+{
+	if (line_num < lines->len)
+	{
+		return g_array_index (lines, Line, line_num).str - text;
+	}
+
+	return length;
+}
+
+/*
+ * _gtef_line_diff_compute:
+ * @old_text: the old text.
+ * @old_length: the length of @old_text, in bytes.
+ * @new_text: the new text.
+ * @new_length: the length of @new_text, in bytes.
+ * @max_cost: the maximum number of inserted and deleted lines to search a
+ *   minimal diff for.
+ *
+ * Computes the hunks to apply to @old_text to get @new_text. The texts don't
+ * need to be nul-terminated.
+ *
+ * Returns: (transfer full): the #GtefLineDiffHunk's, in the order of the
+ * texts, without overlaps. Empty if the texts are equal.
+ */
+GArray *
+_gtef_line_diff_compute (const gchar *old_text,
+			 gsize        old_length,
+			 const gchar *new_text,
+			 gsize        new_length,
+			 guint        max_cost)
+{
+	GArray *old_lines;
+	GArray *new_lines;
+	GArray *hunks;
+	gint n_old_lines;
+	gint n_new_lines;
+	gint prefix = 0;
+	gint suffix = 0;
+	guint i;
+
+	g_return_val_if_fail (old_text != NULL || old_length == 0, NULL);
+	g_return_val_if_fail (new_text != NULL || new_length == 0, NULL);
+
+	hunks = g_array_new (FALSE, FALSE, sizeof (GtefLineDiffHunk));
+
+	old_lines = split_lines (old_text, old_length);
+	new_lines = split_lines (new_text, new_length);
+
+	n_old_lines = old_lines->len;
+	n_new_lines = new_lines->len;
+
+	while (prefix < n_old_lines &&
+	       prefix < n_new_lines &&
+	       line_equal (&g_array_index (old_lines, Line, prefix),
+			   &g_array_index (new_lines, Line, prefix)))
+	{
+		prefix++;
+	}
+
+	while (suffix < n_old_lines - prefix &&
+	       suffix < n_new_lines - prefix &&
+	       line_equal (&g_array_index (old_lines, Line, n_old_lines - 1 - suffix),
+			   &g_array_index (new_lines, Line, n_new_lines - 1 - suffix)))
+	{
+		suffix++;
+	}
+
+	diff_lines (old_lines, prefix, n_old_lines - suffix,
+		    new_lines, prefix, n_new_lines - suffix,
+		    MIN (max_cost, G_MAXINT / 2),
+		    hunks);
+
+	/* From line numbers to byte offsets. */
+	for (i = 0; i < hunks->len; i++)
+	{
+		GtefLineDiffHunk *hunk = &g_array_index (hunks, GtefLineDiffHunk, i);
+
+		hunk->old_start = get_line_offset (old_lines, hunk->old_start, old_text, old_length);
+		hunk->old_end = get_line_offset (old_lines, hunk->old_end, old_text, old_length);
+		hunk->new_start = get_line_offset (new_lines, hunk->new_start, new_text, new_length);
+		hunk->new_end = get_line_offset (new_lines, hunk->new_end, new_text, new_length);
+	}
+
+	g_array_unref (old_lines);
+	g_array_unref (new_lines);
+
+	return hunks;
+}
@@ -0,0 +1,49 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GTEF_LINE_DIFF_H
+#define GTEF_LINE_DIFF_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GtefLineDiffHunk GtefLineDiffHunk;
+
+/* The bytes [old_start, old_end) of the old text are replaced by the bytes
+ * [new_start, new_end) of the new text. The offsets are at line boundaries.
+ */
+struct _GtefLineDiffHunk
+{
+	gsize old_start;
+	gsize old_end;
+	gsize new_start;
+	gsize new_end;
+};
+
+G_GNUC_INTERNAL
+GArray *	_gtef_line_diff_compute		(const gchar *old_text,
+						 gsize        old_length,
+						 const gchar *new_text,
+						 gsize        new_length,
+						 guint        max_cost);
+
+G_END_DECLS
+
+#endif /* GTEF_LINE_DIFF_H */
@@ -0,0 +1,169 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gtef-line-index.h"
+#include <string.h>
+
+/* A sparse index of the line start offsets of a file, to be able to read any
+ * line without reading the whole file. The offset is stored only for one line
+ * every @interval lines (a checkpoint), so for a file with 100 million lines
+ * and an interval of 1024 lines, the index takes less than 1 MB. To reach a
+ * line, the file is read from the previous checkpoint.
+ *
+ * The index is filled by feeding the file content in order, chunk by chunk,
+ * which can be done in a worker thread. Lines are terminated by \n, so the
+ * content must be in an ASCII-compatible encoding. With \r\n, the \r is part
+ * of the line. Like in a GtkTextBuffer, a file ending with a newline has a
+ * last empty line.
+ */
+
+struct _GtefLineIndex
+{
+	/* Element type: guint64. Element i is the offset of line i * interval. */
+	GArray *checkpoints;
+
+	guint interval;
+
+	/* The number of \n fed so far. */
+	guint64 n_newlines;
+
+	/* The number of bytes fed so far. */
+	guint64 size;
+};
+
+GtefLineIndex *
+_gtef_line_index_new (guint interval)
+{
+	GtefLineIndex *index;
+	guint64 first_line_offset = 0;
+
+	g_return_val_if_fail (interval > 0, NULL);
+
+	index = g_new0 (GtefLineIndex, 1);
+	index->interval = interval;
+	index->checkpoints = g_array_new (FALSE, FALSE, sizeof (guint64));
+	g_array_append_val (index->checkpoints, first_line_offset);
+
+	return index;
+}
+
+void
+_gtef_line_index_free (GtefLineIndex *index)
+{
+	if (index != NULL)
+	{
+		g_array_unref (index->checkpoints);
+		g_free (index);
+	}
+}
+
+void
+_gtef_line_index_add_chunk (GtefLineIndex *index,
+			    const gchar   *chunk,
+			    gsize          length)
+{
+	const gchar *p;
+	const gchar *end;
+
+	g_return_if_fail (index != NULL);
+	g_return_if_fail (chunk != NULL || length == 0);
+
+	p = chunk;
+	end = chunk + length;
+
+	while (p < end)
+	{
+		const gchar *newline;
+
+		newline = memchr (p, '\n', end - p);
+		if (newline == NULL)
+		{
+			break;
+		}
+
+		index->n_newlines++;
+
+		if (index->n_newlines % index->interval == 0)
+		{
+			guint64 line_offset;
+
+			line_offset = index->size + (newline - chunk) + 1;
+			g_array_append_val (index->checkpoints, line_offset);
+		}
+
+		p = newline + 1;
+	}
+
+	index->size += length;
+}
+
+guint64
+_gtef_line_index_get_n_lines (GtefLineIndex *index)
+{
+	g_return_val_if_fail (index != NULL, 0);
+
+	return index->n_newlines + 1;
+}
+
+guint64
+_gtef_line_index_get_size (GtefLineIndex *index)
+{
+	g_return_val_if_fail (index != NULL, 0);
+
+	return index->size;
+}
+
+/*
+ * _gtef_line_index_lookup:
+ * @index: a #GtefLineIndex.
+ * @line: a line number, counting from 0.
+ * @checkpoint_line: (out): the nearest line before or at @line whose offset is
+ *   known.
+ * @checkpoint_offset: (out): the offset of @checkpoint_line, in bytes.
+ *
+ * To read @line, read the file from @checkpoint_offset and skip
+ * @line - @checkpoint_line newlines.
+ *
+ * Returns: whether @line exists.
+ */
+gboolean
+_gtef_line_index_lookup (GtefLineIndex *index,
+			 guint64        line,
+			 guint64       *checkpoint_line,
+			 guint64       *checkpoint_offset)
+{
+	guint64 checkpoint_num;
+
+	g_return_val_if_fail (index != NULL, FALSE);
+	g_return_val_if_fail (checkpoint_line != NULL, FALSE);
+	g_return_val_if_fail (checkpoint_offset != NULL, FALSE);
+
+	if (line >= _gtef_line_index_get_n_lines (index))
+	{
+		return FALSE;
+	}
+
+	checkpoint_num = line / index->interval;
+	g_assert (checkpoint_num < index->checkpoints->len);
+
+	*checkpoint_line = checkpoint_num * index->interval;
+	*checkpoint_offset = g_array_index (index->checkpoints, guint64, checkpoint_num);
+
+	return TRUE;
+}
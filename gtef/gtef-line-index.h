@@ -0,0 +1,54 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GTEF_LINE_INDEX_H
+#define GTEF_LINE_INDEX_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GtefLineIndex GtefLineIndex;
+
+G_GNUC_INTERNAL
+GtefLineIndex *	_gtef_line_index_new			(guint interval);
+
+G_GNUC_INTERNAL
+void		_gtef_line_index_free			(GtefLineIndex *index);
+
+G_GNUC_INTERNAL
+void		_gtef_line_index_add_chunk		(GtefLineIndex *index,
+							 const gchar   *chunk,
+							 gsize          length);
+
+G_GNUC_INTERNAL
+guint64		_gtef_line_index_get_n_lines		(GtefLineIndex *index);
+
+G_GNUC_INTERNAL
+guint64		_gtef_line_index_get_size		(GtefLineIndex *index);
+
+G_GNUC_INTERNAL
+gboolean	_gtef_line_index_lookup			(GtefLineIndex *index,
+							 guint64        line,
+							 guint64       *checkpoint_line,
+							 guint64       *checkpoint_offset);
+
+G_END_DECLS
+
+#endif /* GTEF_LINE_INDEX_H */
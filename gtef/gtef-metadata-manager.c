@@ -2,7 +2,7 @@
  * This file is part of Gtef, a text editor library.
  *
  * Copyright 2003-2007 - Paolo Maggi
- * Copyright 2016 - Sébastien Wilmet <swilmet@gnome.org>
+ * Copyright 2016, 2017 - Sébastien Wilmet <swilmet@gnome.org>
  *
  * Gtef is free software; you can redistribute it and/or modify it under
  * the terms of the GNU Lesser General Public License as published by the
@@ -25,48 +25,140 @@
  *
  * The metadata manager permits to save/load metadata on platforms that don't
  * support GVfs metadata, like (at the time of writing) Windows.
+ *
+ * The metadata of a limited number of locations is kept, the least recently
+ * used locations are forgotten first. See
+ * gtef_metadata_manager_set_max_number_of_locations().
  */
 
-/* This code comes from gedit.
- * A better implementation would be to use SQLite.
+/* The store is an append-only log: each change is written as one line at the
+ * end of the file, so a save doesn't rewrite the whole file. When the log
+ * contains too many obsolete records, it is compacted: the file is rewritten
+ * atomically from the in-memory state.
+ *
+ * The file starts with the FILE_HEADER line, followed by records. A record is
+ * a line with tab-separated fields, the first field being the record type:
+ *
+ * T <atime> <uri>              The location has been accessed at <atime>.
+ * S <uri> <key> <value>        Set a metadata value.
+ * R <uri> <key>                Remove a metadata value.
+ * D <uri>                      Forget the location.
+ *
+ * The fields are escaped: \ becomes \\, and tab, newline and carriage return
+ * characters become \t, \n and \r.
+ *
+ * The previous format, written by the metadata manager coming from gedit, was
+ * an XML file. It is imported on the first load.
+ *
+ * In memory, the locations are indexed by URI in a hash table, and are also in
+ * a list ordered by access time, for the LRU eviction.
+ *
+ * The file is written in a separate thread, so that a slow disk (for example a
+ * home directory on NFS) doesn't block the UI. The changes done during 2
+ * seconds are coalesced. Then the records to append, or the whole content for
+ * a compaction, are prepared in the main thread and given to a SaveJob, which
+ * is run in the save thread. The save thread doesn't access the metadata
+ * manager.
  */
 
 #include "gtef-metadata-manager.h"
 #include <libxml/xmlreader.h>
 #include <string.h>
+#include <glib/gstdio.h>
+
+#define DEFAULT_MAX_ITEMS 50
+
+#define FILE_HEADER "GTEF-METADATA 1\n"
 
-#define MAX_ITEMS 50
+/* The log is compacted when it has more than COMPACTION_FACTOR times the
+ * number of live records, plus COMPACTION_MIN_RECORDS.
+ */
+#define COMPACTION_FACTOR 2
+#define COMPACTION_MIN_RECORDS 1000
+
+/* Maximum time to wait for the writes to finish, in
+ * gtef_metadata_manager_shutdown().
+ */
+#define SHUTDOWN_TIMEOUT_SECONDS 5
 
 typedef struct _GtefMetadataManager GtefMetadataManager;
 
 typedef struct _Item Item;
+typedef struct _SaveJob SaveJob;
 
 struct _Item
 {
+	/* Owned, also used as the key of the items hash table. */
+	gchar *uri;
+
 	/* Time of last access in seconds since January 1, 1970 UTC. */
 	gint64 atime;
 
 	GHashTable *values;
+
+	/* Link in the lru queue, data is the Item. */
+	GList lru_link;
+};
+
+struct _SaveJob
+{
+	gchar *path;
+	gchar *contents;
+	gsize length;
+
+	/* Whether to rewrite the whole file, or to append the contents. */
+	guint rewrite : 1;
 };
 
 struct _GtefMetadataManager
 {
 	guint timeout_id;
 
+	/* URI -> Item */
 	GHashTable *items;
 
+	/* The Items, the most recently used first. */
+	GQueue lru;
+
+	guint max_items;
+
 	gchar *metadata_path;
 
+	/* Records not yet appended to the file. */
+	GString *pending_records;
+
+	/* Number of records in the file, plus the pending ones. */
+	guint n_log_records;
+
+	/* Runs the SaveJobs, with one thread. */
+	GThreadPool *save_pool;
+
 	/* It is true if the file has been read. */
 	guint values_loaded : 1;
 
+	/* The file needs to be entirely rewritten at the next save, for
+	 * example if it is in the XML format.
+	 */
+	guint needs_compaction : 1;
+
 	guint unit_test_mode : 1;
 };
 
 static gboolean gtef_metadata_manager_save (gpointer data);
+static void save_now (void);
+static void save_thread_func (gpointer data,
+			      gpointer user_data);
 
 static GtefMetadataManager *gtef_metadata_manager = NULL;
 
+/* Shared with the save thread, which can outlive the metadata manager if
+ * gtef_metadata_manager_shutdown() times out.
+ */
+static GMutex save_mutex;
+static GCond save_cond;
+static guint n_save_jobs = 0;
+static gboolean save_failed = FALSE;
+
 #define METADATA_PREFIX "metadata::"
 
 static gchar *
@@ -84,12 +176,195 @@ item_free (gpointer data)
 
 	item = (Item *)data;
 
+	g_free (item->uri);
+
 	if (item->values != NULL)
 		g_hash_table_destroy (item->values);
 
 	g_free (item);
 }
 
+static Item *
+lookup_item (const gchar *uri)
+{
+	return g_hash_table_lookup (gtef_metadata_manager->items, uri);
+}
+
+/* The new item is the most recently used. */
+static Item *
+add_item (const gchar *uri)
+{
+	Item *item;
+
+	item = g_new0 (Item, 1);
+	item->uri = g_strdup (uri);
+	item->values = g_hash_table_new_full (g_str_hash,
+					      g_str_equal,
+					      g_free,
+					      g_free);
+	item->lru_link.data = item;
+
+	g_hash_table_insert (gtef_metadata_manager->items, item->uri, item);
+	g_queue_push_head_link (&gtef_metadata_manager->lru, &item->lru_link);
+
+	return item;
+}
+
+static void
+remove_item (Item *item)
+{
+	g_queue_unlink (&gtef_metadata_manager->lru, &item->lru_link);
+	g_hash_table_remove (gtef_metadata_manager->items, item->uri);
+}
+
+/* Marks the item as the most recently used. */
+static void
+touch_item (Item   *item,
+	    gint64  atime)
+{
+	item->atime = atime;
+
+	g_queue_unlink (&gtef_metadata_manager->lru, &item->lru_link);
+	g_queue_push_head_link (&gtef_metadata_manager->lru, &item->lru_link);
+}
+
+static void
+append_escaped (GString     *string,
+		const gchar *field)
+{
+	const gchar *p;
+
+	for (p = field; *p != '\0'; p++)
+	{
+		switch (*p)
+		{
+			case '\\':
+				g_string_append (string, "\\\\");
+				break;
+
+			case '\t':
+				g_string_append (string, "\\t");
+				break;
+
+			case '\n':
+				g_string_append (string, "\\n");
+				break;
+
+			case '\r':
+				g_string_append (string, "\\r");
+				break;
+
+			default:
+				g_string_append_c (string, *p);
+				break;
+		}
+	}
+}
+
+/* In-place. */
+static void
+unescape (gchar *field)
+{
+	gchar *src;
+	gchar *dest;
+
+	for (src = dest = field; *src != '\0'; src++, dest++)
+	{
+		if (*src == '\\' && src[1] != '\0')
+		{
+			src++;
+
+			switch (*src)
+			{
+				case 't':
+					*dest = '\t';
+					break;
+
+				case 'n':
+					*dest = '\n';
+					break;
+
+				case 'r':
+					*dest = '\r';
+					break;
+
+				default:
+					*dest = *src;
+					break;
+			}
+		}
+		else
+		{
+			*dest = *src;
+		}
+	}
+
+	*dest = '\0';
+}
+
+static void
+write_touch_record (GString    *string,
+		    const Item *item)
+{
+	g_string_append_printf (string, "T\t%" G_GINT64_FORMAT "\t", item->atime);
+	append_escaped (string, item->uri);
+	g_string_append_c (string, '\n');
+}
+
+static void
+write_set_record (GString     *string,
+		  const Item  *item,
+		  const gchar *key,
+		  const gchar *value)
+{
+	g_string_append (string, "S\t");
+	append_escaped (string, item->uri);
+	g_string_append_c (string, '\t');
+	append_escaped (string, key);
+	g_string_append_c (string, '\t');
+	append_escaped (string, value);
+	g_string_append_c (string, '\n');
+}
+
+static void
+write_remove_record (GString     *string,
+		     const Item  *item,
+		     const gchar *key)
+{
+	g_string_append (string, "R\t");
+	append_escaped (string, item->uri);
+	g_string_append_c (string, '\t');
+	append_escaped (string, key);
+	g_string_append_c (string, '\n');
+}
+
+static void
+write_delete_record (GString    *string,
+		     const Item *item)
+{
+	g_string_append (string, "D\t");
+	append_escaped (string, item->uri);
+	g_string_append_c (string, '\n');
+}
+
+/* Forgets the least recently used items. */
+static void
+evict_items (void)
+{
+	while (g_hash_table_size (gtef_metadata_manager->items) > gtef_metadata_manager->max_items)
+	{
+		Item *item;
+
+		item = g_queue_peek_tail (&gtef_metadata_manager->lru);
+		g_return_if_fail (item != NULL);
+
+		write_delete_record (gtef_metadata_manager->pending_records, item);
+		gtef_metadata_manager->n_log_records++;
+
+		remove_item (item);
+	}
+}
+
 static void
 gtef_metadata_manager_arm_timeout (void)
 {
@@ -139,19 +414,57 @@ gtef_metadata_manager_init (const gchar *metadata_path)
 	gtef_metadata_manager->items =
 		g_hash_table_new_full (g_str_hash,
 				       g_str_equal,
-				       g_free,
+				       NULL,
 				       item_free);
 
+	g_queue_init (&gtef_metadata_manager->lru);
+
+	gtef_metadata_manager->max_items = DEFAULT_MAX_ITEMS;
+
 	gtef_metadata_manager->metadata_path = g_strdup (metadata_path);
 
+	gtef_metadata_manager->pending_records = g_string_new (NULL);
+
+	gtef_metadata_manager->save_pool = g_thread_pool_new (save_thread_func,
+							      NULL,
+							      1,
+							      FALSE,
+							      NULL);
+
 	gtef_metadata_manager->unit_test_mode = FALSE;
 }
 
+/* Waits until the save jobs are finished, or until the timeout. */
+static void
+wait_save_jobs (void)
+{
+	gint64 end_time;
+
+	end_time = g_get_monotonic_time () + SHUTDOWN_TIMEOUT_SECONDS * G_TIME_SPAN_SECOND;
+
+	g_mutex_lock (&save_mutex);
+
+	while (n_save_jobs > 0)
+	{
+		if (!g_cond_wait_until (&save_cond, &save_mutex, end_time))
+		{
+			g_warning ("GtefMetadataManager: the metadata have not been "
+				   "saved after %d seconds, giving up.",
+				   SHUTDOWN_TIMEOUT_SECONDS);
+			break;
+		}
+	}
+
+	g_mutex_unlock (&save_mutex);
+}
+
 /**
  * gtef_metadata_manager_shutdown:
  *
- * This function saves synchronously metadata if they need to be saved, and
- * frees the internal data of the metadata manager.
+ * This function saves the metadata if they need to be saved, and frees the
+ * internal data of the metadata manager. The metadata are written in a
+ * separate thread; this function waits at most 5 seconds for the writes to
+ * finish.
  *
  * Since: 1.0
  */
@@ -165,18 +478,55 @@ gtef_metadata_manager_shutdown (void)
 	{
 		g_source_remove (gtef_metadata_manager->timeout_id);
 		gtef_metadata_manager->timeout_id = 0;
-		gtef_metadata_manager_save (NULL);
 	}
 
+	/* The access times are saved too. */
+	if (gtef_metadata_manager->pending_records->len > 0 ||
+	    gtef_metadata_manager->needs_compaction)
+	{
+		save_now ();
+	}
+
+	wait_save_jobs ();
+
+	/* Doesn't wait: if the timeout has been reached, the pending jobs are
+	 * still run, unless the application exits before.
+	 */
+	g_thread_pool_free (gtef_metadata_manager->save_pool, FALSE, FALSE);
+
 	if (gtef_metadata_manager->items != NULL)
 		g_hash_table_destroy (gtef_metadata_manager->items);
 
+	g_string_free (gtef_metadata_manager->pending_records, TRUE);
+
 	g_free (gtef_metadata_manager->metadata_path);
 
 	g_free (gtef_metadata_manager);
 	gtef_metadata_manager = NULL;
 }
 
+/**
+ * gtef_metadata_manager_set_max_number_of_locations:
+ * @max_number_of_locations: the maximum number of locations for which metadata
+ *   are kept.
+ *
+ * Sets the maximum number of locations for which the metadata manager keeps
+ * the metadata. When the maximum is reached, the metadata of the least
+ * recently used location are forgotten. The default value is 50.
+ *
+ * This function must be called after gtef_metadata_manager_init().
+ *
+ * Since: 2.0
+ */
+void
+gtef_metadata_manager_set_max_number_of_locations (guint max_number_of_locations)
+{
+	g_return_if_fail (gtef_metadata_manager != NULL);
+	g_return_if_fail (max_number_of_locations > 0);
+
+	gtef_metadata_manager->max_items = max_number_of_locations;
+}
+
 static void
 parseItem (xmlDocPtr doc, xmlNodePtr cur)
 {
@@ -199,15 +549,14 @@ parseItem (xmlDocPtr doc, xmlNodePtr cur)
 		return;
 	}
 
-	item = g_new0 (Item, 1);
+	item = lookup_item ((gchar *)uri);
+	if (item == NULL)
+	{
+		item = add_item ((gchar *)uri);
+	}
 
 	item->atime = g_ascii_strtoll ((char *)atime, NULL, 0);
 
-	item->values = g_hash_table_new_full (g_str_hash,
-					      g_str_equal,
-					      g_free,
-					      g_free);
-
 	cur = cur->xmlChildrenNode;
 
 	while (cur != NULL)
@@ -236,40 +585,41 @@ parseItem (xmlDocPtr doc, xmlNodePtr cur)
 		cur = cur->next;
 	}
 
-	g_hash_table_insert (gtef_metadata_manager->items,
-			     g_strdup ((gchar *)uri),
-			     item);
-
 	xmlFree (uri);
 	xmlFree (atime);
 }
 
-/* Returns FALSE in case of error. */
-static gboolean
-load_values (void)
+static gint
+compare_items_by_atime (gconstpointer a,
+			gconstpointer b,
+			gpointer      user_data)
 {
-	xmlDocPtr doc;
-	xmlNodePtr cur;
+	const Item *item_a = a;
+	const Item *item_b = b;
 
-	g_return_val_if_fail (gtef_metadata_manager != NULL, FALSE);
-	g_return_val_if_fail (gtef_metadata_manager->values_loaded == FALSE, FALSE);
-
-	gtef_metadata_manager->values_loaded = TRUE;
+	/* The most recent first. */
+	if (item_a->atime > item_b->atime)
+		return -1;
 
-	xmlKeepBlanksDefault (0);
+	if (item_a->atime < item_b->atime)
+		return 1;
 
-	if (gtef_metadata_manager->metadata_path == NULL)
-	{
-		return FALSE;
-	}
+	return 0;
+}
 
-	/* TODO: avoid races */
-	if (!g_file_test (gtef_metadata_manager->metadata_path, G_FILE_TEST_EXISTS))
-	{
-		return TRUE;
-	}
+/* Imports the XML format. Returns FALSE in case of error. */
+static gboolean
+import_xml (const gchar *contents,
+	    gsize        length)
+{
+	xmlDocPtr doc;
+	xmlNodePtr cur;
 
-	doc = xmlParseFile (gtef_metadata_manager->metadata_path);
+	doc = xmlReadMemory (contents,
+			     length,
+			     gtef_metadata_manager->metadata_path,
+			     NULL,
+			     XML_PARSE_NOBLANKS);
 
 	if (doc == NULL)
 	{
@@ -307,146 +657,436 @@ load_values (void)
 
 	xmlFreeDoc (doc);
 
+	/* The XML format is not ordered. */
+	g_queue_sort (&gtef_metadata_manager->lru, compare_items_by_atime, NULL);
+
+	/* Convert the file to the new format at the next save. */
+	gtef_metadata_manager->needs_compaction = TRUE;
+
 	return TRUE;
 }
 
-static void
-save_values (const gchar *key, const gchar *value, xmlNodePtr parent)
+/* Returns FALSE if the record is invalid. */
+static gboolean
+replay_record (gchar **fields)
 {
-	xmlNodePtr xml_node;
+	guint n_fields;
+	const gchar *type;
+	Item *item;
+	guint i;
 
-	g_return_if_fail (key != NULL);
+	n_fields = g_strv_length (fields);
+	if (n_fields < 2)
+	{
+		return FALSE;
+	}
 
-	if (value == NULL)
-		return;
+	for (i = 1; i < n_fields; i++)
+	{
+		unescape (fields[i]);
+	}
+
+	type = fields[0];
+
+	if (g_str_equal (type, "T") && n_fields == 3)
+	{
+		item = lookup_item (fields[2]);
+		if (item == NULL)
+		{
+			item = add_item (fields[2]);
+		}
+
+		touch_item (item, g_ascii_strtoll (fields[1], NULL, 10));
+		return TRUE;
+	}
+
+	if (g_str_equal (type, "S") && n_fields == 4)
+	{
+		item = lookup_item (fields[1]);
+		if (item == NULL)
+		{
+			item = add_item (fields[1]);
+		}
+
+		g_hash_table_insert (item->values,
+				     g_strdup (fields[2]),
+				     g_strdup (fields[3]));
+		return TRUE;
+	}
+
+	if (g_str_equal (type, "R") && n_fields == 3)
+	{
+		item = lookup_item (fields[1]);
+		if (item != NULL)
+		{
+			g_hash_table_remove (item->values, fields[2]);
+		}
+
+		return TRUE;
+	}
 
-	xml_node = xmlNewChild (parent,
-				NULL,
-				(const xmlChar *)"entry",
-				NULL);
+	if (g_str_equal (type, "D") && n_fields == 2)
+	{
+		item = lookup_item (fields[1]);
+		if (item != NULL)
+		{
+			remove_item (item);
+		}
+
+		return TRUE;
+	}
 
-	xmlSetProp (xml_node,
-		    (const xmlChar *)"key",
-		    (const xmlChar *)key);
-	xmlSetProp (xml_node,
-		    (const xmlChar *)"value",
-		    (const xmlChar *)value);
+	return FALSE;
 }
 
 static void
-save_item (const gchar *key, const gpointer *data, xmlNodePtr parent)
+replay_log (gchar *contents,
+	    gsize  length)
 {
-	xmlNodePtr xml_node;
-	const Item *item = (const Item *)data;
-	gchar *atime;
+	gchar *line;
+	gchar *end;
 
-	g_return_if_fail (key != NULL);
+	end = contents + length;
+	line = contents + strlen (FILE_HEADER);
 
-	if (item == NULL)
-		return;
+	while (line < end)
+	{
+		gchar *newline;
+		gchar **fields;
 
-	xml_node = xmlNewChild (parent, NULL, (const xmlChar *)"document", NULL);
+		newline = memchr (line, '\n', end - line);
 
-	xmlSetProp (xml_node, (const xmlChar *)"uri", (const xmlChar *)key);
+		/* An incomplete record, the application has probably crashed
+		 * while appending to the file.
+		 */
+		if (newline == NULL)
+		{
+			gtef_metadata_manager->needs_compaction = TRUE;
+			break;
+		}
 
-	atime = g_strdup_printf ("%" G_GINT64_FORMAT, item->atime);
-	xmlSetProp (xml_node, (const xmlChar *)"atime", (const xmlChar *)atime);
+		*newline = '\0';
 
-	g_free (atime);
+		fields = g_strsplit (line, "\t", 0);
 
-	g_hash_table_foreach (item->values,
-			      (GHFunc)save_values,
-			      xml_node);
+		if (!replay_record (fields))
+		{
+			gtef_metadata_manager->needs_compaction = TRUE;
+		}
+
+		g_strfreev (fields);
+
+		gtef_metadata_manager->n_log_records++;
+		line = newline + 1;
+	}
 }
 
-static void
-get_oldest (const gchar *key, const gpointer value, const gchar ** key_to_remove)
+/* Returns FALSE in case of error. */
+static gboolean
+load_values (void)
 {
-	const Item *item = (const Item *)value;
+	gchar *contents;
+	gsize length;
+	gboolean ok = TRUE;
+	GError *error = NULL;
+
+	g_return_val_if_fail (gtef_metadata_manager != NULL, FALSE);
+	g_return_val_if_fail (gtef_metadata_manager->values_loaded == FALSE, FALSE);
+
+	gtef_metadata_manager->values_loaded = TRUE;
+
+	if (gtef_metadata_manager->metadata_path == NULL)
+	{
+		return FALSE;
+	}
+
+	if (!g_file_get_contents (gtef_metadata_manager->metadata_path,
+				  &contents,
+				  &length,
+				  &error))
+	{
+		ok = g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT);
+		g_error_free (error);
+
+		/* The file is created at the next save. */
+		gtef_metadata_manager->needs_compaction = TRUE;
+		return ok;
+	}
 
-	if (*key_to_remove == NULL)
+	if (g_str_has_prefix (contents, FILE_HEADER))
 	{
-		*key_to_remove = key;
+		replay_log (contents, length);
 	}
 	else
 	{
-		const Item *item_to_remove =
-			g_hash_table_lookup (gtef_metadata_manager->items,
-					     *key_to_remove);
+		/* An old XML file, or an empty, truncated or corrupted file.
+		 * Rewrite it with the header at the next save, otherwise the
+		 * records would be appended to it.
+		 */
+		gtef_metadata_manager->needs_compaction = TRUE;
+
+		if (length > 0)
+		{
+			ok = import_xml (contents, length);
+		}
+	}
+
+	g_free (contents);
+
+	/* The maximum number of items may have been reduced. */
+	evict_items ();
+
+	if (gtef_metadata_manager->needs_compaction)
+	{
+		gtef_metadata_manager_arm_timeout ();
+	}
+
+	return ok;
+}
+
+static guint
+count_live_records (void)
+{
+	GList *l;
+	guint n_records = 0;
+
+	for (l = gtef_metadata_manager->lru.head; l != NULL; l = l->next)
+	{
+		Item *item = l->data;
+
+		n_records += 1 + g_hash_table_size (item->values);
+	}
 
-		g_return_if_fail (item_to_remove != NULL);
+	return n_records;
+}
+
+/* Serializes the whole in-memory state, for rewriting the file. */
+static GString *
+get_compacted_contents (void)
+{
+	GString *contents;
+	GList *l;
+
+	contents = g_string_new (FILE_HEADER);
+	gtef_metadata_manager->n_log_records = 0;
+
+	/* The least recently used first, so that replaying the log restores the
+	 * same order.
+	 */
+	for (l = gtef_metadata_manager->lru.tail; l != NULL; l = l->prev)
+	{
+		Item *item = l->data;
+		GHashTableIter iter;
+		gpointer key;
+		gpointer value;
 
-		if (item->atime < item_to_remove->atime)
+		write_touch_record (contents, item);
+		gtef_metadata_manager->n_log_records++;
+
+		g_hash_table_iter_init (&iter, item->values);
+		while (g_hash_table_iter_next (&iter, &key, &value))
 		{
-			*key_to_remove = key;
+			write_set_record (contents, item, key, value);
+			gtef_metadata_manager->n_log_records++;
 		}
 	}
+
+	return contents;
 }
 
 static void
-resize_items (void)
+save_job_free (SaveJob *job)
+{
+	g_free (job->path);
+	g_free (job->contents);
+	g_free (job);
+}
+
+static gboolean
+append_to_file (const gchar *path,
+		const gchar *contents,
+		gsize        length)
 {
-	while (g_hash_table_size (gtef_metadata_manager->items) > MAX_ITEMS)
+	FILE *file;
+	gboolean ok;
+
+	file = g_fopen (path, "ab");
+	if (file == NULL)
 	{
-		gpointer key_to_remove = NULL;
+		return FALSE;
+	}
 
-		g_hash_table_foreach (gtef_metadata_manager->items,
-				      (GHFunc)get_oldest,
-				      &key_to_remove);
+	/* One write for all the records. */
+	ok = fwrite (contents, 1, length, file) == length;
 
-		g_return_if_fail (key_to_remove != NULL);
+	if (fclose (file) != 0)
+	{
+		ok = FALSE;
+	}
 
-		g_hash_table_remove (gtef_metadata_manager->items,
-				     key_to_remove);
+	return ok;
+}
+
+/* Runs in the save thread, or in the main thread in unit test mode. Doesn't
+ * access the metadata manager, which can be freed in the meantime.
+ */
+static void
+run_save_job (SaveJob *job)
+{
+	gchar *cache_dir;
+	gboolean ok;
+
+	/* make sure the cache dir exists */
+	cache_dir = g_path_get_dirname (job->path);
+	ok = g_mkdir_with_parents (cache_dir, 0755) != -1;
+	g_free (cache_dir);
+
+	if (ok)
+	{
+		if (job->rewrite)
+		{
+			/* Writes to a temporary file and renames it. */
+			ok = g_file_set_contents (job->path, job->contents, job->length, NULL);
+		}
+		else if (g_file_test (job->path, G_FILE_TEST_EXISTS))
+		{
+			ok = append_to_file (job->path, job->contents, job->length);
+		}
+		else
+		{
+			/* Removed in the meantime, the next save rewrites it. */
+			ok = FALSE;
+		}
 	}
+
+	g_mutex_lock (&save_mutex);
+
+	if (!ok)
+	{
+		save_failed = TRUE;
+	}
+
+	n_save_jobs--;
+	g_cond_broadcast (&save_cond);
+
+	g_mutex_unlock (&save_mutex);
+
+	save_job_free (job);
+}
+
+static void
+save_thread_func (gpointer data,
+		  gpointer user_data)
+{
+	run_save_job (data);
 }
 
 static gboolean
-gtef_metadata_manager_save (gpointer data)
+is_save_job_running (void)
 {
-	xmlDocPtr  doc;
-	xmlNodePtr root;
+	gboolean running;
 
-	gtef_metadata_manager->timeout_id = 0;
+	g_mutex_lock (&save_mutex);
+	running = n_save_jobs > 0;
+	g_mutex_unlock (&save_mutex);
 
-	resize_items ();
+	return running;
+}
 
-	xmlIndentTreeOutput = TRUE;
+/* Takes the records to write on the main thread, and writes them in the save
+ * thread. The jobs are run one at a time, in order.
+ */
+static void
+save_now (void)
+{
+	SaveJob *job;
+	gboolean previous_save_failed;
+	gboolean rewrite;
 
-	doc = xmlNewDoc ((const xmlChar *)"1.0");
-	if (doc == NULL)
-		return TRUE;
+	evict_items ();
 
-	/* Create metadata root */
-	root = xmlNewDocNode (doc, NULL, (const xmlChar *)"metadata", NULL);
-	xmlDocSetRootElement (doc, root);
+	/* FIXME: lock file - Paolo */
+	if (gtef_metadata_manager->metadata_path == NULL)
+	{
+		return;
+	}
 
-	g_hash_table_foreach (gtef_metadata_manager->items,
-			      (GHFunc)save_item,
-			      root);
+	g_mutex_lock (&save_mutex);
+	previous_save_failed = save_failed;
+	save_failed = FALSE;
+	g_mutex_unlock (&save_mutex);
 
-	/* FIXME: lock file - Paolo */
-	if (gtef_metadata_manager->metadata_path != NULL)
+	/* In case of a partial append, rewrite the whole file. */
+	if (previous_save_failed)
 	{
-		gchar *cache_dir;
-		int res;
+		gtef_metadata_manager->needs_compaction = TRUE;
+	}
 
-		/* make sure the cache dir exists */
-		cache_dir = g_path_get_dirname (gtef_metadata_manager->metadata_path);
-		res = g_mkdir_with_parents (cache_dir, 0755);
-		if (res != -1)
-		{
-			xmlSaveFormatFile (gtef_metadata_manager->metadata_path,
-			                   doc,
-			                   1);
-		}
+	rewrite = (gtef_metadata_manager->needs_compaction ||
+		   gtef_metadata_manager->n_log_records >
+		   COMPACTION_FACTOR * count_live_records () + COMPACTION_MIN_RECORDS);
 
-		g_free (cache_dir);
+	if (!rewrite &&
+	    gtef_metadata_manager->pending_records->len == 0)
+	{
+		return;
 	}
 
-	xmlFreeDoc (doc);
+	job = g_new0 (SaveJob, 1);
+	job->path = g_strdup (gtef_metadata_manager->metadata_path);
+	job->rewrite = rewrite;
 
-	return FALSE;
+	if (rewrite)
+	{
+		GString *contents;
+
+		contents = get_compacted_contents ();
+		job->length = contents->len;
+		job->contents = g_string_free (contents, FALSE);
+
+		g_string_truncate (gtef_metadata_manager->pending_records, 0);
+	}
+	else
+	{
+		/* Give the pending records to the job. */
+		job->length = gtef_metadata_manager->pending_records->len;
+		job->contents = g_string_free (gtef_metadata_manager->pending_records, FALSE);
+		gtef_metadata_manager->pending_records = g_string_new (NULL);
+	}
+
+	gtef_metadata_manager->needs_compaction = FALSE;
+
+	g_mutex_lock (&save_mutex);
+	n_save_jobs++;
+	g_mutex_unlock (&save_mutex);
+
+	if (gtef_metadata_manager->unit_test_mode)
+	{
+		run_save_job (job);
+	}
+	else
+	{
+		g_thread_pool_push (gtef_metadata_manager->save_pool, job, NULL);
+	}
+}
+
+static gboolean
+gtef_metadata_manager_save (gpointer data)
+{
+	gtef_metadata_manager->timeout_id = 0;
+
+	/* On a slow disk, don't queue a job behind another: the changes made
+	 * meanwhile are coalesced in the next one.
+	 */
+	if (is_save_job_running ())
+	{
+		gtef_metadata_manager_arm_timeout ();
+		return G_SOURCE_REMOVE;
+	}
+
+	save_now ();
+
+	return G_SOURCE_REMOVE;
 }
 
 static void
@@ -492,7 +1132,7 @@ _gtef_metadata_manager_get_all_metadata_for_location (GFile *location)
 	}
 
 	uri = g_file_get_uri (location);
-	item = g_hash_table_lookup (gtef_metadata_manager->items, uri);
+	item = lookup_item (uri);
 	g_free (uri);
 
 	if (item == NULL)
@@ -500,12 +1140,10 @@ _gtef_metadata_manager_get_all_metadata_for_location (GFile *location)
 		return NULL;
 	}
 
-	item->atime = g_get_real_time () / 1000;
-
-	if (item->values == NULL)
-	{
-		return NULL;
-	}
+	/* The access time is saved with the next changes, or at shutdown. */
+	touch_item (item, g_get_real_time () / 1000);
+	write_touch_record (gtef_metadata_manager->pending_records, item);
+	gtef_metadata_manager->n_log_records++;
 
 	metadata = g_file_info_new ();
 
@@ -521,6 +1159,7 @@ _gtef_metadata_manager_set_metadata_for_location (GFile     *location,
 	gchar **attributes_list;
 	gchar *uri;
 	Item *item;
+	GString *records;
 	gint i;
 
 	g_return_if_fail (G_IS_FILE (location));
@@ -547,24 +1186,18 @@ _gtef_metadata_manager_set_metadata_for_location (GFile     *location,
 
 	uri = g_file_get_uri (location);
 
-	item = g_hash_table_lookup (gtef_metadata_manager->items, uri);
+	item = lookup_item (uri);
 
 	if (item == NULL)
 	{
-		item = g_new0 (Item, 1);
-
-		g_hash_table_insert (gtef_metadata_manager->items,
-				     g_strdup (uri),
-				     item);
+		item = add_item (uri);
 	}
 
-	if (item->values == NULL)
-	{
-		item->values = g_hash_table_new_full (g_str_hash,
-						      g_str_equal,
-						      g_free,
-						      g_free);
-	}
+	touch_item (item, g_get_real_time () / 1000);
+
+	records = gtef_metadata_manager->pending_records;
+	write_touch_record (records, item);
+	gtef_metadata_manager->n_log_records++;
 
 	for (i = 0; attributes_list[i] != NULL; i++)
 	{
@@ -589,21 +1222,32 @@ _gtef_metadata_manager_set_metadata_for_location (GFile     *location,
 
 		if (value != NULL)
 		{
-			g_hash_table_insert (item->values,
-					     g_strdup (key),
-					     g_strdup (value));
+			const gchar *old_value;
+
+			old_value = g_hash_table_lookup (item->values, key);
+
+			if (g_strcmp0 (old_value, value) != 0)
+			{
+				g_hash_table_insert (item->values,
+						     g_strdup (key),
+						     g_strdup (value));
+
+				write_set_record (records, item, key, value);
+				gtef_metadata_manager->n_log_records++;
+			}
 		}
-		else
+		else if (g_hash_table_remove (item->values, key))
 		{
-			g_hash_table_remove (item->values, key);
+			write_remove_record (records, item, key);
+			gtef_metadata_manager->n_log_records++;
 		}
 	}
 
-	item->atime = g_get_real_time () / 1000;
-
 	g_strfreev (attributes_list);
 	g_free (uri);
 
+	evict_items ();
+
 	gtef_metadata_manager_arm_timeout ();
 }
 
@@ -33,6 +33,8 @@ void		gtef_metadata_manager_init				(const gchar *metadata_path);
 
 void		gtef_metadata_manager_shutdown				(void);
 
+void		gtef_metadata_manager_set_max_number_of_locations	(guint max_number_of_locations);
+
 G_GNUC_INTERNAL
 GFileInfo *	_gtef_metadata_manager_get_all_metadata_for_location	(GFile *location);
 
@@ -39,9 +39,13 @@ typedef struct _GtefEncoding			GtefEncoding;
 typedef struct _GtefFile			GtefFile;
 typedef struct _GtefFileLoader			GtefFileLoader;
 typedef struct _GtefFileMetadata		GtefFileMetadata;
+typedef struct _GtefFilePager			GtefFilePager;
 typedef struct _GtefFileSaver			GtefFileSaver;
+typedef struct _GtefFileWatcher			GtefFileWatcher;
 typedef struct _GtefFoldRegion			GtefFoldRegion;
+typedef struct _GtefFoldRegionManager		GtefFoldRegionManager;
 typedef struct _GtefGutterRendererFolds		GtefGutterRendererFolds;
+typedef struct _GtefIndentationFolding		GtefIndentationFolding;
 typedef struct _GtefInfoBar			GtefInfoBar;
 typedef struct _GtefMenuShell			GtefMenuShell;
 typedef struct _GtefTab				GtefTab;
@@ -0,0 +1,615 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "gtef-utf16-converter.h"
+#include <string.h>
+#include <glib/gi18n-lib.h>
+#include "gtef-utils.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* UTF-16 <-> UTF-8 conversion without iconv, for UTF-16, UTF-16LE and
+ * UTF-16BE. ASCII runs are converted by blocks of 8 or 16 characters with
+ * SSE2 if available, or 4 characters otherwise.
+ *
+ * _gtef_utf16_to_utf8() and _gtef_utf8_to_utf16() convert a buffer and stop
+ * before an incomplete or invalid sequence, it's up to the caller to keep the
+ * incomplete sequence for the next chunk. A surrogate pair can thus be split
+ * between two chunks.
+ *
+ * GtefUtf16Converter is a GConverter from UTF-8 to UTF-16, to be used in a
+ * GConverterOutputStream like GCharsetConverter.
+ */
+
+struct _GtefUtf16ConverterPrivate
+{
+	guint big_endian : 1;
+	guint write_bom : 1;
+	guint bom_pending : 1;
+};
+
+#define IS_HIGH_SURROGATE(unit) ((unit) >= 0xD800 && (unit) <= 0xDBFF)
+#define IS_LOW_SURROGATE(unit) ((unit) >= 0xDC00 && (unit) <= 0xDFFF)
+
+static void _gtef_utf16_converter_iface_init (GConverterIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (GtefUtf16Converter,
+			 _gtef_utf16_converter,
+			 G_TYPE_OBJECT,
+			 G_ADD_PRIVATE (GtefUtf16Converter)
+			 G_IMPLEMENT_INTERFACE (G_TYPE_CONVERTER,
+						_gtef_utf16_converter_iface_init))
+
+/*
+ * _gtef_utf16_charset_get_byte_order:
+ * @charset: a character set.
+ * @big_endian: (out): return location for the byte order.
+ * @with_bom: (out): return location for whether the content starts with a
+ *   byte order mark.
+ *
+ * For "UTF-16", the byte order is the one of the host, like with the iconv of
+ * the GNU C library: a BOM is written when converting to UTF-16; when
+ * converting from UTF-16, a BOM at the start of the content is consumed and
+ * determines the byte order. With "UTF-16LE" and "UTF-16BE", a BOM is a
+ * normal character (ZERO WIDTH NO-BREAK SPACE).
+ *
+ * Returns: whether @charset is one of the UTF-16 charsets.
+ */
+gboolean
+_gtef_utf16_charset_get_byte_order (const gchar *charset,
+				    gboolean    *big_endian,
+				    gboolean    *with_bom)
+{
+	g_return_val_if_fail (charset != NULL, FALSE);
+	g_return_val_if_fail (big_endian != NULL, FALSE);
+	g_return_val_if_fail (with_bom != NULL, FALSE);
+
+	if (g_ascii_strcasecmp (charset, "UTF-16") == 0)
+	{
+		*big_endian = G_BYTE_ORDER == G_BIG_ENDIAN;
+		*with_bom = TRUE;
+		return TRUE;
+	}
+
+	if (g_ascii_strcasecmp (charset, "UTF-16LE") == 0)
+	{
+		*big_endian = FALSE;
+		*with_bom = FALSE;
+		return TRUE;
+	}
+
+	if (g_ascii_strcasecmp (charset, "UTF-16BE") == 0)
+	{
+		*big_endian = TRUE;
+		*with_bom = FALSE;
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+static inline guint16
+read_unit (const guchar *p,
+	   gboolean      big_endian)
+{
+	if (big_endian)
+	{
+		return (p[0] << 8) | p[1];
+	}
+
+	return p[0] | (p[1] << 8);
+}
+
+static inline void
+write_unit (guchar   *p,
+	    guint16   unit,
+	    gboolean  big_endian)
+{
+	if (big_endian)
+	{
+		p[0] = unit >> 8;
+		p[1] = unit & 0xFF;
+	}
+	else
+	{
+		p[0] = unit & 0xFF;
+		p[1] = unit >> 8;
+	}
+}
+
+/* Converts the longest prefix of ASCII characters (nul included) of @in,
+ * as long as there is space in the output. Returns the new position in @in.
+ */
+static const guchar *
+narrow_ascii (const guchar  *in,
+	      const guchar  *in_end,
+	      guchar       **out_p,
+	      const guchar  *out_end,
+	      gboolean       big_endian)
+{
+	guchar *out = *out_p;
+
+#ifdef __SSE2__
+	{
+		/* A 16-bit lane is loaded as little-endian, so for UTF-16BE
+		 * the high byte of the code unit is in the low byte of the
+		 * lane.
+		 */
+		const __m128i non_ascii_bits = _mm_set1_epi16 ((gshort) (big_endian ? 0x80FF : 0xFF80));
+		const __m128i zero = _mm_setzero_si128 ();
+
+		while (in_end - in >= 16 && out_end - out >= 8)
+		{
+			__m128i units;
+			__m128i is_ascii;
+
+			units = _mm_loadu_si128 ((const __m128i *) in);
+			is_ascii = _mm_cmpeq_epi16 (_mm_and_si128 (units, non_ascii_bits), zero);
+
+			if (_mm_movemask_epi8 (is_ascii) != 0xFFFF)
+			{
+				break;
+			}
+
+			if (big_endian)
+			{
+				units = _mm_srli_epi16 (units, 8);
+			}
+
+			_mm_storel_epi64 ((__m128i *) out, _mm_packus_epi16 (units, units));
+
+			in += 16;
+			out += 8;
+		}
+	}
+#endif
+
+	while (in_end - in >= 8 && out_end - out >= 4)
+	{
+		guint64 word;
+		gint i;
+
+		memcpy (&word, in, sizeof (word));
+		word = big_endian ? GUINT64_FROM_BE (word) : GUINT64_FROM_LE (word);
+
+		if ((word & G_GUINT64_CONSTANT (0xFF80FF80FF80FF80)) != 0)
+		{
+			break;
+		}
+
+		/* The first code unit is in the low bits for little-endian. */
+		for (i = 0; i < 4; i++)
+		{
+			out[i] = big_endian ? word >> (48 - 16 * i) : word >> (16 * i);
+		}
+
+		in += 8;
+		out += 4;
+	}
+
+	*out_p = out;
+	return in;
+}
+
+/* Converts @n_chars ASCII characters of @in. */
+static void
+widen_ascii (const guchar *in,
+	     gsize         n_chars,
+	     guchar       *out,
+	     gboolean      big_endian)
+{
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128 ();
+
+	while (n_chars >= 16)
+	{
+		__m128i chars;
+		__m128i low;
+		__m128i high;
+
+		chars = _mm_loadu_si128 ((const __m128i *) in);
+
+		if (big_endian)
+		{
+			low = _mm_unpacklo_epi8 (zero, chars);
+			high = _mm_unpackhi_epi8 (zero, chars);
+		}
+		else
+		{
+			low = _mm_unpacklo_epi8 (chars, zero);
+			high = _mm_unpackhi_epi8 (chars, zero);
+		}
+
+		_mm_storeu_si128 ((__m128i *) out, low);
+		_mm_storeu_si128 ((__m128i *) (out + 16), high);
+
+		in += 16;
+		out += 32;
+		n_chars -= 16;
+	}
+#endif
+
+	while (n_chars > 0)
+	{
+		write_unit (out, *in, big_endian);
+
+		in++;
+		out += 2;
+		n_chars--;
+	}
+}
+
+/*
+ * _gtef_utf16_to_utf8:
+ * @inbuf: the UTF-16 input.
+ * @inbuf_size: the size of @inbuf, in bytes.
+ * @big_endian: the byte order of @inbuf.
+ * @outbuf: the output buffer.
+ * @outbuf_size: the size of @outbuf. Not nul-terminated.
+ * @bytes_read: (out): the number of bytes converted from @inbuf.
+ * @bytes_written: (out): the number of bytes written to @outbuf.
+ *
+ * Converts @inbuf until the end, or until a problem happens. In case of
+ * %GTEF_UTF16_STATUS_INVALID, the invalid code unit (a lone surrogate) is the
+ * two bytes at @bytes_read.
+ *
+ * Returns: the #GtefUtf16Status.
+ */
+GtefUtf16Status
+_gtef_utf16_to_utf8 (const gchar *inbuf,
+		     gsize        inbuf_size,
+		     gboolean     big_endian,
+		     gchar       *outbuf,
+		     gsize        outbuf_size,
+		     gsize       *bytes_read,
+		     gsize       *bytes_written)
+{
+	const guchar *in = (const guchar *) inbuf;
+	const guchar *in_end = in + (inbuf_size & ~(gsize) 1);
+	guchar *out = (guchar *) outbuf;
+	const guchar *out_end = out + outbuf_size;
+	GtefUtf16Status status = GTEF_UTF16_STATUS_DONE;
+
+	while (in < in_end)
+	{
+		guint16 unit;
+		gunichar c;
+		gsize in_length = 2;
+		gsize out_length;
+
+		in = narrow_ascii (in, in_end, &out, out_end, big_endian);
+		if (in == in_end)
+		{
+			break;
+		}
+
+		unit = read_unit (in, big_endian);
+		c = unit;
+
+		if (unit < 0x80)
+		{
+			out_length = 1;
+		}
+		else if (unit < 0x800)
+		{
+			out_length = 2;
+		}
+		else if (IS_HIGH_SURROGATE (unit))
+		{
+			guint16 low_unit;
+
+			if (in_end - in < 4)
+			{
+				status = GTEF_UTF16_STATUS_INCOMPLETE;
+				break;
+			}
+
+			low_unit = read_unit (in + 2, big_endian);
+
+			if (!IS_LOW_SURROGATE (low_unit))
+			{
+				status = GTEF_UTF16_STATUS_INVALID;
+				break;
+			}
+
+			c = 0x10000 + ((unit - 0xD800) << 10) + (low_unit - 0xDC00);
+			in_length = 4;
+			out_length = 4;
+		}
+		else if (IS_LOW_SURROGATE (unit))
+		{
+			status = GTEF_UTF16_STATUS_INVALID;
+			break;
+		}
+		else
+		{
+			out_length = 3;
+		}
+
+		if ((gsize) (out_end - out) < out_length)
+		{
+			status = GTEF_UTF16_STATUS_OUTPUT_FULL;
+			break;
+		}
+
+		g_unichar_to_utf8 (c, (gchar *) out);
+
+		in += in_length;
+		out += out_length;
+	}
+
+	/* An odd number of bytes. */
+	if (status == GTEF_UTF16_STATUS_DONE &&
+	    (inbuf_size % 2) != 0)
+	{
+		status = GTEF_UTF16_STATUS_INCOMPLETE;
+	}
+
+	*bytes_read = (const gchar *) in - inbuf;
+	*bytes_written = (gchar *) out - outbuf;
+
+	return status;
+}
+
+/*
+ * _gtef_utf8_to_utf16:
+ * @inbuf: the UTF-8 input.
+ * @inbuf_size: the size of @inbuf, in bytes.
+ * @big_endian: the byte order of @outbuf.
+ * @outbuf: the output buffer.
+ * @outbuf_size: the size of @outbuf.
+ * @bytes_read: (out): the number of bytes converted from @inbuf.
+ * @bytes_written: (out): the number of bytes written to @outbuf.
+ *
+ * The reverse of _gtef_utf16_to_utf8(). Nul bytes are valid in @inbuf.
+ *
+ * Returns: the #GtefUtf16Status.
+ */
+GtefUtf16Status
+_gtef_utf8_to_utf16 (const gchar *inbuf,
+		     gsize        inbuf_size,
+		     gboolean     big_endian,
+		     gchar       *outbuf,
+		     gsize        outbuf_size,
+		     gsize       *bytes_read,
+		     gsize       *bytes_written)
+{
+	const guchar *in = (const guchar *) inbuf;
+	const guchar *in_end = in + inbuf_size;
+	guchar *out = (guchar *) outbuf;
+	const guchar *out_end = out + outbuf_size;
+	GtefUtf16Status status = GTEF_UTF16_STATUS_DONE;
+
+	while (in < in_end)
+	{
+		gsize n_ascii_chars;
+		gunichar c;
+		gsize in_length = 1;
+
+		n_ascii_chars = _gtef_utils_get_ascii_prefix_length ((const gchar *) in,
+								     MIN (in_end - in, (out_end - out) / 2));
+		widen_ascii (in, n_ascii_chars, out, big_endian);
+		in += n_ascii_chars;
+		out += 2 * n_ascii_chars;
+
+		if (in == in_end)
+		{
+			break;
+		}
+
+		c = *in;
+
+		/* The nul byte is not accepted by _gtef_utils_utf8_validate(). */
+		if (c >= 0x80)
+		{
+			const gchar *valid_end;
+			gboolean partial_char;
+
+			_gtef_utils_utf8_validate ((const gchar *) in,
+						   MIN (in_end - in, 4),
+						   &valid_end,
+						   &partial_char);
+
+			if (valid_end == (const gchar *) in)
+			{
+				status = partial_char ? GTEF_UTF16_STATUS_INCOMPLETE : GTEF_UTF16_STATUS_INVALID;
+				break;
+			}
+
+			c = g_utf8_get_char ((const gchar *) in);
+			in_length = g_utf8_skip[*in];
+		}
+
+		if (c >= 0x10000)
+		{
+			if (out_end - out < 4)
+			{
+				status = GTEF_UTF16_STATUS_OUTPUT_FULL;
+				break;
+			}
+
+			c -= 0x10000;
+			write_unit (out, 0xD800 + (c >> 10), big_endian);
+			write_unit (out + 2, 0xDC00 + (c & 0x3FF), big_endian);
+			out += 4;
+		}
+		else
+		{
+			if (out_end - out < 2)
+			{
+				status = GTEF_UTF16_STATUS_OUTPUT_FULL;
+				break;
+			}
+
+			write_unit (out, c, big_endian);
+			out += 2;
+		}
+
+		in += in_length;
+	}
+
+	*bytes_read = (const gchar *) in - inbuf;
+	*bytes_written = (gchar *) out - outbuf;
+
+	return status;
+}
+
+static GConverterResult
+_gtef_utf16_converter_convert (GConverter      *converter,
+			       const void      *inbuf,
+			       gsize            inbuf_size,
+			       void            *outbuf,
+			       gsize            outbuf_size,
+			       GConverterFlags  flags,
+			       gsize           *bytes_read,
+			       gsize           *bytes_written,
+			       GError         **error)
+{
+	GtefUtf16ConverterPrivate *priv = GTEF_UTF16_CONVERTER (converter)->priv;
+	gsize bom_size = 0;
+	GtefUtf16Status status;
+
+	if (priv->bom_pending && inbuf_size > 0)
+	{
+		if (outbuf_size < 2)
+		{
+			g_set_error_literal (error,
+					     G_IO_ERROR,
+					     G_IO_ERROR_NO_SPACE,
+					     _("Not enough space in the output buffer."));
+			return G_CONVERTER_ERROR;
+		}
+
+		write_unit (outbuf, 0xFEFF, priv->big_endian);
+		bom_size = 2;
+		priv->bom_pending = FALSE;
+	}
+
+	status = _gtef_utf8_to_utf16 (inbuf,
+				      inbuf_size,
+				      priv->big_endian,
+				      (gchar *) outbuf + bom_size,
+				      outbuf_size - bom_size,
+				      bytes_read,
+				      bytes_written);
+
+	*bytes_written += bom_size;
+
+	if (status == GTEF_UTF16_STATUS_DONE)
+	{
+		if (flags & G_CONVERTER_INPUT_AT_END)
+		{
+			return G_CONVERTER_FINISHED;
+		}
+
+		if (flags & G_CONVERTER_FLUSH)
+		{
+			return G_CONVERTER_FLUSHED;
+		}
+
+		return G_CONVERTER_CONVERTED;
+	}
+
+	/* Report the problem at the next call, when nothing is converted. */
+	if (*bytes_written > 0)
+	{
+		return G_CONVERTER_CONVERTED;
+	}
+
+	switch (status)
+	{
+		case GTEF_UTF16_STATUS_OUTPUT_FULL:
+			g_set_error_literal (error,
+					     G_IO_ERROR,
+					     G_IO_ERROR_NO_SPACE,
+					     _("Not enough space in the output buffer."));
+			break;
+
+		case GTEF_UTF16_STATUS_INCOMPLETE:
+			g_set_error_literal (error,
+					     G_IO_ERROR,
+					     G_IO_ERROR_PARTIAL_INPUT,
+					     _("The input data ends with an incomplete multi-byte sequence."));
+			break;
+
+		case GTEF_UTF16_STATUS_INVALID:
+			g_set_error_literal (error,
+					     G_IO_ERROR,
+					     G_IO_ERROR_INVALID_DATA,
+					     _("The input data contains an invalid sequence."));
+			break;
+
+		case GTEF_UTF16_STATUS_DONE:
+		default:
+			g_assert_not_reached ();
+	}
+
+	return G_CONVERTER_ERROR;
+}
+
+static void
+_gtef_utf16_converter_reset (GConverter *converter)
+{
+	GtefUtf16ConverterPrivate *priv = GTEF_UTF16_CONVERTER (converter)->priv;
+
+	priv->bom_pending = priv->write_bom;
+}
+
+static void
+_gtef_utf16_converter_iface_init (GConverterIface *iface)
+{
+	iface->convert = _gtef_utf16_converter_convert;
+	iface->reset = _gtef_utf16_converter_reset;
+}
+
+static void
+_gtef_utf16_converter_class_init (GtefUtf16ConverterClass *klass)
+{
+}
+
+static void
+_gtef_utf16_converter_init (GtefUtf16Converter *converter)
+{
+	converter->priv = _gtef_utf16_converter_get_instance_private (converter);
+}
+
+/*
+ * _gtef_utf16_converter_new:
+ * @big_endian: the byte order of the output.
+ * @write_bom: whether to write a byte order mark before the content.
+ *
+ * Returns: a new #GtefUtf16Converter, a #GConverter from UTF-8 to UTF-16.
+ */
+GtefUtf16Converter *
+_gtef_utf16_converter_new (gboolean big_endian,
+			   gboolean write_bom)
+{
+	GtefUtf16Converter *converter;
+
+	converter = g_object_new (GTEF_TYPE_UTF16_CONVERTER, NULL);
+
+	converter->priv->big_endian = big_endian != FALSE;
+	converter->priv->write_bom = write_bom != FALSE;
+	converter->priv->bom_pending = converter->priv->write_bom;
+
+	return converter;
+}
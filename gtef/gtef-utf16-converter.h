@@ -0,0 +1,99 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GTEF_UTF16_CONVERTER_H
+#define GTEF_UTF16_CONVERTER_H
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+#define GTEF_TYPE_UTF16_CONVERTER             (_gtef_utf16_converter_get_type ())
+#define GTEF_UTF16_CONVERTER(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), GTEF_TYPE_UTF16_CONVERTER, GtefUtf16Converter))
+#define GTEF_UTF16_CONVERTER_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST ((klass), GTEF_TYPE_UTF16_CONVERTER, GtefUtf16ConverterClass))
+#define GTEF_IS_UTF16_CONVERTER(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GTEF_TYPE_UTF16_CONVERTER))
+#define GTEF_IS_UTF16_CONVERTER_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass), GTEF_TYPE_UTF16_CONVERTER))
+#define GTEF_UTF16_CONVERTER_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj), GTEF_TYPE_UTF16_CONVERTER, GtefUtf16ConverterClass))
+
+typedef struct _GtefUtf16Converter         GtefUtf16Converter;
+typedef struct _GtefUtf16ConverterClass    GtefUtf16ConverterClass;
+typedef struct _GtefUtf16ConverterPrivate  GtefUtf16ConverterPrivate;
+
+struct _GtefUtf16Converter
+{
+	GObject parent;
+
+	GtefUtf16ConverterPrivate *priv;
+};
+
+struct _GtefUtf16ConverterClass
+{
+	GObjectClass parent_class;
+};
+
+/*
+ * GtefUtf16Status:
+ * @GTEF_UTF16_STATUS_DONE: all the input has been converted.
+ * @GTEF_UTF16_STATUS_OUTPUT_FULL: stopped because the output buffer is full.
+ * @GTEF_UTF16_STATUS_INCOMPLETE: stopped before an incomplete character at the
+ *   end of the input.
+ * @GTEF_UTF16_STATUS_INVALID: stopped before an invalid sequence.
+ */
+typedef enum _GtefUtf16Status
+{
+	GTEF_UTF16_STATUS_DONE,
+	GTEF_UTF16_STATUS_OUTPUT_FULL,
+	GTEF_UTF16_STATUS_INCOMPLETE,
+	GTEF_UTF16_STATUS_INVALID
+} GtefUtf16Status;
+
+G_GNUC_INTERNAL
+gboolean	_gtef_utf16_charset_get_byte_order	(const gchar *charset,
+							 gboolean    *big_endian,
+							 gboolean    *with_bom);
+
+G_GNUC_INTERNAL
+GtefUtf16Status	_gtef_utf16_to_utf8			(const gchar *inbuf,
+							 gsize        inbuf_size,
+							 gboolean     big_endian,
+							 gchar       *outbuf,
+							 gsize        outbuf_size,
+							 gsize       *bytes_read,
+							 gsize       *bytes_written);
+
+G_GNUC_INTERNAL
+GtefUtf16Status	_gtef_utf8_to_utf16			(const gchar *inbuf,
+							 gsize        inbuf_size,
+							 gboolean     big_endian,
+							 gchar       *outbuf,
+							 gsize        outbuf_size,
+							 gsize       *bytes_read,
+							 gsize       *bytes_written);
+
+G_GNUC_INTERNAL
+GType		_gtef_utf16_converter_get_type		(void);
+
+G_GNUC_INTERNAL
+GtefUtf16Converter *
+		_gtef_utf16_converter_new		(gboolean big_endian,
+							 gboolean write_bom);
+
+G_END_DECLS
+
+#endif /* GTEF_UTF16_CONVERTER_H */
@@ -25,6 +25,10 @@
 #include "gtef-utils.h"
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 /**
  * SECTION:utils
  * @title: GtefUtils
@@ -320,6 +324,582 @@ _gtef_utils_strv_copy (const gchar * const *strv)
 	return new_strv;
 }
 
+/* Returns TRUE if the 8 bytes of @word are ASCII characters, without nul
+ * bytes. If a byte is zero, the subtraction sets its high bit (the borrow can
+ * propagate, but only when there is already a zero byte).
+ */
+static inline gboolean
+word_is_ascii_without_nul (guint64 word)
+{
+	return ((word | (word - G_GUINT64_CONSTANT (0x0101010101010101))) &
+		G_GUINT64_CONSTANT (0x8080808080808080)) == 0;
+}
+
+/* Skips the longest prefix of ASCII characters, without nul bytes, 16 or 8
+ * bytes at a time. Stops before the block containing a non-ASCII or nul byte.
+ */
+static const guchar *
+skip_ascii (const guchar *p,
+	    const guchar *end)
+{
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128 ();
+
+	while (end - p >= 16)
+	{
+		__m128i block;
+		__m128i nul_bytes;
+
+		block = _mm_loadu_si128 ((const __m128i *) p);
+		nul_bytes = _mm_cmpeq_epi8 (block, zero);
+
+		/* The mask has the high bit of each byte, and the nul bytes
+		 * are all ones.
+		 */
+		if (_mm_movemask_epi8 (_mm_or_si128 (block, nul_bytes)) != 0)
+		{
+			break;
+		}
+
+		p += 16;
+	}
+#endif
+
+	while (end - p >= 8)
+	{
+		guint64 word;
+
+		memcpy (&word, p, sizeof (word));
+
+		if (!word_is_ascii_without_nul (word))
+		{
+			break;
+		}
+
+		p += 8;
+	}
+
+	return p;
+}
+
+/*
+ * _gtef_utils_utf8_validate:
+ * @str: a string.
+ * @length: the length of @str, in bytes.
+ * @end: (out) (optional): return location for the end of the valid data.
+ * @partial_char: (out) (optional): return location to know whether @str ends
+ *   with an incomplete, but valid so far, multi-byte character.
+ *
+ * Like g_utf8_validate() with an explicit length (so nul bytes are invalid),
+ * but faster for the common case of mostly ASCII text: ASCII runs are checked
+ * by blocks of 16 bytes with SSE2 if available, or 8 bytes otherwise.
+ *
+ * If @str ends with an incomplete multi-byte character, %FALSE is returned,
+ * @end points to the start of that character and @partial_char is set to
+ * %TRUE. It permits to validate a stream of chunks, where a character can be
+ * split between two chunks.
+ *
+ * Returns: %TRUE if all of @str is valid UTF-8.
+ */
+gboolean
+_gtef_utils_utf8_validate (const gchar  *str,
+			   gsize         length,
+			   const gchar **end,
+			   gboolean     *partial_char)
+{
+	const guchar *p = (const guchar *) str;
+	const guchar *str_end = p + length;
+	gboolean valid = TRUE;
+	gboolean partial = FALSE;
+
+	while (p < str_end)
+	{
+		guchar c;
+		guchar min_second;
+		guchar max_second;
+		gsize char_length;
+		gsize available;
+		gsize i;
+
+		p = skip_ascii (p, str_end);
+		if (p == str_end)
+		{
+			break;
+		}
+
+		c = *p;
+
+		if (c < 0x80)
+		{
+			if (c == 0)
+			{
+				valid = FALSE;
+				break;
+			}
+
+			p++;
+			continue;
+		}
+
+		/* See the table 3-7 “Well-Formed UTF-8 Byte Sequences” in the
+		 * Unicode standard. Overlong forms, surrogates and code points
+		 * above U+10FFFF are rejected.
+		 */
+		min_second = 0x80;
+		max_second = 0xBF;
+
+		if (c < 0xC2)
+		{
+			valid = FALSE;
+			break;
+		}
+		else if (c < 0xE0)
+		{
+			char_length = 2;
+		}
+		else if (c < 0xF0)
+		{
+			char_length = 3;
+
+			if (c == 0xE0)
+			{
+				min_second = 0xA0;
+			}
+			else if (c == 0xED)
+			{
+				max_second = 0x9F;
+			}
+		}
+		else if (c < 0xF5)
+		{
+			char_length = 4;
+
+			if (c == 0xF0)
+			{
+				min_second = 0x90;
+			}
+			else if (c == 0xF4)
+			{
+				max_second = 0x8F;
+			}
+		}
+		else
+		{
+			valid = FALSE;
+			break;
+		}
+
+		available = MIN (char_length, (gsize) (str_end - p));
+
+		for (i = 1; i < available; i++)
+		{
+			guchar min = i == 1 ? min_second : 0x80;
+			guchar max = i == 1 ? max_second : 0xBF;
+
+			if (p[i] < min || p[i] > max)
+			{
+				valid = FALSE;
+				break;
+			}
+		}
+
+		if (!valid)
+		{
+			break;
+		}
+
+		if (available < char_length)
+		{
+			valid = FALSE;
+			partial = TRUE;
+			break;
+		}
+
+		p += char_length;
+	}
+
+	if (end != NULL)
+	{
+		*end = (const gchar *) p;
+	}
+
+	if (partial_char != NULL)
+	{
+		*partial_char = partial;
+	}
+
+	return valid;
+}
+
+/*
+ * _gtef_utils_get_ascii_prefix_length:
+ * @str: a string.
+ * @length: the length of @str, in bytes.
+ *
+ * Returns: the number of bytes at the start of @str that are ASCII characters
+ * other than the nul byte. Checked by blocks of 16 or 8 bytes, like
+ * _gtef_utils_utf8_validate().
+ */
+gsize
+_gtef_utils_get_ascii_prefix_length (const gchar *str,
+				     gsize        length)
+{
+	const guchar *start = (const guchar *) str;
+	const guchar *end = start + length;
+	const guchar *p;
+
+	p = skip_ascii (start, end);
+
+	while (p < end && *p != 0 && *p < 0x80)
+	{
+		p++;
+	}
+
+	return p - start;
+}
+
+static inline guint
+popcount (guint32 bits)
+{
+#if defined (__GNUC__)
+	return __builtin_popcount (bits);
+#else
+	guint count = 0;
+
+	while (bits != 0)
+	{
+		bits &= bits - 1;
+		count++;
+	}
+
+	return count;
+#endif
+}
+
+/* Returns a mask with the high bit of each byte of @word set if the byte is
+ * equal to @byte_value. Unlike the trick used in word_is_ascii_without_nul(),
+ * there is no false positive.
+ */
+static inline guint64
+word_match_byte (guint64 word,
+		 guchar  byte_value)
+{
+	const guint64 low_bits = G_GUINT64_CONSTANT (0x7F7F7F7F7F7F7F7F);
+	guint64 x;
+
+	x = word ^ (G_GUINT64_CONSTANT (0x0101010101010101) * byte_value);
+
+	return ~(((x & low_bits) + low_bits) | x | low_bits);
+}
+
+/* Counts the bits of a mask returned by word_match_byte(). */
+static inline guint
+word_mask_count (guint64 mask)
+{
+	return (guint) (((mask >> 7) * G_GUINT64_CONSTANT (0x0101010101010101)) >> 56);
+}
+
+/*
+ * _gtef_utils_count_newlines:
+ * @str: a string.
+ * @length: the length of @str, in bytes.
+ * @n_lf: (inout): the number of \n, not preceded by \r.
+ * @n_cr: (inout): the number of \r, not followed by \n.
+ * @n_cr_lf: (inout): the number of \r\n.
+ *
+ * Counts the newlines in @str, and adds the results to the three counters.
+ * The bytes are compared 16 at a time with SSE2 if available, or 8 at a time
+ * otherwise.
+ *
+ * If @str is a part of a bigger text, the caller must ensure that a \r\n is
+ * not split, i.e. @str must not end with a \r followed by a \n in the next
+ * part.
+ */
+void
+_gtef_utils_count_newlines (const gchar *str,
+			    gsize        length,
+			    guint64     *n_lf,
+			    guint64     *n_cr,
+			    guint64     *n_cr_lf)
+{
+	const guchar *p = (const guchar *) str;
+	const guchar *end = p + length;
+	guint64 lf_count = 0;
+	guint64 cr_count = 0;
+	guint64 cr_lf_count = 0;
+
+#ifdef __SSE2__
+	{
+		const __m128i lf = _mm_set1_epi8 ('\n');
+		const __m128i cr = _mm_set1_epi8 ('\r');
+
+		while (end - p >= 16)
+		{
+			__m128i block;
+			guint32 lf_mask;
+			guint32 cr_mask;
+
+			block = _mm_loadu_si128 ((const __m128i *) p);
+			lf_mask = _mm_movemask_epi8 (_mm_cmpeq_epi8 (block, lf));
+			cr_mask = _mm_movemask_epi8 (_mm_cmpeq_epi8 (block, cr));
+
+			if ((lf_mask | cr_mask) != 0)
+			{
+				lf_count += popcount (lf_mask);
+				cr_count += popcount (cr_mask);
+				cr_lf_count += popcount (cr_mask & (lf_mask >> 1));
+
+				/* \r\n across two blocks. */
+				if ((cr_mask & 0x8000) != 0 &&
+				    end - p > 16 &&
+				    p[16] == '\n')
+				{
+					cr_lf_count++;
+				}
+			}
+
+			p += 16;
+		}
+	}
+#endif
+
+	while (end - p >= 8)
+	{
+		guint64 word;
+		guint64 lf_mask;
+		guint64 cr_mask;
+
+		memcpy (&word, p, sizeof (word));
+		word = GUINT64_FROM_LE (word);
+
+		lf_mask = word_match_byte (word, '\n');
+		cr_mask = word_match_byte (word, '\r');
+
+		if ((lf_mask | cr_mask) != 0)
+		{
+			lf_count += word_mask_count (lf_mask);
+			cr_count += word_mask_count (cr_mask);
+			cr_lf_count += word_mask_count (cr_mask & (lf_mask >> 8));
+
+			if ((cr_mask >> 63) != 0 &&
+			    end - p > 8 &&
+			    p[8] == '\n')
+			{
+				cr_lf_count++;
+			}
+		}
+
+		p += 8;
+	}
+
+	for (; p < end; p++)
+	{
+		if (*p == '\n')
+		{
+			lf_count++;
+		}
+		else if (*p == '\r')
+		{
+			cr_count++;
+
+			if (p + 1 < end && p[1] == '\n')
+			{
+				cr_lf_count++;
+			}
+		}
+	}
+
+	*n_lf += lf_count - cr_lf_count;
+	*n_cr += cr_count - cr_lf_count;
+	*n_cr_lf += cr_lf_count;
+}
+
+static inline guint
+lowest_set_bit (guint64 mask)
+{
+#if defined (__GNUC__)
+	return __builtin_ctzll (mask);
+#else
+	guint n = 0;
+
+	while ((mask & 1) == 0)
+	{
+		mask >>= 1;
+		n++;
+	}
+
+	return n;
+#endif
+}
+
+/*
+ * _gtef_utils_find_line_terminator:
+ * @str: a UTF-8 string.
+ * @length: the length of @str, in bytes.
+ * @skip_lf: whether to not stop at \n.
+ *
+ * Finds the first byte that can start a line terminator as understood by
+ * #GtkTextBuffer: \r, \n (unless @skip_lf is %TRUE), or the first byte of
+ * U+2029 PARAGRAPH SEPARATOR. For the latter, other characters begin with the
+ * same byte, so the caller needs to check the following bytes.
+ *
+ * The bytes are compared 16 at a time with SSE2 if available, or 8 at a time
+ * otherwise.
+ *
+ * Returns: the index of the byte found, or @length if there is none.
+ */
+gsize
+_gtef_utils_find_line_terminator (const gchar *str,
+				  gsize        length,
+				  gboolean     skip_lf)
+{
+	const guchar *start = (const guchar *) str;
+	const guchar *p = start;
+	const guchar *end = start + length;
+
+#ifdef __SSE2__
+	{
+		const __m128i lf = _mm_set1_epi8 ('\n');
+		const __m128i cr = _mm_set1_epi8 ('\r');
+		const __m128i ps = _mm_set1_epi8 ((gchar) 0xE2);
+
+		while (end - p >= 16)
+		{
+			__m128i block;
+			__m128i matches;
+			guint32 mask;
+
+			block = _mm_loadu_si128 ((const __m128i *) p);
+			matches = _mm_or_si128 (_mm_cmpeq_epi8 (block, cr),
+						_mm_cmpeq_epi8 (block, ps));
+
+			if (!skip_lf)
+			{
+				matches = _mm_or_si128 (matches, _mm_cmpeq_epi8 (block, lf));
+			}
+
+			mask = _mm_movemask_epi8 (matches);
+
+			if (mask != 0)
+			{
+				return (p - start) + lowest_set_bit (mask);
+			}
+
+			p += 16;
+		}
+	}
+#endif
+
+	while (end - p >= 8)
+	{
+		guint64 word;
+		guint64 mask;
+
+		memcpy (&word, p, sizeof (word));
+		word = GUINT64_FROM_LE (word);
+
+		mask = word_match_byte (word, '\r') | word_match_byte (word, 0xE2);
+
+		if (!skip_lf)
+		{
+			mask |= word_match_byte (word, '\n');
+		}
+
+		if (mask != 0)
+		{
+			return (p - start) + lowest_set_bit (mask) / 8;
+		}
+
+		p += 8;
+	}
+
+	for (; p < end; p++)
+	{
+		if (*p == '\r' ||
+		    *p == 0xE2 ||
+		    (*p == '\n' && !skip_lf))
+		{
+			break;
+		}
+	}
+
+	return p - start;
+}
+
+/*
+ * _gtef_utils_find_nul_code_unit:
+ * @str: a string.
+ * @length: the length of @str, in bytes.
+ *
+ * Finds the first pair of nul bytes at an even offset, i.e. a zero 16-bit code
+ * unit. Text in an ASCII-compatible encoding or in UTF-16 doesn't contain such
+ * a pair (U+0000 aside), while most binary files and UTF-32 text do. The code units are
+ * compared 8 at a time with SSE2 if available, or 4 at a time otherwise.
+ *
+ * Returns: the index of the first nul byte of the pair, or @length if there is
+ * none.
+ */
+gsize
+_gtef_utils_find_nul_code_unit (const gchar *str,
+				gsize        length)
+{
+	const guchar *start = (const guchar *) str;
+	const guchar *p = start;
+	const guchar *end = start + length;
+
+#ifdef __SSE2__
+	{
+		const __m128i zero = _mm_setzero_si128 ();
+
+		while (end - p >= 16)
+		{
+			__m128i block;
+			guint32 mask;
+
+			block = _mm_loadu_si128 ((const __m128i *) p);
+			mask = _mm_movemask_epi8 (_mm_cmpeq_epi16 (block, zero));
+
+			if (mask != 0)
+			{
+				return (p - start) + lowest_set_bit (mask);
+			}
+
+			p += 16;
+		}
+	}
+#endif
+
+	while (end - p >= 8)
+	{
+		guint64 word;
+		guint64 mask;
+
+		memcpy (&word, p, sizeof (word));
+		word = GUINT64_FROM_LE (word);
+
+		/* Keep the nul bytes at even offsets followed by a nul byte. */
+		mask = word_match_byte (word, 0);
+		mask &= (mask >> 8) & G_GUINT64_CONSTANT (0x0080008000800080);
+
+		if (mask != 0)
+		{
+			return (p - start) + lowest_set_bit (mask) / 8;
+		}
+
+		p += 8;
+	}
+
+	for (; end - p >= 2; p += 2)
+	{
+		if (p[0] == 0 && p[1] == 0)
+		{
+			return p - start;
+		}
+	}
+
+	return length;
+}
+
 static gint
 get_menu_item_position (GtkMenuShell *menu_shell,
 			GtkMenuItem  *item)
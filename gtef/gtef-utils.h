@@ -49,6 +49,32 @@ gchar *		_gtef_utils_get_fallback_basename_for_display	(GFile *location);
 G_GNUC_INTERNAL
 gchar **	_gtef_utils_strv_copy				(const gchar * const *strv);
 
+G_GNUC_INTERNAL
+gboolean	_gtef_utils_utf8_validate			(const gchar  *str,
+								 gsize         length,
+								 const gchar **end,
+								 gboolean     *partial_char);
+
+G_GNUC_INTERNAL
+gsize		_gtef_utils_get_ascii_prefix_length		(const gchar *str,
+								 gsize        length);
+
+G_GNUC_INTERNAL
+void		_gtef_utils_count_newlines			(const gchar *str,
+								 gsize        length,
+								 guint64     *n_lf,
+								 guint64     *n_cr,
+								 guint64     *n_cr_lf);
+
+G_GNUC_INTERNAL
+gsize		_gtef_utils_find_line_terminator		(const gchar *str,
+								 gsize        length,
+								 gboolean     skip_lf);
+
+G_GNUC_INTERNAL
+gsize		_gtef_utils_find_nul_code_unit			(const gchar *str,
+								 gsize        length);
+
 /* Widget utilities */
 
 gchar *		gtef_utils_recent_chooser_menu_get_item_uri	(GtkRecentChooserMenu *menu,
@@ -24,6 +24,7 @@
 
 #include "gtef-view.h"
 #include "gtef-buffer.h"
+#include "gtef-file-pager.h"
 
 /**
  * SECTION:view
@@ -36,7 +37,31 @@
 
 #define SCROLL_MARGIN 0.02
 
-G_DEFINE_TYPE (GtefView, gtef_view, GTK_SOURCE_TYPE_VIEW)
+typedef struct _GtefViewPrivate GtefViewPrivate;
+
+struct _GtefViewPrivate
+{
+	/* Weak ref */
+	GtefFilePager *file_pager;
+
+	/* The buffer on which the insert-text handler is connected. */
+	GtkTextBuffer *buffer;
+	gulong insert_text_handler_id;
+
+	guint auto_scroll_idle_id;
+	guint auto_scroll : 1;
+};
+
+enum
+{
+	PROP_0,
+	PROP_AUTO_SCROLL,
+	N_PROPERTIES
+};
+
+static GParamSpec *properties[N_PROPERTIES];
+
+G_DEFINE_TYPE_WITH_PRIVATE (GtefView, gtef_view, GTK_SOURCE_TYPE_VIEW)
 
 static GtkTextBuffer *
 gtef_view_create_buffer (GtkTextView *view)
@@ -44,17 +69,188 @@ gtef_view_create_buffer (GtkTextView *view)
 	return GTK_TEXT_BUFFER (gtef_buffer_new ());
 }
 
+static gboolean
+auto_scroll_idle_cb (gpointer user_data)
+{
+	GtefView *view = GTEF_VIEW (user_data);
+	GtefViewPrivate *priv = gtef_view_get_instance_private (view);
+	GtkTextBuffer *buffer;
+
+	priv->auto_scroll_idle_id = 0;
+
+	buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (view));
+	gtk_text_view_scroll_mark_onscreen (GTK_TEXT_VIEW (view),
+					    gtk_text_buffer_get_insert (buffer));
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Connected after the default handler, @location points to the end of the
+ * inserted text. Several insertions, e.g. the blocks of a GtefFileLoader, are
+ * followed by only one scroll.
+ */
+static void
+insert_text_after_cb (GtkTextBuffer *buffer,
+		      GtkTextIter   *location,
+		      const gchar   *text,
+		      gint           length,
+		      GtefView      *view)
+{
+	GtefViewPrivate *priv = gtef_view_get_instance_private (view);
+	GtkTextIter cursor;
+
+	if (!priv->auto_scroll ||
+	    priv->auto_scroll_idle_id != 0 ||
+	    !gtk_text_iter_is_end (location))
+	{
+		return;
+	}
+
+	gtk_text_buffer_get_iter_at_mark (buffer,
+					  &cursor,
+					  gtk_text_buffer_get_insert (buffer));
+
+	if (gtk_text_iter_is_end (&cursor))
+	{
+		priv->auto_scroll_idle_id = g_idle_add (auto_scroll_idle_cb, view);
+	}
+}
+
+static void
+set_buffer (GtefView      *view,
+	    GtkTextBuffer *buffer)
+{
+	GtefViewPrivate *priv = gtef_view_get_instance_private (view);
+
+	if (priv->buffer == buffer)
+	{
+		return;
+	}
+
+	if (priv->buffer != NULL)
+	{
+		g_signal_handler_disconnect (priv->buffer, priv->insert_text_handler_id);
+		priv->insert_text_handler_id = 0;
+		g_clear_object (&priv->buffer);
+	}
+
+	if (buffer != NULL)
+	{
+		priv->buffer = g_object_ref (buffer);
+
+		priv->insert_text_handler_id =
+			g_signal_connect_object (buffer,
+						 "insert-text",
+						 G_CALLBACK (insert_text_after_cb),
+						 view,
+						 G_CONNECT_AFTER);
+	}
+}
+
+static void
+notify_buffer_cb (GtefView *view)
+{
+	set_buffer (view, gtk_text_view_get_buffer (GTK_TEXT_VIEW (view)));
+}
+
+static void
+gtef_view_get_property (GObject    *object,
+			guint       prop_id,
+			GValue     *value,
+			GParamSpec *pspec)
+{
+	GtefView *view = GTEF_VIEW (object);
+
+	switch (prop_id)
+	{
+		case PROP_AUTO_SCROLL:
+			g_value_set_boolean (value, gtef_view_get_auto_scroll (view));
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+			break;
+	}
+}
+
+static void
+gtef_view_set_property (GObject      *object,
+			guint         prop_id,
+			const GValue *value,
+			GParamSpec   *pspec)
+{
+	GtefView *view = GTEF_VIEW (object);
+
+	switch (prop_id)
+	{
+		case PROP_AUTO_SCROLL:
+			gtef_view_set_auto_scroll (view, g_value_get_boolean (value));
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+			break;
+	}
+}
+
+static void
+gtef_view_dispose (GObject *object)
+{
+	GtefView *view = GTEF_VIEW (object);
+	GtefViewPrivate *priv = gtef_view_get_instance_private (view);
+
+	_gtef_view_set_file_pager (view, NULL);
+	set_buffer (view, NULL);
+
+	if (priv->auto_scroll_idle_id != 0)
+	{
+		g_source_remove (priv->auto_scroll_idle_id);
+		priv->auto_scroll_idle_id = 0;
+	}
+
+	G_OBJECT_CLASS (gtef_view_parent_class)->dispose (object);
+}
+
 static void
 gtef_view_class_init (GtefViewClass *klass)
 {
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
 	GtkTextViewClass *text_view_class = GTK_TEXT_VIEW_CLASS (klass);
 
+	object_class->get_property = gtef_view_get_property;
+	object_class->set_property = gtef_view_set_property;
+	object_class->dispose = gtef_view_dispose;
+
 	text_view_class->create_buffer = gtef_view_create_buffer;
+
+	/**
+	 * GtefView:auto-scroll:
+	 *
+	 * Whether to scroll to the end when text is inserted at the end of the
+	 * buffer while the cursor is at the end. For example for a log file
+	 * loaded with the #GtefFileLoader:follow mode: the view follows the
+	 * new lines, unless the user moves the cursor elsewhere.
+	 *
+	 * Since: 2.0
+	 */
+	properties[PROP_AUTO_SCROLL] =
+		g_param_spec_boolean ("auto-scroll",
+				      "Auto Scroll",
+				      "",
+				      FALSE,
+				      G_PARAM_READWRITE |
+				      G_PARAM_STATIC_STRINGS);
+
+	g_object_class_install_properties (object_class, N_PROPERTIES, properties);
 }
 
 static void
 gtef_view_init (GtefView *view)
 {
+	g_signal_connect (view,
+			  "notify::buffer",
+			  G_CALLBACK (notify_buffer_cb),
+			  NULL);
 }
 
 /**
@@ -248,6 +444,9 @@ gtef_view_scroll_to_cursor (GtefView *view)
  * Places the cursor at the position returned by
  * gtk_text_buffer_get_iter_at_line(), and scrolls to that position.
  *
+ * If a #GtefFilePager is attached to @view, @line is a line of the whole file
+ * and gtef_file_pager_goto_line() is called instead.
+ *
  * Returns: %TRUE if the cursor has been moved exactly to @line, %FALSE if that
  *   line didn't exist.
  * Since: 2.0
@@ -256,12 +455,20 @@ gboolean
 gtef_view_goto_line (GtefView *view,
 		     gint      line)
 {
+	GtefViewPrivate *priv;
 	GtkTextBuffer *buffer;
 	GtkTextIter iter;
 	gboolean line_exists;
 
 	g_return_val_if_fail (GTEF_IS_VIEW (view), FALSE);
 
+	priv = gtef_view_get_instance_private (view);
+
+	if (priv->file_pager != NULL)
+	{
+		return gtef_file_pager_goto_line (priv->file_pager, line);
+	}
+
 	buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (view));
 
 	gtk_text_buffer_get_iter_at_line (buffer, &iter, line);
@@ -362,3 +569,92 @@ gtef_view_select_lines (GtefView *view,
 
 	gtef_view_scroll_to_cursor (view);
 }
+
+/**
+ * gtef_view_get_auto_scroll:
+ * @view: a #GtefView.
+ *
+ * Returns: the value of the #GtefView:auto-scroll property.
+ * Since: 2.0
+ */
+gboolean
+gtef_view_get_auto_scroll (GtefView *view)
+{
+	GtefViewPrivate *priv;
+
+	g_return_val_if_fail (GTEF_IS_VIEW (view), FALSE);
+
+	priv = gtef_view_get_instance_private (view);
+	return priv->auto_scroll;
+}
+
+/**
+ * gtef_view_set_auto_scroll:
+ * @view: a #GtefView.
+ * @auto_scroll: the new value.
+ *
+ * Sets the #GtefView:auto-scroll property.
+ *
+ * Since: 2.0
+ */
+void
+gtef_view_set_auto_scroll (GtefView *view,
+			   gboolean  auto_scroll)
+{
+	GtefViewPrivate *priv;
+
+	g_return_if_fail (GTEF_IS_VIEW (view));
+
+	priv = gtef_view_get_instance_private (view);
+
+	auto_scroll = auto_scroll != FALSE;
+
+	if (priv->auto_scroll != auto_scroll)
+	{
+		priv->auto_scroll = auto_scroll;
+		g_object_notify_by_pspec (G_OBJECT (view), properties[PROP_AUTO_SCROLL]);
+	}
+}
+
+GtefFilePager *
+_gtef_view_get_file_pager (GtefView *view)
+{
+	GtefViewPrivate *priv;
+
+	g_return_val_if_fail (GTEF_IS_VIEW (view), NULL);
+
+	priv = gtef_view_get_instance_private (view);
+	return priv->file_pager;
+}
+
+/* Called by the GtefFilePager, which has a weak ref to the view. */
+void
+_gtef_view_set_file_pager (GtefView      *view,
+			   GtefFilePager *file_pager)
+{
+	GtefViewPrivate *priv;
+
+	g_return_if_fail (GTEF_IS_VIEW (view));
+	g_return_if_fail (file_pager == NULL || GTEF_IS_FILE_PAGER (file_pager));
+
+	priv = gtef_view_get_instance_private (view);
+
+	if (priv->file_pager == file_pager)
+	{
+		return;
+	}
+
+	if (priv->file_pager != NULL)
+	{
+		g_object_remove_weak_pointer (G_OBJECT (priv->file_pager),
+					      (gpointer *) &priv->file_pager);
+	}
+
+	priv->file_pager = file_pager;
+
+	if (priv->file_pager != NULL)
+	{
+		g_object_add_weak_pointer (G_OBJECT (priv->file_pager),
+					   (gpointer *) &priv->file_pager);
+	}
+}
@@ -25,6 +25,7 @@
 #endif
 
 #include <gtksourceview/gtksource.h>
+#include <gtef/gtef-types.h>
 
 G_BEGIN_DECLS
 
@@ -65,6 +66,18 @@ void			gtef_view_select_lines				(GtefView *view,
 									 gint      start_line,
 									 gint      end_line);
 
+gboolean		gtef_view_get_auto_scroll			(GtefView *view);
+
+void			gtef_view_set_auto_scroll			(GtefView *view,
+									 gboolean  auto_scroll);
+
+G_GNUC_INTERNAL
+GtefFilePager *		_gtef_view_get_file_pager			(GtefView *view);
+
+G_GNUC_INTERNAL
+void			_gtef_view_set_file_pager			(GtefView      *view,
+									 GtefFilePager *file_pager);
+
 G_END_DECLS
 
 #endif /* GTEF_VIEW_H */
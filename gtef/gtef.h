@@ -36,9 +36,13 @@
 #include <gtef/gtef-file.h>
 #include <gtef/gtef-file-loader.h>
 #include <gtef/gtef-file-metadata.h>
+#include <gtef/gtef-file-pager.h>
 #include <gtef/gtef-file-saver.h>
+#include <gtef/gtef-file-watcher.h>
 #include <gtef/gtef-fold-region.h>
+#include <gtef/gtef-fold-region-manager.h>
 #include <gtef/gtef-gutter-renderer-folds.h>
+#include <gtef/gtef-indentation-folding.h>
 #include <gtef/gtef-info-bar.h>
 #include <gtef/gtef-iter.h>
 #include <gtef/gtef-menu-item.h>
@@ -0,0 +1,222 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Compares GtefEncodingConverter, which has built-in decoders for the
+ * single-byte charsets and UTF-16, with a plain g_iconv() loop, for the
+ * conversion to UTF-8. The content is fed by chunks, like GtefFileLoader does.
+ */
+
+#include <gtef/gtef.h>
+#include <errno.h>
+#include "gtef/gtef-encoding-converter.h"
+
+#define CONTENT_SIZE (16 * 1024 * 1024)
+#define CHUNK_SIZE (64 * 1024)
+#define OUTBUF_SIZE (1024 * 1024)
+#define N_ITERATIONS 5
+
+static gchar *
+create_content (const gchar *utf8_line,
+		const gchar *charset,
+		gsize       *length)
+{
+	GString *content;
+	gchar *line;
+	gsize line_length;
+	GError *error = NULL;
+
+	line = g_convert (utf8_line, -1, charset, "UTF-8", NULL, &line_length, &error);
+	g_assert_no_error (error);
+
+	content = g_string_sized_new (CONTENT_SIZE + line_length);
+
+	while (content->len < CONTENT_SIZE)
+	{
+		g_string_append_len (content, line, line_length);
+	}
+
+	g_free (line);
+
+	*length = content->len;
+	return g_string_free (content, FALSE);
+}
+
+static gsize
+convert_with_iconv (const gchar *content,
+		    gsize        length,
+		    const gchar *charset)
+{
+	GIConv conv;
+	gchar *outbuf;
+	gsize offset;
+	gsize n_bytes_written = 0;
+
+	conv = g_iconv_open ("UTF-8", charset);
+	g_assert (conv != (GIConv)-1);
+
+	outbuf = g_malloc (OUTBUF_SIZE);
+
+	for (offset = 0; offset < length; offset += CHUNK_SIZE)
+	{
+		gchar *inbuf = (gchar *) content + offset;
+		gsize inbytes_left = MIN (CHUNK_SIZE, length - offset);
+
+		while (inbytes_left > 0)
+		{
+			gchar *out = outbuf;
+			gsize outbytes_left = OUTBUF_SIZE;
+			gsize ret;
+
+			ret = g_iconv (conv, &inbuf, &inbytes_left, &out, &outbytes_left);
+			g_assert (ret != (gsize)-1 || errno == E2BIG);
+
+			n_bytes_written += OUTBUF_SIZE - outbytes_left;
+		}
+	}
+
+	g_free (outbuf);
+	g_iconv_close (conv);
+
+	return n_bytes_written;
+}
+
+static void
+converter_cb (const gchar *str,
+	      gsize        length,
+	      gpointer     user_data)
+{
+	gsize *n_bytes_written = user_data;
+
+	*n_bytes_written += length;
+}
+
+static gsize
+convert_with_converter (const gchar *content,
+			gsize        length,
+			const gchar *charset)
+{
+	GtefEncodingConverter *converter;
+	gsize offset;
+	gsize n_bytes_written = 0;
+	GError *error = NULL;
+
+	converter = _gtef_encoding_converter_new (OUTBUF_SIZE);
+	_gtef_encoding_converter_set_callback (converter, converter_cb, &n_bytes_written);
+
+	_gtef_encoding_converter_open (converter, "UTF-8", charset, &error);
+	g_assert_no_error (error);
+
+	for (offset = 0; offset < length; offset += CHUNK_SIZE)
+	{
+		_gtef_encoding_converter_feed (converter,
+					       content + offset,
+					       MIN (CHUNK_SIZE, length - offset),
+					       &error);
+		g_assert_no_error (error);
+	}
+
+	_gtef_encoding_converter_close (converter, &error);
+	g_assert_no_error (error);
+
+	g_object_unref (converter);
+
+	return n_bytes_written;
+}
+
+static void
+test_charset (const gchar *charset,
+	      const gchar *utf8_line)
+{
+	gchar *content;
+	gsize length;
+	GTimer *timer;
+	gdouble iconv_time;
+	gdouble converter_time;
+	gsize iconv_length = 0;
+	gsize converter_length = 0;
+	gint i;
+
+	content = create_content (utf8_line, charset, &length);
+
+	timer = g_timer_new ();
+
+	for (i = 0; i < N_ITERATIONS; i++)
+	{
+		iconv_length = convert_with_iconv (content, length, charset);
+	}
+
+	iconv_time = g_timer_elapsed (timer, NULL);
+	g_timer_start (timer);
+
+	for (i = 0; i < N_ITERATIONS; i++)
+	{
+		converter_length = convert_with_converter (content, length, charset);
+	}
+
+	converter_time = g_timer_elapsed (timer, NULL);
+
+	g_assert_cmpuint (iconv_length, ==, converter_length);
+
+	g_print ("%-14s iconv: %8.1f MB/s, GtefEncodingConverter: %8.1f MB/s\n",
+		 charset,
+		 length * N_ITERATIONS / iconv_time / (1000 * 1000),
+		 length * N_ITERATIONS / converter_time / (1000 * 1000));
+
+	g_timer_destroy (timer);
+	g_free (content);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+	const gchar *ascii = "Lorem ipsum dolor sit amet, consectetur adipiscing elit.\n";
+	const gchar *french = "Portez ce vieux whisky au juge blond qui fume, à l'été.\n";
+	const gchar *french_quote = "Portez ce vieux whisky au juge blond qui fume, à l’été.\n";
+	const gchar *russian = "Съешь же ещё этих мягких французских булок, да выпей чаю.\n";
+	const gchar *greek = "Ξεσκεπάζω την ψυχοφθόρα βδελυγμία.\n";
+	const gchar *chinese = "我能吞下玻璃而不伤身体。\n";
+
+	gtk_init (&argc, &argv);
+
+	g_print ("ASCII content:\n");
+	test_charset ("ISO-8859-15", ascii);
+	test_charset ("WINDOWS-1252", ascii);
+
+	g_print ("Mostly ASCII content:\n");
+	test_charset ("ISO-8859-1", french);
+	test_charset ("ISO-8859-15", french);
+	test_charset ("WINDOWS-1252", french_quote);
+
+	g_print ("Mostly non-ASCII content:\n");
+	test_charset ("ISO-8859-5", russian);
+	test_charset ("WINDOWS-1251", russian);
+	test_charset ("KOI8-R", russian);
+	test_charset ("ISO-8859-7", greek);
+	test_charset ("WINDOWS-1253", greek);
+
+	g_print ("UTF-16 content:\n");
+	test_charset ("UTF-16LE", ascii);
+	test_charset ("UTF-16BE", ascii);
+	test_charset ("UTF-16BE", french);
+	test_charset ("UTF-16LE", russian);
+	test_charset ("UTF-16LE", chinese);
+
+	return 0;
+}
@@ -0,0 +1,663 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Performance tests for loading files. Prints the wall-clock time and the
+ * number of chunks (i.e. GBytes allocations) for several file sizes, the
+ * throughput of loading a gzip-compressed file compared to the same content
+ * uncompressed, the time to load many small files in a row with and
+ * without the pool of GtefEncodingConverter, and the time taken by the
+ * encoding detection on a big ASCII file and on a big binary file.
+ */
+
+#include <gtef/gtef.h>
+#include "gtef/gtef-encoding-converter.h"
+#include "gtef/gtef-file-content-loader.h"
+
+#define N_ITERATIONS 5
+#define N_SMALL_FILES 500
+
+typedef struct _LoadData LoadData;
+
+struct _LoadData
+{
+	GMainLoop *main_loop;
+	guint n_chunks;
+	gsize n_bytes;
+};
+
+static GFile *
+create_test_file (gsize size)
+{
+	gchar *path;
+	GString *content;
+	GError *error = NULL;
+	GFile *file;
+
+	path = g_build_filename (g_get_tmp_dir (), "gtef-test-file-loader-performance", NULL);
+
+	content = g_string_sized_new (size);
+	while (content->len < size)
+	{
+		g_string_append (content, "Lorem ipsum dolor sit amet, consectetur adipiscing elit.\n");
+	}
+	g_string_truncate (content, size);
+
+	g_file_set_contents (path, content->str, content->len, &error);
+	g_assert_no_error (error);
+
+	file = g_file_new_for_path (path);
+
+	g_string_free (content, TRUE);
+	g_free (path);
+	return file;
+}
+
+static gboolean
+chunk_cb (GBytes   *chunk,
+	  gpointer  user_data,
+	  GError  **error)
+{
+	LoadData *data = user_data;
+
+	data->n_chunks++;
+	data->n_bytes += g_bytes_get_size (chunk);
+
+	return TRUE;
+}
+
+static void
+load_cb (GObject      *source_object,
+	 GAsyncResult *result,
+	 gpointer      user_data)
+{
+	GtefFileContentLoader *content_loader = GTEF_FILE_CONTENT_LOADER (source_object);
+	LoadData *data = user_data;
+	GError *error = NULL;
+
+	_gtef_file_content_loader_load_finish (content_loader, result, &error);
+	g_assert_no_error (error);
+
+	g_main_loop_quit (data->main_loop);
+}
+
+static void
+test_content_loader (GFile    *location,
+		     gsize     size,
+		     gboolean  use_mmap)
+{
+	GTimer *timer;
+	gdouble total_time = 0.0;
+	LoadData data = { 0 };
+	gint i;
+
+	data.main_loop = g_main_loop_new (NULL, FALSE);
+	timer = g_timer_new ();
+
+	for (i = 0; i < N_ITERATIONS; i++)
+	{
+		GtefFileContentLoader *content_loader;
+
+		data.n_chunks = 0;
+		data.n_bytes = 0;
+
+		content_loader = _gtef_file_content_loader_new_from_file (location);
+		_gtef_file_content_loader_set_max_size (content_loader, -1);
+		_gtef_file_content_loader_set_use_mmap (content_loader, use_mmap);
+		_gtef_file_content_loader_set_chunk_callback (content_loader, chunk_cb, &data);
+
+		g_timer_start (timer);
+
+		_gtef_file_content_loader_load_async (content_loader,
+						      G_PRIORITY_DEFAULT,
+						      NULL,
+						      NULL, NULL, NULL,
+						      load_cb,
+						      &data);
+
+		g_main_loop_run (data.main_loop);
+
+		g_timer_stop (timer);
+		total_time += g_timer_elapsed (timer, NULL);
+
+		g_assert_cmpuint (data.n_bytes, ==, size);
+		g_object_unref (content_loader);
+	}
+
+	g_print ("%3" G_GSIZE_FORMAT " MB, %-12s %8.2f ms, %6u chunks\n",
+		 size / (1000 * 1000),
+		 use_mmap ? "mmap:" : "GInputStream:",
+		 total_time * 1000.0 / N_ITERATIONS,
+		 data.n_chunks);
+
+	g_timer_destroy (timer);
+	g_main_loop_unref (data.main_loop);
+}
+
+static void
+test_content_loader_backends (void)
+{
+	const gsize sizes[] = { 1000 * 1000, 10 * 1000 * 1000, 50 * 1000 * 1000 };
+	guint i;
+
+	g_print ("GtefFileContentLoader backends (average of %d loads):\n", N_ITERATIONS);
+
+	for (i = 0; i < G_N_ELEMENTS (sizes); i++)
+	{
+		GFile *location;
+
+		location = create_test_file (sizes[i]);
+
+		test_content_loader (location, sizes[i], FALSE);
+		test_content_loader (location, sizes[i], TRUE);
+
+		g_file_delete (location, NULL, NULL);
+		g_object_unref (location);
+	}
+}
+
+typedef struct _LatencyData LatencyData;
+
+struct _LatencyData
+{
+	GMainLoop *main_loop;
+	gint64 last_tick_time;
+	gint64 max_latency;
+};
+
+/* Measures the longest time the main loop has been blocked. */
+static gboolean
+tick_cb (gpointer user_data)
+{
+	LatencyData *data = user_data;
+	gint64 now;
+
+	now = g_get_monotonic_time ();
+
+	if (data->last_tick_time > 0)
+	{
+		data->max_latency = MAX (data->max_latency, now - data->last_tick_time);
+	}
+
+	data->last_tick_time = now;
+	return G_SOURCE_CONTINUE;
+}
+
+static void
+file_loader_load_cb (GObject      *source_object,
+		     GAsyncResult *result,
+		     gpointer      user_data)
+{
+	GtefFileLoader *loader = GTEF_FILE_LOADER (source_object);
+	LatencyData *data = user_data;
+	GError *error = NULL;
+
+	gtef_file_loader_load_finish (loader, result, &error);
+	g_assert_no_error (error);
+
+	g_main_loop_quit (data->main_loop);
+}
+
+static void
+test_file_loader_latency (void)
+{
+	const gsize size = 50 * 1000 * 1000;
+	GFile *location;
+	GtefBuffer *buffer;
+	GtefFile *file;
+	GtefFileLoader *loader;
+	LatencyData data = { 0 };
+	GTimer *timer;
+	guint tick_id;
+
+	location = create_test_file (size);
+
+	buffer = gtef_buffer_new ();
+	file = gtef_buffer_get_file (buffer);
+	gtef_file_set_location (file, location);
+
+	loader = gtef_file_loader_new (buffer, file);
+	gtef_file_loader_set_max_size (loader, -1);
+
+	data.main_loop = g_main_loop_new (NULL, FALSE);
+
+	/* Same priority as the redraws. */
+	tick_id = g_timeout_add_full (GDK_PRIORITY_REDRAW, 1, tick_cb, &data, NULL);
+
+	timer = g_timer_new ();
+
+	gtef_file_loader_load_async (loader,
+				     G_PRIORITY_DEFAULT,
+				     NULL,
+				     NULL, NULL, NULL,
+				     file_loader_load_cb,
+				     &data);
+
+	g_main_loop_run (data.main_loop);
+
+	g_print ("\nGtefFileLoader, %" G_GSIZE_FORMAT " MB: %.2f ms, "
+		 "main loop blocked at most %.2f ms\n",
+		 size / (1000 * 1000),
+		 g_timer_elapsed (timer, NULL) * 1000.0,
+		 data.max_latency / 1000.0);
+
+	g_source_remove (tick_id);
+	g_timer_destroy (timer);
+	g_main_loop_unref (data.main_loop);
+	g_object_unref (loader);
+	g_object_unref (buffer);
+
+	g_file_delete (location, NULL, NULL);
+	g_object_unref (location);
+}
+
+static GFile *
+create_gzip_file (GFile *location)
+{
+	gchar *path;
+	GFile *gzip_location;
+	GFileInputStream *input_stream;
+	GFileOutputStream *file_output_stream;
+	GZlibCompressor *compressor;
+	GOutputStream *output_stream;
+	GError *error = NULL;
+
+	path = g_build_filename (g_get_tmp_dir (), "gtef-test-file-loader-performance.gz", NULL);
+	gzip_location = g_file_new_for_path (path);
+
+	input_stream = g_file_read (location, NULL, &error);
+	g_assert_no_error (error);
+
+	file_output_stream = g_file_replace (gzip_location, NULL, FALSE, G_FILE_CREATE_NONE, NULL, &error);
+	g_assert_no_error (error);
+
+	compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1);
+	output_stream = g_converter_output_stream_new (G_OUTPUT_STREAM (file_output_stream),
+						       G_CONVERTER (compressor));
+
+	g_output_stream_splice (output_stream,
+				G_INPUT_STREAM (input_stream),
+				G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE |
+				G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+				NULL,
+				&error);
+	g_assert_no_error (error);
+
+	g_object_unref (output_stream);
+	g_object_unref (compressor);
+	g_object_unref (file_output_stream);
+	g_object_unref (input_stream);
+	g_free (path);
+	return gzip_location;
+}
+
+/* Returns the wall-clock time, in seconds. */
+static gdouble
+load_into_buffer (GFile               *location,
+		  GtefCompressionType  expected_compression_type)
+{
+	GtefBuffer *buffer;
+	GtefFile *file;
+	GtefFileLoader *loader;
+	LatencyData data = { 0 };
+	GTimer *timer;
+	gdouble elapsed;
+
+	buffer = gtef_buffer_new ();
+	file = gtef_buffer_get_file (buffer);
+	gtef_file_set_location (file, location);
+
+	loader = gtef_file_loader_new (buffer, file);
+	gtef_file_loader_set_max_size (loader, -1);
+
+	data.main_loop = g_main_loop_new (NULL, FALSE);
+	timer = g_timer_new ();
+
+	gtef_file_loader_load_async (loader,
+				     G_PRIORITY_DEFAULT,
+				     NULL,
+				     NULL, NULL, NULL,
+				     file_loader_load_cb,
+				     &data);
+
+	g_main_loop_run (data.main_loop);
+
+	elapsed = g_timer_elapsed (timer, NULL);
+
+	g_assert_cmpint (gtef_file_loader_get_compression_type (loader), ==, expected_compression_type);
+	g_assert_cmpint (gtef_file_get_compression_type (file), ==, expected_compression_type);
+
+	g_timer_destroy (timer);
+	g_main_loop_unref (data.main_loop);
+	g_object_unref (loader);
+	g_object_unref (buffer);
+
+	return elapsed;
+}
+
+static void
+test_file_loader_compression (void)
+{
+	const gsize size = 50 * 1000 * 1000;
+	GFile *location;
+	GFile *gzip_location;
+	gdouble uncompressed_time = 0.0;
+	gdouble gzip_time = 0.0;
+	gint i;
+
+	location = create_test_file (size);
+	gzip_location = create_gzip_file (location);
+
+	for (i = 0; i < N_ITERATIONS; i++)
+	{
+		uncompressed_time += load_into_buffer (location, GTEF_COMPRESSION_TYPE_NONE);
+		gzip_time += load_into_buffer (gzip_location, GTEF_COMPRESSION_TYPE_GZIP);
+	}
+
+	uncompressed_time /= N_ITERATIONS;
+	gzip_time /= N_ITERATIONS;
+
+	g_print ("\nGtefFileLoader, %" G_GSIZE_FORMAT " MB of content (average of %d loads):\n",
+		 size / (1000 * 1000),
+		 N_ITERATIONS);
+	g_print ("uncompressed: %8.2f ms, %7.1f MB/s\n",
+		 uncompressed_time * 1000.0,
+		 size / uncompressed_time / (1000 * 1000));
+	g_print ("gzip:         %8.2f ms, %7.1f MB/s\n",
+		 gzip_time * 1000.0,
+		 size / gzip_time / (1000 * 1000));
+
+	g_file_delete (gzip_location, NULL, NULL);
+	g_object_unref (gzip_location);
+	g_file_delete (location, NULL, NULL);
+	g_object_unref (location);
+}
+
+/* In a charset converted with iconv, not with the built-in decoders for the
+ * single-byte charsets and UTF-16.
+ */
+static GPtrArray *
+create_small_files (void)
+{
+	GPtrArray *locations;
+	GString *content;
+	gchar *euc_jp_content;
+	gsize euc_jp_length;
+	guint i;
+	GError *error = NULL;
+
+	content = g_string_new (NULL);
+	for (i = 0; i < 20; i++)
+	{
+		g_string_append (content, "日本語のテキストファイルです。これは小さいファイルの読み込みのテストです。\n");
+	}
+
+	euc_jp_content = g_convert (content->str, content->len, "EUC-JP", "UTF-8", NULL, &euc_jp_length, &error);
+	g_assert_no_error (error);
+
+	locations = g_ptr_array_new_with_free_func (g_object_unref);
+
+	for (i = 0; i < N_SMALL_FILES; i++)
+	{
+		gchar *basename;
+		gchar *path;
+
+		basename = g_strdup_printf ("gtef-test-file-loader-performance-%u", i);
+		path = g_build_filename (g_get_tmp_dir (), basename, NULL);
+
+		g_file_set_contents (path, euc_jp_content, euc_jp_length, &error);
+		g_assert_no_error (error);
+
+		g_ptr_array_add (locations, g_file_new_for_path (path));
+
+		g_free (basename);
+		g_free (path);
+	}
+
+	g_string_free (content, TRUE);
+	g_free (euc_jp_content);
+	return locations;
+}
+
+/* Returns the wall-clock time, in seconds. */
+static gdouble
+load_small_files (GPtrArray *locations,
+		  gboolean   use_pool)
+{
+	GTimer *timer;
+	guint i;
+
+	timer = g_timer_new ();
+
+	for (i = 0; i < locations->len; i++)
+	{
+		/* Like before the pool existed: g_iconv_open() and a new output
+		 * buffer for each file.
+		 */
+		if (!use_pool)
+		{
+			_gtef_encoding_converter_clear_pool ();
+		}
+
+		load_into_buffer (g_ptr_array_index (locations, i), GTEF_COMPRESSION_TYPE_NONE);
+	}
+
+	return g_timer_elapsed (timer, NULL);
+}
+
+static void
+test_file_loader_small_files (void)
+{
+	GPtrArray *locations;
+	gdouble without_pool_time;
+	gdouble with_pool_time;
+	guint i;
+
+	locations = create_small_files ();
+
+	/* Warm up, to load the gconv modules. */
+	load_into_buffer (g_ptr_array_index (locations, 0), GTEF_COMPRESSION_TYPE_NONE);
+
+	without_pool_time = load_small_files (locations, FALSE);
+	with_pool_time = load_small_files (locations, TRUE);
+
+	g_print ("\nGtefFileLoader, %u small EUC-JP files in a row:\n", locations->len);
+	g_print ("without pool: %8.2f ms, %6.3f ms per file\n",
+		 without_pool_time * 1000.0,
+		 without_pool_time * 1000.0 / locations->len);
+	g_print ("with pool:    %8.2f ms, %6.3f ms per file\n",
+		 with_pool_time * 1000.0,
+		 with_pool_time * 1000.0 / locations->len);
+
+	for (i = 0; i < locations->len; i++)
+	{
+		g_file_delete (g_ptr_array_index (locations, i), NULL, NULL);
+	}
+
+	g_ptr_array_unref (locations);
+}
+
+static void
+binary_load_cb (GObject      *source_object,
+		GAsyncResult *result,
+		gpointer      user_data)
+{
+	GtefFileLoader *loader = GTEF_FILE_LOADER (source_object);
+	GMainLoop *main_loop = user_data;
+	GError *error = NULL;
+
+	gtef_file_loader_load_finish (loader, result, &error);
+	g_assert (g_error_matches (error,
+				   GTEF_FILE_LOADER_ERROR,
+				   GTEF_FILE_LOADER_ERROR_BINARY_CONTENT));
+	g_error_free (error);
+
+	g_main_loop_quit (main_loop);
+}
+
+/* Returns the wall-clock time, in seconds, until the error is returned. */
+static gdouble
+load_binary_file (GFile *location)
+{
+	GtefBuffer *buffer;
+	GtefFile *file;
+	GtefFileLoader *loader;
+	GMainLoop *main_loop;
+	GTimer *timer;
+	gdouble elapsed;
+
+	buffer = gtef_buffer_new ();
+	file = gtef_buffer_get_file (buffer);
+	gtef_file_set_location (file, location);
+
+	loader = gtef_file_loader_new (buffer, file);
+	gtef_file_loader_set_max_size (loader, -1);
+
+	main_loop = g_main_loop_new (NULL, FALSE);
+	timer = g_timer_new ();
+
+	gtef_file_loader_load_async (loader,
+				     G_PRIORITY_DEFAULT,
+				     NULL,
+				     NULL, NULL, NULL,
+				     binary_load_cb,
+				     main_loop);
+
+	g_main_loop_run (main_loop);
+
+	elapsed = g_timer_elapsed (timer, NULL);
+
+	g_timer_destroy (timer);
+	g_main_loop_unref (main_loop);
+	g_object_unref (loader);
+	g_object_unref (buffer);
+
+	return elapsed;
+}
+
+/* Returns the wall-clock time, in seconds, of a load where the encoding is
+ * determined on the whole content. The first insertion in the buffer waits for
+ * the encoding detection.
+ */
+static gdouble
+detect_whole_content_encoding (GFile *location)
+{
+	GtefBuffer *buffer;
+	GtefFile *file;
+	GtefFileLoader *loader;
+	LatencyData data = { 0 };
+	GTimer *timer;
+	gdouble elapsed;
+
+	buffer = gtef_buffer_new ();
+	file = gtef_buffer_get_file (buffer);
+	gtef_file_set_location (file, location);
+
+	loader = gtef_file_loader_new (buffer, file);
+	gtef_file_loader_set_max_size (loader, -1);
+	gtef_file_loader_set_sniff_size (loader, -1);
+
+	data.main_loop = g_main_loop_new (NULL, FALSE);
+	timer = g_timer_new ();
+
+	gtef_file_loader_load_async (loader,
+				     G_PRIORITY_DEFAULT,
+				     NULL,
+				     NULL, NULL, NULL,
+				     file_loader_load_cb,
+				     &data);
+
+	g_main_loop_run (data.main_loop);
+
+	elapsed = g_timer_elapsed (timer, NULL);
+
+	g_assert_cmpint (gtef_file_loader_get_encoding_detection_method (loader),
+			 ==,
+			 GTEF_ENCODING_DETECTION_METHOD_ASCII);
+
+	g_timer_destroy (timer);
+	g_main_loop_unref (data.main_loop);
+	g_object_unref (loader);
+	g_object_unref (buffer);
+
+	return elapsed;
+}
+
+static void
+test_file_loader_classification (void)
+{
+	const gsize size = 50 * 1000 * 1000;
+	GFile *location;
+	gchar *path;
+	gchar *binary_content;
+	gdouble ascii_time = 0.0;
+	gdouble binary_time = 0.0;
+	gint i;
+	GError *error = NULL;
+
+	location = create_test_file (size);
+
+	for (i = 0; i < N_ITERATIONS; i++)
+	{
+		ascii_time += detect_whole_content_encoding (location);
+	}
+
+	g_file_delete (location, NULL, NULL);
+	g_object_unref (location);
+
+	/* Zeros, like the padding found in most binary files. */
+	path = g_build_filename (g_get_tmp_dir (), "gtef-test-file-loader-performance", NULL);
+	binary_content = g_malloc0 (size);
+	g_file_set_contents (path, binary_content, size, &error);
+	g_assert_no_error (error);
+	location = g_file_new_for_path (path);
+
+	for (i = 0; i < N_ITERATIONS; i++)
+	{
+		binary_time += load_binary_file (location);
+	}
+
+	ascii_time /= N_ITERATIONS;
+	binary_time /= N_ITERATIONS;
+
+	g_print ("\nGtefFileLoader, encoding detection on %" G_GSIZE_FORMAT " MB (average of %d loads):\n",
+		 size / (1000 * 1000),
+		 N_ITERATIONS);
+	g_print ("ASCII, whole content sniffed: %8.2f ms\n", ascii_time * 1000.0);
+	g_print ("binary, aborted early:        %8.2f ms\n", binary_time * 1000.0);
+
+	g_file_delete (location, NULL, NULL);
+	g_object_unref (location);
+	g_free (binary_content);
+	g_free (path);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+	gtk_init (&argc, &argv);
+
+	test_content_loader_backends ();
+	test_file_loader_latency ();
+	test_file_loader_compression ();
+	test_file_loader_small_files ();
+	test_file_loader_classification ();
+
+	return 0;
+}
@@ -0,0 +1,223 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Performance tests for saving files. Prints the wall-clock time to read a
+ * whole buffer with GtefBufferInputStream, and the time and throughput to save
+ * it with GtefFileSaver, for several numbers of lines. Pass a directory as
+ * argument to save there instead of the tmp directory, for example a directory
+ * on a network mount.
+ */
+
+#include <gtef/gtef.h>
+#include "gtef/gtef-buffer-input-stream.h"
+
+#define N_ITERATIONS 5
+#define READ_BUFFER_SIZE 8192
+
+static GtefBuffer *
+create_buffer (guint n_lines)
+{
+	GtefBuffer *buffer;
+	GString *content;
+	guint i;
+
+	content = g_string_new (NULL);
+
+	for (i = 0; i < n_lines; i++)
+	{
+		g_string_append_printf (content,
+					"%u: Lorem ipsum dolor sit amet, consectetur adipiscing elit.\n",
+					i);
+	}
+
+	buffer = gtef_buffer_new ();
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), content->str, content->len);
+
+	g_string_free (content, TRUE);
+	return buffer;
+}
+
+static void
+test_input_stream (GtefBuffer      *buffer,
+		   GtefNewlineType  newline_type)
+{
+	GTimer *timer;
+	gdouble total_time = 0.0;
+	gsize n_bytes = 0;
+	gint i;
+
+	timer = g_timer_new ();
+
+	for (i = 0; i < N_ITERATIONS; i++)
+	{
+		GtefBufferInputStream *stream;
+		gchar read_buffer[READ_BUFFER_SIZE];
+		gssize n_read;
+		GError *error = NULL;
+
+		stream = _gtef_buffer_input_stream_new (GTK_TEXT_BUFFER (buffer), newline_type, TRUE);
+		n_bytes = 0;
+
+		g_timer_start (timer);
+
+		do
+		{
+			n_read = g_input_stream_read (G_INPUT_STREAM (stream),
+						      read_buffer,
+						      sizeof (read_buffer),
+						      NULL,
+						      &error);
+			g_assert_no_error (error);
+			n_bytes += n_read;
+		}
+		while (n_read > 0);
+
+		g_timer_stop (timer);
+		total_time += g_timer_elapsed (timer, NULL);
+
+		g_input_stream_close (G_INPUT_STREAM (stream), NULL, NULL);
+		g_object_unref (stream);
+	}
+
+	g_print ("  GtefBufferInputStream, %-6s %8.2f ms, %" G_GSIZE_FORMAT " bytes\n",
+		 newline_type == GTEF_NEWLINE_TYPE_LF ? "LF:" : "CR-LF:",
+		 total_time * 1000.0 / N_ITERATIONS,
+		 n_bytes);
+
+	g_timer_destroy (timer);
+}
+
+static void
+save_cb (GObject      *source_object,
+	 GAsyncResult *result,
+	 gpointer      user_data)
+{
+	GtefFileSaver *saver = GTEF_FILE_SAVER (source_object);
+	GMainLoop *main_loop = user_data;
+	GError *error = NULL;
+
+	gtef_file_saver_save_finish (saver, result, &error);
+	g_assert_no_error (error);
+
+	g_main_loop_quit (main_loop);
+}
+
+static void
+test_file_saver (GtefBuffer         *buffer,
+		 GFile              *location,
+		 GtefFileSaverFlags  flags)
+{
+	GtefFile *file;
+	GMainLoop *main_loop;
+	GTimer *timer;
+	gdouble total_time = 0.0;
+	GFileInfo *info;
+	goffset file_size;
+	gint i;
+	GError *error = NULL;
+
+	file = gtef_buffer_get_file (buffer);
+	gtef_file_set_location (file, location);
+
+	main_loop = g_main_loop_new (NULL, FALSE);
+	timer = g_timer_new ();
+
+	for (i = 0; i < N_ITERATIONS; i++)
+	{
+		GtefFileSaver *saver;
+
+		saver = gtef_file_saver_new (buffer, file);
+		gtef_file_saver_set_flags (saver, flags);
+
+		g_timer_start (timer);
+
+		gtef_file_saver_save_async (saver,
+					    G_PRIORITY_DEFAULT,
+					    NULL,
+					    NULL, NULL, NULL,
+					    save_cb,
+					    main_loop);
+
+		g_main_loop_run (main_loop);
+
+		g_timer_stop (timer);
+		total_time += g_timer_elapsed (timer, NULL);
+
+		g_object_unref (saver);
+	}
+
+	info = g_file_query_info (location,
+				  G_FILE_ATTRIBUTE_STANDARD_SIZE,
+				  G_FILE_QUERY_INFO_NONE,
+				  NULL,
+				  &error);
+	g_assert_no_error (error);
+	file_size = g_file_info_get_size (info);
+	g_object_unref (info);
+
+	total_time /= N_ITERATIONS;
+
+	g_print ("  GtefFileSaver, %-14s %8.2f ms, %7.1f MB/s\n",
+		 (flags & GTEF_FILE_SAVER_FLAGS_SNAPSHOT) != 0 ? "snapshot:" : "live buffer:",
+		 total_time * 1000.0,
+		 file_size / total_time / (1000 * 1000));
+
+	g_timer_destroy (timer);
+	g_main_loop_unref (main_loop);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+	const guint n_lines[] = { 100 * 1000, 1000 * 1000 };
+	gchar *path;
+	GFile *location;
+	guint i;
+
+	gtk_init (&argc, &argv);
+
+	path = g_build_filename (argc > 1 ? argv[1] : g_get_tmp_dir (),
+				 "gtef-test-file-saver-performance",
+				 NULL);
+	location = g_file_new_for_path (path);
+
+	g_print ("Average of %d iterations:\n", N_ITERATIONS);
+
+	for (i = 0; i < G_N_ELEMENTS (n_lines); i++)
+	{
+		GtefBuffer *buffer;
+
+		buffer = create_buffer (n_lines[i]);
+
+		g_print ("%u lines:\n", n_lines[i]);
+		test_input_stream (buffer, GTEF_NEWLINE_TYPE_LF);
+		test_input_stream (buffer, GTEF_NEWLINE_TYPE_CR_LF);
+		test_file_saver (buffer, location, GTEF_FILE_SAVER_FLAGS_NONE);
+		test_file_saver (buffer, location, GTEF_FILE_SAVER_FLAGS_SNAPSHOT);
+
+		g_object_unref (buffer);
+	}
+
+	g_file_delete (location, NULL, NULL);
+	g_object_unref (location);
+	g_free (path);
+
+	return 0;
+}
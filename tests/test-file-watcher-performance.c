@@ -0,0 +1,222 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* Performance tests for the file watcher, with 500 files in 10 directories.
+ * Prints the time to add the files and the number of monitors created, and the
+ * time to check all the files in one batch, compared to calling
+ * gtef_file_check_file_on_disk() on each file. The latter blocks the main
+ * thread during the whole time.
+ */
+
+#include <gtef/gtef.h>
+#include <glib/gstdio.h>
+
+#define N_DIRS 10
+#define N_FILES_PER_DIR 50
+
+static void
+check_files_cb (GObject      *source_object,
+		GAsyncResult *result,
+		gpointer      user_data)
+{
+	GError *error = NULL;
+
+	gtef_file_watcher_check_files_finish (GTEF_FILE_WATCHER (source_object), result, &error);
+	g_assert_no_error (error);
+
+	gtk_main_quit ();
+}
+
+static gchar *
+get_dir_path (const gchar *base_dir,
+	      guint        dir_num)
+{
+	gchar *dirname;
+	gchar *path;
+
+	dirname = g_strdup_printf ("dir-%u", dir_num);
+	path = g_build_filename (base_dir, dirname, NULL);
+	g_free (dirname);
+
+	return path;
+}
+
+static GPtrArray *
+create_files (const gchar *base_dir)
+{
+	GPtrArray *files;
+	guint dir_num;
+
+	files = g_ptr_array_new_with_free_func (g_object_unref);
+
+	for (dir_num = 0; dir_num < N_DIRS; dir_num++)
+	{
+		gchar *dir_path;
+		guint file_num;
+
+		dir_path = get_dir_path (base_dir, dir_num);
+		g_mkdir_with_parents (dir_path, 0700);
+
+		for (file_num = 0; file_num < N_FILES_PER_DIR; file_num++)
+		{
+			gchar *basename;
+			gchar *path;
+			GFile *location;
+			GtefFile *file;
+			GError *error = NULL;
+
+			basename = g_strdup_printf ("file-%u.txt", file_num);
+			path = g_build_filename (dir_path, basename, NULL);
+
+			g_file_set_contents (path, "a", -1, &error);
+			g_assert_no_error (error);
+
+			location = g_file_new_for_path (path);
+			file = gtef_file_new ();
+			gtef_file_set_location (file, location);
+			g_ptr_array_add (files, file);
+
+			g_object_unref (location);
+			g_free (path);
+			g_free (basename);
+		}
+
+		g_free (dir_path);
+	}
+
+	return files;
+}
+
+static void
+delete_files (const gchar *base_dir,
+	      GPtrArray   *files)
+{
+	guint i;
+
+	for (i = 0; i < files->len; i++)
+	{
+		GtefFile *file = g_ptr_array_index (files, i);
+
+		g_file_delete (gtef_file_get_location (file), NULL, NULL);
+	}
+
+	for (i = 0; i < N_DIRS; i++)
+	{
+		gchar *dir_path;
+
+		dir_path = get_dir_path (base_dir, i);
+		g_rmdir (dir_path);
+		g_free (dir_path);
+	}
+
+	g_rmdir (base_dir);
+}
+
+static void
+add_files (GtefFileWatcher *watcher,
+	   GPtrArray       *files)
+{
+	guint i;
+
+	for (i = 0; i < files->len; i++)
+	{
+		gtef_file_watcher_add_file (watcher, g_ptr_array_index (files, i));
+	}
+}
+
+static void
+remove_files (GtefFileWatcher *watcher,
+	      GPtrArray       *files)
+{
+	guint i;
+
+	for (i = 0; i < files->len; i++)
+	{
+		gtef_file_watcher_remove_file (watcher, g_ptr_array_index (files, i));
+	}
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+	GtefFileWatcher *watcher;
+	gchar *base_dir;
+	GPtrArray *files;
+	GTimer *timer;
+	gdouble add_time;
+	gdouble batch_time;
+	gdouble sync_time;
+	guint n_monitors;
+	guint i;
+
+	gtk_init (&argc, &argv);
+
+	watcher = gtef_file_watcher_get_instance ();
+	base_dir = g_build_filename (g_get_tmp_dir (), "gtef-test-file-watcher-performance", NULL);
+	files = create_files (base_dir);
+	timer = g_timer_new ();
+
+	/* Monitored. */
+	g_timer_start (timer);
+	add_files (watcher, files);
+	add_time = g_timer_elapsed (timer, NULL);
+	n_monitors = _gtef_file_watcher_get_n_monitors (watcher);
+	remove_files (watcher, files);
+
+	/* Checked in one batch. */
+	_gtef_file_watcher_set_use_monitors (watcher, FALSE);
+	add_files (watcher, files);
+
+	g_timer_start (timer);
+	gtef_file_watcher_check_files_async (watcher,
+					     G_PRIORITY_DEFAULT,
+					     NULL,
+					     check_files_cb,
+					     NULL);
+	gtk_main ();
+	batch_time = g_timer_elapsed (timer, NULL);
+
+	remove_files (watcher, files);
+
+	/* Checked synchronously, one by one. */
+	g_timer_start (timer);
+	for (i = 0; i < files->len; i++)
+	{
+		gtef_file_check_file_on_disk (g_ptr_array_index (files, i));
+	}
+	sync_time = g_timer_elapsed (timer, NULL);
+
+	g_print ("%u files: add %.2f ms (%u monitors), "
+		 "batched check %.2f ms, synchronous check %.2f ms\n",
+		 files->len,
+		 add_time * 1000.0,
+		 n_monitors,
+		 batch_time * 1000.0,
+		 sync_time * 1000.0);
+
+	delete_files (base_dir, files);
+
+	g_timer_destroy (timer);
+	g_ptr_array_unref (files);
+	g_free (base_dir);
+
+	return 0;
+}
@@ -27,9 +27,14 @@ create_view (void)
 	GtefFoldRegion *fold_region;
 	GtkTextIter start_iter;
 	GtkTextIter end_iter;
+	GtkSourceGutter *gutter;
 
 	view = gtef_view_new ();
 
+	/* The folding states are taken from the GtefFoldRegionManager. */
+	gutter = gtk_source_view_get_gutter (GTK_SOURCE_VIEW (view), GTK_TEXT_WINDOW_LEFT);
+	gtk_source_gutter_insert (gutter, gtef_gutter_renderer_folds_new (), 0);
+
 	buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (view));
 	gtk_text_buffer_insert_at_cursor (buffer, "Line0\nLine1\nLine2\nLine3\nLine4\nLine5", -1);
 
@@ -0,0 +1,235 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Performance test for drawing GtefGutterRendererFolds, on a 100k-lines buffer
+ * with nested and folded regions, for a HiDPI surface. Scrolling is simulated
+ * by drawing the visible lines of successive frames, like GtkSourceGutter.
+ *
+ * The renderer paints pre-rendered glyphs when the source is a plain color,
+ * and strokes the signs directly otherwise; a gradient source is used to
+ * measure the direct drawing.
+ */
+
+#include <gtef/gtef.h>
+
+#define N_LINES 100000
+#define N_FRAMES 2000
+#define N_VISIBLE_LINES 60
+#define SCROLL_N_LINES 3
+#define SCALE 2
+#define CELL_WIDTH 9
+#define CELL_HEIGHT 17
+#define PADDING 2
+
+static GPtrArray *
+create_regions (GtkTextBuffer *buffer)
+{
+	GPtrArray *regions;
+	gint line;
+
+	regions = g_ptr_array_new_with_free_func (g_object_unref);
+
+	for (line = 0; line + 20 < N_LINES; line += 20)
+	{
+		GtkTextIter start;
+		GtkTextIter end;
+		GtefFoldRegion *fold_region;
+
+		gtk_text_buffer_get_iter_at_line (buffer, &start, line);
+		gtk_text_buffer_get_iter_at_line (buffer, &end, line + 18);
+		fold_region = gtef_fold_region_new (buffer, &start, &end);
+		g_ptr_array_add (regions, fold_region);
+
+		gtk_text_buffer_get_iter_at_line (buffer, &start, line + 2);
+		gtk_text_buffer_get_iter_at_line (buffer, &end, line + 8);
+		g_ptr_array_add (regions, gtef_fold_region_new (buffer, &start, &end));
+
+		if (line % 60 == 0)
+		{
+			gtef_fold_region_set_folded (fold_region, TRUE);
+		}
+	}
+
+	return regions;
+}
+
+static void
+draw_frame (GtkSourceGutterRenderer *renderer,
+	    cairo_t                 *cr,
+	    GtkTextIter             *first_line)
+{
+	GtkTextIter start;
+	GtkTextIter end;
+	GtkTextIter line_start;
+	GdkRectangle background_area;
+	GdkRectangle cell_area;
+	gint i;
+
+	start = *first_line;
+	end = start;
+	for (i = 1; i < N_VISIBLE_LINES; i++)
+	{
+		gtk_text_iter_forward_visible_line (&end);
+	}
+	gtk_text_iter_forward_to_line_end (&end);
+
+	background_area.x = 0;
+	background_area.y = 0;
+	background_area.width = CELL_WIDTH + 2 * PADDING;
+	background_area.height = CELL_HEIGHT;
+
+	cell_area.x = PADDING;
+	cell_area.y = 0;
+	cell_area.width = CELL_WIDTH;
+	cell_area.height = CELL_HEIGHT;
+
+	gtk_source_gutter_renderer_begin (renderer, cr, &background_area, &cell_area, &start, &end);
+
+	line_start = start;
+	for (i = 0; i < N_VISIBLE_LINES; i++)
+	{
+		GtkTextIter line_end = line_start;
+
+		gtk_text_iter_forward_to_line_end (&line_end);
+
+		gtk_source_gutter_renderer_draw (renderer,
+						 cr,
+						 &background_area,
+						 &cell_area,
+						 &line_start,
+						 &line_end,
+						 GTK_SOURCE_GUTTER_RENDERER_STATE_NORMAL);
+
+		background_area.y += CELL_HEIGHT;
+		cell_area.y += CELL_HEIGHT;
+
+		if (!gtk_text_iter_forward_visible_line (&line_start))
+		{
+			break;
+		}
+	}
+
+	gtk_source_gutter_renderer_end (renderer);
+}
+
+static gdouble
+scroll (GtkSourceGutterRenderer *renderer,
+	GtkTextBuffer           *buffer,
+	cairo_pattern_t         *source)
+{
+	cairo_surface_t *surface;
+	cairo_t *cr;
+	GtkTextIter first_line;
+	GTimer *timer;
+	gdouble elapsed;
+	gint frame;
+
+	surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+					      (CELL_WIDTH + 2 * PADDING) * SCALE,
+					      N_VISIBLE_LINES * CELL_HEIGHT * SCALE);
+	cairo_surface_set_device_scale (surface, SCALE, SCALE);
+	cr = cairo_create (surface);
+
+	gtk_text_buffer_get_start_iter (buffer, &first_line);
+	timer = g_timer_new ();
+
+	for (frame = 0; frame < N_FRAMES; frame++)
+	{
+		gint i;
+
+		cairo_save (cr);
+		cairo_set_operator (cr, CAIRO_OPERATOR_CLEAR);
+		cairo_paint (cr);
+		cairo_restore (cr);
+
+		cairo_set_source (cr, source);
+		draw_frame (renderer, cr, &first_line);
+
+		for (i = 0; i < SCROLL_N_LINES; i++)
+		{
+			gtk_text_iter_forward_visible_line (&first_line);
+		}
+	}
+
+	elapsed = g_timer_elapsed (timer, NULL);
+
+	g_timer_destroy (timer);
+	cairo_destroy (cr);
+	cairo_surface_destroy (surface);
+
+	return elapsed;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+	GtkWidget *view;
+	GtkTextBuffer *buffer;
+	GtkSourceGutter *gutter;
+	GtkSourceGutterRenderer *renderer;
+	GPtrArray *regions;
+	cairo_pattern_t *gradient;
+	cairo_pattern_t *color;
+	GString *text;
+	gdouble direct_time;
+	gdouble cached_time;
+	gint line;
+
+	gtk_init (&argc, &argv);
+
+	view = g_object_ref_sink (gtef_view_new ());
+	buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (view));
+
+	text = g_string_new (NULL);
+	for (line = 0; line < N_LINES; line++)
+	{
+		g_string_append_printf (text, "Line %d\n", line);
+	}
+	gtk_text_buffer_set_text (buffer, text->str, -1);
+	g_string_free (text, TRUE);
+
+	regions = create_regions (buffer);
+
+	gutter = gtk_source_view_get_gutter (GTK_SOURCE_VIEW (view), GTK_TEXT_WINDOW_LEFT);
+	renderer = gtef_gutter_renderer_folds_new ();
+	gtk_source_gutter_insert (gutter, renderer, 0);
+
+	/* Same color, but not a solid pattern. */
+	gradient = cairo_pattern_create_linear (0.0, 0.0, 0.0, 1.0);
+	cairo_pattern_add_color_stop_rgb (gradient, 0.0, 0.0, 0.0, 0.0);
+	cairo_pattern_add_color_stop_rgb (gradient, 1.0, 0.0, 0.0, 0.0);
+
+	color = cairo_pattern_create_rgb (0.0, 0.0, 0.0);
+
+	direct_time = scroll (renderer, buffer, gradient);
+	cached_time = scroll (renderer, buffer, color);
+
+	g_print ("%d lines, %u fold regions, %d frames of %d lines, scale %d\n",
+		 N_LINES, regions->len, N_FRAMES, N_VISIBLE_LINES, SCALE);
+	g_print ("Direct drawing: %8.2f µs per frame\n", direct_time * 1000000.0 / N_FRAMES);
+	g_print ("Cached glyphs:  %8.2f µs per frame\n", cached_time * 1000000.0 / N_FRAMES);
+
+	cairo_pattern_destroy (gradient);
+	cairo_pattern_destroy (color);
+	g_ptr_array_unref (regions);
+	g_object_unref (view);
+
+	return 0;
+}
@@ -0,0 +1,242 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Performance test for GtefIndentationFolding on a 200k-lines buffer. Prints
+ * the time of the initial computation, and the average time per keystroke for
+ * different kinds of edits. The edits are done at random lines, and then at
+ * the first line of large regions.
+ */
+
+#include <gtef/gtef.h>
+
+#define N_LINES 200000
+#define N_KEYSTROKES 1000
+#define LARGE_REGION_SIZE 20000
+
+static gchar *
+create_text (void)
+{
+	GString *text;
+	guint line;
+
+	text = g_string_new (NULL);
+
+	/* Blocks nested up to 4 levels, like functions in a source file. */
+	for (line = 0; line < N_LINES; line++)
+	{
+		guint depth;
+
+		depth = line % 50 == 0 ? 0 : 1 + (line % 7) % 4;
+
+		if (line % 13 == 0)
+		{
+			g_string_append_c (text, '\n');
+			continue;
+		}
+
+		g_string_append_printf (text, "%*sstatement_%u ();\n", depth * 8, "", line);
+	}
+
+	return g_string_free (text, FALSE);
+}
+
+static gchar *
+create_text_with_large_regions (void)
+{
+	GString *text;
+	guint line;
+
+	text = g_string_new (NULL);
+
+	/* Blocks with only one level of indentation, like long lists. */
+	for (line = 0; line < N_LINES; line++)
+	{
+		guint depth;
+
+		depth = line % LARGE_REGION_SIZE == 0 ? 0 : 1;
+
+		g_string_append_printf (text, "%*sitem_%u,\n", depth * 8, "", line);
+	}
+
+	return g_string_free (text, FALSE);
+}
+
+static void
+wait_computation (GtefIndentationFolding *folding)
+{
+	while (gtef_indentation_folding_get_computing (folding))
+	{
+		g_main_context_iteration (NULL, TRUE);
+	}
+}
+
+typedef enum
+{
+	EDIT_INSERT_CHAR,
+	EDIT_INSERT_NEWLINE,
+	EDIT_DELETE_CHAR,
+	EDIT_CHANGE_INDENTATION,
+} EditType;
+
+static void
+do_edit (GtkTextBuffer *buffer,
+	 EditType       type,
+	 gint           line)
+{
+	GtkTextIter iter;
+	GtkTextIter end;
+
+	gtk_text_buffer_get_iter_at_line (buffer, &iter, line);
+
+	switch (type)
+	{
+		case EDIT_INSERT_CHAR:
+			gtk_text_iter_forward_to_line_end (&iter);
+			gtk_text_buffer_insert (buffer, &iter, "x", -1);
+			break;
+
+		case EDIT_INSERT_NEWLINE:
+			gtk_text_iter_forward_to_line_end (&iter);
+			gtk_text_buffer_insert (buffer, &iter, "\n\t\t", -1);
+			break;
+
+		case EDIT_DELETE_CHAR:
+			gtk_text_iter_forward_to_line_end (&iter);
+			end = iter;
+			if (gtk_text_iter_backward_char (&iter))
+			{
+				gtk_text_buffer_delete (buffer, &iter, &end);
+			}
+			break;
+
+		case EDIT_CHANGE_INDENTATION:
+			gtk_text_buffer_insert (buffer, &iter, "\t", -1);
+			break;
+
+		default:
+			g_assert_not_reached ();
+	}
+}
+
+/* The edits are done at lines multiple of @line_step. */
+static void
+test_edits (GtkTextBuffer *buffer,
+	    EditType       type,
+	    gint           line_step,
+	    const gchar   *name)
+{
+	GTimer *timer;
+	gdouble elapsed;
+	guint i;
+
+	timer = g_timer_new ();
+
+	for (i = 0; i < N_KEYSTROKES; i++)
+	{
+		gint line;
+
+		line = g_random_int_range (0, gtk_text_buffer_get_line_count (buffer) / line_step);
+		do_edit (buffer, type, line * line_step);
+	}
+
+	elapsed = g_timer_elapsed (timer, NULL);
+
+	g_print ("%-20s %8.2f µs per keystroke\n",
+		 name,
+		 elapsed * 1000000.0 / N_KEYSTROKES);
+
+	g_timer_destroy (timer);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+	GtkTextBuffer *buffer;
+	GtefIndentationFolding *folding;
+	GtefFoldRegionManager *manager;
+	gchar *text;
+	GTimer *timer;
+	gdouble computation_time;
+	gdouble baseline_time;
+	guint i;
+
+	gtk_init (&argc, &argv);
+
+	buffer = gtk_text_buffer_new (NULL);
+	text = create_text ();
+	gtk_text_buffer_set_text (buffer, text, -1);
+	g_free (text);
+
+	timer = g_timer_new ();
+
+	/* The baseline, without the fold regions. */
+	for (i = 0; i < N_KEYSTROKES; i++)
+	{
+		do_edit (buffer, EDIT_INSERT_CHAR, g_random_int_range (0, N_LINES));
+	}
+	baseline_time = g_timer_elapsed (timer, NULL);
+
+	g_timer_start (timer);
+	folding = gtef_indentation_folding_new (buffer);
+	wait_computation (folding);
+	computation_time = g_timer_elapsed (timer, NULL);
+
+	manager = gtef_fold_region_manager_get_from_buffer (buffer);
+
+	g_print ("%u lines, %u fold regions\n",
+		 gtk_text_buffer_get_line_count (buffer),
+		 gtef_fold_region_manager_get_n_regions (manager));
+
+	/* Includes the delay before starting the computation. */
+	g_print ("Initial computation: %.2f ms\n", computation_time * 1000.0);
+
+	g_print ("%-20s %8.2f µs per keystroke\n",
+		 "No folding",
+		 baseline_time * 1000000.0 / N_KEYSTROKES);
+
+	test_edits (buffer, EDIT_INSERT_CHAR, 1, "Insert char");
+	test_edits (buffer, EDIT_INSERT_NEWLINE, 1, "Insert new line");
+	test_edits (buffer, EDIT_DELETE_CHAR, 1, "Delete char");
+	test_edits (buffer, EDIT_CHANGE_INDENTATION, 1, "Change indentation");
+
+	g_assert (!gtef_indentation_folding_get_computing (folding));
+
+	text = create_text_with_large_regions ();
+	gtk_text_buffer_set_text (buffer, text, -1);
+	g_free (text);
+	wait_computation (folding);
+
+	g_print ("\nRegions of %u lines, edits at their first line:\n",
+		 LARGE_REGION_SIZE);
+
+	/* No new lines are inserted or deleted, so the lines stay the first
+	 * lines of the regions.
+	 */
+	test_edits (buffer, EDIT_INSERT_CHAR, LARGE_REGION_SIZE, "Insert char");
+	test_edits (buffer, EDIT_DELETE_CHAR, LARGE_REGION_SIZE, "Delete char");
+
+	g_assert (!gtef_indentation_folding_get_computing (folding));
+
+	g_timer_destroy (timer);
+	g_object_unref (folding);
+	g_object_unref (buffer);
+
+	return 0;
+}
@@ -0,0 +1,183 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Performance tests for the metadata manager, for several numbers of
+ * locations. Prints the time to open the store (i.e. the first access), to
+ * save one change, and to import the old XML format.
+ */
+
+#include <gtef/gtef.h>
+#include <glib/gstdio.h>
+
+static gchar *
+get_uri (guint i)
+{
+	return g_strdup_printf ("file:///home/user/gtef-test-metadata-manager/file-%u.txt", i);
+}
+
+static void
+set_metadata (guint        i,
+	      const gchar *value)
+{
+	gchar *uri;
+	GFile *location;
+	GFileInfo *info;
+
+	uri = get_uri (i);
+	location = g_file_new_for_uri (uri);
+
+	info = g_file_info_new ();
+	g_file_info_set_attribute_string (info, "metadata::gtef-position", value);
+	g_file_info_set_attribute_string (info, "metadata::gtef-encoding", "UTF-8");
+	g_file_info_set_attribute_string (info, "metadata::gtef-language", "c");
+
+	_gtef_metadata_manager_set_metadata_for_location (location, info);
+
+	g_object_unref (info);
+	g_object_unref (location);
+	g_free (uri);
+}
+
+static void
+open_store (const gchar *path,
+	    guint        n_locations)
+{
+	GFile *location;
+	GFileInfo *info;
+
+	gtef_metadata_manager_init (path);
+	gtef_metadata_manager_set_max_number_of_locations (n_locations);
+
+	/* The store is loaded on the first access. */
+	location = g_file_new_for_uri ("file:///gtef-test-not-in-store");
+	info = _gtef_metadata_manager_get_all_metadata_for_location (location);
+	g_assert (info == NULL);
+	g_object_unref (location);
+}
+
+static void
+create_xml_store (const gchar *path,
+		  guint        n_locations)
+{
+	GString *contents;
+	GError *error = NULL;
+	guint i;
+
+	contents = g_string_new ("<?xml version=\"1.0\"?>\n<metadata>\n");
+
+	for (i = 0; i < n_locations; i++)
+	{
+		gchar *uri;
+
+		uri = get_uri (i);
+		g_string_append_printf (contents,
+					"  <document uri=\"%s\" atime=\"%u\">\n"
+					"    <entry key=\"gtef-position\" value=\"%u\"/>\n"
+					"    <entry key=\"gtef-encoding\" value=\"UTF-8\"/>\n"
+					"    <entry key=\"gtef-language\" value=\"c\"/>\n"
+					"  </document>\n",
+					uri, i, i);
+		g_free (uri);
+	}
+
+	g_string_append (contents, "</metadata>\n");
+
+	g_file_set_contents (path, contents->str, contents->len, &error);
+	g_assert_no_error (error);
+
+	g_string_free (contents, TRUE);
+}
+
+static void
+test_n_locations (const gchar *path,
+		  guint        n_locations)
+{
+	GTimer *timer;
+	gdouble fill_time;
+	gdouble open_time;
+	gdouble save_time;
+	gdouble import_time;
+	guint i;
+
+	timer = g_timer_new ();
+
+	/* Fill the store. */
+	g_unlink (path);
+	open_store (path, n_locations);
+
+	g_timer_start (timer);
+	for (i = 0; i < n_locations; i++)
+	{
+		set_metadata (i, "0");
+	}
+	gtef_metadata_manager_shutdown ();
+	fill_time = g_timer_elapsed (timer, NULL);
+
+	/* Open. */
+	g_timer_start (timer);
+	open_store (path, n_locations);
+	open_time = g_timer_elapsed (timer, NULL);
+
+	/* Save one change. */
+	g_timer_start (timer);
+	set_metadata (n_locations / 2, "42");
+	gtef_metadata_manager_shutdown ();
+	save_time = g_timer_elapsed (timer, NULL);
+
+	/* Import the XML format. */
+	create_xml_store (path, n_locations);
+
+	g_timer_start (timer);
+	open_store (path, n_locations);
+	gtef_metadata_manager_shutdown ();
+	import_time = g_timer_elapsed (timer, NULL);
+
+	g_print ("%5u locations: fill %8.2f ms, open %7.2f ms, "
+		 "save one change %6.2f ms, import XML %8.2f ms\n",
+		 n_locations,
+		 fill_time * 1000.0,
+		 open_time * 1000.0,
+		 save_time * 1000.0,
+		 import_time * 1000.0);
+
+	g_timer_destroy (timer);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+	const guint n_locations[] = { 50, 1000, 10000 };
+	gchar *path;
+	guint i;
+
+	gtk_init (&argc, &argv);
+
+	path = g_build_filename (g_get_tmp_dir (), "gtef-test-metadata-manager-performance", NULL);
+
+	for (i = 0; i < G_N_ELEMENTS (n_locations); i++)
+	{
+		test_n_locations (path, n_locations[i]);
+	}
+
+	g_unlink (path);
+	g_free (path);
+
+	return 0;
+}
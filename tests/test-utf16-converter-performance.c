@@ -0,0 +1,175 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Compares GtefUtf16Converter with GCharsetConverter, for the conversion from
+ * UTF-8 to UTF-16 done by GtefFileSaver. The content is passed to
+ * g_converter_convert() by chunks, like GConverterOutputStream does.
+ */
+
+#include <gtef/gtef.h>
+#include <string.h>
+#include "gtef/gtef-utf16-converter.h"
+
+#define CONTENT_SIZE (16 * 1024 * 1024)
+#define CHUNK_SIZE (64 * 1024)
+#define OUTBUF_SIZE (1024 * 1024)
+#define N_ITERATIONS 5
+
+static gchar *
+create_content (const gchar *utf8_line,
+		gsize       *length)
+{
+	GString *content;
+
+	content = g_string_sized_new (CONTENT_SIZE + strlen (utf8_line));
+
+	while (content->len < CONTENT_SIZE)
+	{
+		g_string_append (content, utf8_line);
+	}
+
+	*length = content->len;
+	return g_string_free (content, FALSE);
+}
+
+static gsize
+convert (GConverter  *converter,
+	 const gchar *content,
+	 gsize        length)
+{
+	gchar *outbuf;
+	gsize offset = 0;
+	gsize n_bytes_written = 0;
+
+	outbuf = g_malloc (OUTBUF_SIZE);
+
+	while (offset < length)
+	{
+		gsize chunk_size = MIN (CHUNK_SIZE, length - offset);
+		GConverterFlags flags = G_CONVERTER_NO_FLAGS;
+		gsize bytes_read;
+		gsize bytes_written;
+		GError *error = NULL;
+
+		if (offset + chunk_size == length)
+		{
+			flags = G_CONVERTER_INPUT_AT_END;
+		}
+
+		g_converter_convert (converter,
+				     content + offset,
+				     chunk_size,
+				     outbuf,
+				     OUTBUF_SIZE,
+				     flags,
+				     &bytes_read,
+				     &bytes_written,
+				     &error);
+		g_assert_no_error (error);
+
+		offset += bytes_read;
+		n_bytes_written += bytes_written;
+	}
+
+	g_free (outbuf);
+
+	return n_bytes_written;
+}
+
+static void
+test_charset (const gchar *charset,
+	      const gchar *utf8_line)
+{
+	gchar *content;
+	gsize length;
+	gboolean big_endian;
+	gboolean with_bom;
+	GTimer *timer;
+	gdouble charset_converter_time;
+	gdouble utf16_converter_time;
+	gsize charset_converter_length = 0;
+	gsize utf16_converter_length = 0;
+	gint i;
+
+	content = create_content (utf8_line, &length);
+	g_assert (_gtef_utf16_charset_get_byte_order (charset, &big_endian, &with_bom));
+
+	timer = g_timer_new ();
+
+	for (i = 0; i < N_ITERATIONS; i++)
+	{
+		GCharsetConverter *converter;
+
+		converter = g_charset_converter_new (charset, "UTF-8", NULL);
+		charset_converter_length = convert (G_CONVERTER (converter), content, length);
+		g_object_unref (converter);
+	}
+
+	charset_converter_time = g_timer_elapsed (timer, NULL);
+	g_timer_start (timer);
+
+	for (i = 0; i < N_ITERATIONS; i++)
+	{
+		GtefUtf16Converter *converter;
+
+		converter = _gtef_utf16_converter_new (big_endian, with_bom);
+		utf16_converter_length = convert (G_CONVERTER (converter), content, length);
+		g_object_unref (converter);
+	}
+
+	utf16_converter_time = g_timer_elapsed (timer, NULL);
+
+	g_assert_cmpuint (charset_converter_length, ==, utf16_converter_length);
+
+	g_print ("%-9s GCharsetConverter: %8.1f MB/s, GtefUtf16Converter: %8.1f MB/s\n",
+		 charset,
+		 length * N_ITERATIONS / charset_converter_time / (1000 * 1000),
+		 length * N_ITERATIONS / utf16_converter_time / (1000 * 1000));
+
+	g_timer_destroy (timer);
+	g_free (content);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+	const gchar *ascii = "Lorem ipsum dolor sit amet, consectetur adipiscing elit.\n";
+	const gchar *french = "Portez ce vieux whisky au juge blond qui fume, à l'été.\n";
+	const gchar *russian = "Съешь же ещё этих мягких французских булок, да выпей чаю.\n";
+	const gchar *chinese = "我能吞下玻璃而不伤身体。\n";
+	const gchar *emoji = "Emoji outside the BMP: 😀 🚀 🎉\n";
+
+	gtk_init (&argc, &argv);
+
+	g_print ("ASCII content:\n");
+	test_charset ("UTF-16", ascii);
+	test_charset ("UTF-16LE", ascii);
+	test_charset ("UTF-16BE", ascii);
+
+	g_print ("Mostly ASCII content:\n");
+	test_charset ("UTF-16LE", french);
+	test_charset ("UTF-16LE", emoji);
+
+	g_print ("Mostly non-ASCII content:\n");
+	test_charset ("UTF-16LE", russian);
+	test_charset ("UTF-16BE", chinese);
+
+	return 0;
+}
@@ -0,0 +1,97 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Compares _gtef_utils_utf8_validate() with g_utf8_validate(). */
+
+#include <gtef/gtef.h>
+#include <string.h>
+
+#define CONTENT_SIZE (16 * 1024 * 1024)
+#define N_ITERATIONS 10
+
+static gchar *
+create_content (const gchar *line,
+		gsize        size)
+{
+	GString *content;
+
+	content = g_string_sized_new (size + strlen (line));
+
+	while (content->len < size)
+	{
+		g_string_append (content, line);
+	}
+
+	return g_string_free (content, FALSE);
+}
+
+static void
+test_validate (const gchar *description,
+	       const gchar *line)
+{
+	gchar *content;
+	gsize length;
+	GTimer *timer;
+	gdouble glib_time;
+	gdouble gtef_time;
+	gint i;
+
+	content = create_content (line, CONTENT_SIZE);
+	length = strlen (content);
+
+	timer = g_timer_new ();
+
+	for (i = 0; i < N_ITERATIONS; i++)
+	{
+		g_assert_true (g_utf8_validate (content, length, NULL));
+	}
+
+	glib_time = g_timer_elapsed (timer, NULL);
+	g_timer_start (timer);
+
+	for (i = 0; i < N_ITERATIONS; i++)
+	{
+		g_assert_true (_gtef_utils_utf8_validate (content, length, NULL, NULL));
+	}
+
+	gtef_time = g_timer_elapsed (timer, NULL);
+
+	g_print ("%-10s g_utf8_validate(): %8.1f MB/s, "
+		 "_gtef_utils_utf8_validate(): %8.1f MB/s\n",
+		 description,
+		 length * N_ITERATIONS / glib_time / (1000 * 1000),
+		 length * N_ITERATIONS / gtef_time / (1000 * 1000));
+
+	g_timer_destroy (timer);
+	g_free (content);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+	gtk_init (&argc, &argv);
+
+	test_validate ("ASCII:", "Lorem ipsum dolor sit amet, consectetur adipiscing elit.\n");
+	test_validate ("Latin:", "Portez ce vieux whisky au juge blond qui fume, à l’été.\n");
+	test_validate ("Greek:", "Ξεσκεπάζω την ψυχοφθόρα βδελυγμία.\n");
+	test_validate ("CJK:", "いろはにほへと ちりぬるを わかよたれそ つねならむ\n");
+
+	return 0;
+}
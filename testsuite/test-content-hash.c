@@ -0,0 +1,113 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <glib.h>
+#include "gtef/gtef-content-hash.h"
+
+static void
+check_hash (const gchar *content,
+	    const gchar *expected_hash)
+{
+	gsize length;
+	gsize split;
+	gchar *hash_str;
+
+	length = strlen (content);
+
+	hash_str = _gtef_content_hash_compute_for_data (content, length);
+	g_assert_cmpstr (hash_str, ==, expected_hash);
+	g_free (hash_str);
+
+	/* The chunk boundaries must not matter. */
+	for (split = 1; split <= 40; split++)
+	{
+		GtefContentHash *hash;
+		gsize offset;
+
+		hash = _gtef_content_hash_new ();
+
+		for (offset = 0; offset < length; offset += split)
+		{
+			_gtef_content_hash_update (hash, content + offset, MIN (split, length - offset));
+		}
+
+		hash_str = _gtef_content_hash_get_string (hash);
+		g_assert_cmpstr (hash_str, ==, expected_hash);
+		g_free (hash_str);
+
+		_gtef_content_hash_free (hash);
+	}
+}
+
+/* The expected values are the ones of the reference XXH64 implementation. */
+static void
+test_xxh64 (void)
+{
+	GString *content;
+	gint i;
+
+	check_hash ("", "ef46db3751d8e999");
+	check_hash ("a", "d24ec4f1a98c6e5b");
+	check_hash ("abc", "44bc2cf5ad770999");
+
+	/* Several stripes, and a rest of each size. */
+	content = g_string_new (NULL);
+	for (i = 0; i < 100; i++)
+	{
+		g_string_append_printf (content, "line %d\n", i);
+	}
+
+	check_hash (content->str, "3685b69d191fd0f8");
+	g_string_free (content, TRUE);
+}
+
+static void
+test_get_string_not_closing (void)
+{
+	GtefContentHash *hash;
+	gchar *hash_str;
+
+	hash = _gtef_content_hash_new ();
+	_gtef_content_hash_update (hash, "a", 1);
+
+	hash_str = _gtef_content_hash_get_string (hash);
+	g_assert_cmpstr (hash_str, ==, "d24ec4f1a98c6e5b");
+	g_free (hash_str);
+
+	_gtef_content_hash_update (hash, "bc", 2);
+
+	hash_str = _gtef_content_hash_get_string (hash);
+	g_assert_cmpstr (hash_str, ==, "44bc2cf5ad770999");
+	g_free (hash_str);
+
+	_gtef_content_hash_free (hash);
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/content-hash/xxh64", test_xxh64);
+	g_test_add_func ("/content-hash/get-string-not-closing", test_get_string_not_closing);
+
+	return g_test_run ();
+}
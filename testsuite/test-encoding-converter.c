@@ -17,7 +17,10 @@
  * along with this library; if not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <string.h>
+#include <gtef/gtef.h>
 #include "gtef/gtef-encoding-converter.h"
+#include "gtef/gtef-encoding-private.h"
 #include <gio/gio.h> /* For G_IO_ERROR */
 
 static void
@@ -299,6 +302,430 @@ test_invalid_sequence (void)
 	g_object_unref (converter);
 }
 
+static void
+invalid_sequence_cb (const gchar *bytes,
+		     gsize        length,
+		     gpointer     user_data)
+{
+	GQueue *received_output = user_data;
+	GString *str;
+	gsize i;
+
+	str = g_string_new ("<");
+	for (i = 0; i < length; i++)
+	{
+		g_string_append_printf (str, "%02X", (guint8) bytes[i]);
+	}
+	g_string_append_c (str, '>');
+
+	g_queue_push_tail (received_output, g_string_free (str, FALSE));
+}
+
+static void
+test_invalid_sequence_callback (void)
+{
+	GtefEncodingConverter *converter;
+	GQueue *received_output;
+	GQueue *expected_output;
+	GError *error = NULL;
+
+	received_output = g_queue_new ();
+	expected_output = g_queue_new ();
+
+	converter = _gtef_encoding_converter_new (-1);
+	_gtef_encoding_converter_set_callback (converter, converter_cb, received_output);
+	_gtef_encoding_converter_set_invalid_sequence_callback (converter,
+								invalid_sequence_cb,
+								received_output);
+
+	_gtef_encoding_converter_open (converter, "UTF-8", "UTF-8", &error);
+	g_assert_no_error (error);
+
+	/* The output before the invalid byte is flushed first. */
+	_gtef_encoding_converter_feed (converter, "Hello S\251bastien", -1, &error);
+	g_assert_no_error (error);
+
+	/* Ends with the start of a two-byte character. */
+	_gtef_encoding_converter_feed (converter, ".\303", -1, &error);
+	g_assert_no_error (error);
+
+	_gtef_encoding_converter_close (converter, &error);
+	g_assert_no_error (error);
+
+	g_queue_push_tail (expected_output, g_strdup ("Hello S"));
+	g_queue_push_tail (expected_output, g_strdup ("<A9>"));
+	g_queue_push_tail (expected_output, g_strdup ("bastien."));
+	g_queue_push_tail (expected_output, g_strdup ("<C3>"));
+
+	compare_outputs (received_output, expected_output);
+
+	g_queue_free_full (received_output, g_free);
+	g_queue_free_full (expected_output, g_free);
+	g_object_unref (converter);
+}
+
+static void
+append_cb (const gchar *str,
+	   gsize        length,
+	   gpointer     user_data)
+{
+	GString *received = user_data;
+
+	g_string_append_len (received, str, length);
+}
+
+static void
+append_invalid_cb (const gchar *bytes,
+		   gsize        length,
+		   gpointer     user_data)
+{
+	GString *received = user_data;
+	gsize i;
+
+	for (i = 0; i < length; i++)
+	{
+		g_string_append_printf (received, "<%02X>", (guint8) bytes[i]);
+	}
+}
+
+/* The single-byte charsets are converted without iconv, the result must be the
+ * same as g_convert().
+ */
+static void
+check_single_byte_charset (const gchar *charset)
+{
+	GtefEncodingConverter *converter;
+	GString *received;
+	GString *expected;
+	gchar all_bytes[256];
+	guint byte;
+	GError *error = NULL;
+
+	for (byte = 0; byte < 256; byte++)
+	{
+		all_bytes[byte] = (gchar) byte;
+	}
+
+	expected = g_string_new (NULL);
+
+	for (byte = 0; byte < 256; byte++)
+	{
+		gchar *utf8;
+		gsize bytes_written;
+
+		utf8 = g_convert (all_bytes + byte, 1, "UTF-8", charset, NULL, &bytes_written, NULL);
+
+		if (utf8 != NULL)
+		{
+			g_string_append_len (expected, utf8, bytes_written);
+		}
+		else
+		{
+			g_string_append_printf (expected, "<%02X>", byte);
+		}
+
+		g_free (utf8);
+	}
+
+	/* A small buffer, to flush in the middle of the characters. */
+	converter = _gtef_encoding_converter_new (5);
+
+	received = g_string_new (NULL);
+	_gtef_encoding_converter_set_callback (converter, append_cb, received);
+	_gtef_encoding_converter_set_invalid_sequence_callback (converter, append_invalid_cb, received);
+
+	_gtef_encoding_converter_open (converter, "UTF-8", charset, &error);
+	g_assert_no_error (error);
+
+	/* In two chunks, and ASCII runs longer than a SIMD block. */
+	_gtef_encoding_converter_feed (converter, all_bytes, 100, &error);
+	g_assert_no_error (error);
+	_gtef_encoding_converter_feed (converter, all_bytes + 100, 156, &error);
+	g_assert_no_error (error);
+
+	_gtef_encoding_converter_close (converter, &error);
+	g_assert_no_error (error);
+
+	g_assert_cmpuint (received->len, ==, expected->len);
+	g_assert (memcmp (received->str, expected->str, expected->len) == 0);
+
+	g_string_free (received, TRUE);
+	g_string_free (expected, TRUE);
+	g_object_unref (converter);
+}
+
+static void
+test_single_byte_charsets (void)
+{
+	GSList *encodings;
+	GSList *l;
+	guint n_charsets = 0;
+
+	encodings = gtef_encoding_get_all ();
+
+	for (l = encodings; l != NULL; l = l->next)
+	{
+		const gchar *charset = gtef_encoding_get_charset (l->data);
+
+		if (_gtef_encoding_charset_is_single_byte (charset))
+		{
+			check_single_byte_charset (charset);
+			n_charsets++;
+		}
+	}
+
+	g_assert_cmpuint (n_charsets, >, 0);
+
+	g_slist_free_full (encodings, (GDestroyNotify) gtef_encoding_free);
+}
+
+static gchar *
+convert_utf16 (const gchar *content,
+	       gsize        length,
+	       const gchar *charset,
+	       gsize        chunk_size)
+{
+	GtefEncodingConverter *converter;
+	GString *received;
+	gsize offset;
+	GError *error = NULL;
+
+	/* The smallest buffer for which the UTF-16 decoder is used. */
+	converter = _gtef_encoding_converter_new (5);
+
+	received = g_string_new (NULL);
+	_gtef_encoding_converter_set_callback (converter, append_cb, received);
+	_gtef_encoding_converter_set_invalid_sequence_callback (converter, append_invalid_cb, received);
+
+	_gtef_encoding_converter_open (converter, "UTF-8", charset, &error);
+	g_assert_no_error (error);
+
+	for (offset = 0; offset < length; offset += chunk_size)
+	{
+		_gtef_encoding_converter_feed (converter,
+					       content + offset,
+					       MIN (chunk_size, length - offset),
+					       &error);
+		g_assert_no_error (error);
+	}
+
+	_gtef_encoding_converter_close (converter, &error);
+	g_assert_no_error (error);
+
+	g_object_unref (converter);
+	return g_string_free (received, FALSE);
+}
+
+/* The surrogate pairs and the BOM are split between chunks. */
+static void
+check_utf16 (const gchar *content,
+	     gsize        length,
+	     const gchar *charset,
+	     const gchar *expected)
+{
+	gsize chunk_size;
+
+	for (chunk_size = 1; chunk_size <= length; chunk_size++)
+	{
+		gchar *received;
+
+		received = convert_utf16 (content, length, charset, chunk_size);
+		g_assert_cmpstr (received, ==, expected);
+		g_free (received);
+	}
+}
+
+static void
+test_utf16 (void)
+{
+	const gchar *utf8 = "Hello Sébastien, 中文 \360\237\230\200 and more ASCII text.";
+	const gchar *charsets[] = { "UTF-16LE", "UTF-16BE", "UTF-16" };
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (charsets); i++)
+	{
+		gchar *content;
+		gsize length;
+		GError *error = NULL;
+
+		content = g_convert (utf8, -1, charsets[i], "UTF-8", NULL, &length, &error);
+		g_assert_no_error (error);
+
+		check_utf16 (content, length, charsets[i], utf8);
+
+		g_free (content);
+	}
+
+	/* A BOM in the other byte order than the host. */
+	check_utf16 ("\377\376a\0b\0", 6, "UTF-16", "ab");
+	check_utf16 ("\376\377\0a\0b", 6, "UTF-16", "ab");
+
+	/* Without BOM, in the byte order of the host. */
+	check_utf16 (G_BYTE_ORDER == G_BIG_ENDIAN ? "\0a\0b" : "a\0b\0", 4, "UTF-16", "ab");
+
+	/* The BOM is a normal character for UTF-16LE. */
+	check_utf16 ("\377\376a\0", 4, "UTF-16LE", "\357\273\277a");
+
+	/* A lone high surrogate, a lone low surrogate, and an odd number of
+	 * bytes at the end.
+	 */
+	check_utf16 ("a\0\1\330b\0", 6, "UTF-16LE", "a<01><D8>b");
+	check_utf16 ("a\0\1\334b\0", 6, "UTF-16LE", "a<01><DC>b");
+	check_utf16 ("a\0\1\330", 4, "UTF-16LE", "a<01><D8>");
+	check_utf16 ("a\0b", 3, "UTF-16LE", "a<62>");
+}
+
+static gchar *
+convert_with_converter (GtefEncodingConverter *converter,
+			const gchar           *charset,
+			const gchar           *content,
+			gboolean               complete)
+{
+	GString *received;
+	GError *error = NULL;
+
+	received = g_string_new (NULL);
+	_gtef_encoding_converter_set_callback (converter, append_cb, received);
+
+	_gtef_encoding_converter_open (converter, "UTF-8", charset, &error);
+	g_assert_no_error (error);
+
+	_gtef_encoding_converter_feed (converter, content, -1, &error);
+	g_assert_no_error (error);
+
+	_gtef_encoding_converter_close (converter, &error);
+
+	if (complete)
+	{
+		g_assert_no_error (error);
+	}
+	else
+	{
+		g_assert_error (error, G_CONVERT_ERROR, G_CONVERT_ERROR_PARTIAL_INPUT);
+		g_clear_error (&error);
+	}
+
+	return g_string_free (received, FALSE);
+}
+
+static void
+test_pool (void)
+{
+	GtefEncodingConverter *converters[10];
+	gint64 buffer_size;
+	guint n_convs;
+	gint64 outbufs_size;
+	gchar *received;
+	guint i;
+
+	_gtef_encoding_converter_clear_pool ();
+	_gtef_encoding_converter_get_pool_size (&n_convs, &outbufs_size);
+	g_assert_cmpuint (n_convs, ==, 0);
+	g_assert_cmpint (outbufs_size, ==, 0);
+
+	converters[0] = _gtef_encoding_converter_new (-1);
+	buffer_size = _gtef_encoding_converter_get_buffer_size (converters[0]);
+
+	/* Stops in the two-byte mode of ISO-2022-JP, in the middle of a
+	 * character.
+	 */
+	received = convert_with_converter (converters[0], "ISO-2022-JP", "\033$BF|K", FALSE);
+	g_assert_cmpstr (received, ==, "\346\227\245");
+	g_free (received);
+
+	_gtef_encoding_converter_get_pool_size (&n_convs, &outbufs_size);
+	g_assert_cmpuint (n_convs, ==, 1);
+	g_assert_cmpint (outbufs_size, ==, buffer_size);
+
+	/* The iconv descriptor from the pool is in its initial state. */
+	received = convert_with_converter (converters[0], "iso-2022-jp", "abc", TRUE);
+	g_assert_cmpstr (received, ==, "abc");
+	g_free (received);
+
+	_gtef_encoding_converter_get_pool_size (&n_convs, &outbufs_size);
+	g_assert_cmpuint (n_convs, ==, 1);
+	g_assert_cmpint (outbufs_size, ==, buffer_size);
+
+	g_object_unref (converters[0]);
+
+	/* The idle memory is limited. */
+	for (i = 0; i < G_N_ELEMENTS (converters); i++)
+	{
+		GError *error = NULL;
+
+		converters[i] = _gtef_encoding_converter_new (-1);
+		_gtef_encoding_converter_open (converters[i], "UTF-8", "ISO-2022-JP", &error);
+		g_assert_no_error (error);
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (converters); i++)
+	{
+		GError *error = NULL;
+
+		_gtef_encoding_converter_close (converters[i], &error);
+		g_assert_no_error (error);
+		g_object_unref (converters[i]);
+	}
+
+	_gtef_encoding_converter_get_pool_size (&n_convs, &outbufs_size);
+	g_assert_cmpuint (n_convs, >, 0);
+	g_assert_cmpuint (n_convs, <, G_N_ELEMENTS (converters));
+	g_assert_cmpint (outbufs_size, >=, buffer_size);
+	g_assert_cmpint (outbufs_size, <, G_N_ELEMENTS (converters) * buffer_size);
+
+	_gtef_encoding_converter_clear_pool ();
+	_gtef_encoding_converter_get_pool_size (&n_convs, &outbufs_size);
+	g_assert_cmpuint (n_convs, ==, 0);
+	g_assert_cmpint (outbufs_size, ==, 0);
+}
+
+/* A character split in every possible way, with an iconv conversion. */
+static void
+test_carry (void)
+{
+	const gchar *utf8 = "Hello S\303\251bastien, \344\270\255\346\226\207 \360\237\230\200.";
+	gchar *gb18030;
+	gsize length;
+	gsize chunk_size;
+	GError *error = NULL;
+
+	gb18030 = g_convert (utf8, -1, "GB18030", "UTF-8", NULL, &length, &error);
+	g_assert_no_error (error);
+
+	for (chunk_size = 1; chunk_size <= length; chunk_size++)
+	{
+		GtefEncodingConverter *converter;
+		GString *received;
+		gsize offset;
+
+		converter = _gtef_encoding_converter_new (-1);
+		received = g_string_new (NULL);
+		_gtef_encoding_converter_set_callback (converter, append_cb, received);
+
+		_gtef_encoding_converter_open (converter, "UTF-8", "GB18030", &error);
+		g_assert_no_error (error);
+
+		for (offset = 0; offset < length; offset += chunk_size)
+		{
+			_gtef_encoding_converter_feed (converter,
+						       gb18030 + offset,
+						       MIN (chunk_size, length - offset),
+						       &error);
+			g_assert_no_error (error);
+		}
+
+		_gtef_encoding_converter_close (converter, &error);
+		g_assert_no_error (error);
+
+		g_assert_cmpstr (received->str, ==, utf8);
+
+		g_string_free (received, TRUE);
+		g_object_unref (converter);
+	}
+
+	g_free (gb18030);
+}
+
 static void
 test_end_with_incomplete_input (void)
 {
@@ -321,6 +748,43 @@ test_end_with_incomplete_input (void)
 	g_object_unref (converter);
 }
 
+/* The incomplete character is kept by a flush, and completed by the next
+ * chunk.
+ */
+static void
+test_flush (void)
+{
+	GtefEncodingConverter *converter;
+	GString *received;
+	GError *error = NULL;
+
+	converter = _gtef_encoding_converter_new (-1);
+	received = g_string_new (NULL);
+	_gtef_encoding_converter_set_callback (converter, append_cb, received);
+
+	_gtef_encoding_converter_open (converter, "UTF-8", "UTF-8", &error);
+	g_assert_no_error (error);
+
+	_gtef_encoding_converter_feed (converter, "S\303", -1, &error);
+	g_assert_no_error (error);
+
+	_gtef_encoding_converter_flush (converter);
+	g_assert_cmpstr (received->str, ==, "S");
+
+	_gtef_encoding_converter_feed (converter, "\251bastien", -1, &error);
+	g_assert_no_error (error);
+
+	_gtef_encoding_converter_flush (converter);
+	g_assert_cmpstr (received->str, ==, "S\303\251bastien");
+
+	_gtef_encoding_converter_close (converter, &error);
+	g_assert_no_error (error);
+	g_assert_cmpstr (received->str, ==, "S\303\251bastien");
+
+	g_string_free (received, TRUE);
+	g_object_unref (converter);
+}
+
 gint
 main (gint   argc,
       gchar *argv[])
@@ -332,7 +796,13 @@ main (gint   argc,
 	g_test_add_func ("/encoding-converter/buffer-full", test_buffer_full);
 	g_test_add_func ("/encoding-converter/incomplete-input", test_incomplete_input);
 	g_test_add_func ("/encoding-converter/invalid-sequence", test_invalid_sequence);
+	g_test_add_func ("/encoding-converter/invalid-sequence-callback", test_invalid_sequence_callback);
 	g_test_add_func ("/encoding-converter/end-with-incomplete-input", test_end_with_incomplete_input);
+	g_test_add_func ("/encoding-converter/single-byte-charsets", test_single_byte_charsets);
+	g_test_add_func ("/encoding-converter/UTF-16", test_utf16);
+	g_test_add_func ("/encoding-converter/pool", test_pool);
+	g_test_add_func ("/encoding-converter/carry", test_carry);
+	g_test_add_func ("/encoding-converter/flush", test_flush);
 
 	return g_test_run ();
 }
@@ -20,6 +20,7 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <gtef/gtef.h>
+#include "gtef/gtef-file-content-loader.h"
 
 #define DEFAULT_CONTENTS "My shiny content!"
 #define MAX_SIZE 10000
@@ -406,6 +407,102 @@ test_split_cr_lf (void)
 	g_free (content);
 }
 
+typedef struct
+{
+	gsize chunk_size;
+	guint n_chunks;
+} ChunkCount;
+
+static gboolean
+count_chunks_cb (GBytes   *chunk,
+		 gpointer  user_data,
+		 GError  **error)
+{
+	ChunkCount *count = user_data;
+
+	g_assert_cmpuint (g_bytes_get_size (chunk), <=, count->chunk_size);
+	count->n_chunks++;
+
+	return TRUE;
+}
+
+static void
+load_content_cb (GObject      *source_object,
+		 GAsyncResult *result,
+		 gpointer      user_data)
+{
+	GtefFileContentLoader *content_loader = GTEF_FILE_CONTENT_LOADER (source_object);
+	GError *error = NULL;
+
+	_gtef_file_content_loader_load_finish (content_loader, result, &error);
+	g_assert_no_error (error);
+
+	gtk_main_quit ();
+}
+
+static void
+check_chunk_size (GFile    *location,
+		  gboolean  use_mmap,
+		  gsize     chunk_size,
+		  guint     expected_n_chunks)
+{
+	GtefFileContentLoader *content_loader;
+	ChunkCount count = { chunk_size, 0 };
+
+	content_loader = _gtef_file_content_loader_new_from_file (location);
+	_gtef_file_content_loader_set_use_mmap (content_loader, use_mmap);
+	_gtef_file_content_loader_set_chunk_size (content_loader, chunk_size);
+	_gtef_file_content_loader_set_chunk_callback (content_loader, count_chunks_cb, &count);
+
+	_gtef_file_content_loader_load_async (content_loader,
+					      G_PRIORITY_DEFAULT,
+					      NULL,
+					      NULL, NULL, NULL,
+					      load_content_cb,
+					      NULL);
+
+	gtk_main ();
+
+	g_assert_cmpuint (count.n_chunks, ==, expected_n_chunks);
+	g_object_unref (content_loader);
+}
+
+/* The chunk size is honoured for the memory-mapped local files too, even if
+ * it is explicitly set to the default value.
+ */
+static void
+test_chunk_size (void)
+{
+	gchar *path;
+	GFile *location;
+	gchar *content;
+	gsize content_size;
+	GError *error = NULL;
+
+	path = g_build_filename (g_get_tmp_dir (), "gtef-test-file-loader", NULL);
+	g_file_set_contents (path, "0123456789", -1, &error);
+	g_assert_no_error (error);
+	location = g_file_new_for_path (path);
+
+	check_chunk_size (location, TRUE, 4, 3);
+	check_chunk_size (location, FALSE, 4, 3);
+
+	content_size = 3 * GTEF_FILE_CONTENT_LOADER_DEFAULT_CHUNK_SIZE + 1;
+	content = g_malloc (content_size);
+	memset (content, 'a', content_size);
+	g_file_set_contents (path, content, content_size, &error);
+	g_assert_no_error (error);
+	g_free (content);
+
+	check_chunk_size (location, TRUE, GTEF_FILE_CONTENT_LOADER_DEFAULT_CHUNK_SIZE, 4);
+
+	g_file_delete (location, NULL, &error);
+	g_assert_no_error (error);
+
+	g_free (path);
+	g_object_unref (location);
+}
+
 static void
 test_loader_max_size (const gchar *contents,
 		      const gchar *expected_buffer_content,
@@ -482,6 +579,702 @@ test_encoding (void)
 		     -1);
 }
 
+static void
+encoding_detection_cb (GObject      *source_object,
+		       GAsyncResult *result,
+		       gpointer      user_data)
+{
+	GtefFileLoader *loader = GTEF_FILE_LOADER (source_object);
+	GError **error = user_data;
+
+	gtef_file_loader_load_finish (loader, result, error);
+
+	gtk_main_quit ();
+}
+
+/* @expected_charset is %NULL if the content is binary. */
+static void
+check_encoding_detection (const gchar                 *contents,
+			  gssize                       length,
+			  const gchar                 *expected_buffer_content,
+			  const gchar                 *expected_charset,
+			  GtefEncodingDetectionMethod  expected_method)
+{
+	GtefBuffer *buffer;
+	GtefFile *file;
+	GtefFileLoader *loader;
+	gchar *path;
+	GFile *location;
+	GtkTextIter start;
+	GtkTextIter end;
+	gchar *buffer_contents;
+	GError *error = NULL;
+
+	path = g_build_filename (g_get_tmp_dir (), "gtef-test-file-loader", NULL);
+	g_file_set_contents (path, contents, length, &error);
+	g_assert_no_error (error);
+	location = g_file_new_for_path (path);
+
+	buffer = gtef_buffer_new ();
+	gtk_source_buffer_set_implicit_trailing_newline (GTK_SOURCE_BUFFER (buffer), FALSE);
+	file = gtef_buffer_get_file (buffer);
+	gtef_file_set_location (file, location);
+
+	loader = gtef_file_loader_new (buffer, file);
+	gtef_file_loader_set_chunk_size (loader, CHUNK_SIZE);
+
+	gtef_file_loader_load_async (loader,
+				     G_PRIORITY_DEFAULT,
+				     NULL,
+				     NULL, NULL, NULL,
+				     encoding_detection_cb,
+				     &error);
+
+	gtk_main ();
+
+	if (expected_charset == NULL)
+	{
+		g_assert (g_error_matches (error,
+					   GTEF_FILE_LOADER_ERROR,
+					   GTEF_FILE_LOADER_ERROR_BINARY_CONTENT));
+		g_clear_error (&error);
+	}
+	else
+	{
+		GtefEncoding *expected_encoding;
+
+		g_assert_no_error (error);
+
+		expected_encoding = gtef_encoding_new (expected_charset);
+		check_equal_encodings (gtef_file_loader_get_encoding (loader), expected_encoding);
+		gtef_encoding_free (expected_encoding);
+	}
+
+	g_assert_cmpint (gtef_file_loader_get_encoding_detection_method (loader), ==, expected_method);
+
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+	buffer_contents = gtk_text_buffer_get_text (GTK_TEXT_BUFFER (buffer), &start, &end, TRUE);
+	g_assert_cmpstr (buffer_contents, ==, expected_buffer_content);
+	g_free (buffer_contents);
+
+	g_file_delete (location, NULL, &error);
+	g_assert_no_error (error);
+
+	g_free (path);
+	g_object_unref (location);
+	g_object_unref (loader);
+	g_object_unref (buffer);
+}
+
+static void
+test_encoding_detection (void)
+{
+	gchar *binary_content;
+	gsize binary_length = 256 * 1024;
+
+	/* Byte order marks. The UTF-8 BOM is kept in the buffer, so that it is
+	 * saved back.
+	 */
+	check_encoding_detection ("\357\273\277abc\n", -1,
+				  "\357\273\277abc\n",
+				  "UTF-8",
+				  GTEF_ENCODING_DETECTION_METHOD_BOM);
+
+	check_encoding_detection ("\377\376a\0b\0\n\0", 8,
+				  "ab\n",
+				  "UTF-16",
+				  GTEF_ENCODING_DETECTION_METHOD_BOM);
+
+	check_encoding_detection ("\376\377\0a\0b\0\n", 8,
+				  "ab\n",
+				  "UTF-16",
+				  GTEF_ENCODING_DETECTION_METHOD_BOM);
+
+	/* Not UTF-16 with a nul character. */
+	check_encoding_detection ("\377\376\0\0a\0\0\0\n\0\0\0", 12,
+				  "a\n",
+				  "UTF-32",
+				  GTEF_ENCODING_DETECTION_METHOD_BOM);
+
+	/* Pure ASCII. */
+	check_encoding_detection ("abc\n", -1,
+				  "abc\n",
+				  "ASCII",
+				  GTEF_ENCODING_DETECTION_METHOD_ASCII);
+
+	check_encoding_detection ("", 0,
+				  "",
+				  "UTF-8",
+				  GTEF_ENCODING_DETECTION_METHOD_ASCII);
+
+	/* Valid UTF-8. */
+	check_encoding_detection ("STRA\341\272\236E\n", -1,
+				  "STRA\341\272\236E\n",
+				  "UTF-8",
+				  GTEF_ENCODING_DETECTION_METHOD_UTF8_VALIDATION);
+
+	/* uchardet. */
+	check_encoding_detection ("Un \351l\351phant \347a trompe \351norm\351ment.\n", -1,
+				  "Un \303\251l\303\251phant \303\247a trompe \303\251norm\303\251ment.\n",
+				  "ISO-8859-1",
+				  GTEF_ENCODING_DETECTION_METHOD_UCHARDET);
+
+	/* UTF-32 without BOM has a zero 16-bit code unit in each character. */
+	check_encoding_detection ("a\0\0\0b\0\0\0\n\0\0\0", 12,
+				  "",
+				  NULL,
+				  GTEF_ENCODING_DETECTION_METHOD_NONE);
+
+	/* Binary content: an ELF header followed by zeros. The loading is
+	 * aborted after the first chunk, nothing is inserted.
+	 */
+	binary_content = g_malloc0 (binary_length);
+	memcpy (binary_content, "\177ELF\2\1\1", 7);
+
+	check_encoding_detection (binary_content, binary_length,
+				  "",
+				  NULL,
+				  GTEF_ENCODING_DETECTION_METHOD_NONE);
+
+	g_free (binary_content);
+}
+
+/* Makes the insertion of the content slow. */
+static void
+slow_progress_cb (goffset  current_num_bytes,
+		  goffset  total_num_bytes,
+		  gpointer user_data)
+{
+	g_usleep (1000);
+}
+
+/* The content is read faster than it is consumed: the reading is paused while
+ * the raw chunks wait to be decoded, so that they don't pile up in memory.
+ */
+static void
+test_input_queue_bounded (void)
+{
+	GtefBuffer *buffer;
+	GtefFile *file;
+	GtefFileLoader *loader;
+	gchar *path;
+	GFile *location;
+	gchar *content;
+	gsize content_size = 4 * 1024 * 1024;
+	GError *error = NULL;
+
+	content = generate_content (content_size, NULL);
+
+	path = g_build_filename (g_get_tmp_dir (), "gtef-test-file-loader", NULL);
+	g_file_set_contents (path, content, content_size, &error);
+	g_assert_no_error (error);
+	location = g_file_new_for_path (path);
+
+	buffer = gtef_buffer_new ();
+	gtk_source_buffer_set_implicit_trailing_newline (GTK_SOURCE_BUFFER (buffer), FALSE);
+	file = gtef_buffer_get_file (buffer);
+	gtef_file_set_location (file, location);
+
+	loader = gtef_file_loader_new (buffer, file);
+	gtef_file_loader_set_chunk_size (loader, CHUNK_SIZE);
+
+	gtef_file_loader_load_async (loader,
+				     G_PRIORITY_DEFAULT,
+				     NULL,
+				     slow_progress_cb, NULL, NULL,
+				     encoding_detection_cb,
+				     &error);
+
+	gtk_main ();
+	g_assert_no_error (error);
+
+	g_assert_cmpint (gtk_text_buffer_get_char_count (GTK_TEXT_BUFFER (buffer)), ==, content_size);
+	g_assert_cmpuint (_gtef_file_loader_get_max_input_length (loader), >, 0);
+	g_assert_cmpuint (_gtef_file_loader_get_max_input_length (loader), <=,
+			  _gtef_file_loader_get_max_pending_chunks ());
+
+	g_file_delete (location, NULL, &error);
+	g_assert_no_error (error);
+
+	g_free (content);
+	g_free (path);
+	g_object_unref (location);
+	g_object_unref (loader);
+	g_object_unref (buffer);
+}
+
+static void
+check_cached_encoding (GtefBuffer                  *buffer,
+		       const gchar                 *expected_buffer_content,
+		       const gchar                 *expected_charset,
+		       GtefEncodingDetectionMethod  expected_method)
+{
+	GtefFile *file;
+	GtefFileMetadata *metadata;
+	GtefFileLoader *loader;
+	GtefEncoding *expected_encoding;
+	GtkTextIter start;
+	GtkTextIter end;
+	gchar *buffer_contents;
+	gchar *value;
+	GError *error = NULL;
+
+	file = gtef_buffer_get_file (buffer);
+	loader = gtef_file_loader_new (buffer, file);
+
+	gtef_file_loader_load_async (loader,
+				     G_PRIORITY_DEFAULT,
+				     NULL,
+				     NULL, NULL, NULL,
+				     encoding_detection_cb,
+				     &error);
+
+	gtk_main ();
+
+	g_assert_no_error (error);
+	g_assert_cmpint (gtef_file_loader_get_encoding_detection_method (loader), ==, expected_method);
+
+	expected_encoding = gtef_encoding_new (expected_charset);
+	check_equal_encodings (gtef_file_loader_get_encoding (loader), expected_encoding);
+	gtef_encoding_free (expected_encoding);
+
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+	buffer_contents = gtk_text_buffer_get_text (GTK_TEXT_BUFFER (buffer), &start, &end, TRUE);
+	g_assert_cmpstr (buffer_contents, ==, expected_buffer_content);
+	g_free (buffer_contents);
+
+	/* The result is stored in the metadata, for the next load. */
+	metadata = gtef_file_get_file_metadata (file);
+
+	value = gtef_file_metadata_get (metadata, "gtef-encoding");
+	g_assert_cmpstr (value, ==, expected_charset);
+	g_free (value);
+
+	value = gtef_file_metadata_get (metadata, "gtef-newline-type");
+	g_assert_cmpstr (value, ==, "lf");
+	g_free (value);
+
+	value = gtef_file_metadata_get (metadata, "gtef-validity-key");
+	g_assert (value != NULL);
+	g_free (value);
+
+	g_object_unref (loader);
+}
+
+static void
+test_cached_encoding (void)
+{
+	GtefBuffer *buffer;
+	GtefFile *file;
+	gchar *path;
+	GFile *location;
+	GError *error = NULL;
+
+	path = g_build_filename (g_get_tmp_dir (), "gtef-test-file-loader", NULL);
+	g_file_set_contents (path, "Un \351l\351phant \347a trompe \351norm\351ment.\n", -1, &error);
+	g_assert_no_error (error);
+	location = g_file_new_for_path (path);
+
+	buffer = gtef_buffer_new ();
+	gtk_source_buffer_set_implicit_trailing_newline (GTK_SOURCE_BUFFER (buffer), FALSE);
+	file = gtef_buffer_get_file (buffer);
+	gtef_file_set_location (file, location);
+
+	check_cached_encoding (buffer,
+			       "Un \303\251l\303\251phant \303\247a trompe \303\251norm\303\251ment.\n",
+			       "ISO-8859-1",
+			       GTEF_ENCODING_DETECTION_METHOD_UCHARDET);
+
+	/* Same file, the detection is skipped. */
+	check_cached_encoding (buffer,
+			       "Un \303\251l\303\251phant \303\247a trompe \303\251norm\303\251ment.\n",
+			       "ISO-8859-1",
+			       GTEF_ENCODING_DETECTION_METHOD_METADATA);
+
+	/* Wrong metadata: the conversion fails, and the content is loaded
+	 * again with the detection.
+	 */
+	gtef_file_metadata_set (gtef_file_get_file_metadata (file), "gtef-encoding", "UTF-8");
+
+	check_cached_encoding (buffer,
+			       "Un \303\251l\303\251phant \303\247a trompe \303\251norm\303\251ment.\n",
+			       "ISO-8859-1",
+			       GTEF_ENCODING_DETECTION_METHOD_UCHARDET);
+
+	/* Modified file. */
+	g_file_set_contents (path, "An elephant.\n", -1, &error);
+	g_assert_no_error (error);
+
+	check_cached_encoding (buffer,
+			       "An elephant.\n",
+			       "ASCII",
+			       GTEF_ENCODING_DETECTION_METHOD_ASCII);
+
+	g_file_delete (location, NULL, &error);
+	g_assert_no_error (error);
+
+	g_free (path);
+	g_object_unref (location);
+	g_object_unref (buffer);
+}
+
+static void
+escape_invalid_chars_cb (GObject      *source_object,
+			 GAsyncResult *result,
+			 gpointer      user_data)
+{
+	GtefFileLoader *loader = GTEF_FILE_LOADER (source_object);
+	GtefFile *file;
+	GError *error = NULL;
+
+	gtef_file_loader_load_finish (loader, result, &error);
+	g_assert_no_error (error);
+
+	/* Only the first chunk has been sniffed. */
+	file = gtef_file_loader_get_file (loader);
+	g_assert_cmpstr (gtef_encoding_get_charset (gtef_file_get_encoding (file)), ==, "UTF-8");
+
+	gtk_main_quit ();
+}
+
+static void
+test_escape_invalid_chars (void)
+{
+	GtefBuffer *buffer;
+	GtefFile *file;
+	GtefFileLoader *loader;
+	gchar *path;
+	GFile *location;
+	GtkTextIter start;
+	GtkTextIter end;
+	gchar *buffer_contents;
+	GError *error = NULL;
+
+	/* With chunks of 4 bytes, the invalid bytes are at different positions
+	 * relative to the incomplete characters kept between the chunks. The
+	 * chunk size applies also to the memory-mapped local files, see
+	 * test_chunk_size():
+	 * "abcd" "\nx\342\202" "\254\377y\r" "\n\303z\342" "\n"
+	 */
+	const gchar *contents = "abcd\nx\342\202\254\377y\r\n\303z\342\n";
+
+	path = g_build_filename (g_get_tmp_dir (), "gtef-test-file-loader", NULL);
+	g_file_set_contents (path, contents, -1, &error);
+	g_assert_no_error (error);
+	location = g_file_new_for_path (path);
+
+	buffer = gtef_buffer_new ();
+	gtk_source_buffer_set_implicit_trailing_newline (GTK_SOURCE_BUFFER (buffer), FALSE);
+	file = gtef_buffer_get_file (buffer);
+	gtef_file_set_location (file, location);
+
+	loader = gtef_file_loader_new (buffer, file);
+	g_assert (!gtef_file_loader_get_escape_invalid_chars (loader));
+	gtef_file_loader_set_escape_invalid_chars (loader, TRUE);
+
+	/* The sniff window, the first chunk, is ASCII, so UTF-8 is chosen and
+	 * the next chunks are converted with escaping.
+	 */
+	gtef_file_loader_set_chunk_size (loader, 4);
+	gtef_file_loader_set_sniff_size (loader, 4);
+
+	gtef_file_loader_load_async (loader,
+				     G_PRIORITY_DEFAULT,
+				     NULL,
+				     NULL, NULL, NULL,
+				     escape_invalid_chars_cb,
+				     NULL);
+
+	gtk_main ();
+
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+	buffer_contents = gtk_text_buffer_get_text (GTK_TEXT_BUFFER (buffer), &start, &end, TRUE);
+	g_assert_cmpstr (buffer_contents, ==, "abcd\nx\342\202\254\\FFy\r\n\\C3z\\E2\n");
+	g_free (buffer_contents);
+
+	g_assert (_gtef_buffer_has_invalid_chars (buffer));
+
+	/* Text inserted inside an escaped sequence is invalid too. */
+	gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (buffer), &start, 8);
+	gtk_text_buffer_insert (GTK_TEXT_BUFFER (buffer), &start, "ab", -1);
+
+	/* Remove the first two escaped sequences. */
+	gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (buffer), &start, 6);
+	gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (buffer), &end, 18);
+	gtk_text_buffer_delete (GTK_TEXT_BUFFER (buffer), &start, &end);
+	g_assert (_gtef_buffer_has_invalid_chars (buffer));
+
+	/* Remove the last one. */
+	gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (buffer), &start, 7);
+	gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (buffer), &end, 10);
+	gtk_text_buffer_delete (GTK_TEXT_BUFFER (buffer), &start, &end);
+	g_assert (!_gtef_buffer_has_invalid_chars (buffer));
+
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (buffer), &start, &end);
+	buffer_contents = gtk_text_buffer_get_text (GTK_TEXT_BUFFER (buffer), &start, &end, TRUE);
+	g_assert_cmpstr (buffer_contents, ==, "abcd\nxz\n");
+	g_free (buffer_contents);
+
+	g_file_delete (location, NULL, &error);
+	g_assert_no_error (error);
+
+	g_free (path);
+	g_object_unref (location);
+	g_object_unref (loader);
+	g_object_unref (buffer);
+}
+
+static void
+append_to_file (GFile       *location,
+		const gchar *content)
+{
+	GFileOutputStream *stream;
+	GError *error = NULL;
+
+	stream = g_file_append_to (location, G_FILE_CREATE_NONE, NULL, &error);
+	g_assert_no_error (error);
+
+	g_output_stream_write_all (G_OUTPUT_STREAM (stream), content, strlen (content), NULL, NULL, &error);
+	g_assert_no_error (error);
+
+	g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, &error);
+	g_assert_no_error (error);
+
+	g_object_unref (stream);
+}
+
+/* Rewrites the file in place, so it keeps the same file identifier. */
+static void
+rewrite_file (GFile       *location,
+	      const gchar *content)
+{
+	GFileIOStream *stream;
+	GOutputStream *output_stream;
+	GError *error = NULL;
+
+	stream = g_file_open_readwrite (location, NULL, &error);
+	g_assert_no_error (error);
+
+	g_seekable_truncate (G_SEEKABLE (stream), 0, NULL, &error);
+	g_assert_no_error (error);
+
+	output_stream = g_io_stream_get_output_stream (G_IO_STREAM (stream));
+	g_output_stream_write_all (output_stream, content, strlen (content), NULL, NULL, &error);
+	g_assert_no_error (error);
+
+	g_io_stream_close (G_IO_STREAM (stream), NULL, &error);
+	g_assert_no_error (error);
+
+	g_object_unref (stream);
+}
+
+static void
+check_reload (GtefFileLoader *loader,
+	      const gchar    *expected_buffer_content)
+{
+	GtkTextBuffer *buffer;
+	GtkTextIter start;
+	GtkTextIter end;
+	gchar *buffer_contents;
+	GError *error = NULL;
+
+	gtef_file_loader_load_async (loader,
+				     G_PRIORITY_DEFAULT,
+				     NULL,
+				     NULL, NULL, NULL,
+				     encoding_detection_cb,
+				     &error);
+
+	gtk_main ();
+
+	g_assert_no_error (error);
+
+	buffer = GTK_TEXT_BUFFER (gtef_file_loader_get_buffer (loader));
+	gtk_text_buffer_get_bounds (buffer, &start, &end);
+	buffer_contents = gtk_text_buffer_get_text (buffer, &start, &end, TRUE);
+	g_assert_cmpstr (buffer_contents, ==, expected_buffer_content);
+	g_free (buffer_contents);
+
+	g_assert (!gtk_text_buffer_get_modified (buffer));
+}
+
+static void
+test_follow (void)
+{
+	GtefBuffer *buffer;
+	GtefFile *file;
+	GtefFileLoader *loader;
+	gchar *path;
+	GFile *location;
+	GtkTextIter iter;
+	GtkTextIter end;
+	GError *error = NULL;
+
+	path = g_build_filename (g_get_tmp_dir (), "gtef-test-file-loader", NULL);
+	g_file_set_contents (path, "line 1\nline 2\n", -1, &error);
+	g_assert_no_error (error);
+	location = g_file_new_for_path (path);
+
+	buffer = gtef_buffer_new ();
+	gtk_source_buffer_set_implicit_trailing_newline (GTK_SOURCE_BUFFER (buffer), TRUE);
+	file = gtef_buffer_get_file (buffer);
+	gtef_file_set_location (file, location);
+
+	loader = gtef_file_loader_new (buffer, file);
+	gtef_file_loader_set_follow (loader, TRUE);
+
+	check_reload (loader, "line 1\nline 2");
+
+	/* The \r is kept until the next character is known. */
+	append_to_file (location, "line 3\r");
+	check_reload (loader, "line 1\nline 2\nline 3");
+
+	/* An incomplete character is kept too. */
+	append_to_file (location, "\nline \303");
+	check_reload (loader, "line 1\nline 2\nline 3\r\nline ");
+
+	append_to_file (location, "\251\n");
+	check_reload (loader, "line 1\nline 2\nline 3\r\nline \303\251");
+	g_assert_cmpint (gtef_file_loader_get_newline_count (loader, GTEF_NEWLINE_TYPE_LF), ==, 3);
+	g_assert_cmpint (gtef_file_loader_get_newline_count (loader, GTEF_NEWLINE_TYPE_CR_LF), ==, 1);
+	g_assert_cmpint (gtef_file_loader_get_newline_type (loader), ==, GTEF_NEWLINE_TYPE_LF);
+
+	/* Nothing appended. */
+	check_reload (loader, "line 1\nline 2\nline 3\r\nline \303\251");
+
+	/* Rewritten in place, bigger than before. */
+	rewrite_file (location, "A completely different content, longer than the previous one.\n");
+	check_reload (loader, "A completely different content, longer than the previous one.");
+
+	/* Truncated. */
+	rewrite_file (location, "Short.\n");
+	check_reload (loader, "Short.");
+
+	/* Replaced by another file. */
+	g_file_set_contents (path, "Rotated.\n", -1, &error);
+	g_assert_no_error (error);
+	check_reload (loader, "Rotated.");
+
+	append_to_file (location, "More.\n");
+	check_reload (loader, "Rotated.\nMore.");
+
+	/* The buffer has been modified. */
+	gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (buffer), &iter);
+	gtk_text_buffer_insert (GTK_TEXT_BUFFER (buffer), &iter, "Edited. ", -1);
+	append_to_file (location, "Even more.\n");
+	check_reload (loader, "Rotated.\nMore.\nEven more.");
+
+	/* Modified without changing the number of characters. */
+	gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (buffer), &iter, 0);
+	gtk_text_buffer_get_iter_at_offset (GTK_TEXT_BUFFER (buffer), &end, 1);
+	gtk_text_buffer_delete (GTK_TEXT_BUFFER (buffer), &iter, &end);
+	gtk_text_buffer_insert (GTK_TEXT_BUFFER (buffer), &iter, "X", -1);
+	append_to_file (location, "Last.\n");
+	check_reload (loader, "Rotated.\nMore.\nEven more.\nLast.");
+
+	g_file_delete (location, NULL, &error);
+	g_assert_no_error (error);
+
+	g_free (path);
+	g_object_unref (location);
+	g_object_unref (loader);
+	g_object_unref (buffer);
+}
+
+static void
+check_mark_position (GtkTextBuffer *buffer,
+		     GtkTextMark   *mark,
+		     gint           expected_line,
+		     gint           expected_line_offset)
+{
+	GtkTextIter iter;
+
+	gtk_text_buffer_get_iter_at_mark (buffer, &iter, mark);
+	g_assert_cmpint (gtk_text_iter_get_line (&iter), ==, expected_line);
+	g_assert_cmpint (gtk_text_iter_get_line_offset (&iter), ==, expected_line_offset);
+}
+
+static void
+test_patch_buffer (void)
+{
+	GtefBuffer *buffer;
+	GtefFile *file;
+	GtefFileLoader *loader;
+	gchar *path;
+	GFile *location;
+	GtkTextIter iter;
+	GtkTextMark *first_line_mark;
+	GtkTextMark *changed_line_mark;
+	GtkTextMark *last_line_mark;
+	GtkTextMark *insert;
+	GError *error = NULL;
+
+	path = g_build_filename (g_get_tmp_dir (), "gtef-test-file-loader", NULL);
+	g_file_set_contents (path, "line 1\nline 2\nline 3\nline 4\n", -1, &error);
+	g_assert_no_error (error);
+	location = g_file_new_for_path (path);
+
+	buffer = gtef_buffer_new ();
+	gtk_source_buffer_set_implicit_trailing_newline (GTK_SOURCE_BUFFER (buffer), TRUE);
+	file = gtef_buffer_get_file (buffer);
+	gtef_file_set_location (file, location);
+
+	loader = gtef_file_loader_new (buffer, file);
+	g_assert (!gtef_file_loader_get_patch_buffer (loader));
+	gtef_file_loader_set_patch_buffer (loader, TRUE);
+
+	/* The buffer is empty, it is filled as usual. */
+	check_reload (loader, "line 1\nline 2\nline 3\nline 4");
+
+	gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &iter, 0, 2);
+	first_line_mark = gtk_text_buffer_create_mark (GTK_TEXT_BUFFER (buffer), NULL, &iter, TRUE);
+
+	gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &iter, 1, 2);
+	changed_line_mark = gtk_text_buffer_create_mark (GTK_TEXT_BUFFER (buffer), NULL, &iter, TRUE);
+
+	gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &iter, 3, 2);
+	last_line_mark = gtk_text_buffer_create_mark (GTK_TEXT_BUFFER (buffer), NULL, &iter, TRUE);
+
+	gtk_text_buffer_get_iter_at_line_offset (GTK_TEXT_BUFFER (buffer), &iter, 2, 4);
+	gtk_text_buffer_place_cursor (GTK_TEXT_BUFFER (buffer), &iter);
+	insert = gtk_text_buffer_get_insert (GTK_TEXT_BUFFER (buffer));
+
+	/* One line changed, one line inserted before the last line. */
+	g_file_set_contents (path, "line 1\nline two\nline 3\nline 3.5\nline 4\n", -1, &error);
+	g_assert_no_error (error);
+	check_reload (loader, "line 1\nline two\nline 3\nline 3.5\nline 4");
+
+	check_mark_position (GTK_TEXT_BUFFER (buffer), first_line_mark, 0, 2);
+	check_mark_position (GTK_TEXT_BUFFER (buffer), changed_line_mark, 1, 0);
+	check_mark_position (GTK_TEXT_BUFFER (buffer), last_line_mark, 4, 2);
+	check_mark_position (GTK_TEXT_BUFFER (buffer), insert, 2, 4);
+
+	/* The same content. */
+	check_reload (loader, "line 1\nline two\nline 3\nline 3.5\nline 4");
+	check_mark_position (GTK_TEXT_BUFFER (buffer), last_line_mark, 4, 2);
+
+	/* Without the trailing newline, and with the first line removed. */
+	g_file_set_contents (path, "line two\nline 3\nline 3.5\nline 4", -1, &error);
+	g_assert_no_error (error);
+	check_reload (loader, "line two\nline 3\nline 3.5\nline 4");
+	check_mark_position (GTK_TEXT_BUFFER (buffer), last_line_mark, 3, 2);
+	check_mark_position (GTK_TEXT_BUFFER (buffer), insert, 1, 4);
+
+	/* The buffer modifications are discarded, like with a normal load. */
+	gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (buffer), &iter);
+	gtk_text_buffer_insert (GTK_TEXT_BUFFER (buffer), &iter, "Edited. ", -1);
+	check_reload (loader, "line two\nline 3\nline 3.5\nline 4");
+	check_mark_position (GTK_TEXT_BUFFER (buffer), last_line_mark, 3, 2);
+
+	g_file_delete (location, NULL, &error);
+	g_assert_no_error (error);
+
+	g_free (path);
+	g_object_unref (location);
+	g_object_unref (loader);
+	g_object_unref (buffer);
+}
+
 #ifndef G_OS_WIN32
 static GFile *
 create_writable_file (void)
@@ -655,8 +1448,15 @@ main (gint   argc,
 
 	g_test_add_func ("/file-loader/newlines", test_newlines);
 	g_test_add_func ("/file-loader/split-cr-lf", test_split_cr_lf);
+	g_test_add_func ("/file-loader/chunk-size", test_chunk_size);
 	g_test_add_func ("/file-loader/max-size", test_max_size);
 	g_test_add_func ("/file-loader/encoding", test_encoding);
+	g_test_add_func ("/file-loader/encoding-detection", test_encoding_detection);
+	g_test_add_func ("/file-loader/input-queue-bounded", test_input_queue_bounded);
+	g_test_add_func ("/file-loader/cached-encoding", test_cached_encoding);
+	g_test_add_func ("/file-loader/escape-invalid-chars", test_escape_invalid_chars);
+	g_test_add_func ("/file-loader/follow", test_follow);
+	g_test_add_func ("/file-loader/patch-buffer", test_patch_buffer);
 
 #ifndef G_OS_WIN32
 	g_test_add_func ("/file-loader/readonly", test_readonly);
@@ -418,6 +418,250 @@ test_set_without_load (void)
 	teardown_unit_test ();
 }
 
+static gchar *
+get_manager_value (const gchar *uri,
+		   const gchar *key)
+{
+	GFile *location;
+	GFileInfo *info;
+	gchar *attribute_key;
+	gchar *value = NULL;
+
+	location = g_file_new_for_uri (uri);
+	info = _gtef_metadata_manager_get_all_metadata_for_location (location);
+
+	if (info != NULL)
+	{
+		attribute_key = g_strconcat ("metadata::", key, NULL);
+		value = g_strdup (g_file_info_get_attribute_string (info, attribute_key));
+		g_free (attribute_key);
+		g_object_unref (info);
+	}
+
+	g_object_unref (location);
+	return value;
+}
+
+static void
+set_manager_value (const gchar *uri,
+		   const gchar *key,
+		   const gchar *value)
+{
+	GFile *location;
+	GFileInfo *info;
+	gchar *attribute_key;
+
+	location = g_file_new_for_uri (uri);
+	info = g_file_info_new ();
+
+	attribute_key = g_strconcat ("metadata::", key, NULL);
+
+	if (value != NULL)
+	{
+		g_file_info_set_attribute_string (info, attribute_key, value);
+	}
+	else
+	{
+		/* Unset. */
+		g_file_info_set_attribute (info,
+					   attribute_key,
+					   G_FILE_ATTRIBUTE_TYPE_INVALID,
+					   NULL);
+	}
+
+	g_free (attribute_key);
+
+	_gtef_metadata_manager_set_metadata_for_location (location, info);
+
+	g_object_unref (info);
+	g_object_unref (location);
+}
+
+static void
+test_metadata_manager_import_xml (void)
+{
+	gchar *path;
+	gchar *contents;
+	gchar *value;
+	GError *error = NULL;
+
+	path = get_metadata_manager_path ();
+	g_file_set_contents (path,
+			     "<?xml version=\"1.0\"?>\n"
+			     "<metadata>\n"
+			     "  <document uri=\"file:///gtef-test-a\" atime=\"10\">\n"
+			     "    <entry key=\"" TEST_KEY "\" value=\"morbid\"/>\n"
+			     "  </document>\n"
+			     "</metadata>\n",
+			     -1,
+			     &error);
+	g_assert_no_error (error);
+
+	setup_unit_test ();
+
+	value = get_manager_value ("file:///gtef-test-a", TEST_KEY);
+	g_assert_cmpstr (value, ==, "morbid");
+	g_free (value);
+
+	/* Converted to the new format. */
+	gtef_metadata_manager_shutdown ();
+
+	g_file_get_contents (path, &contents, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (g_str_has_prefix (contents, "GTEF-METADATA"));
+	g_free (contents);
+
+	setup_unit_test ();
+
+	value = get_manager_value ("file:///gtef-test-a", TEST_KEY);
+	g_assert_cmpstr (value, ==, "morbid");
+	g_free (value);
+
+	teardown_unit_test ();
+	g_free (path);
+}
+
+static void
+check_store_repaired (const gchar *contents)
+{
+	gchar *path;
+	gchar *new_contents;
+	gchar *value;
+	GError *error = NULL;
+
+	path = get_metadata_manager_path ();
+	g_file_set_contents (path, contents, -1, &error);
+	g_assert_no_error (error);
+
+	setup_unit_test ();
+
+	value = get_manager_value ("file:///gtef-test-a", TEST_KEY);
+	g_assert (value == NULL);
+
+	set_manager_value ("file:///gtef-test-a", TEST_KEY, "a");
+
+	/* Rewritten with the header, not appended. */
+	gtef_metadata_manager_shutdown ();
+
+	g_file_get_contents (path, &new_contents, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (g_str_has_prefix (new_contents, "GTEF-METADATA"));
+	g_free (new_contents);
+
+	setup_unit_test ();
+
+	value = get_manager_value ("file:///gtef-test-a", TEST_KEY);
+	g_assert_cmpstr (value, ==, "a");
+	g_free (value);
+
+	teardown_unit_test ();
+	g_free (path);
+}
+
+static void
+test_metadata_manager_invalid_store (void)
+{
+	check_store_repaired ("");
+	check_store_repaired ("garbage");
+	check_store_repaired ("<?xml version=\"1.0\"?>\n<metadata>\n  <document uri=");
+}
+
+static void
+test_metadata_manager_lru (void)
+{
+	gchar *value;
+
+	setup_unit_test ();
+	gtef_metadata_manager_set_max_number_of_locations (2);
+
+	set_manager_value ("file:///gtef-test-a", TEST_KEY, "a");
+	set_manager_value ("file:///gtef-test-b", TEST_KEY, "b");
+
+	/* Access a, so b is the least recently used. */
+	value = get_manager_value ("file:///gtef-test-a", TEST_KEY);
+	g_assert_cmpstr (value, ==, "a");
+	g_free (value);
+
+	set_manager_value ("file:///gtef-test-c", TEST_KEY, "c\tis\nescaped\\");
+
+	value = get_manager_value ("file:///gtef-test-b", TEST_KEY);
+	g_assert (value == NULL);
+
+	/* Reload from the file. */
+	gtef_metadata_manager_shutdown ();
+	setup_unit_test ();
+
+	value = get_manager_value ("file:///gtef-test-a", TEST_KEY);
+	g_assert_cmpstr (value, ==, "a");
+	g_free (value);
+
+	value = get_manager_value ("file:///gtef-test-b", TEST_KEY);
+	g_assert (value == NULL);
+
+	value = get_manager_value ("file:///gtef-test-c", TEST_KEY);
+	g_assert_cmpstr (value, ==, "c\tis\nescaped\\");
+	g_free (value);
+
+	/* Unset */
+	set_manager_value ("file:///gtef-test-a", TEST_KEY, NULL);
+
+	gtef_metadata_manager_shutdown ();
+	setup_unit_test ();
+
+	value = get_manager_value ("file:///gtef-test-a", TEST_KEY);
+	g_assert (value == NULL);
+
+	teardown_unit_test ();
+}
+
+/* Without the unit test mode, the file is written in the save thread. */
+static void
+test_metadata_manager_save_thread (void)
+{
+	gchar *path;
+	gchar *value;
+	guint i;
+
+	path = get_metadata_manager_path ();
+	g_unlink (path);
+	gtef_metadata_manager_init (path);
+
+	/* A burst of changes, flushed by the shutdown. */
+	for (i = 0; i < 100; i++)
+	{
+		gchar *str;
+
+		str = g_strdup_printf ("%u", i);
+		set_manager_value ("file:///gtef-test-a", TEST_KEY, str);
+		g_free (str);
+	}
+
+	gtef_metadata_manager_shutdown ();
+	g_assert (g_file_test (path, G_FILE_TEST_EXISTS));
+
+	gtef_metadata_manager_init (path);
+
+	value = get_manager_value ("file:///gtef-test-a", TEST_KEY);
+	g_assert_cmpstr (value, ==, "99");
+	g_free (value);
+
+	set_manager_value ("file:///gtef-test-b", TEST_KEY, "b");
+	gtef_metadata_manager_shutdown ();
+
+	setup_unit_test ();
+
+	value = get_manager_value ("file:///gtef-test-a", TEST_KEY);
+	g_assert_cmpstr (value, ==, "99");
+	g_free (value);
+
+	value = get_manager_value ("file:///gtef-test-b", TEST_KEY);
+	g_assert_cmpstr (value, ==, "b");
+	g_free (value);
+
+	teardown_unit_test ();
+	g_free (path);
+}
+
 gint
 main (gint    argc,
       gchar **argv)
@@ -428,6 +672,10 @@ main (gint    argc,
 	g_test_add_func ("/file/load_save_metadata_sync", test_load_save_metadata_sync);
 	g_test_add_func ("/file/load_save_metadata_async", test_load_save_metadata_async);
 	g_test_add_func ("/file/set_without_load", test_set_without_load);
+	g_test_add_func ("/file/metadata_manager_import_xml", test_metadata_manager_import_xml);
+	g_test_add_func ("/file/metadata_manager_invalid_store", test_metadata_manager_invalid_store);
+	g_test_add_func ("/file/metadata_manager_lru", test_metadata_manager_lru);
+	g_test_add_func ("/file/metadata_manager_save_thread", test_metadata_manager_save_thread);
 
 	return g_test_run ();
 }
@@ -0,0 +1,249 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtef/gtef.h>
+#include <glib/gstdio.h>
+
+#define N_LINES 5000
+#define WINDOW_SIZE 1000
+
+/* With @line_length > 0, the lines are padded with trailing spaces. */
+static gchar *
+create_file (gint line_length)
+{
+	gchar *path;
+	GString *content;
+	GError *error = NULL;
+	gint i;
+
+	/* Line i contains i, and the file ends with a newline. */
+	content = g_string_new (NULL);
+	for (i = 0; i < N_LINES; i++)
+	{
+		g_string_append_printf (content, "%-*d\n", line_length, i);
+	}
+
+	path = g_build_filename (g_get_tmp_dir (), "gtef-test-file-pager", NULL);
+	g_file_set_contents (path, content->str, content->len, &error);
+	g_assert_no_error (error);
+
+	g_string_free (content, TRUE);
+	return path;
+}
+
+static void
+open_cb (GObject      *source_object,
+	 GAsyncResult *result,
+	 gpointer      user_data)
+{
+	GError *error = NULL;
+
+	gtef_file_pager_open_finish (GTEF_FILE_PAGER (source_object), result, &error);
+	g_assert_no_error (error);
+
+	gtk_main_quit ();
+}
+
+static void
+window_start_notify_cb (GtefFilePager *pager,
+			GParamSpec    *pspec,
+			gpointer       user_data)
+{
+	gtk_main_quit ();
+}
+
+static void
+check_cursor_line (GtefFilePager *pager,
+		   gint64         expected_line)
+{
+	GtkTextBuffer *buffer;
+	GtkTextIter start;
+	GtkTextIter end;
+	gchar *text;
+	gchar *expected_text;
+
+	buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (gtef_file_pager_get_view (pager)));
+
+	gtk_text_buffer_get_iter_at_mark (buffer, &start, gtk_text_buffer_get_insert (buffer));
+	g_assert_cmpint (gtef_file_pager_get_window_start (pager) + gtk_text_iter_get_line (&start),
+			 ==,
+			 expected_line);
+
+	end = start;
+	gtk_text_iter_forward_to_line_end (&end);
+	text = gtk_text_iter_get_text (&start, &end);
+	g_strchomp (text);
+
+	expected_text = expected_line < N_LINES ? g_strdup_printf ("%" G_GINT64_FORMAT, expected_line) : g_strdup ("");
+	g_assert_cmpstr (text, ==, expected_text);
+
+	g_free (text);
+	g_free (expected_text);
+}
+
+static void
+goto_line_and_wait (GtefFilePager *pager,
+		    gint64         line)
+{
+	gulong handler_id;
+
+	handler_id = g_signal_connect (pager,
+				       "notify::window-start",
+				       G_CALLBACK (window_start_notify_cb),
+				       NULL);
+
+	g_assert (gtef_view_goto_line (gtef_file_pager_get_view (pager), line));
+	gtk_main ();
+
+	g_signal_handler_disconnect (pager, handler_id);
+}
+
+static void
+test_goto_line (void)
+{
+	gchar *path;
+	GFile *location;
+	GtefView *view;
+	GtkTextBuffer *buffer;
+	GtefFile *file;
+	GtefFilePager *pager;
+
+	path = create_file (0);
+	location = g_file_new_for_path (path);
+
+	view = GTEF_VIEW (gtef_view_new ());
+	g_object_ref_sink (view);
+	buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (view));
+
+	file = gtef_buffer_get_file (GTEF_BUFFER (buffer));
+	gtef_file_set_location (file, location);
+
+	pager = gtef_file_pager_new (view, file);
+	gtef_file_pager_set_window_size (pager, WINDOW_SIZE);
+	g_assert (!gtk_text_view_get_editable (GTK_TEXT_VIEW (view)));
+
+	gtef_file_pager_open_async (pager,
+				    G_PRIORITY_DEFAULT,
+				    NULL,
+				    open_cb,
+				    NULL);
+	gtk_main ();
+
+	/* The last line is empty. */
+	g_assert_cmpint (gtef_file_pager_get_n_lines (pager), ==, N_LINES + 1);
+	g_assert_cmpint (gtef_file_pager_get_window_start (pager), ==, 0);
+	g_assert_cmpint (gtk_text_buffer_get_line_count (buffer), ==, WINDOW_SIZE);
+	check_cursor_line (pager, 0);
+
+	/* In the current window. */
+	g_assert (gtef_view_goto_line (view, 10));
+	check_cursor_line (pager, 10);
+
+	/* In the middle of the file, the line is in the middle of the window. */
+	goto_line_and_wait (pager, 3000);
+	g_assert_cmpint (gtef_file_pager_get_window_start (pager), ==, 3000 - WINDOW_SIZE / 2);
+	g_assert_cmpint (gtk_text_buffer_get_line_count (buffer), ==, WINDOW_SIZE);
+	check_cursor_line (pager, 3000);
+
+	/* Last window. */
+	goto_line_and_wait (pager, N_LINES);
+	g_assert_cmpint (gtef_file_pager_get_window_start (pager), ==, N_LINES + 1 - WINDOW_SIZE);
+	g_assert_cmpint (gtk_text_buffer_get_line_count (buffer), ==, WINDOW_SIZE);
+	check_cursor_line (pager, N_LINES);
+
+	/* Back to the first window. */
+	goto_line_and_wait (pager, 42);
+	g_assert_cmpint (gtef_file_pager_get_window_start (pager), ==, 0);
+	check_cursor_line (pager, 42);
+
+	g_object_unref (pager);
+	g_object_unref (view);
+	g_object_unref (location);
+	g_unlink (path);
+	g_free (path);
+}
+
+static void
+test_long_lines (void)
+{
+	gchar *path;
+	GFile *location;
+	GtefView *view;
+	GtkTextBuffer *buffer;
+	GtefFile *file;
+	GtefFilePager *pager;
+
+	path = create_file (999);
+	location = g_file_new_for_path (path);
+
+	view = GTEF_VIEW (gtef_view_new ());
+	g_object_ref_sink (view);
+	buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (view));
+
+	file = gtef_buffer_get_file (GTEF_BUFFER (buffer));
+	gtef_file_set_location (file, location);
+
+	pager = gtef_file_pager_new (view, file);
+	gtef_file_pager_set_window_size (pager, WINDOW_SIZE);
+
+	gtef_file_pager_open_async (pager,
+				    G_PRIORITY_DEFAULT,
+				    NULL,
+				    open_cb,
+				    NULL);
+	gtk_main ();
+
+	g_assert_cmpint (gtk_text_buffer_get_line_count (buffer), ==, WINDOW_SIZE);
+
+	/* The next windows contain a few dozen lines of 1000 bytes. The window
+	 * start is computed for a full window, so the window would end before
+	 * the line without dropping its first lines.
+	 */
+	_gtef_file_pager_set_max_window_bytes (pager, 20000);
+
+	goto_line_and_wait (pager, 3000);
+	g_assert_cmpint (gtef_file_pager_get_window_start (pager), >, 3000 - WINDOW_SIZE / 2);
+	g_assert_cmpint (gtk_text_buffer_get_line_count (buffer), <, WINDOW_SIZE);
+	check_cursor_line (pager, 3000);
+
+	/* Now the window start is computed from the truncated window. */
+	goto_line_and_wait (pager, 4000);
+	check_cursor_line (pager, 4000);
+
+	goto_line_and_wait (pager, 1000);
+	check_cursor_line (pager, 1000);
+
+	g_object_unref (pager);
+	g_object_unref (view);
+	g_object_unref (location);
+	g_unlink (path);
+	g_free (path);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+	gtk_test_init (&argc, &argv);
+
+	g_test_add_func ("/file-pager/goto-line", test_goto_line);
+	g_test_add_func ("/file-pager/long-lines", test_long_lines);
+
+	return g_test_run ();
+}
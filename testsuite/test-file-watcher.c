@@ -0,0 +1,262 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtef/gtef.h>
+#include <glib/gstdio.h>
+#include <unistd.h>
+
+static void
+load_cb (GObject      *source_object,
+	 GAsyncResult *result,
+	 gpointer      user_data)
+{
+	GtefFileLoader *loader = GTEF_FILE_LOADER (source_object);
+	GError *error = NULL;
+
+	gtef_file_loader_load_finish (loader, result, &error);
+	g_assert_no_error (error);
+
+	gtk_main_quit ();
+}
+
+static void
+load (GtefBuffer *buffer)
+{
+	GtefFile *file;
+	GtefFileLoader *loader;
+
+	file = gtef_buffer_get_file (buffer);
+
+	loader = gtef_file_loader_new (buffer, file);
+	gtef_file_loader_load_async (loader,
+				     G_PRIORITY_DEFAULT,
+				     NULL, /* cancellable */
+				     NULL, NULL, NULL, /* progress cb */
+				     load_cb,
+				     NULL);
+
+	gtk_main ();
+	g_object_unref (loader);
+}
+
+static GtefBuffer *
+create_loaded_buffer (const gchar *path)
+{
+	GtefBuffer *buffer;
+	GFile *location;
+	GError *error = NULL;
+
+	g_file_set_contents (path, "a", -1, &error);
+	g_assert_no_error (error);
+
+	buffer = gtef_buffer_new ();
+
+	location = g_file_new_for_path (path);
+	gtef_file_set_location (gtef_buffer_get_file (buffer), location);
+	g_object_unref (location);
+
+	load (buffer);
+
+	return buffer;
+}
+
+static void
+file_changed_cb (GtefFileWatcher *watcher,
+		 GtefFile        *file,
+		 GtefFile        *expected_file)
+{
+	if (file == expected_file)
+	{
+		gtk_main_quit ();
+	}
+}
+
+static gboolean
+timeout_cb (gpointer user_data)
+{
+	g_assert_not_reached ();
+	return G_SOURCE_REMOVE;
+}
+
+static void
+wait_file_changed (GtefFile *file)
+{
+	GtefFileWatcher *watcher;
+	gulong handler_id;
+	guint timeout_id;
+
+	watcher = gtef_file_watcher_get_instance ();
+
+	handler_id = g_signal_connect (watcher,
+				       "file-changed",
+				       G_CALLBACK (file_changed_cb),
+				       file);
+
+	timeout_id = g_timeout_add_seconds (10, timeout_cb, NULL);
+
+	gtk_main ();
+
+	g_source_remove (timeout_id);
+	g_signal_handler_disconnect (watcher, handler_id);
+}
+
+static void
+test_monitored_files (void)
+{
+	GtefFileWatcher *watcher;
+	guint n_monitors;
+	gchar *path1;
+	gchar *path2;
+	GtefBuffer *buffer1;
+	GtefBuffer *buffer2;
+	GtefFile *file1;
+	GtefFile *file2;
+	GError *error = NULL;
+
+	watcher = gtef_file_watcher_get_instance ();
+	n_monitors = _gtef_file_watcher_get_n_monitors (watcher);
+
+	path1 = g_build_filename (g_get_tmp_dir (), "gtef-test-file-watcher-1", NULL);
+	path2 = g_build_filename (g_get_tmp_dir (), "gtef-test-file-watcher-2", NULL);
+
+	buffer1 = create_loaded_buffer (path1);
+	buffer2 = create_loaded_buffer (path2);
+	file1 = gtef_buffer_get_file (buffer1);
+	file2 = gtef_buffer_get_file (buffer2);
+
+	/* One monitor for the two files in the same directory. */
+	gtef_file_watcher_add_file (watcher, file1);
+	gtef_file_watcher_add_file (watcher, file2);
+	g_assert (gtef_file_watcher_is_monitored (watcher, file1));
+	g_assert (gtef_file_watcher_is_monitored (watcher, file2));
+	g_assert_cmpuint (_gtef_file_watcher_get_n_monitors (watcher), ==, n_monitors + 1);
+
+	/* Modify externally.
+	 * Sleep one second to force the timestamp/etag to change.
+	 */
+	sleep (1);
+	g_file_set_contents (path1, "b", -1, &error);
+	g_assert_no_error (error);
+
+	wait_file_changed (file1);
+	g_assert (gtef_file_is_externally_modified (file1));
+	g_assert (!gtef_file_is_deleted (file1));
+	g_assert (!gtef_file_is_externally_modified (file2));
+
+	/* Delete */
+	g_unlink (path2);
+
+	wait_file_changed (file2);
+	g_assert (gtef_file_is_deleted (file2));
+
+	/* The monitor is removed with the last file of the directory. */
+	gtef_file_watcher_remove_file (watcher, file1);
+	g_assert (!gtef_file_watcher_is_monitored (watcher, file1));
+	g_assert_cmpuint (_gtef_file_watcher_get_n_monitors (watcher), ==, n_monitors + 1);
+
+	g_object_unref (buffer2);
+	g_assert_cmpuint (_gtef_file_watcher_get_n_monitors (watcher), ==, n_monitors);
+
+	g_unlink (path1);
+	g_free (path1);
+	g_free (path2);
+	g_object_unref (buffer1);
+}
+
+static void
+check_files_cb (GObject      *source_object,
+		GAsyncResult *result,
+		gpointer      user_data)
+{
+	GtefFileWatcher *watcher = GTEF_FILE_WATCHER (source_object);
+	GError *error = NULL;
+
+	gtef_file_watcher_check_files_finish (watcher, result, &error);
+	g_assert_no_error (error);
+
+	gtk_main_quit ();
+}
+
+static void
+check_files (void)
+{
+	gtef_file_watcher_check_files_async (gtef_file_watcher_get_instance (),
+					     G_PRIORITY_DEFAULT,
+					     NULL,
+					     check_files_cb,
+					     NULL);
+	gtk_main ();
+}
+
+static void
+test_check_files (void)
+{
+	GtefFileWatcher *watcher;
+	gchar *path;
+	GtefBuffer *buffer;
+	GtefFile *file;
+	GError *error = NULL;
+
+	watcher = gtef_file_watcher_get_instance ();
+	_gtef_file_watcher_set_use_monitors (watcher, FALSE);
+
+	path = g_build_filename (g_get_tmp_dir (), "gtef-test-file-watcher", NULL);
+	buffer = create_loaded_buffer (path);
+	file = gtef_buffer_get_file (buffer);
+
+	gtef_file_watcher_add_file (watcher, file);
+	g_assert (!gtef_file_watcher_is_monitored (watcher, file));
+
+	check_files ();
+	g_assert (!gtef_file_is_externally_modified (file));
+	g_assert (!gtef_file_is_deleted (file));
+
+	sleep (1);
+	g_file_set_contents (path, "b", -1, &error);
+	g_assert_no_error (error);
+
+	check_files ();
+	g_assert (gtef_file_is_externally_modified (file));
+
+	/* Loading again resets the etag. */
+	load (buffer);
+	check_files ();
+	g_assert (!gtef_file_is_externally_modified (file));
+
+	g_unlink (path);
+	check_files ();
+	g_assert (gtef_file_is_deleted (file));
+
+	_gtef_file_watcher_set_use_monitors (watcher, TRUE);
+
+	g_free (path);
+	g_object_unref (buffer);
+}
+
+gint
+main (gint   argc,
+      gchar *argv[])
+{
+	gtk_test_init (&argc, &argv);
+
+	g_test_add_func ("/file-watcher/monitored-files", test_monitored_files);
+	g_test_add_func ("/file-watcher/check-files", test_check_files);
+
+	return g_test_run ();
+}
@@ -138,6 +138,88 @@ save_as (GtefBuffer *buffer,
 	g_object_unref (saver);
 }
 
+static void
+save_if_changed (GtefBuffer *buffer)
+{
+	GtefFile *file;
+	GtefFileSaver *saver;
+
+	file = gtef_buffer_get_file (buffer);
+
+	saver = gtef_file_saver_new (buffer, file);
+	gtef_file_saver_set_flags (saver, GTEF_FILE_SAVER_FLAGS_SKIP_IF_UNCHANGED);
+	gtef_file_saver_save_async (saver,
+				    G_PRIORITY_DEFAULT,
+				    NULL, /* cancellable */
+				    NULL, NULL, NULL, /* progress cb */
+				    save_cb,
+				    GINT_TO_POINTER (FALSE));
+
+	gtk_main ();
+	g_object_unref (saver);
+}
+
+static void
+check_content_cb (GObject      *source_object,
+		  GAsyncResult *result,
+		  gpointer      user_data)
+{
+	GtefFile *file = GTEF_FILE (source_object);
+	GError *error = NULL;
+
+	gtef_file_check_content_on_disk_finish (file, result, &error);
+	g_assert_no_error (error);
+
+	gtk_main_quit ();
+}
+
+static void
+check_content_async (GtefFile *file)
+{
+	gtef_file_check_content_on_disk_async (file,
+					       G_PRIORITY_DEFAULT,
+					       NULL, /* cancellable */
+					       check_content_cb,
+					       NULL);
+
+	gtk_main ();
+}
+
+static guint64
+get_modification_time (GFile *location)
+{
+	GFileInfo *info;
+	guint64 mtime;
+	GError *error = NULL;
+
+	info = g_file_query_info (location,
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED,
+				  G_FILE_QUERY_INFO_NONE,
+				  NULL,
+				  &error);
+	g_assert_no_error (error);
+
+	mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+	g_object_unref (info);
+
+	return mtime;
+}
+
+static void
+set_modification_time (GFile   *location,
+		       guint64  mtime)
+{
+	GError *error = NULL;
+
+	g_file_set_attribute_uint64 (location,
+				     G_FILE_ATTRIBUTE_TIME_MODIFIED,
+				     mtime,
+				     G_FILE_QUERY_INFO_NONE,
+				     NULL,
+				     &error);
+	g_assert_no_error (error);
+}
+
 static void
 test_externally_modified (void)
 {
@@ -250,6 +332,175 @@ test_externally_modified (void)
 	g_object_unref (buffer);
 }
 
+static void
+test_content_modified (void)
+{
+	GtefBuffer *buffer;
+	GtefFile *file;
+	gchar *path;
+	GFile *location;
+	GError *error = NULL;
+
+	buffer = gtef_buffer_new ();
+	file = gtef_buffer_get_file (buffer);
+
+	path = g_build_filename (g_get_tmp_dir (), "gtef-test-file", NULL);
+	g_file_set_contents (path, "a\n", -1, &error);
+	g_assert_no_error (error);
+
+	location = g_file_new_for_path (path);
+	gtef_file_set_location (file, location);
+
+	/* Without checksum, the etags are compared. */
+	load (buffer);
+	set_modification_time (location, 2000000);
+	gtef_file_check_content_on_disk (file);
+	g_assert (gtef_file_is_externally_modified (file));
+
+	gtef_file_set_compute_checksum (file, TRUE);
+	load (buffer);
+	gtef_file_check_content_on_disk (file);
+	g_assert (!gtef_file_is_externally_modified (file));
+
+	/* Only the modification time changes. */
+	set_modification_time (location, 1000000);
+	gtef_file_check_file_on_disk (file);
+	g_assert (gtef_file_is_externally_modified (file));
+	gtef_file_check_content_on_disk (file);
+	g_assert (!gtef_file_is_externally_modified (file));
+
+	/* The new etag is kept, the save operation doesn't fail. */
+	save (buffer, FALSE);
+	gtef_file_check_content_on_disk (file);
+	g_assert (!gtef_file_is_externally_modified (file));
+
+	/* The content changes, with the same modification time. */
+	set_modification_time (location, 1000000);
+	gtef_file_check_content_on_disk (file);
+	g_assert (!gtef_file_is_externally_modified (file));
+
+	g_file_set_contents (path, "b\n", -1, &error);
+	g_assert_no_error (error);
+	set_modification_time (location, 1000000);
+	gtef_file_check_content_on_disk (file);
+	g_assert (gtef_file_is_externally_modified (file));
+
+	/* Cleanup */
+	g_file_delete (location, NULL, &error);
+	g_assert_no_error (error);
+
+	gtef_file_check_content_on_disk (file);
+	g_assert (gtef_file_is_deleted (file));
+
+	g_free (path);
+	g_object_unref (location);
+	g_object_unref (buffer);
+}
+
+static void
+test_content_modified_async (void)
+{
+	GtefBuffer *buffer;
+	GtefFile *file;
+	gchar *path;
+	GFile *location;
+	GError *error = NULL;
+
+	buffer = gtef_buffer_new ();
+	file = gtef_buffer_get_file (buffer);
+
+	path = g_build_filename (g_get_tmp_dir (), "gtef-test-file", NULL);
+	g_file_set_contents (path, "a\n", -1, &error);
+	g_assert_no_error (error);
+
+	location = g_file_new_for_path (path);
+	gtef_file_set_location (file, location);
+	gtef_file_set_compute_checksum (file, TRUE);
+
+	load (buffer);
+
+	/* Only the modification time changes. */
+	set_modification_time (location, 1000000);
+	check_content_async (file);
+	g_assert (!gtef_file_is_externally_modified (file));
+
+	/* The content changes, with the same modification time. */
+	g_file_set_contents (path, "b\n", -1, &error);
+	g_assert_no_error (error);
+	set_modification_time (location, 1000000);
+	check_content_async (file);
+	g_assert (gtef_file_is_externally_modified (file));
+
+	/* Cleanup */
+	g_file_delete (location, NULL, &error);
+	g_assert_no_error (error);
+
+	check_content_async (file);
+	g_assert (gtef_file_is_deleted (file));
+
+	g_free (path);
+	g_object_unref (location);
+	g_object_unref (buffer);
+}
+
+static void
+test_skip_if_unchanged (void)
+{
+	GtefBuffer *buffer;
+	GtefFile *file;
+	gchar *path;
+	GFile *location;
+	gchar *content;
+	GError *error = NULL;
+
+	buffer = gtef_buffer_new ();
+	file = gtef_buffer_get_file (buffer);
+
+	path = g_build_filename (g_get_tmp_dir (), "gtef-test-file", NULL);
+	g_file_set_contents (path, "a\n", -1, &error);
+	g_assert_no_error (error);
+
+	location = g_file_new_for_path (path);
+	gtef_file_set_location (file, location);
+	gtef_file_set_compute_checksum (file, TRUE);
+
+	load (buffer);
+
+	/* Same content: the file is not written. */
+	set_modification_time (location, 1000000);
+	gtk_text_buffer_set_modified (GTK_TEXT_BUFFER (buffer), TRUE);
+	save_if_changed (buffer);
+	g_assert_cmpuint (get_modification_time (location), ==, 1000000);
+	g_assert (!gtk_text_buffer_get_modified (GTK_TEXT_BUFFER (buffer)));
+	gtef_file_check_file_on_disk (file);
+	g_assert (!gtef_file_is_externally_modified (file));
+
+	/* Different content. */
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (buffer), "b", -1);
+	save_if_changed (buffer);
+	g_assert_cmpuint (get_modification_time (location), !=, 1000000);
+
+	g_file_get_contents (path, &content, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_cmpstr (content, ==, "b\n");
+	g_free (content);
+
+	/* Same content after an external modification. */
+	set_modification_time (location, 1000000);
+	gtef_file_check_content_on_disk (file);
+	g_assert (!gtef_file_is_externally_modified (file));
+	save_if_changed (buffer);
+	g_assert_cmpuint (get_modification_time (location), ==, 1000000);
+
+	/* Cleanup */
+	g_file_delete (location, NULL, &error);
+	g_assert_no_error (error);
+
+	g_free (path);
+	g_object_unref (location);
+	g_object_unref (buffer);
+}
+
 gint
 main (gint   argc,
       gchar *argv[])
@@ -257,6 +508,9 @@ main (gint   argc,
 	gtk_test_init (&argc, &argv);
 
 	g_test_add_func ("/file/externally-modified", test_externally_modified);
+	g_test_add_func ("/file/content-modified", test_content_modified);
+	g_test_add_func ("/file/content-modified-async", test_content_modified_async);
+	g_test_add_func ("/file/skip-if-unchanged", test_skip_if_unchanged);
 
 	return g_test_run ();
 }
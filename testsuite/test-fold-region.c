@@ -407,6 +407,136 @@ test_call_other_methods_before_set_bounds (void)
 	g_object_unref (buffer);
 }
 
+static void
+test_nested_regions (void)
+{
+	GtkTextBuffer *buffer;
+	GtefFoldRegion *outer_region;
+	GtefFoldRegion *inner_region;
+
+	buffer = test_create_and_fill_buffer (8);
+
+	outer_region = test_create_fold_region (buffer, 1, 5);
+	inner_region = test_create_fold_region (buffer, 2, 3);
+
+	gtef_fold_region_set_folded (inner_region, TRUE);
+	gtef_fold_region_set_folded (outer_region, TRUE);
+	g_assert (test_next_visible_line (buffer, 1) == 6);
+
+	/* The inner region is still hidden by the outer one. */
+	gtef_fold_region_set_folded (inner_region, FALSE);
+	g_assert (test_next_visible_line (buffer, 1) == 6);
+
+	gtef_fold_region_set_folded (inner_region, TRUE);
+	gtef_fold_region_set_folded (outer_region, FALSE);
+	g_assert (test_next_visible_line (buffer, 1) == 2);
+	g_assert (test_next_visible_line (buffer, 2) == 4);
+
+	g_object_unref (outer_region);
+	g_assert (test_next_visible_line (buffer, 2) == 4);
+
+	g_object_unref (inner_region);
+	g_assert (test_next_visible_line (buffer, 2) == 3);
+
+	g_object_unref (buffer);
+}
+
+static void
+test_manager_queries (void)
+{
+	GtkTextBuffer *buffer;
+	GtefFoldRegionManager *manager;
+	GPtrArray *regions;
+	GtkTextIter iter;
+	gint line;
+	guint i;
+
+	buffer = test_create_and_fill_buffer (100);
+	manager = gtef_fold_region_manager_get_from_buffer (buffer);
+	g_assert (gtef_fold_region_manager_get_buffer (manager) == buffer);
+
+	regions = g_ptr_array_new_with_free_func (g_object_unref);
+
+	for (i = 0; i < 200; i++)
+	{
+		gint start_line;
+		gint end_line;
+
+		start_line = g_test_rand_int_range (0, 99);
+		end_line = g_test_rand_int_range (start_line + 1, 100);
+
+		g_ptr_array_add (regions, test_create_fold_region (buffer, start_line, end_line));
+	}
+
+	/* The regions move with the text. */
+	gtk_text_buffer_get_iter_at_line (buffer, &iter, 40);
+	gtk_text_buffer_insert (buffer, &iter, "Inserted\nInserted\n", -1);
+
+	for (i = 0; i < 50; i++)
+	{
+		g_ptr_array_remove_index_fast (regions, g_test_rand_int_range (0, regions->len));
+	}
+
+	g_assert_cmpuint (gtef_fold_region_manager_get_n_regions (manager), ==, regions->len);
+
+	for (line = 0; line < 102; line++)
+	{
+		GList *at_line;
+		GList *starting;
+		guint n_expected_at_line = 0;
+		guint n_expected_starting = 0;
+		GList *l;
+
+		at_line = gtef_fold_region_manager_get_regions_at_line (manager, line);
+		starting = gtef_fold_region_manager_get_regions_starting_at_line (manager, line);
+
+		for (i = 0; i < regions->len; i++)
+		{
+			GtkTextIter start_iter;
+			GtkTextIter end_iter;
+			gint start_line;
+			gint end_line;
+
+			gtef_fold_region_get_bounds (g_ptr_array_index (regions, i), &start_iter, &end_iter);
+			start_line = gtk_text_iter_get_line (&start_iter);
+			end_line = gtk_text_iter_get_line (&end_iter);
+
+			if (start_line <= line && line <= end_line)
+			{
+				n_expected_at_line++;
+			}
+
+			if (start_line == line)
+			{
+				n_expected_starting++;
+			}
+		}
+
+		g_assert_cmpuint (g_list_length (at_line), ==, n_expected_at_line);
+		g_assert_cmpuint (g_list_length (starting), ==, n_expected_starting);
+
+		/* Ordered by start position. */
+		for (l = at_line; l != NULL && l->next != NULL; l = l->next)
+		{
+			GtkTextIter start_iter;
+			GtkTextIter next_start_iter;
+			GtkTextIter end_iter;
+
+			gtef_fold_region_get_bounds (l->data, &start_iter, &end_iter);
+			gtef_fold_region_get_bounds (l->next->data, &next_start_iter, &end_iter);
+			g_assert_cmpint (gtk_text_iter_compare (&start_iter, &next_start_iter), <=, 0);
+		}
+
+		g_list_free (at_line);
+		g_list_free (starting);
+	}
+
+	g_ptr_array_unref (regions);
+	g_assert_cmpuint (gtef_fold_region_manager_get_n_regions (manager), ==, 0);
+
+	g_object_unref (buffer);
+}
+
 gint
 main (gint    argc,
       gchar **argv)
@@ -427,6 +557,8 @@ main (gint    argc,
 	g_test_add_func ("/fold-region/double_unfold", test_double_unfold);
 	g_test_add_func ("/fold-region/overlapping_regions", test_overlapping_regions);
 	g_test_add_func ("/fold-region/call_other_methods_before_set_bounds", test_call_other_methods_before_set_bounds);
+	g_test_add_func ("/fold-region/nested_regions", test_nested_regions);
+	g_test_add_func ("/fold-region/manager_queries", test_manager_queries);
 
 	return g_test_run ();
 }
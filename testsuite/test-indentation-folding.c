@@ -0,0 +1,319 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtef/gtef.h>
+
+static void
+wait_computation (GtefIndentationFolding *folding)
+{
+	while (gtef_indentation_folding_get_computing (folding))
+	{
+		g_main_context_iteration (NULL, TRUE);
+	}
+}
+
+/* Returns the regions as "start-end" line pairs. */
+static gchar *
+get_regions_string (GtkTextBuffer *buffer)
+{
+	GtefFoldRegionManager *manager;
+	GString *str;
+	GList *regions;
+	GList *l;
+
+	manager = gtef_fold_region_manager_get_from_buffer (buffer);
+	regions = gtef_fold_region_manager_get_regions_in_range (manager,
+								 0,
+								 gtk_text_buffer_get_line_count (buffer));
+
+	str = g_string_new (NULL);
+
+	for (l = regions; l != NULL; l = l->next)
+	{
+		GtkTextIter start;
+		GtkTextIter end;
+
+		gtef_fold_region_get_bounds (l->data, &start, &end);
+		g_string_append_printf (str, "%s%d-%d",
+					l == regions ? "" : " ",
+					gtk_text_iter_get_line (&start),
+					gtk_text_iter_get_line (&end));
+	}
+
+	g_list_free (regions);
+	return g_string_free (str, FALSE);
+}
+
+static void
+check_regions (const gchar *text,
+	       const gchar *expected_regions)
+{
+	GtkTextBuffer *buffer;
+	GtefIndentationFolding *folding;
+	gchar *regions;
+
+	buffer = gtk_text_buffer_new (NULL);
+	gtk_text_buffer_set_text (buffer, text, -1);
+
+	folding = gtef_indentation_folding_new (buffer);
+	g_assert (gtef_indentation_folding_get_buffer (folding) == buffer);
+	wait_computation (folding);
+
+	regions = get_regions_string (buffer);
+	g_assert_cmpstr (regions, ==, expected_regions);
+	g_free (regions);
+
+	g_object_unref (folding);
+	g_assert_cmpuint (gtef_fold_region_manager_get_n_regions (gtef_fold_region_manager_get_from_buffer (buffer)), ==, 0);
+	g_object_unref (buffer);
+}
+
+static void
+test_compute (void)
+{
+	check_regions ("", "");
+	check_regions ("a\nb\nc", "");
+	check_regions ("a\n\tb\n\tc\nd", "0-2");
+	check_regions ("a\n  b\n    c\n  d\ne\n  f", "0-3 1-2 4-5");
+
+	/* Blank lines don't end a region, and are not at the end of it. */
+	check_regions ("a\n\tb\n\n\t\n\tc\n\nd", "0-4");
+
+	/* Tabs go to the next tab stop. */
+	check_regions ("a\n\tb\n        c\nd", "0-2");
+	check_regions ("  a\n\tb\n        c", "0-2");
+
+	/* Other line terminators. */
+	check_regions ("a\r\n\tb\r\tc\xe2\x80\xa9" "d", "0-2");
+}
+
+static void
+test_tab_width (void)
+{
+	GtkTextBuffer *buffer;
+	GtefIndentationFolding *folding;
+	gchar *regions;
+
+	buffer = gtk_text_buffer_new (NULL);
+	gtk_text_buffer_set_text (buffer, "\ta\n    b", -1);
+
+	folding = gtef_indentation_folding_new (buffer);
+	wait_computation (folding);
+
+	regions = get_regions_string (buffer);
+	g_assert_cmpstr (regions, ==, "");
+	g_free (regions);
+
+	gtef_indentation_folding_set_tab_width (folding, 2);
+	g_assert_cmpuint (gtef_indentation_folding_get_tab_width (folding), ==, 2);
+	g_assert (gtef_indentation_folding_get_computing (folding));
+	wait_computation (folding);
+
+	regions = get_regions_string (buffer);
+	g_assert_cmpstr (regions, ==, "0-1");
+	g_free (regions);
+
+	g_object_unref (folding);
+	g_object_unref (buffer);
+}
+
+static void
+test_keep_regions (void)
+{
+	GtkTextBuffer *buffer;
+	GtefIndentationFolding *folding;
+	GtefFoldRegionManager *manager;
+	GtefFoldRegion *fold_region;
+	GList *regions;
+	GtkTextIter iter;
+	GtkTextIter start;
+	GtkTextIter end;
+
+	buffer = gtk_text_buffer_new (NULL);
+	gtk_text_buffer_set_text (buffer, "a\n\tb\n\tc\nd\n", -1);
+	manager = gtef_fold_region_manager_get_from_buffer (buffer);
+
+	folding = gtef_indentation_folding_new (buffer);
+	wait_computation (folding);
+
+	regions = gtef_fold_region_manager_get_regions_starting_at_line (manager, 0);
+	g_assert_cmpuint (g_list_length (regions), ==, 1);
+	fold_region = g_object_ref (regions->data);
+	g_list_free (regions);
+
+	gtef_fold_region_set_folded (fold_region, TRUE);
+
+	/* Extend the region. */
+	gtk_text_buffer_get_iter_at_line (buffer, &iter, 3);
+	gtk_text_buffer_insert (buffer, &iter, "\td\n", -1);
+
+	regions = gtef_fold_region_manager_get_regions_starting_at_line (manager, 0);
+	g_assert_cmpuint (g_list_length (regions), ==, 1);
+	g_assert (regions->data == fold_region);
+	g_list_free (regions);
+
+	g_assert (gtef_fold_region_get_folded (fold_region));
+	gtef_fold_region_get_bounds (fold_region, &start, &end);
+	g_assert_cmpint (gtk_text_iter_get_line (&end), ==, 3);
+
+	/* The same object after a full computation. */
+	gtef_indentation_folding_set_tab_width (folding, 4);
+	wait_computation (folding);
+
+	regions = gtef_fold_region_manager_get_regions_starting_at_line (manager, 0);
+	g_assert_cmpuint (g_list_length (regions), ==, 1);
+	g_assert (regions->data == fold_region);
+	g_list_free (regions);
+
+	/* Remove the region. */
+	gtk_text_buffer_get_iter_at_line (buffer, &start, 1);
+	gtk_text_buffer_get_iter_at_line (buffer, &end, 4);
+	gtk_text_buffer_delete (buffer, &start, &end);
+
+	g_assert_cmpuint (gtef_fold_region_manager_get_n_regions (manager), ==, 0);
+	g_assert (gtef_fold_region_get_buffer (fold_region) == NULL);
+
+	g_object_unref (fold_region);
+	g_object_unref (folding);
+	g_object_unref (buffer);
+}
+
+static void
+random_edit (GtkTextBuffer *buffer)
+{
+	const gchar *insertions[] = { "x", "\t", "  ", "\n", "\n\t", "\n  y", "\n\n", "z\n\t\tw\n" };
+	GtkTextIter start;
+	GtkTextIter end;
+	gint n_chars;
+
+	n_chars = gtk_text_buffer_get_char_count (buffer);
+	gtk_text_buffer_get_iter_at_offset (buffer, &start, g_test_rand_int_range (0, n_chars + 1));
+
+	if (n_chars == 0 || g_test_rand_bit ())
+	{
+		gtk_text_buffer_insert (buffer,
+					&start,
+					insertions[g_test_rand_int_range (0, G_N_ELEMENTS (insertions))],
+					-1);
+	}
+	else
+	{
+		end = start;
+		gtk_text_iter_forward_chars (&end, g_test_rand_int_range (1, 10));
+		gtk_text_buffer_delete (buffer, &start, &end);
+	}
+}
+
+static void
+test_incremental_update (void)
+{
+	GtkTextBuffer *buffer;
+	GtefIndentationFolding *folding;
+	guint i;
+
+	buffer = gtk_text_buffer_new (NULL);
+	gtk_text_buffer_set_text (buffer,
+				  "a\n"
+				  "\tb\n"
+				  "\t\tc\n"
+				  "\n"
+				  "\td\n"
+				  "e\n"
+				  "  f\n"
+				  "    g\n"
+				  "  h\n"
+				  "i\n",
+				  -1);
+
+	folding = gtef_indentation_folding_new (buffer);
+	wait_computation (folding);
+
+	for (i = 0; i < 500; i++)
+	{
+		GtkTextBuffer *expected_buffer;
+		GtefIndentationFolding *expected_folding;
+		GtkTextIter start;
+		GtkTextIter end;
+		gchar *text;
+		gchar *regions;
+		gchar *expected_regions;
+
+		random_edit (buffer);
+		g_assert (!gtef_indentation_folding_get_computing (folding));
+
+		gtk_text_buffer_get_bounds (buffer, &start, &end);
+		text = gtk_text_buffer_get_text (buffer, &start, &end, TRUE);
+
+		expected_buffer = gtk_text_buffer_new (NULL);
+		gtk_text_buffer_set_text (expected_buffer, text, -1);
+		expected_folding = gtef_indentation_folding_new (expected_buffer);
+		wait_computation (expected_folding);
+
+		regions = get_regions_string (buffer);
+		expected_regions = get_regions_string (expected_buffer);
+		g_assert_cmpstr (regions, ==, expected_regions);
+
+		g_free (text);
+		g_free (regions);
+		g_free (expected_regions);
+		g_object_unref (expected_folding);
+		g_object_unref (expected_buffer);
+	}
+
+	g_object_unref (folding);
+	g_object_unref (buffer);
+}
+
+/* The full computation is scheduled, and the buffer is finalized before it
+ * starts.
+ */
+static void
+test_buffer_finalized (void)
+{
+	GtkTextBuffer *buffer;
+	GtefIndentationFolding *folding;
+
+	buffer = gtk_text_buffer_new (NULL);
+	gtk_text_buffer_set_text (buffer, "a\n\tb\n", -1);
+
+	folding = gtef_indentation_folding_new (buffer);
+	g_assert (gtef_indentation_folding_get_computing (folding));
+
+	g_object_unref (buffer);
+	g_assert (gtef_indentation_folding_get_buffer (folding) == NULL);
+
+	wait_computation (folding);
+
+	g_object_unref (folding);
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+	gtk_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/indentation-folding/compute", test_compute);
+	g_test_add_func ("/indentation-folding/tab_width", test_tab_width);
+	g_test_add_func ("/indentation-folding/keep_regions", test_keep_regions);
+	g_test_add_func ("/indentation-folding/incremental_update", test_incremental_update);
+	g_test_add_func ("/indentation-folding/buffer_finalized", test_buffer_finalized);
+
+	return g_test_run ();
+}
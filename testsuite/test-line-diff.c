@@ -0,0 +1,128 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <glib.h>
+#include "gtef/gtef-line-diff.h"
+
+/* Applies the hunks to @old_text, from the end, and checks that the result is
+ * @new_text. Returns the number of hunks.
+ */
+static guint
+check_diff (const gchar *old_text,
+	    const gchar *new_text,
+	    guint        max_cost)
+{
+	GArray *hunks;
+	GString *result;
+	guint n_hunks;
+	guint i;
+
+	hunks = _gtef_line_diff_compute (old_text, strlen (old_text),
+					 new_text, strlen (new_text),
+					 max_cost);
+
+	result = g_string_new (old_text);
+
+	for (i = hunks->len; i > 0; i--)
+	{
+		GtefLineDiffHunk *hunk = &g_array_index (hunks, GtefLineDiffHunk, i - 1);
+
+		g_assert_cmpuint (hunk->old_start, <=, hunk->old_end);
+		g_assert_cmpuint (hunk->new_start, <=, hunk->new_end);
+		g_assert (hunk->old_start < hunk->old_end ||
+			  hunk->new_start < hunk->new_end);
+
+		if (i < hunks->len)
+		{
+			GtefLineDiffHunk *next_hunk = &g_array_index (hunks, GtefLineDiffHunk, i);
+
+			g_assert_cmpuint (hunk->old_end, <, next_hunk->old_start);
+		}
+
+		g_string_erase (result, hunk->old_start, hunk->old_end - hunk->old_start);
+		g_string_insert_len (result,
+				     hunk->old_start,
+				     new_text + hunk->new_start,
+				     hunk->new_end - hunk->new_start);
+	}
+
+	g_assert_cmpstr (result->str, ==, new_text);
+
+	n_hunks = hunks->len;
+
+	g_string_free (result, TRUE);
+	g_array_unref (hunks);
+
+	return n_hunks;
+}
+
+static void
+test_hunks (void)
+{
+	GArray *hunks;
+	GtefLineDiffHunk *hunk;
+
+	g_assert_cmpuint (check_diff ("", "", 100), ==, 0);
+	g_assert_cmpuint (check_diff ("a\nb", "a\nb", 100), ==, 0);
+	g_assert_cmpuint (check_diff ("", "a\nb", 100), ==, 1);
+	g_assert_cmpuint (check_diff ("a\nb", "", 100), ==, 1);
+	g_assert_cmpuint (check_diff ("a\nb", "a\nb\n", 100), ==, 1);
+	g_assert_cmpuint (check_diff ("a\r\nb\r\n", "a\r\nc\r\n", 100), ==, 1);
+
+	/* Two separate changes. */
+	g_assert_cmpuint (check_diff ("a\nb\nc\nd\ne\n", "a\nc\nd\nX\ne\n", 100), ==, 2);
+
+	/* Above the maximum cost, the lines between the first and the last
+	 * changes are replaced in one hunk.
+	 */
+	g_assert_cmpuint (check_diff ("a\nb\nc\nd\ne\n", "a\nc\nd\nX\ne\n", 1), ==, 1);
+
+	/* Only the changed line. */
+	hunks = _gtef_line_diff_compute ("line 1\nline 2\nline 3\n", 21,
+					 "line 1\nline two\nline 3\n", 23,
+					 100);
+	g_assert_cmpuint (hunks->len, ==, 1);
+	hunk = &g_array_index (hunks, GtefLineDiffHunk, 0);
+	g_assert_cmpuint (hunk->old_start, ==, 7);
+	g_assert_cmpuint (hunk->old_end, ==, 14);
+	g_assert_cmpuint (hunk->new_start, ==, 7);
+	g_assert_cmpuint (hunk->new_end, ==, 16);
+	g_array_unref (hunks);
+}
+
+static void
+test_repeated_lines (void)
+{
+	/* Many equal lines, the matching must still be correct. */
+	g_assert_cmpuint (check_diff ("}\n}\n}\nx\n}\n}\n", "}\nx\n}\n}\n}\n}\n", 100), ==, 2);
+	g_assert_cmpuint (check_diff ("\n\n\n\n", "\n\na\n\n\n", 100), ==, 1);
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/line-diff/hunks", test_hunks);
+	g_test_add_func ("/line-diff/repeated-lines", test_repeated_lines);
+
+	return g_test_run ();
+}
@@ -0,0 +1,99 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2017 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <glib.h>
+#include "gtef/gtef-line-index.h"
+
+static void
+check_index (const gchar   *content,
+	     guint          interval,
+	     gsize          split,
+	     const guint64 *line_starts,
+	     guint          n_lines)
+{
+	GtefLineIndex *index;
+	gsize length;
+	guint64 line;
+
+	length = strlen (content);
+
+	/* The chunk boundary must not matter. */
+	index = _gtef_line_index_new (interval);
+	_gtef_line_index_add_chunk (index, content, split);
+	_gtef_line_index_add_chunk (index, content + split, length - split);
+
+	g_assert_cmpuint (_gtef_line_index_get_n_lines (index), ==, n_lines);
+	g_assert_cmpuint (_gtef_line_index_get_size (index), ==, length);
+
+	for (line = 0; line < n_lines; line++)
+	{
+		guint64 checkpoint_line;
+		guint64 checkpoint_offset;
+
+		g_assert (_gtef_line_index_lookup (index, line, &checkpoint_line, &checkpoint_offset));
+		g_assert_cmpuint (checkpoint_line, <=, line);
+		g_assert_cmpuint (line - checkpoint_line, <, interval);
+		g_assert_cmpuint (checkpoint_offset, ==, line_starts[checkpoint_line]);
+	}
+
+	g_assert (!_gtef_line_index_lookup (index, n_lines, &line, &line));
+
+	_gtef_line_index_free (index);
+}
+
+static void
+test_lookup (void)
+{
+	const gchar *content = "a\nbb\n\nccc\r\nd";
+	const guint64 line_starts[] = { 0, 2, 5, 6, 11 };
+	guint interval;
+	gsize split;
+
+	for (interval = 1; interval <= 5; interval++)
+	{
+		for (split = 0; split <= strlen (content); split++)
+		{
+			check_index (content, interval, split, line_starts, G_N_ELEMENTS (line_starts));
+		}
+	}
+}
+
+static void
+test_trailing_newline (void)
+{
+	const guint64 line_starts[] = { 0, 2 };
+	const guint64 empty_line_starts[] = { 0 };
+
+	/* Like in a GtkTextBuffer, there is a last empty line. */
+	check_index ("a\n", 1, 0, line_starts, G_N_ELEMENTS (line_starts));
+	check_index ("", 1, 0, empty_line_starts, G_N_ELEMENTS (empty_line_starts));
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/line-index/lookup", test_lookup);
+	g_test_add_func ("/line-index/trailing-newline", test_trailing_newline);
+
+	return g_test_run ();
+}
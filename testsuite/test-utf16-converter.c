@@ -0,0 +1,357 @@
+/*
+ * This file is part of Gtef, a text editor library.
+ *
+ * Copyright 2016 - Sébastien Wilmet <swilmet@gnome.org>
+ *
+ * Gtef is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * Gtef is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <gio/gio.h>
+#include "gtef/gtef-utf16-converter.h"
+
+/* ASCII runs longer than a SIMD block, nul bytes, and characters of each
+ * UTF-8 length, including a surrogate pair in UTF-16.
+ */
+static const gchar content[] =
+	"Lorem ipsum dolor sit amet, consectetur adipiscing elit.\n"
+	"S\303\251bastien \342\202\254 \344\270\255\346\226\207 \360\237\230\200 \0nul\0\n"
+	"\360\237\232\200\360\237\216\211\303\251\303\251 and some more ASCII text.";
+
+static void
+test_charset_get_byte_order (void)
+{
+	gboolean big_endian;
+	gboolean with_bom;
+
+	g_assert (_gtef_utf16_charset_get_byte_order ("UTF-16", &big_endian, &with_bom));
+	g_assert_cmpint (big_endian, ==, G_BYTE_ORDER == G_BIG_ENDIAN);
+	g_assert (with_bom);
+
+	g_assert (_gtef_utf16_charset_get_byte_order ("utf-16le", &big_endian, &with_bom));
+	g_assert (!big_endian);
+	g_assert (!with_bom);
+
+	g_assert (_gtef_utf16_charset_get_byte_order ("UTF-16BE", &big_endian, &with_bom));
+	g_assert (big_endian);
+	g_assert (!with_bom);
+
+	g_assert (!_gtef_utf16_charset_get_byte_order ("UTF-8", &big_endian, &with_bom));
+	g_assert (!_gtef_utf16_charset_get_byte_order ("UTF-32", &big_endian, &with_bom));
+}
+
+/* Converts by chunks of @chunk_size bytes, with an output buffer of
+ * @outbuf_size bytes, keeping the incomplete characters for the next chunk.
+ */
+static GString *
+convert_by_chunks (gboolean     to_utf16,
+		   const gchar *inbuf,
+		   gsize        inbuf_size,
+		   gboolean     big_endian,
+		   gsize        chunk_size,
+		   gsize        outbuf_size)
+{
+	GString *output;
+	gchar *outbuf;
+	gsize offset = 0;
+
+	output = g_string_new (NULL);
+	outbuf = g_malloc (outbuf_size);
+
+	while (offset < inbuf_size)
+	{
+		gsize available = MIN (chunk_size, inbuf_size - offset);
+		GtefUtf16Status status;
+		gsize bytes_read;
+		gsize bytes_written;
+
+		if (to_utf16)
+		{
+			status = _gtef_utf8_to_utf16 (inbuf + offset, available, big_endian,
+						      outbuf, outbuf_size,
+						      &bytes_read, &bytes_written);
+		}
+		else
+		{
+			status = _gtef_utf16_to_utf8 (inbuf + offset, available, big_endian,
+						      outbuf, outbuf_size,
+						      &bytes_read, &bytes_written);
+		}
+
+		g_assert_cmpint (status, !=, GTEF_UTF16_STATUS_INVALID);
+
+		if (status == GTEF_UTF16_STATUS_DONE)
+		{
+			g_assert_cmpuint (bytes_read, ==, available);
+		}
+
+		/* An incomplete character, take the next chunk with it. */
+		if (status == GTEF_UTF16_STATUS_INCOMPLETE && bytes_read == 0)
+		{
+			g_assert_cmpuint (offset + available, <, inbuf_size);
+			chunk_size++;
+		}
+
+		g_string_append_len (output, outbuf, bytes_written);
+		offset += bytes_read;
+	}
+
+	g_free (outbuf);
+	return output;
+}
+
+static void
+check_conversions (const gchar *charset,
+		   gboolean     big_endian)
+{
+	gchar *utf16;
+	gsize utf16_length;
+	gsize chunk_size;
+	GError *error = NULL;
+
+	utf16 = g_convert (content, sizeof (content) - 1, charset, "UTF-8", NULL, &utf16_length, &error);
+	g_assert_no_error (error);
+
+	for (chunk_size = 1; chunk_size <= 40; chunk_size++)
+	{
+		gsize outbuf_size;
+
+		for (outbuf_size = 4; outbuf_size <= 40; outbuf_size += 9)
+		{
+			GString *output;
+
+			output = convert_by_chunks (TRUE, content, sizeof (content) - 1,
+						    big_endian, chunk_size, outbuf_size);
+			g_assert_cmpuint (output->len, ==, utf16_length);
+			g_assert (memcmp (output->str, utf16, utf16_length) == 0);
+			g_string_free (output, TRUE);
+
+			output = convert_by_chunks (FALSE, utf16, utf16_length,
+						    big_endian, chunk_size, outbuf_size);
+			g_assert_cmpuint (output->len, ==, sizeof (content) - 1);
+			g_assert (memcmp (output->str, content, output->len) == 0);
+			g_string_free (output, TRUE);
+		}
+	}
+
+	g_free (utf16);
+}
+
+static void
+test_conversions (void)
+{
+	check_conversions ("UTF-16LE", FALSE);
+	check_conversions ("UTF-16BE", TRUE);
+}
+
+static void
+check_status (gboolean         to_utf16,
+	      const gchar     *inbuf,
+	      gsize            inbuf_size,
+	      GtefUtf16Status  expected_status,
+	      gsize            expected_bytes_read)
+{
+	gchar outbuf[16];
+	GtefUtf16Status status;
+	gsize bytes_read;
+	gsize bytes_written;
+
+	if (to_utf16)
+	{
+		status = _gtef_utf8_to_utf16 (inbuf, inbuf_size, FALSE,
+					      outbuf, sizeof (outbuf),
+					      &bytes_read, &bytes_written);
+	}
+	else
+	{
+		status = _gtef_utf16_to_utf8 (inbuf, inbuf_size, FALSE,
+					      outbuf, sizeof (outbuf),
+					      &bytes_read, &bytes_written);
+	}
+
+	g_assert_cmpint (status, ==, expected_status);
+	g_assert_cmpuint (bytes_read, ==, expected_bytes_read);
+}
+
+static void
+test_invalid_input (void)
+{
+	/* UTF-16LE. A lone low surrogate, a high surrogate without low
+	 * surrogate, and an incomplete surrogate pair or code unit.
+	 */
+	check_status (FALSE, "a\0\1\334", 4, GTEF_UTF16_STATUS_INVALID, 2);
+	check_status (FALSE, "a\0\1\330b\0", 6, GTEF_UTF16_STATUS_INVALID, 2);
+	check_status (FALSE, "a\0\1\330\1", 5, GTEF_UTF16_STATUS_INCOMPLETE, 2);
+	check_status (FALSE, "a\0b", 3, GTEF_UTF16_STATUS_INCOMPLETE, 2);
+
+	/* UTF-8. Invalid bytes, an overlong form, a surrogate, and an
+	 * incomplete character.
+	 */
+	check_status (TRUE, "a\200", 2, GTEF_UTF16_STATUS_INVALID, 1);
+	check_status (TRUE, "a\300\200", 3, GTEF_UTF16_STATUS_INVALID, 1);
+	check_status (TRUE, "a\355\240\200", 4, GTEF_UTF16_STATUS_INVALID, 1);
+	check_status (TRUE, "a\360\237\230", 4, GTEF_UTF16_STATUS_INCOMPLETE, 1);
+
+	/* The output is full. */
+	check_status (TRUE, "abcdefghijklmnopqrstuvwxyz", 26, GTEF_UTF16_STATUS_OUTPUT_FULL, 8);
+}
+
+/* Like GtefFileSaver, with a GConverterOutputStream, and compare with
+ * GCharsetConverter.
+ */
+static GBytes *
+write_with_converter (GConverter *converter,
+		      gsize       chunk_size)
+{
+	GOutputStream *memory_stream;
+	GOutputStream *converter_stream;
+	gsize offset;
+	GBytes *bytes;
+	GError *error = NULL;
+
+	memory_stream = g_memory_output_stream_new_resizable ();
+	converter_stream = g_converter_output_stream_new (memory_stream, converter);
+
+	for (offset = 0; offset < sizeof (content) - 1; offset += chunk_size)
+	{
+		g_output_stream_write_all (converter_stream,
+					   content + offset,
+					   MIN (chunk_size, sizeof (content) - 1 - offset),
+					   NULL,
+					   NULL,
+					   &error);
+		g_assert_no_error (error);
+	}
+
+	g_output_stream_close (converter_stream, NULL, &error);
+	g_assert_no_error (error);
+
+	bytes = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (memory_stream));
+
+	g_object_unref (converter_stream);
+	g_object_unref (memory_stream);
+
+	return bytes;
+}
+
+static void
+check_converter (const gchar *charset)
+{
+	GCharsetConverter *charset_converter;
+	GBytes *expected;
+	gboolean big_endian;
+	gboolean with_bom;
+	gsize chunk_size;
+	GError *error = NULL;
+
+	charset_converter = g_charset_converter_new (charset, "UTF-8", &error);
+	g_assert_no_error (error);
+	expected = write_with_converter (G_CONVERTER (charset_converter), sizeof (content));
+	g_object_unref (charset_converter);
+
+	g_assert (_gtef_utf16_charset_get_byte_order (charset, &big_endian, &with_bom));
+
+	for (chunk_size = 1; chunk_size <= 8; chunk_size++)
+	{
+		GtefUtf16Converter *converter;
+		GBytes *received;
+
+		converter = _gtef_utf16_converter_new (big_endian, with_bom);
+		received = write_with_converter (G_CONVERTER (converter), chunk_size);
+		g_assert (g_bytes_equal (received, expected));
+
+		/* After a reset, the BOM is written again. */
+		g_converter_reset (G_CONVERTER (converter));
+		g_bytes_unref (received);
+		received = write_with_converter (G_CONVERTER (converter), chunk_size);
+		g_assert (g_bytes_equal (received, expected));
+
+		g_bytes_unref (received);
+		g_object_unref (converter);
+	}
+
+	g_bytes_unref (expected);
+}
+
+static void
+test_converter (void)
+{
+	check_converter ("UTF-16LE");
+	check_converter ("UTF-16BE");
+	check_converter ("UTF-16");
+}
+
+static void
+test_converter_invalid_input (void)
+{
+	GtefUtf16Converter *converter;
+	gchar outbuf[16];
+	gsize bytes_read;
+	gsize bytes_written;
+	GConverterResult result;
+	GError *error = NULL;
+
+	converter = _gtef_utf16_converter_new (FALSE, TRUE);
+
+	/* The BOM and "a" are converted, the error comes at the next call. */
+	result = g_converter_convert (G_CONVERTER (converter),
+				      "a\377", 2,
+				      outbuf, sizeof (outbuf),
+				      G_CONVERTER_NO_FLAGS,
+				      &bytes_read, &bytes_written,
+				      &error);
+	g_assert_no_error (error);
+	g_assert_cmpint (result, ==, G_CONVERTER_CONVERTED);
+	g_assert_cmpuint (bytes_read, ==, 1);
+	g_assert_cmpuint (bytes_written, ==, 4);
+	g_assert (memcmp (outbuf, "\377\376a\0", 4) == 0);
+
+	result = g_converter_convert (G_CONVERTER (converter),
+				      "\377", 1,
+				      outbuf, sizeof (outbuf),
+				      G_CONVERTER_NO_FLAGS,
+				      &bytes_read, &bytes_written,
+				      &error);
+	g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+	g_assert_cmpint (result, ==, G_CONVERTER_ERROR);
+	g_clear_error (&error);
+
+	/* An incomplete character. */
+	result = g_converter_convert (G_CONVERTER (converter),
+				      "\303", 1,
+				      outbuf, sizeof (outbuf),
+				      G_CONVERTER_INPUT_AT_END,
+				      &bytes_read, &bytes_written,
+				      &error);
+	g_assert_error (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT);
+	g_assert_cmpint (result, ==, G_CONVERTER_ERROR);
+	g_clear_error (&error);
+
+	g_object_unref (converter);
+}
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/utf16-converter/charset-get-byte-order", test_charset_get_byte_order);
+	g_test_add_func ("/utf16-converter/conversions", test_conversions);
+	g_test_add_func ("/utf16-converter/invalid-input", test_invalid_input);
+	g_test_add_func ("/utf16-converter/converter", test_converter);
+	g_test_add_func ("/utf16-converter/converter-invalid-input", test_converter_invalid_input);
+
+	return g_test_run ();
+}